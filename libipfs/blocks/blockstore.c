@@ -1,6 +1,8 @@
 /***
  * a thin wrapper over a datastore for getting and putting block objects
  */
+#include <unistd.h>
+
 #include "libp2p/crypto/encoding/base32.h"
 #include "cid/cid.h"
 #include "blocks/block.h"
@@ -48,11 +50,21 @@ int ipfs_blockstore_free(struct Blockstore* blockstore) {
 
 /**
  * Delete a block based on its Cid
+ * NOTE: This only removes the file. The datastore record is left alone.
  * @param cid the Cid to look for
  * @param returns true(1) on success
  */
 int ipfs_blockstore_delete(const struct BlockstoreContext* context, struct Cid* cid) {
-	return 0;
+	unsigned char* key = ipfs_blockstore_hash_to_base32(cid->hash, cid->hash_length);
+	if (key == NULL)
+		return 0;
+	char* filename = ipfs_blockstore_path_get(context->fs_repo, (char*)key);
+	free(key);
+	if (filename == NULL)
+		return 0;
+	int retVal = unlink(filename) == 0;
+	free(filename);
+	return retVal;
 }
 
 /***
@@ -61,7 +73,16 @@ int ipfs_blockstore_delete(const struct BlockstoreContext* context, struct Cid*
  * @returns true(1) if found
  */
 int ipfs_blockstore_has(const struct BlockstoreContext* context, struct Cid* cid) {
-	return 0;
+	unsigned char* key = ipfs_blockstore_hash_to_base32(cid->hash, cid->hash_length);
+	if (key == NULL)
+		return 0;
+	char* filename = ipfs_blockstore_path_get(context->fs_repo, (char*)key);
+	free(key);
+	if (filename == NULL)
+		return 0;
+	int retVal = os_utils_file_exists(filename);
+	free(filename);
+	return retVal;
 }
 
 unsigned char* ipfs_blockstore_cid_to_base32(const struct Cid* cid) {
@@ -334,13 +355,20 @@ int ipfs_blockstore_put_node(const struct HashtableNode* node, const struct FSRe
 int ipfs_blockstore_get_node(const unsigned char* hash, size_t hash_length, struct HashtableNode** node, const struct FSRepo* fs_repo) {
 	// get datastore key, which is a base32 key of the multihash
 	unsigned char* key = ipfs_blockstore_hash_to_base32(hash, hash_length);
+	if (key == NULL)
+		return 0;
 
 	char* filename = ipfs_blockstore_path_get(fs_repo, (char*)key);
 
+	FILE* file = filename == NULL ? NULL : fopen(filename, "rb");
+	if (file == NULL) {
+		free(key);
+		free(filename);
+		return 0;
+	}
+
 	size_t file_size = os_utils_file_size(filename);
 	unsigned char buffer[file_size];
-
-	FILE* file = fopen(filename, "rb");
 	size_t bytes_read = fread(buffer, 1, file_size, file);
 	fclose(file);
 
@@ -168,10 +168,10 @@ int ipfs_cid_decode_hash_from_ipfs_ipns_string(const char* incoming, struct Cid*
 	if (strstr(incoming, "/ipfs/") != incoming && strstr(incoming, "/ipns/") != incoming)
 		return 0;
 	const char* base58 = &incoming[6];
-	char* slash = strstr(incoming, "/");
-	if (slash != NULL)
-		slash[0] = '\0';
-	return ipfs_cid_decode_hash_from_base58((unsigned char*)base58, strlen(base58), cid);
+	// the hash ends at the next slash, if there is one
+	const char* slash = strchr(base58, '/');
+	size_t base58_length = slash != NULL ? (size_t)(slash - base58) : strlen(base58);
+	return ipfs_cid_decode_hash_from_base58((unsigned char*)base58, base58_length, cid);
 }
 
 /***
@@ -3,182 +3,332 @@
 #include "cid/cid.h"
 #include "util/errs.h"
 
-struct CidSet *ipfs_cid_set_new ()
+// the fewest slots a set has once something is added
+#define CID_SET_MIN_CAPACITY 16
+// the smallest arena
+#define CID_SET_MIN_ARENA 1024
+
+// A Cid, as it is kept in the arena. The multihash follows it.
+struct CidSetEntry {
+    int version;
+    int codec;
+    size_t hash_length;
+    unsigned char hash[];
+};
+
+// The bytes an entry takes in the arena, rounded up so the next one is aligned.
+static size_t ipfs_cid_set_entry_size (size_t hash_length)
 {
-    return calloc(1, sizeof(struct CidSet));
+    size_t size = sizeof (struct CidSetEntry) + hash_length;
+    return (size + sizeof (size_t) - 1) & ~(sizeof (size_t) - 1);
 }
 
-void ipfs_cid_set_destroy (struct CidSet **set)
+static struct CidSetEntry *ipfs_cid_set_entry (struct CidSet *set, size_t offset)
+{
+    return (struct CidSetEntry*) (set->arena + offset - CID_SET_SLOT_FIRST);
+}
+
+// FNV-1a of the multihash.
+static uint32_t ipfs_cid_set_hash (const unsigned char *bytes, size_t length)
 {
-    struct CidSet *prev;
+    uint32_t hash = 2166136261u;
 
-    if (set) {
-        while (*set) {
-            prev = *set;
-            *set = (*set)->next;
-            if (prev->cid) {
-                free (prev->cid);
+    for (size_t i = 0 ; i < length ; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Find the slot a multihash is in, or the slot it should go in if it is not there.
+// NOTE: there must be at least one empty slot.
+static size_t ipfs_cid_set_find (struct CidSet *set, const unsigned char *hash, size_t hash_length, uint32_t hash_code, int *found)
+{
+    size_t mask = set->capacity - 1;
+    size_t pos = hash_code & mask;
+    size_t insert_at = set->capacity; // the first removed slot seen, if any
+
+    for (;;) {
+        struct CidSetSlot *slot = &set->slots[pos];
+        if (slot->offset == CID_SET_SLOT_EMPTY) {
+            *found = 0;
+            return insert_at < set->capacity ? insert_at : pos;
+        }
+        if (slot->offset == CID_SET_SLOT_REMOVED) {
+            if (insert_at == set->capacity) {
+                insert_at = pos;
+            }
+        } else if (slot->hash == hash_code) {
+            struct CidSetEntry *entry = ipfs_cid_set_entry (set, slot->offset);
+            if ((entry->hash_length == hash_length) &&
+                (memcmp (entry->hash, hash, hash_length) == 0)) {
+                *found = 1;
+                return pos;
             }
-            free (prev);
         }
+        pos = (pos + 1) & mask;
     }
 }
 
-int ipfs_cid_set_add (struct CidSet *set, struct Cid *cid, int visit)
+// Move everything into a table big enough for num_cids, and an arena with
+// room for extra_bytes more. Removed slots and the arena space they used go away.
+static int ipfs_cid_set_rehash (struct CidSet *set, size_t num_cids, size_t extra_bytes)
 {
-    if (!set || !cid) {
-        return ErrInvalidParam;
+    size_t capacity = CID_SET_MIN_CAPACITY;
+    size_t live_bytes = 0;
+
+    // keep the table at most 70% full
+    while (num_cids * 10 >= capacity * 7) {
+        capacity *= 2;
     }
-    if (!set->cid) { // First item.
-        set->cid = malloc(sizeof (struct Cid));
-        if (!set->cid) {
-            return ErrAllocFailed;
+    for (size_t i = 0 ; i < set->capacity ; i++) {
+        if (set->slots[i].offset >= CID_SET_SLOT_FIRST) {
+            live_bytes += ipfs_cid_set_entry_size (ipfs_cid_set_entry (set, set->slots[i].offset)->hash_length);
+        }
+    }
+    size_t arena_size = (live_bytes + extra_bytes) * 2;
+    if (arena_size < CID_SET_MIN_ARENA) {
+        arena_size = CID_SET_MIN_ARENA;
+    }
+    struct CidSetSlot *slots = calloc (capacity, sizeof (struct CidSetSlot));
+    if (!slots) {
+        return ErrAllocFailed;
+    }
+    unsigned char *arena = malloc (arena_size);
+    if (!arena) {
+        free (slots);
+        return ErrAllocFailed;
+    }
+    size_t arena_used = 0;
+    for (size_t i = 0 ; i < set->capacity ; i++) {
+        if (set->slots[i].offset < CID_SET_SLOT_FIRST) {
+            continue;
+        }
+        struct CidSetEntry *entry = ipfs_cid_set_entry (set, set->slots[i].offset);
+        size_t entry_size = ipfs_cid_set_entry_size (entry->hash_length);
+        memcpy (arena + arena_used, entry, entry_size);
+        size_t pos = set->slots[i].hash & (capacity - 1);
+        while (slots[pos].offset != CID_SET_SLOT_EMPTY) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        slots[pos].offset = arena_used + CID_SET_SLOT_FIRST;
+        slots[pos].hash = set->slots[i].hash;
+        arena_used += entry_size;
+    }
+    free (set->slots);
+    free (set->arena);
+    set->slots = slots;
+    set->capacity = capacity;
+    set->removed = 0;
+    set->arena = arena;
+    set->arena_size = arena_size;
+    set->arena_used = arena_used;
+    return 0;
+}
+
+// Make room for num_cids more Cids, whose entries take extra_bytes.
+static int ipfs_cid_set_reserve (struct CidSet *set, size_t num_cids, size_t extra_bytes)
+{
+    if ((set->count + set->removed + num_cids) * 10 >= set->capacity * 7) {
+        return ipfs_cid_set_rehash (set, set->count + num_cids, extra_bytes);
+    }
+    if (set->arena_used + extra_bytes > set->arena_size) {
+        size_t arena_size = set->arena_size * 2;
+        if (arena_size < set->arena_used + extra_bytes) {
+            arena_size = set->arena_used + extra_bytes;
         }
-        memcpy(set->cid, cid, sizeof (struct Cid));
-        set->cid->hash = calloc(1, cid->hash_length);
-        if (!set->cid->hash) {
-            free (set->cid);
+        // entries are found by their offset, so the arena can move
+        unsigned char *arena = realloc (set->arena, arena_size);
+        if (!arena) {
             return ErrAllocFailed;
         }
-        memcpy(set->cid->hash, cid->hash, cid->hash_length);
-        return 0;
+        set->arena = arena;
+        set->arena_size = arena_size;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
+    return 0;
+}
+
+struct CidSet *ipfs_cid_set_new ()
+{
+    return calloc(1, sizeof(struct CidSet));
+}
+
+void ipfs_cid_set_destroy (struct CidSet **set)
+{
+    if (set && *set) {
+        free ((*set)->slots);
+        free ((*set)->arena);
+        free (*set);
+        *set = NULL;
+    }
+}
+
+int ipfs_cid_set_add (struct CidSet *set, struct Cid *cid, int visit)
+{
+    int found, err;
+
+    if (!set || !cid || !cid->hash) {
+        return ErrInvalidParam;
+    }
+    uint32_t hash_code = ipfs_cid_set_hash (cid->hash, cid->hash_length);
+    size_t pos;
+    if (set->capacity > 0) {
+        pos = ipfs_cid_set_find (set, cid->hash, cid->hash_length, hash_code, &found);
+        if (found) {
             // Already added.
             if (!visit) {
                 // update with new cid.
-                free(set->cid->hash);
-                memcpy(set->cid, cid, sizeof (struct Cid));
-                set->cid->hash = calloc(1, cid->hash_length);
-                if (!set->cid->hash) {
-                    return ErrAllocFailed;
-                }
-                memcpy(set->cid->hash, cid->hash, cid->hash_length);
+                struct CidSetEntry *entry = ipfs_cid_set_entry (set, set->slots[pos].offset);
+                entry->version = cid->version;
+                entry->codec = cid->codec;
             }
             return 0;
         }
-        if (!set->next) {
-            set->next = ipfs_cid_set_new();
-            if (!set->next) {
-                return ErrAllocFailed;
-            }
-            set = set->next;
-            set->cid = malloc(sizeof (struct Cid));
-            if (!set->cid) {
-                return ErrAllocFailed;
-            }
-            memcpy(set->cid, cid, sizeof (struct Cid));
-            set->cid->hash = calloc(1, cid->hash_length);
-            if (!set->cid->hash) {
-                return ErrAllocFailed;
-            }
-            memcpy(set->cid->hash, cid->hash, cid->hash_length);
-            return 0;
-        }
-        set = set->next;
     }
-    //this should never get hit
+    size_t entry_size = ipfs_cid_set_entry_size (cid->hash_length);
+    err = ipfs_cid_set_reserve (set, 1, entry_size);
+    if (err) {
+        return err;
+    }
+    // the table may have been rebuilt (even at the same size, to drop removed
+    // slots), so look for the slot again.
+    pos = ipfs_cid_set_find (set, cid->hash, cid->hash_length, hash_code, &found);
+    struct CidSetEntry *entry = (struct CidSetEntry*) (set->arena + set->arena_used);
+    entry->version = cid->version;
+    entry->codec = cid->codec;
+    entry->hash_length = cid->hash_length;
+    memcpy (entry->hash, cid->hash, cid->hash_length);
+    if (set->slots[pos].offset == CID_SET_SLOT_REMOVED) {
+        set->removed--;
+    }
+    set->slots[pos].offset = set->arena_used + CID_SET_SLOT_FIRST;
+    set->slots[pos].hash = hash_code;
+    set->arena_used += entry_size;
+    set->count++;
     return 0;
 }
 
-int ipfs_cid_set_has (struct CidSet *set, struct Cid *cid)
+int ipfs_cid_set_add_all (struct CidSet *set, struct Cid **cids, int num_cids, int visit)
 {
-    if (!set || !cid || !set->cid) {
-        return 0;
+    size_t bytes = 0;
+    int i, err;
+
+    if (!set || (!cids && num_cids > 0) || num_cids < 0) {
+        return ErrInvalidParam;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
-            return 1; // has
+    for (i = 0 ; i < num_cids ; i++) {
+        if (cids[i]) {
+            bytes += ipfs_cid_set_entry_size (cids[i]->hash_length);
         }
-        if (!set->next) {
-            return 0; // end without found.
+    }
+    // one resize for all of them, instead of several along the way.
+    err = ipfs_cid_set_reserve (set, num_cids, bytes);
+    if (err) {
+        return err;
+    }
+    for (i = 0 ; i < num_cids ; i++) {
+        err = ipfs_cid_set_add (set, cids[i], visit);
+        if (err) {
+            return err;
         }
-        set = set->next;
     }
     return 0;
 }
 
+int ipfs_cid_set_has (struct CidSet *set, struct Cid *cid)
+{
+    int found;
+
+    if (!set || !cid || !cid->hash || set->count == 0) {
+        return 0;
+    }
+    ipfs_cid_set_find (set, cid->hash, cid->hash_length, ipfs_cid_set_hash (cid->hash, cid->hash_length), &found);
+    return found;
+}
+
 int ipfs_cid_set_remove (struct CidSet *set, struct Cid *cid)
 {
-    struct CidSet *prev = set;
+    int found;
 
-    if (!set || !cid || !set->cid) {
+    if (!set || !cid || !cid->hash || set->count == 0) {
         return 0;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
-            free (set->cid);
-            if (prev == set) { // first item
-                set = set->next;
-                if (!set) {
-                    prev->cid = NULL;
-                    return 1;
-                }
-                prev->cid = set->cid;
-            } else {
-                prev->next = set->next;
-            }
-            free (set);
-            return 1; // removed
-        }
-        if (!set->next) {
-            return 0; // end without found.
+    size_t pos = ipfs_cid_set_find (set, cid->hash, cid->hash_length, ipfs_cid_set_hash (cid->hash, cid->hash_length), &found);
+    if (!found) {
+        return 0;
+    }
+    // the slot cannot be emptied, or what was placed after it could not be found.
+    set->slots[pos].offset = CID_SET_SLOT_REMOVED;
+    set->removed++;
+    set->count--;
+    if (set->count == 0) {
+        ipfs_cid_set_clear (set);
+    }
+    return 1; // removed
+}
+
+void ipfs_cid_set_clear (struct CidSet *set)
+{
+    if (set) {
+        if (set->slots) {
+            memset (set->slots, 0, set->capacity * sizeof (struct CidSetSlot));
         }
-        prev = set;
-        set = set->next;
+        set->count = 0;
+        set->removed = 0;
+        set->arena_used = 0;
     }
-    return 0;
 }
 
 int ipfs_cid_set_len (struct CidSet *set)
 {
-    int len;
-
-    if (!set || !set->cid) {
+    if (!set) {
         return 0;
     }
-
-    for (len = 0 ; set ; len++, set = set->next);
-
-    return len;
+    return (int) set->count;
 }
 
 unsigned char **ipfs_cid_set_keys (struct CidSet *set)
 {
-    int i, len=ipfs_cid_set_len(set);
+    int i = 0, len = ipfs_cid_set_len(set);
     unsigned char **ret;
 
     ret = calloc(len+1, sizeof(char*));
     if (ret) {
-        for (i = 0 ; i<len ; len++) {
-            if (set && set->cid && set->cid->hash) {
-                ret[i] = calloc(1, set->cid->hash_length + 1);
-                if (ret[i]) {
-                    memcpy(ret[i], set->cid->hash, set->cid->hash_length);
-                }
+        for (size_t pos = 0 ; set && pos < set->capacity ; pos++) {
+            if (set->slots[pos].offset < CID_SET_SLOT_FIRST) {
+                continue;
+            }
+            struct CidSetEntry *entry = ipfs_cid_set_entry (set, set->slots[pos].offset);
+            ret[i] = calloc(1, entry->hash_length + 1);
+            if (ret[i]) {
+                memcpy(ret[i], entry->hash, entry->hash_length);
             }
-            set = set->next;
+            i++;
         }
     }
     return ret;
 }
 
+// NOTE: the Cid passed to func points into the set. It is only good until func returns,
+// and func must not change the set.
 int ipfs_cid_set_foreach (struct CidSet *set, int (*func)(struct Cid *))
 {
+    struct Cid cid;
     int err = 0;
 
-    while (set) {
-        if (set->cid) {
-            err = func (set->cid);
-            if (err) {
-                return err;
-            }
+    for (size_t pos = 0 ; set && pos < set->capacity ; pos++) {
+        if (set->slots[pos].offset < CID_SET_SLOT_FIRST) {
+            continue;
+        }
+        struct CidSetEntry *entry = ipfs_cid_set_entry (set, set->slots[pos].offset);
+        cid.version = entry->version;
+        cid.codec = entry->codec;
+        cid.hash = entry->hash;
+        cid.hash_length = entry->hash_length;
+        err = func (&cid);
+        if (err) {
+            return err;
         }
-        set = set->next;
     }
 
     return err;
@@ -9,6 +9,10 @@
 #include "core/null.h" // for ipfs_null_shutdown
 #include "core/ipfs_node.h"
 #include "core/bootstrap.h"
+#include "core/reprovider.h"
+#include "core/gc.h"
+#include "namesys/republisher.h"
+#include "journal/replication_manager.h"
 #include "repo/fsrepo/fs_repo.h"
 #include "repo/init.h"
 #include "libp2p/utils/logger.h"
@@ -18,6 +22,10 @@ int ipfs_daemon_start(char* repo_path) {
     pthread_t work_pths[MAX];
     struct IpfsNodeListenParams listen_param;
     struct MultiAddress* ma = NULL;
+    struct IpfsReprovider* reprovider = NULL;
+    struct IpnsRepublisher* republisher = NULL;
+    struct ReplicationManager* replication = NULL;
+    struct IpfsGarbageCollector* gc = NULL;
 
     libp2p_logger_info("daemon", "Initializing daemon for %s...\n", repo_path);
 
@@ -39,6 +47,28 @@ int ipfs_daemon_start(char* repo_path) {
 
     local_node->routing->Bootstrap(local_node->routing);
 
+    // keep announcing what we have, so others can find it
+    reprovider = ipfs_reprovider_new(local_node);
+    if (reprovider != NULL)
+    	ipfs_reprovider_start(reprovider);
+
+    // keep our IPNS names alive on the network
+    republisher = ipfs_namesys_republisher_new(local_node);
+    if (republisher != NULL && ipfs_namesys_republisher_start(republisher))
+    	local_node->republisher = republisher;
+
+    // keep our replication peers up to date, each at its own pace
+    if (local_node->repo->config->replication->announce) {
+    	replication = ipfs_replication_manager_new(local_node);
+    	if (replication != NULL && ipfs_replication_manager_start(replication))
+    		local_node->replication_manager = replication;
+    }
+
+    // remove unpinned blocks when the repo gets full
+    gc = ipfs_gc_new(local_node);
+    if (gc != NULL)
+    	ipfs_gc_start(gc);
+
     libp2p_logger_info("daemon", "Daemon for %s is ready on port %d\n", listen_param.local_node->identity->peer->id, listen_param.port);
 
     // Wait for pthreads to finish.
@@ -53,6 +83,18 @@ int ipfs_daemon_start(char* repo_path) {
     exit:
 	libp2p_logger_debug("daemon", "Cleaning up daemon processes for %s\n", repo_path);
     // clean up
+    if (gc != NULL)
+    	ipfs_gc_free(gc);
+    if (replication != NULL) {
+    	local_node->replication_manager = NULL;
+    	ipfs_replication_manager_free(replication);
+    }
+    if (reprovider != NULL)
+    	ipfs_reprovider_free(reprovider);
+    if (republisher != NULL) {
+    	local_node->republisher = NULL;
+    	ipfs_namesys_republisher_free(republisher);
+    }
     if (ma != NULL)
     	multiaddress_free(ma);
     if (local_node != NULL) {
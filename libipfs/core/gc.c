@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/os/utils.h"
+#include "libp2p/utils/logger.h"
+#include "libp2p/utils/vector.h"
+#include "blocks/blockstore.h"
+#include "cid/cid.h"
+#include "core/gc.h"
+#include "merkledag/walker.h"
+#include "pin/pin.h"
+#include "repo/fsrepo/lmdb_cursor.h"
+#include "repo/fsrepo/lmdb_datastore.h"
+#include "repo/fsrepo/journalstore.h"
+#include "repo/fsrepo/pinindex.h"
+
+// what the sweep hands to repo_fsrepo_lmdb_delete_blocks
+struct GcSweepContext {
+	struct IpfsGarbageCollector* gc;
+	int blocked; // blocks were pinned since they were last marked, so nothing was deleted
+};
+
+/***
+ * Convert a size from the config (i.e. "10GB" or "512MiB") into bytes
+ * @param size the size. Units can be B, KB, MB, GB, TB (powers of 1000) or KiB, MiB, GiB, TiB (powers of 1024)
+ * @param bytes where to put the results
+ * @returns true(1) on success, false(0) if it cannot be parsed
+ */
+int ipfs_gc_parse_size(const char* size, unsigned long long* bytes) {
+	static const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+	static const char* binary_units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	if (size == NULL || bytes == NULL)
+		return 0;
+	const char* pos = size;
+	while (*pos == ' ')
+		pos++;
+	if (*pos < '0' || *pos > '9')
+		return 0;
+	unsigned long long value = 0;
+	while (*pos >= '0' && *pos <= '9') {
+		value = value * 10 + (*pos - '0');
+		pos++;
+	}
+	while (*pos == ' ')
+		pos++;
+	if (*pos == 0) {
+		*bytes = value;
+		return 1;
+	}
+	for(int i = 0; i < 5; i++) {
+		unsigned long long multiplier = 1;
+		for(int j = 0; j < i; j++)
+			multiplier *= 1000;
+		if (strcasecmp(pos, units[i]) == 0) {
+			*bytes = value * multiplier;
+			return 1;
+		}
+		multiplier = 1ULL << (10 * i);
+		if (strcasecmp(pos, binary_units[i]) == 0) {
+			*bytes = value * multiplier;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***
+ * Get the space used by the blockstore and the datastore
+ * @param fs_repo the repo
+ * @param bytes where to put the results
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_storage_used(const struct FSRepo* fs_repo, unsigned long long* bytes) {
+	struct stat st;
+	if (fs_repo == NULL || bytes == NULL)
+		return 0;
+	*bytes = 0;
+
+	// the blockstore
+	char* blockstore_path = ipfs_blockstore_path_get(fs_repo, "");
+	if (blockstore_path == NULL)
+		return 0;
+	DIR* dir = opendir(blockstore_path);
+	if (dir == NULL) {
+		free(blockstore_path);
+		return 0;
+	}
+	size_t path_size = strlen(blockstore_path) + 256 + 2;
+	char file_path[path_size];
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		if (os_utils_filepath_join(blockstore_path, entry->d_name, file_path, path_size) && stat(file_path, &st) == 0 && S_ISREG(st.st_mode))
+			*bytes += st.st_size;
+	}
+	closedir(dir);
+	free(blockstore_path);
+
+	// the datastore
+	struct Datastore* datastore = fs_repo->config->datastore;
+	if (datastore != NULL && datastore->path != NULL) {
+		size_t data_path_size = strlen(datastore->path) + 10;
+		char data_path[data_path_size];
+		if (os_utils_filepath_join(datastore->path, "data.mdb", data_path, data_path_size) && stat(data_path, &st) == 0)
+			*bytes += st.st_size;
+	}
+	return 1;
+}
+
+/***
+ * See if the run in progress should stop
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) if it should stop, false(0) otherwise
+ */
+static int ipfs_gc_cancelled(struct IpfsGarbageCollector* gc) {
+	pthread_mutex_lock(&gc->lock);
+	int cancel = gc->cancel;
+	pthread_mutex_unlock(&gc->lock);
+	return cancel;
+}
+
+/***
+ * Called for each block reached while marking. Stops the walk if the run was cancelled.
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @param context the IpfsGarbageCollector
+ * @returns MERKLEDAG_WALK_FOLLOW, or MERKLEDAG_WALK_STOP if the run was cancelled
+ */
+static int ipfs_gc_mark_visit(const unsigned char* hash, size_t hash_size, void* context) {
+	return ipfs_gc_cancelled((struct IpfsGarbageCollector*) context) ? MERKLEDAG_WALK_STOP : MERKLEDAG_WALK_FOLLOW;
+}
+
+/***
+ * Bring the pin index up to date, so it holds every block that can be reached from a pinned journal record
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_gc_mark(struct IpfsGarbageCollector* gc) {
+	// only what was pinned since the last run is walked
+	return ipfs_pin_index_update(gc->local_node->repo);
+}
+
+/***
+ * Called by each put that pins. While a run is in progress, remembers the block so it is marked.
+ * NOTE: the put holds the write lock of the datastore
+ * @param key the hash of the block
+ * @param key_size the size of key
+ * @param listener_context the IpfsGarbageCollector
+ */
+static void ipfs_gc_pin_listener(const uint8_t* key, size_t key_size, void* listener_context) {
+	struct IpfsGarbageCollector* gc = (struct IpfsGarbageCollector*) listener_context;
+	pthread_mutex_lock(&gc->lock);
+	if (gc->barrier != NULL) {
+		struct JournalRecord* rec = lmdb_journal_record_new();
+		if (rec != NULL) {
+			rec->hash = (uint8_t*) malloc(key_size);
+			if (rec->hash != NULL) {
+				memcpy(rec->hash, key, key_size);
+				rec->hash_size = key_size;
+				rec->pin = 1;
+				libp2p_utils_vector_add(gc->barrier, rec);
+			} else {
+				lmdb_journal_record_free(rec);
+			}
+		}
+	}
+	pthread_mutex_unlock(&gc->lock);
+}
+
+/***
+ * Free the blocks pinned while a run was in progress
+ * @param barrier the JournalRecords
+ */
+static void ipfs_gc_barrier_free(struct Libp2pVector* barrier) {
+	if (barrier != NULL) {
+		for(int i = 0; i < barrier->total; i++)
+			lmdb_journal_record_free((struct JournalRecord*) libp2p_utils_vector_get(barrier, i));
+		libp2p_utils_vector_free(barrier);
+	}
+}
+
+/***
+ * Mark the blocks pinned since this was last called, and everything they link to
+ * @param gc the IpfsGarbageCollector
+ * @param marked where to put the blocks marked
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_gc_mark_barrier(struct IpfsGarbageCollector* gc, struct CidSet* marked) {
+	pthread_mutex_lock(&gc->lock);
+	struct Libp2pVector* pinned = gc->barrier;
+	if (pinned == NULL || pinned->total == 0) {
+		pthread_mutex_unlock(&gc->lock);
+		return 1;
+	}
+	gc->barrier = libp2p_utils_vector_new(1);
+	pthread_mutex_unlock(&gc->lock);
+	if (gc->barrier == NULL) {
+		ipfs_gc_barrier_free(pinned);
+		return 0;
+	}
+
+	struct MerkledagWalker* walker = ipfs_merkledag_walker_new(gc->local_node->repo, marked, gc->mark_threads, ipfs_gc_mark_visit, gc);
+	int failed = walker == NULL;
+	for(int i = 0; i < pinned->total && !failed; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(pinned, i);
+		if (!ipfs_merkledag_walker_add(walker, rec->hash, rec->hash_size))
+			failed = 1;
+	}
+	ipfs_gc_barrier_free(pinned);
+	if (walker == NULL)
+		return 0;
+	if (failed)
+		ipfs_merkledag_walker_stop(walker);
+	int retVal = ipfs_merkledag_walker_wait(walker) && !failed;
+	ipfs_merkledag_walker_free(walker);
+	return retVal;
+}
+
+/***
+ * Called by repo_fsrepo_lmdb_delete_blocks once no put can commit. Says whether blocks were pinned since they were last marked.
+ * @param context the GcSweepContext
+ * @returns true(1) if the batch can be deleted, false(0) if it has to be marked again first
+ */
+static int ipfs_gc_sweep_proceed(void* context) {
+	struct GcSweepContext* sweep = (struct GcSweepContext*) context;
+	pthread_mutex_lock(&sweep->gc->lock);
+	sweep->blocked = sweep->gc->barrier != NULL && sweep->gc->barrier->total > 0;
+	pthread_mutex_unlock(&sweep->gc->lock);
+	return !sweep->blocked;
+}
+
+/***
+ * Remove the file of a block swept from the datastore
+ * NOTE: If the file was written since the run started, the block is being stored again. It is left alone.
+ * @param gc the IpfsGarbageCollector
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @param started when the run started (as a file time)
+ * @param bytes_freed where to add the size of the file
+ * @returns true(1) if the file was removed, false(0) otherwise
+ */
+static int ipfs_gc_delete_file(struct IpfsGarbageCollector* gc, const unsigned char* hash, size_t hash_size, time_t started, unsigned long long* bytes_freed) {
+	struct stat st;
+	unsigned char* key = ipfs_blockstore_hash_to_base32(hash, hash_size);
+	if (key == NULL)
+		return 0;
+	char* filename = ipfs_blockstore_path_get(gc->local_node->repo, (char*)key);
+	free(key);
+	if (filename == NULL)
+		return 0;
+	int retVal = 0;
+	if (stat(filename, &st) == 0 && st.st_mtime < started && unlink(filename) == 0) {
+		*bytes_freed += st.st_size;
+		retVal = 1;
+	}
+	free(filename);
+	return retVal;
+}
+
+/***
+ * Delete the blocks that are not in the pin index and were not marked, a batch at a time
+ * @param gc the IpfsGarbageCollector
+ * @param marked the blocks pinned during the run, and what they link to
+ * @param before the time the run started. Nothing stored since then is deleted.
+ * @param started the time the run started, as a file time
+ * @param blocks_deleted where to put the number of blocks deleted
+ * @param bytes_freed where to put the space freed in the blockstore
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_gc_sweep(struct IpfsGarbageCollector* gc, struct CidSet* marked, unsigned long long before, time_t started,
+		unsigned long long* blocks_deleted, unsigned long long* bytes_freed) {
+	struct Datastore* datastore = gc->local_node->repo->config->datastore;
+	void* handle = datastore->datastore_context;
+	struct Libp2pVector* keys = NULL;
+	uint8_t* after_key = NULL;
+	size_t after_key_size = 0;
+	uint8_t* batch_keys[GC_SWEEP_BATCH_SIZE];
+	size_t batch_key_sizes[GC_SWEEP_BATCH_SIZE];
+	int deleted[GC_SWEEP_BATCH_SIZE];
+	struct GcSweepContext sweep;
+	int retVal = 0;
+
+	*blocks_deleted = 0;
+	*bytes_freed = 0;
+	while (1) {
+		if (ipfs_gc_cancelled(gc))
+			goto exit;
+		if (!repo_fsrepo_lmdb_get_keys_after(datastore, after_key, after_key_size, GC_SWEEP_BATCH_SIZE, &keys))
+			goto exit;
+		if (keys->total == 0)
+			break;
+		sweep.gc = gc;
+		do {
+			// what was pinned since the last batch must be marked before anything is deleted
+			if (ipfs_gc_cancelled(gc) || !ipfs_gc_mark_barrier(gc, marked))
+				goto exit;
+			int num_keys = 0;
+			for(int i = 0; i < keys->total; i++) {
+				struct DatastoreRecord* rec = (struct DatastoreRecord*) libp2p_utils_vector_get(keys, i);
+				struct Cid cid;
+				cid.version = 0;
+				cid.codec = CID_DAG_PROTOBUF;
+				cid.hash = rec->key;
+				cid.hash_length = rec->key_size;
+				if (!ipfs_cid_set_has(marked, &cid) && !lmdb_pinindex_get(handle, rec->key, rec->key_size, NULL)) {
+					batch_keys[num_keys] = rec->key;
+					batch_key_sizes[num_keys] = rec->key_size;
+					num_keys++;
+				}
+			}
+			sweep.blocked = 0;
+			// each batch is its own transaction, so others can write in between
+			if (num_keys > 0 && repo_fsrepo_lmdb_delete_blocks(datastore, num_keys, batch_keys, batch_key_sizes, before, ipfs_gc_sweep_proceed, &sweep, deleted)) {
+				for(int i = 0; i < num_keys; i++) {
+					if (deleted[i]) {
+						(*blocks_deleted)++;
+						ipfs_gc_delete_file(gc, batch_keys[i], batch_key_sizes[i], started, bytes_freed);
+					}
+				}
+			}
+		} while (sweep.blocked);
+		// the next batch starts after the last key of this one
+		struct DatastoreRecord* last = (struct DatastoreRecord*) libp2p_utils_vector_get(keys, keys->total - 1);
+		free(after_key);
+		after_key = last->key;
+		after_key_size = last->key_size;
+		last->key = NULL;
+		for(int i = 0; i < keys->total; i++)
+			libp2p_datastore_record_free((struct DatastoreRecord*) libp2p_utils_vector_get(keys, i));
+		libp2p_utils_vector_free(keys);
+		keys = NULL;
+	}
+	retVal = 1;
+	exit:
+	if (keys != NULL) {
+		for(int i = 0; i < keys->total; i++)
+			libp2p_datastore_record_free((struct DatastoreRecord*) libp2p_utils_vector_get(keys, i));
+		libp2p_utils_vector_free(keys);
+	}
+	free(after_key);
+	return retVal;
+}
+
+/***
+ * Mark and sweep once, now, in the calling thread
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_run(struct IpfsGarbageCollector* gc) {
+	unsigned long long blocks_deleted = 0;
+	unsigned long long bytes_freed = 0;
+	unsigned long long used = 0;
+	int retVal = 0;
+
+	if (gc == NULL)
+		return 0;
+	pthread_mutex_lock(&gc->lock);
+	if (gc->collecting) {
+		pthread_mutex_unlock(&gc->lock);
+		return 0;
+	}
+	gc->collecting = 1;
+	gc->barrier = libp2p_utils_vector_new(1);
+	pthread_mutex_unlock(&gc->lock);
+
+	// a put that pinned before the barrier was up is committed before the run starts, so marking sees it
+	repo_fsrepo_lmdb_wait_for_puts(gc->local_node->repo->config->datastore);
+	// records are stamped with os_utils_gmtime, files with time
+	unsigned long long before = os_utils_gmtime();
+	time_t started = time(NULL);
+	struct CidSet* marked = ipfs_cid_set_new();
+	if (marked == NULL || gc->barrier == NULL)
+		goto exit;
+	libp2p_logger_debug("gc", "Updating the pin index.\n");
+	if (!ipfs_gc_mark(gc)) {
+		libp2p_logger_error("gc", "Unable to update the pin index. Nothing was deleted.\n");
+		goto exit;
+	}
+	libp2p_logger_debug("gc", "Sweeping.\n");
+	retVal = ipfs_gc_sweep(gc, marked, before, started, &blocks_deleted, &bytes_freed);
+	libp2p_logger_debug("gc", "Deleted %llu blocks, freeing %llu bytes.\n", blocks_deleted, bytes_freed);
+	exit:
+	ipfs_cid_set_destroy(&marked);
+	ipfs_gc_storage_used(gc->local_node->repo, &used);
+	pthread_mutex_lock(&gc->lock);
+	ipfs_gc_barrier_free(gc->barrier);
+	gc->barrier = NULL;
+	gc->collecting = 0;
+	gc->runs++;
+	gc->blocks_deleted += blocks_deleted;
+	gc->bytes_freed += bytes_freed;
+	gc->used_after_run = used;
+	pthread_mutex_unlock(&gc->lock);
+	return retVal;
+}
+
+/***
+ * Wait until the lock is signaled or the number of seconds has passed
+ * NOTE: caller must hold the lock
+ * @param gc the IpfsGarbageCollector
+ * @param secs the most seconds to wait
+ */
+static void ipfs_gc_wait(struct IpfsGarbageCollector* gc, time_t secs) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += secs;
+	pthread_cond_timedwait(&gc->wake, &gc->lock, &deadline);
+}
+
+/***
+ * The background thread. Checks the size of the repo, and collects when it reaches the watermark.
+ * @param arg the IpfsGarbageCollector
+ * @returns NULL
+ */
+static void* ipfs_gc_thread(void* arg) {
+	struct IpfsGarbageCollector* gc = (struct IpfsGarbageCollector*) arg;
+	unsigned long long threshold = gc->storage_max / 100 * gc->watermark;
+
+	pthread_mutex_lock(&gc->lock);
+	while (gc->running) {
+		int requested = gc->requested;
+		unsigned long long used_after_run = gc->used_after_run;
+		gc->requested = 0;
+		pthread_mutex_unlock(&gc->lock);
+
+		unsigned long long used = 0;
+		int collect = requested;
+		// if a run could not get below the watermark, wait for more to be added before trying again
+		if (!collect && ipfs_gc_storage_used(gc->local_node->repo, &used))
+			collect = used >= threshold && used > used_after_run;
+		if (collect) {
+			libp2p_logger_debug("gc", "The repo holds %llu of %llu bytes. Collecting.\n", used, gc->storage_max);
+			ipfs_gc_run(gc);
+		}
+
+		pthread_mutex_lock(&gc->lock);
+		if (gc->running && !gc->requested)
+			ipfs_gc_wait(gc, gc->check_interval_secs);
+	}
+	pthread_mutex_unlock(&gc->lock);
+	return NULL;
+}
+
+/***
+ * Build a garbage collector using the settings in the config
+ * @param local_node the node whose repo is collected
+ * @returns the IpfsGarbageCollector, or NULL on error or if StorageMax cannot be parsed
+ */
+struct IpfsGarbageCollector* ipfs_gc_new(struct IpfsNode* local_node) {
+	if (local_node == NULL || local_node->repo == NULL || local_node->repo->config == NULL || local_node->repo->config->datastore == NULL)
+		return NULL;
+	struct Datastore* datastore = local_node->repo->config->datastore;
+	unsigned long long storage_max = 0;
+	if (!ipfs_gc_parse_size(datastore->storage_max, &storage_max) || storage_max == 0) {
+		libp2p_logger_error("gc", "Unable to parse StorageMax %s. Not collecting garbage.\n", datastore->storage_max == NULL ? "" : datastore->storage_max);
+		return NULL;
+	}
+	struct IpfsGarbageCollector* gc = (struct IpfsGarbageCollector*) malloc(sizeof(struct IpfsGarbageCollector));
+	if (gc == NULL)
+		return NULL;
+	gc->local_node = local_node;
+	gc->storage_max = storage_max;
+	gc->watermark = datastore->storage_gc_watermark > 0 && datastore->storage_gc_watermark <= 100 ? datastore->storage_gc_watermark : 90;
+	gc->check_interval_secs = GC_CHECK_INTERVAL;
+	gc->mark_threads = GC_MARK_THREADS;
+	gc->used_after_run = 0;
+	gc->runs = 0;
+	gc->blocks_deleted = 0;
+	gc->bytes_freed = 0;
+	gc->requested = 0;
+	gc->collecting = 0;
+	gc->cancel = 0;
+	gc->running = 0;
+	gc->barrier = NULL;
+	pthread_mutex_init(&gc->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&gc->wake, &attr);
+	pthread_condattr_destroy(&attr);
+	// hear about every put that pins, so a run in progress does not delete what it needs
+	struct lmdb_context* db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context != NULL) {
+		db_context->pin_listener_context = gc;
+		db_context->pin_listener = ipfs_gc_pin_listener;
+	}
+	return gc;
+}
+
+/***
+ * Start watching the size of the repo in a background thread
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_start(struct IpfsGarbageCollector* gc) {
+	if (gc == NULL)
+		return 0;
+	pthread_mutex_lock(&gc->lock);
+	if (gc->running) {
+		pthread_mutex_unlock(&gc->lock);
+		return 1;
+	}
+	gc->running = 1;
+	gc->cancel = 0;
+	if (pthread_create(&gc->thread, NULL, ipfs_gc_thread, gc) != 0) {
+		gc->running = 0;
+		pthread_mutex_unlock(&gc->lock);
+		libp2p_logger_error("gc", "Unable to start the garbage collector thread.\n");
+		return 0;
+	}
+	pthread_mutex_unlock(&gc->lock);
+	return 1;
+}
+
+/***
+ * Have the background thread collect now, no matter the size of the repo
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_request(struct IpfsGarbageCollector* gc) {
+	if (gc == NULL)
+		return;
+	pthread_mutex_lock(&gc->lock);
+	gc->requested = 1;
+	pthread_cond_broadcast(&gc->wake);
+	pthread_mutex_unlock(&gc->lock);
+}
+
+/***
+ * Stop the background thread and wait for it to finish. A run in progress stops after its current batch.
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_stop(struct IpfsGarbageCollector* gc) {
+	if (gc == NULL)
+		return;
+	pthread_mutex_lock(&gc->lock);
+	if (!gc->running) {
+		pthread_mutex_unlock(&gc->lock);
+		return;
+	}
+	gc->running = 0;
+	gc->cancel = 1;
+	pthread_cond_broadcast(&gc->wake);
+	pthread_mutex_unlock(&gc->lock);
+	pthread_join(gc->thread, NULL);
+	pthread_mutex_lock(&gc->lock);
+	gc->cancel = 0;
+	pthread_mutex_unlock(&gc->lock);
+}
+
+/***
+ * Free the resources of an IpfsGarbageCollector
+ * NOTE: stops it first if it is running
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_free(struct IpfsGarbageCollector* gc) {
+	if (gc != NULL) {
+		ipfs_gc_stop(gc);
+		struct lmdb_context* db_context = (struct lmdb_context*) gc->local_node->repo->config->datastore->datastore_context;
+		if (db_context != NULL && db_context->pin_listener_context == gc) {
+			db_context->pin_listener = NULL;
+			db_context->pin_listener_context = NULL;
+		}
+		pthread_cond_destroy(&gc->wake);
+		pthread_mutex_destroy(&gc->lock);
+		free(gc);
+	}
+}
@@ -4,6 +4,7 @@
 #include "libp2p/conn/dialer.h"
 #include "libp2p/identify/identify.h"
 #include "libp2p/net/multistream.h"
+#include "libp2p/utils/logger.h"
 #include "libp2p/utils/vector.h"
 #include "libp2p/secio/secio.h"
 #include "libp2p/routing/dht_protocol.h"
@@ -13,6 +14,9 @@
 #include "core/ipfs_node.h"
 #include "exchange/bitswap/bitswap.h"
 #include "journal/journal.h"
+#include "journal/replication_manager.h"
+#include "namesys/resolver.h"
+#include "namesys/routing.h"
 
 struct IpfsNode* ipfs_node_new() {
 	struct IpfsNode* node = malloc(sizeof(struct IpfsNode));
@@ -27,10 +31,25 @@ struct IpfsNode* ipfs_node_new() {
 		node->repo = NULL;
 		node->routing = NULL;
 		node->api_context = NULL;
+		node->dialer = NULL;
+		node->swarm = NULL;
+		node->ipns_cache = NULL;
+		node->republisher = NULL;
+		node->replication_manager = NULL;
 	}
 	return node;
 }
 
+/***
+ * Build the cache of IPNS names
+ * @returns the cache, or NULL on error
+ */
+static struct routingResolver* ipfs_node_ipns_cache_new() {
+	// the cache does not use the routing system, but insists on one
+	static struct libp2p_routing_value_store route;
+	return ipfs_namesys_new_routing_resolver(&route, IPNS_CACHE_SIZE);
+}
+
 struct Libp2pVector* ipfs_node_online_build_protocol_handlers(struct IpfsNode* node) {
 	struct Libp2pVector* retVal = libp2p_utils_vector_new(1);
 	if (retVal != NULL) {
@@ -52,6 +71,71 @@ struct Libp2pVector* ipfs_node_online_build_protocol_handlers(struct IpfsNode* n
 	return retVal;
 }
 
+/***
+ * Find the rate limiters of the protocols that have one
+ * @param node the node
+ * @param dht where to put the limiter of kademlia (NULL if there is none)
+ * @param bitswap where to put the limiter of bitswap (NULL if there is none)
+ */
+static void ipfs_node_get_rate_limiters(struct IpfsNode* node, struct Libp2pRateLimiter** dht, struct Libp2pRateLimiter** bitswap) {
+	*dht = NULL;
+	*bitswap = NULL;
+	const struct Libp2pProtocolHandler* handler = NULL;
+	if (node->protocol_handlers != NULL)
+		handler = libp2p_protocol_get_handler(node->protocol_handlers, "/ipfs/kad/1.0.0\n");
+	if (handler != NULL && handler->context != NULL)
+		*dht = ((struct DhtContext*)handler->context)->rate_limiter;
+	if (node->exchange != NULL && node->exchange->exchangeContext != NULL)
+		*bitswap = ((struct BitswapContext*)node->exchange->exchangeContext)->rate_limiter;
+}
+
+/***
+ * Use the limits from the config for inbound requests
+ * @param node the node
+ */
+static void ipfs_node_set_rate_limits(struct IpfsNode* node) {
+	struct RateLimit* limits = &node->repo->config->rate_limit;
+	struct Libp2pRateLimiter* limiters[2];
+	ipfs_node_get_rate_limiters(node, &limiters[0], &limiters[1]);
+	for(int i = 0; i < 2; i++) {
+		if (limiters[i] != NULL)
+			libp2p_net_ratelimit_set_limits(limiters[i], limits->global_rate, limits->global_burst,
+					limits->peer_rate, limits->peer_burst, limits->max_in_flight);
+	}
+}
+
+/***
+ * Log what the rate limiters have admitted and dropped, and how far behind each replication peer is
+ * @param node the node
+ */
+void ipfs_node_log_stats(struct IpfsNode* node) {
+	if (node == NULL)
+		return;
+	struct Libp2pRateLimiter* limiters[2];
+	ipfs_node_get_rate_limiters(node, &limiters[0], &limiters[1]);
+	for(int i = 0; i < 2; i++) {
+		if (limiters[i] == NULL)
+			continue;
+		struct RateLimitStats stats;
+		libp2p_net_ratelimit_get_stats(limiters[i], &stats);
+		libp2p_logger_info("ipfs_node", "%s: admitted %llu/%llu/%llu, dropped per peer %llu/%llu/%llu, global %llu/%llu/%llu, busy %llu/%llu/%llu (high/normal/low).\n",
+				limiters[i]->protocol_id,
+				stats.admitted[0], stats.admitted[1], stats.admitted[2],
+				stats.dropped_peer[0], stats.dropped_peer[1], stats.dropped_peer[2],
+				stats.dropped_global[0], stats.dropped_global[1], stats.dropped_global[2],
+				stats.dropped_busy[0], stats.dropped_busy[1], stats.dropped_busy[2]);
+	}
+	struct ReplicationManager* replication = node->replication_manager;
+	for(int i = 0; replication != NULL && i < replication->workers->total; i++) {
+		struct ReplicationStats stats;
+		if (!ipfs_replication_manager_get_stats(replication, i, &stats))
+			continue;
+		const struct ReplicationWorker* worker = (const struct ReplicationWorker*) libp2p_utils_vector_get(replication->workers, i);
+		libp2p_logger_info("ipfs_node", "replication to %s: %llu seconds behind, %llu of %llu sync(s) failed, %d in a row.\n",
+				libp2p_peer_id_to_string(worker->replication_peer->peer), stats.lag_secs, stats.failures, stats.attempts, stats.consecutive_failures);
+	}
+}
+
 int ipfs_node_online_protocol_handlers_free(struct Libp2pVector* handlers) {
 	for(int i = 0; i < handlers->total; i++) {
 		struct Libp2pProtocolHandler* current = (struct Libp2pProtocolHandler*) libp2p_utils_vector_get(handlers, i);
@@ -100,8 +184,12 @@ int ipfs_node_online_new(const char* repo_path, struct IpfsNode** node) {
 	local_node->mode = MODE_OFFLINE;
 	local_node->routing = ipfs_routing_new_online(local_node, &fs_repo->config->identity->private_key);
 	local_node->exchange = ipfs_bitswap_new(local_node);
+	ipfs_node_set_rate_limits(local_node);
 	local_node->swarm = libp2p_swarm_new(local_node->protocol_handlers, local_node->repo->config->datastore, local_node->repo->config->filestore);
 	local_node->dialer = libp2p_conn_dialer_new(local_node->identity->peer, local_node->peerstore, &local_node->identity->private_key, local_node->swarm);
+	local_node->ipns_cache = ipfs_node_ipns_cache_new();
+	// stale names are served while they are resolved again
+	ipfs_routing_cache_set_refresh(local_node->ipns_cache, ipfs_namesys_resolver_refresh, local_node);
 
 	// fire up the API
 	api_start(local_node, 10, 5);
@@ -149,6 +237,7 @@ int ipfs_node_offline_new(const char* repo_path, struct IpfsNode** node) {
 	local_node->exchange = ipfs_bitswap_new(local_node);
 	local_node->swarm = libp2p_swarm_new(local_node->protocol_handlers, local_node->repo->config->datastore, local_node->repo->config->filestore);
 	local_node->dialer = libp2p_conn_dialer_new(local_node->identity->peer, local_node->peerstore, &local_node->identity->private_key, local_node->swarm);
+	local_node->ipns_cache = ipfs_node_ipns_cache_new();
 
 	if (api_running(local_node))
 		local_node->mode = MODE_API_AVAILABLE;
@@ -168,14 +257,18 @@ int ipfs_node_free(struct IpfsNode* node) {
 		if (node->exchange != NULL) {
 			node->exchange->Close(node->exchange);
 		}
+		// the refresh thread of the cache can use everything else
+		if (node->ipns_cache != NULL)
+			ipfs_namesys_routing_resolver_free(node->ipns_cache);
+		// the handlers can refer to the stores and the repo, so they go first
+		if (node->protocol_handlers != NULL)
+			ipfs_node_online_protocol_handlers_free(node->protocol_handlers);
 		if (node->providerstore != NULL)
 			libp2p_providerstore_free(node->providerstore);
 		if (node->peerstore != NULL)
 			libp2p_peerstore_free(node->peerstore);
 		if (node->repo != NULL)
 			ipfs_repo_fsrepo_free(node->repo);
-		if (node->protocol_handlers != NULL)
-			ipfs_node_online_protocol_handlers_free(node->protocol_handlers);
 		if (node->mode == MODE_ONLINE) {
 			ipfs_routing_online_free(node->routing);
 		}
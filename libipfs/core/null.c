@@ -4,6 +4,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -33,6 +34,8 @@
 
 // this should be set to 5 for normal operation, perhaps higher for debugging purposes
 #define DEFAULT_NETWORK_TIMEOUT 5
+// how often (in seconds) the node's counters are logged while listening
+#define NULL_STATS_SECS 300
 
 static int null_shutting_down = 0;
 
@@ -172,6 +175,8 @@ void* ipfs_null_listen (void *ptr)
     if (listen_param->local_node->peerstore->head_entry != NULL)
     		current_peer_entry = listen_param->local_node->peerstore->head_entry;
 
+    time_t last_stats = time(NULL);
+
     // the main loop, listening for new connections
     for (;;) {
 		//libp2p_logger_debug("null", "%s Attempting socket read with fd %d.\n", listen_param->local_node->identity->peer->id, socketfd);
@@ -222,6 +227,10 @@ void* ipfs_null_listen (void *ptr)
     			current_peer_entry = current_peer_entry->next;
     		if (current_peer_entry == NULL)
     			current_peer_entry = listen_param->local_node->peerstore->head_entry;
+    		if (time(NULL) - last_stats >= NULL_STATS_SECS) {
+    			ipfs_node_log_stats(listen_param->local_node);
+    			last_stats = time(NULL);
+    		}
     	}
     }
 
@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/conn/dialer.h"
+#include "libp2p/os/utils.h"
+#include "libp2p/peer/peerstore.h"
+#include "libp2p/record/message.h"
+#include "libp2p/routing/dht_protocol.h"
+#include "libp2p/utils/logger.h"
+#include "libp2p/utils/vector.h"
+#include "libp2p/yamux/yamux.h"
+#include "protobuf/varint.h"
+#include "cid/cid.h"
+#include "core/reprovider.h"
+#include "merkledag/merkledag.h"
+#include "merkledag/node.h"
+#include "repo/fsrepo/lmdb_datastore.h"
+#include "repo/fsrepo/journalstore.h"
+#include "routing/routing.h"
+
+// the name of the file in the repo directory that holds the progress
+#define REPROVIDER_STATE_FILE "reprovider_state"
+#define REPROVIDER_STATE_MAGIC "RPV1"
+// the seconds to wait for a peer to connect
+#define REPROVIDER_CONNECT_TIMEOUT 5
+
+/***
+ * The keys of a batch that go to one peer
+ */
+struct ReproviderTarget {
+	struct Libp2pPeer* peer; // the peer in the peerstore
+	struct Libp2pVector* messages; // the ADD_PROVIDER messages (owned by the batch)
+};
+
+/***
+ * Convert a strategy name from the config into a ReproviderStrategy
+ * @param name "all", "pinned" or "roots"
+ * @param strategy where to put the results
+ * @returns true(1) on success, false(0) if the name is not known
+ */
+int ipfs_reprovider_parse_strategy(const char* name, enum ReproviderStrategy* strategy) {
+	if (name == NULL || strategy == NULL)
+		return 0;
+	if (strcmp(name, "all") == 0)
+		*strategy = REPROVIDER_STRATEGY_ALL;
+	else if (strcmp(name, "pinned") == 0)
+		*strategy = REPROVIDER_STRATEGY_PINNED;
+	else if (strcmp(name, "roots") == 0)
+		*strategy = REPROVIDER_STRATEGY_ROOTS;
+	else
+		return 0;
+	return 1;
+}
+
+/***
+ * Convert an interval from the config (i.e. "12h" or "1h30m") into seconds
+ * @param interval the interval. Units can be s, m, h or d. No unit means seconds
+ * @param secs where to put the results
+ * @returns true(1) on success, false(0) if it cannot be parsed
+ */
+int ipfs_reprovider_parse_interval(const char* interval, time_t* secs) {
+	if (interval == NULL || secs == NULL || *interval == 0)
+		return 0;
+	time_t total = 0;
+	const char* pos = interval;
+	while (*pos != 0) {
+		if (*pos < '0' || *pos > '9')
+			return 0;
+		time_t value = 0;
+		while (*pos >= '0' && *pos <= '9') {
+			value = value * 10 + (*pos - '0');
+			pos++;
+		}
+		switch (*pos) {
+			case 0:
+			case 's':
+				break;
+			case 'm':
+				value *= 60;
+				break;
+			case 'h':
+				value *= 60 * 60;
+				break;
+			case 'd':
+				value *= 24 * 60 * 60;
+				break;
+			default:
+				return 0;
+		}
+		if (*pos != 0)
+			pos++;
+		total += value;
+	}
+	*secs = total;
+	return 1;
+}
+
+/***
+ * Save where we are, so a restart can pick up from there
+ * NOTE: caller must hold the lock
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_reprovider_save_state(struct IpfsReprovider* reprovider) {
+	char tmp_path[strlen(reprovider->state_path) + 5];
+	uint8_t varint[10];
+	size_t varint_size = 0;
+
+	// write to a temporary file first, so a crash can't leave half a file
+	sprintf(tmp_path, "%s.tmp", reprovider->state_path);
+	FILE* f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		libp2p_logger_error("reprovider", "Unable to write %s.\n", tmp_path);
+		return 0;
+	}
+	fwrite(REPROVIDER_STATE_MAGIC, 1, 4, f);
+	fputc(reprovider->strategy, f);
+	varint_encode(reprovider->round_started, varint, sizeof(varint), &varint_size);
+	fwrite(varint, 1, varint_size, f);
+	if (reprovider->position != NULL) {
+		struct JournalRecord* pos = reprovider->position;
+		fputc(1, f);
+		varint_encode(pos->timestamp, varint, sizeof(varint), &varint_size);
+		fwrite(varint, 1, varint_size, f);
+		fputc(pos->pin, f);
+		fputc(pos->pending, f);
+		varint_encode(pos->hash_size, varint, sizeof(varint), &varint_size);
+		fwrite(varint, 1, varint_size, f);
+		fwrite(pos->hash, 1, pos->hash_size, f);
+	} else {
+		fputc(0, f);
+	}
+	if (fclose(f) != 0 || rename(tmp_path, reprovider->state_path) != 0) {
+		unlink(tmp_path);
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Read a varint from a file
+ * @param f the file
+ * @param value where to put the results
+ * @returns true(1) on success, false(0) if the file is truncated
+ */
+static int ipfs_reprovider_read_varint(FILE* f, unsigned long long* value) {
+	uint8_t varint[10];
+	size_t varint_size = 0;
+	int c;
+	do {
+		if (varint_size == sizeof(varint) || (c = fgetc(f)) == EOF)
+			return 0;
+		varint[varint_size++] = c;
+	} while (c & 0x80);
+	*value = varint_decode(varint, varint_size, NULL);
+	return 1;
+}
+
+/***
+ * Load the progress saved by ipfs_reprovider_save_state
+ * NOTE: if the strategy changed since it was saved, a new round starts
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) if something was loaded, false(0) otherwise
+ */
+static int ipfs_reprovider_load_state(struct IpfsReprovider* reprovider) {
+	unsigned char magic[4];
+	unsigned long long value = 0;
+	struct JournalRecord* pos = NULL;
+	int retVal = 0;
+
+	FILE* f = fopen(reprovider->state_path, "rb");
+	if (f == NULL)
+		return 0;
+	if (fread(magic, 1, 4, f) != 4 || memcmp(magic, REPROVIDER_STATE_MAGIC, 4) != 0)
+		goto exit;
+	if (fgetc(f) != (int)reprovider->strategy) {
+		libp2p_logger_debug("reprovider", "The strategy changed. Starting over.\n");
+		goto exit;
+	}
+	if (!ipfs_reprovider_read_varint(f, &value))
+		goto exit;
+	time_t round_started = (time_t)value;
+	if (fgetc(f) == 1) {
+		pos = lmdb_journal_record_new();
+		if (pos == NULL || !ipfs_reprovider_read_varint(f, &pos->timestamp))
+			goto exit;
+		int pin = fgetc(f);
+		int pending = fgetc(f);
+		if (pin == EOF || pending == EOF || !ipfs_reprovider_read_varint(f, &value) || value == 0 || value > 1024)
+			goto exit;
+		pos->pin = pin;
+		pos->pending = pending;
+		pos->hash_size = value;
+		pos->hash = (uint8_t*) malloc(pos->hash_size);
+		if (pos->hash == NULL || fread(pos->hash, 1, pos->hash_size, f) != pos->hash_size)
+			goto exit;
+	}
+	reprovider->round_started = round_started;
+	reprovider->position = pos;
+	pos = NULL;
+	retVal = 1;
+	exit:
+	fclose(f);
+	lmdb_journal_record_free(pos);
+	return retVal;
+}
+
+/***
+ * Add tokens to the bucket for the time that has passed
+ * NOTE: caller must hold the lock
+ * @param reprovider the IpfsReprovider
+ */
+static void ipfs_reprovider_refill(struct IpfsReprovider* reprovider) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = (now.tv_sec - reprovider->last_refill.tv_sec) + (now.tv_nsec - reprovider->last_refill.tv_nsec) / 1e9;
+	reprovider->tokens += elapsed * reprovider->rate;
+	if (reprovider->tokens > reprovider->burst)
+		reprovider->tokens = reprovider->burst;
+	reprovider->last_refill = now;
+}
+
+/***
+ * Wait until the lock is signaled or the number of seconds has passed
+ * NOTE: caller must hold the lock
+ * @param reprovider the IpfsReprovider
+ * @param secs the most seconds to wait
+ */
+static void ipfs_reprovider_wait(struct IpfsReprovider* reprovider, double secs) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += (time_t)secs;
+	deadline.tv_nsec += (long)((secs - (time_t)secs) * 1e9);
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_cond_timedwait(&reprovider->wake, &reprovider->lock, &deadline);
+}
+
+/***
+ * Take a token from the bucket, waiting for one if it is empty
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) when a token was taken, false(0) if the reprovider is stopping
+ */
+static int ipfs_reprovider_take_token(struct IpfsReprovider* reprovider) {
+	int retVal = 0;
+	pthread_mutex_lock(&reprovider->lock);
+	while (reprovider->running) {
+		ipfs_reprovider_refill(reprovider);
+		if (reprovider->tokens >= 1.0) {
+			reprovider->tokens -= 1.0;
+			retVal = 1;
+			break;
+		}
+		ipfs_reprovider_wait(reprovider, (1.0 - reprovider->tokens) / reprovider->rate);
+	}
+	pthread_mutex_unlock(&reprovider->lock);
+	return retVal;
+}
+
+/***
+ * See if the reprovider should keep going
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) if it is running
+ */
+static int ipfs_reprovider_is_running(struct IpfsReprovider* reprovider) {
+	pthread_mutex_lock(&reprovider->lock);
+	int retVal = reprovider->running;
+	pthread_mutex_unlock(&reprovider->lock);
+	return retVal;
+}
+
+/***
+ * Read the next batch of records, and decide which of them to announce
+ * @param reprovider the IpfsReprovider
+ * @param records where to put what was read (JournalRecords), empty at the end of the round
+ * @param keys where to put the keys to announce (pointers into records)
+ * @returns true(1) on success, false(0) on error
+ */
+static int ipfs_reprovider_next_batch(struct IpfsReprovider* reprovider, struct Libp2pVector** records, struct Libp2pVector** keys) {
+	struct Datastore* datastore = reprovider->local_node->repo->config->datastore;
+	*keys = NULL;
+
+	if (reprovider->strategy == REPROVIDER_STRATEGY_PINNED) {
+		if (!lmdb_journalstore_get_records_after(datastore->datastore_context, reprovider->position, reprovider->batch_size, records))
+			return 0;
+	} else {
+		struct Libp2pVector* found = NULL;
+		struct JournalRecord* pos = reprovider->position;
+		if (!repo_fsrepo_lmdb_get_keys_after(datastore, pos == NULL ? NULL : pos->hash, pos == NULL ? 0 : pos->hash_size, reprovider->batch_size, &found))
+			return 0;
+		// turn them into JournalRecords, so the position is the same type for every strategy
+		*records = libp2p_utils_vector_new(found->total + 1);
+		for(int i = 0; i < found->total; i++) {
+			struct DatastoreRecord* ds_rec = (struct DatastoreRecord*) libp2p_utils_vector_get(found, i);
+			struct JournalRecord* rec = lmdb_journal_record_new();
+			if (rec != NULL) {
+				rec->pin = 1;
+				rec->hash = ds_rec->key;
+				rec->hash_size = ds_rec->key_size;
+				ds_rec->key = NULL;
+				libp2p_utils_vector_add(*records, rec);
+			}
+			libp2p_datastore_record_free(ds_rec);
+		}
+		libp2p_utils_vector_free(found);
+	}
+
+	*keys = libp2p_utils_vector_new((*records)->total + 1);
+	// the journal can have the same hash more than once
+	struct CidSet* seen = ipfs_cid_set_new();
+	if (*keys == NULL || seen == NULL) {
+		ipfs_cid_set_destroy(&seen);
+		return 0;
+	}
+	for(int i = 0; i < (*records)->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(*records, i);
+		if (!rec->pin)
+			continue;
+		struct Cid cid;
+		cid.version = 0;
+		cid.codec = CID_DAG_PROTOBUF;
+		cid.hash = rec->hash;
+		cid.hash_length = rec->hash_size;
+		if (ipfs_cid_set_has(seen, &cid))
+			continue;
+		ipfs_cid_set_add(seen, &cid, 1);
+		if (reprovider->strategy == REPROVIDER_STRATEGY_PINNED) {
+			// it may have been removed since it was pinned
+			struct DatastoreRecord* ds_rec = NULL;
+			if (!datastore->datastore_get(rec->hash, rec->hash_size, &ds_rec, datastore))
+				continue;
+			libp2p_datastore_record_free(ds_rec);
+		} else if (reprovider->strategy == REPROVIDER_STRATEGY_ROOTS) {
+			// there is no pin set to say which nodes are roots, so skip the leaves
+			struct HashtableNode* node = NULL;
+			if (!ipfs_merkledag_get(rec->hash, rec->hash_size, &node, reprovider->local_node->repo))
+				continue;
+			int has_links = node->head_link != NULL;
+			ipfs_hashtable_node_free(node);
+			if (!has_links)
+				continue;
+		}
+		libp2p_utils_vector_add(*keys, rec);
+	}
+	ipfs_cid_set_destroy(&seen);
+	return 1;
+}
+
+/***
+ * Find the target for a peer, adding one if it is not there
+ * @param targets the vector of ReproviderTargets
+ * @param peer the peer
+ * @returns the ReproviderTarget, or NULL on error
+ */
+static struct ReproviderTarget* ipfs_reprovider_get_target(struct Libp2pVector* targets, struct Libp2pPeer* peer) {
+	for(int i = 0; i < targets->total; i++) {
+		struct ReproviderTarget* target = (struct ReproviderTarget*) libp2p_utils_vector_get(targets, i);
+		if (target->peer == peer)
+			return target;
+	}
+	struct ReproviderTarget* target = (struct ReproviderTarget*) malloc(sizeof(struct ReproviderTarget));
+	if (target == NULL)
+		return NULL;
+	target->peer = peer;
+	target->messages = libp2p_utils_vector_new(REPROVIDER_BATCH_SIZE);
+	libp2p_utils_vector_add(targets, target);
+	return target;
+}
+
+/***
+ * Send one peer all of its ADD_PROVIDER messages, then read the answers
+ * NOTE: This is done on a kademlia stream of our own. The session's default
+ * stream belongs to the swarm listener (and bitswap), so the answers cannot be read there.
+ * @param reprovider the IpfsReprovider
+ * @param target the peer and its messages
+ * @returns the number of messages sent
+ */
+static int ipfs_reprovider_send_to_target(struct IpfsReprovider* reprovider, struct ReproviderTarget* target) {
+	struct IpfsNode* local_node = reprovider->local_node;
+	struct Libp2pPeer* peer = target->peer;
+	int sent = 0;
+
+	if (!libp2p_peer_is_connected(peer)) {
+		if (!libp2p_peer_connect(local_node->dialer, peer, local_node->peerstore, local_node->repo->config->datastore, REPROVIDER_CONNECT_TIMEOUT)) {
+			libp2p_logger_debug("reprovider", "Unable to connect to %s.\n", libp2p_peer_id_to_string(peer));
+			return 0;
+		}
+	}
+	struct Stream* kademlia_stream = libp2p_conn_dialer_get_stream(local_node->dialer, peer, "kademlia");
+	if (kademlia_stream == NULL) {
+		libp2p_logger_debug("reprovider", "Unable to open a kademlia stream to %s.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	for(int i = 0; i < target->messages->total; i++) {
+		if (!ipfs_reprovider_take_token(reprovider))
+			break;
+		struct KademliaMessage* msg = (struct KademliaMessage*) libp2p_utils_vector_get(target->messages, i);
+		size_t protobuf_size = libp2p_message_protobuf_encode_size(msg);
+		unsigned char* protobuf = (unsigned char*) malloc(protobuf_size);
+		if (protobuf == NULL)
+			break;
+		libp2p_message_protobuf_encode(msg, protobuf, protobuf_size, &protobuf_size);
+		struct StreamMessage outgoing;
+		outgoing.data = protobuf;
+		outgoing.data_size = protobuf_size;
+		outgoing.error_number = 0;
+		int written = kademlia_stream->write(kademlia_stream->stream_context, &outgoing);
+		free(protobuf);
+		if (!written)
+			break;
+		sent++;
+	}
+	// the remote echoes each ADD_PROVIDER. Read them so they don't pile up.
+	for(int i = 0; i < sent; i++) {
+		struct StreamMessage* answer = NULL;
+		if (!kademlia_stream->read(kademlia_stream->stream_context, &answer, 5) || answer == NULL) {
+			libp2p_stream_message_free(answer);
+			break;
+		}
+		libp2p_stream_message_free(answer);
+	}
+	// done with the channel. It is the parent of the kademlia stream, and takes it with it.
+	libp2p_yamux_channel_abandon(kademlia_stream->parent_stream);
+	return sent;
+}
+
+/***
+ * Announce a batch of keys to the peers closest to each of them
+ * @param reprovider the IpfsReprovider
+ * @param keys the JournalRecords that hold the keys
+ * @returns true(1) if the batch was finished, false(0) if the reprovider stopped first
+ */
+static int ipfs_reprovider_announce(struct IpfsReprovider* reprovider, struct Libp2pVector* keys) {
+	struct IpfsNode* local_node = reprovider->local_node;
+	struct Libp2pVector* messages = libp2p_utils_vector_new(keys->total + 1);
+	struct Libp2pVector* targets = libp2p_utils_vector_new(REPROVIDER_PEERS_PER_KEY);
+	int retVal = 1;
+
+	// group the keys by the peers closest to them
+	for(int i = 0; i < keys->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(keys, i);
+		struct Libp2pVector* closest = libp2p_routing_dht_closest_peers(local_node->peerstore, rec->hash, rec->hash_size, REPROVIDER_PEERS_PER_KEY);
+		if (closest == NULL)
+			continue;
+		struct KademliaMessage* msg = libp2p_message_new();
+		if (msg == NULL) {
+			libp2p_utils_vector_free(closest);
+			continue;
+		}
+		msg->message_type = MESSAGE_TYPE_ADD_PROVIDER;
+		msg->key = malloc(rec->hash_size);
+		if (msg->key != NULL) {
+			memcpy(msg->key, rec->hash, rec->hash_size);
+			msg->key_size = rec->hash_size;
+		}
+		msg->provider_peer_head = libp2p_utils_linked_list_new();
+		if (msg->key == NULL || msg->provider_peer_head == NULL) {
+			libp2p_message_free(msg);
+			libp2p_utils_vector_free(closest);
+			continue;
+		}
+		msg->provider_peer_head->item = ipfs_routing_online_build_local_peer(local_node->routing);
+		libp2p_utils_vector_add(messages, msg);
+		for(int j = 0; j < closest->total; j++) {
+			struct ReproviderTarget* target = ipfs_reprovider_get_target(targets, (struct Libp2pPeer*) libp2p_utils_vector_get(closest, j));
+			if (target != NULL)
+				libp2p_utils_vector_add(target->messages, msg);
+		}
+		libp2p_utils_vector_free(closest);
+	}
+
+	// one connection per peer, with all of its messages written at once
+	for(int i = 0; i < targets->total; i++) {
+		if (!ipfs_reprovider_is_running(reprovider)) {
+			retVal = 0;
+			break;
+		}
+		struct ReproviderTarget* target = (struct ReproviderTarget*) libp2p_utils_vector_get(targets, i);
+		int sent = ipfs_reprovider_send_to_target(reprovider, target);
+		libp2p_logger_debug("reprovider", "Announced %d of %d keys to %s.\n", sent, target->messages->total, libp2p_peer_id_to_string(target->peer));
+	}
+	if (retVal && !ipfs_reprovider_is_running(reprovider))
+		retVal = 0;
+
+	for(int i = 0; i < targets->total; i++) {
+		struct ReproviderTarget* target = (struct ReproviderTarget*) libp2p_utils_vector_get(targets, i);
+		libp2p_utils_vector_free(target->messages);
+		free(target);
+	}
+	libp2p_utils_vector_free(targets);
+	for(int i = 0; i < messages->total; i++)
+		libp2p_message_free((struct KademliaMessage*) libp2p_utils_vector_get(messages, i));
+	libp2p_utils_vector_free(messages);
+	return retVal;
+}
+
+/***
+ * Free a vector of JournalRecords
+ * @param records the vector
+ */
+static void ipfs_reprovider_records_free(struct Libp2pVector* records) {
+	if (records == NULL)
+		return;
+	for(int i = 0; i < records->total; i++)
+		lmdb_journal_record_free((struct JournalRecord*) libp2p_utils_vector_get(records, i));
+	libp2p_utils_vector_free(records);
+}
+
+/***
+ * The background thread. Walks the datastore a batch at a time, and
+ * sleeps between rounds.
+ * @param arg the IpfsReprovider
+ * @returns NULL
+ */
+static void* ipfs_reprovider_thread(void* arg) {
+	struct IpfsReprovider* reprovider = (struct IpfsReprovider*) arg;
+
+	pthread_mutex_lock(&reprovider->lock);
+	while (reprovider->running) {
+		if (reprovider->position == NULL) {
+			// between rounds
+			time_t now = time(NULL);
+			time_t next_round = reprovider->round_started + reprovider->interval_secs;
+			if (reprovider->round_started != 0 && now < next_round) {
+				ipfs_reprovider_wait(reprovider, next_round - now);
+				continue;
+			}
+			reprovider->round_started = now;
+			libp2p_logger_debug("reprovider", "Starting a round of announcements.\n");
+		}
+		pthread_mutex_unlock(&reprovider->lock);
+
+		struct Libp2pVector* records = NULL;
+		struct Libp2pVector* keys = NULL;
+		int finished = 0;
+		int ok = ipfs_reprovider_next_batch(reprovider, &records, &keys);
+		if (ok && keys->total > 0)
+			finished = ipfs_reprovider_announce(reprovider, keys);
+		else if (ok)
+			finished = 1;
+
+		pthread_mutex_lock(&reprovider->lock);
+		if (!ok) {
+			libp2p_logger_error("reprovider", "Unable to read from the datastore. Trying again later.\n");
+			ipfs_reprovider_wait(reprovider, 60);
+		} else if (finished) {
+			if (records->total == 0) {
+				libp2p_logger_debug("reprovider", "Finished a round of announcements. %llu keys announced so far.\n", reprovider->announced);
+				lmdb_journal_record_free(reprovider->position);
+				reprovider->position = NULL;
+			} else {
+				// move past the batch. The last record is taken out of the vector so it is not freed below
+				reprovider->announced += keys->total;
+				lmdb_journal_record_free(reprovider->position);
+				reprovider->position = (struct JournalRecord*) libp2p_utils_vector_get(records, records->total - 1);
+				records->total--;
+			}
+			ipfs_reprovider_save_state(reprovider);
+		}
+		if (keys != NULL)
+			libp2p_utils_vector_free(keys);
+		ipfs_reprovider_records_free(records);
+	}
+	ipfs_reprovider_save_state(reprovider);
+	pthread_mutex_unlock(&reprovider->lock);
+	return NULL;
+}
+
+/***
+ * Build a reprovider using the settings in the config, and load the saved progress
+ * @param local_node the node whose datastore is announced
+ * @returns the IpfsReprovider, or NULL on error or if reproviding is turned off
+ */
+struct IpfsReprovider* ipfs_reprovider_new(struct IpfsNode* local_node) {
+	if (local_node == NULL || local_node->repo == NULL || local_node->routing == NULL)
+		return NULL;
+	struct Reprovider* config = &local_node->repo->config->reprovider;
+
+	time_t interval_secs = REPROVIDER_DEFAULT_INTERVAL;
+	if (config->interval != NULL && !ipfs_reprovider_parse_interval(config->interval, &interval_secs)) {
+		libp2p_logger_error("reprovider", "Unable to parse Reprovider.Interval %s. Using the default.\n", config->interval);
+		interval_secs = REPROVIDER_DEFAULT_INTERVAL;
+	}
+	if (interval_secs == 0) {
+		libp2p_logger_debug("reprovider", "Reprovider.Interval is 0. Not announcing.\n");
+		return NULL;
+	}
+	enum ReproviderStrategy strategy = REPROVIDER_STRATEGY_ALL;
+	if (config->strategy != NULL && !ipfs_reprovider_parse_strategy(config->strategy, &strategy)) {
+		libp2p_logger_error("reprovider", "Unknown Reprovider.Strategy %s. Using all.\n", config->strategy);
+		strategy = REPROVIDER_STRATEGY_ALL;
+	}
+
+	struct IpfsReprovider* reprovider = (struct IpfsReprovider*) malloc(sizeof(struct IpfsReprovider));
+	if (reprovider == NULL)
+		return NULL;
+	reprovider->local_node = local_node;
+	reprovider->strategy = strategy;
+	reprovider->interval_secs = interval_secs;
+	reprovider->batch_size = REPROVIDER_BATCH_SIZE;
+	reprovider->rate = REPROVIDER_DEFAULT_RATE;
+	reprovider->burst = REPROVIDER_DEFAULT_BURST;
+	reprovider->tokens = reprovider->burst;
+	clock_gettime(CLOCK_MONOTONIC, &reprovider->last_refill);
+	reprovider->round_started = 0;
+	reprovider->position = NULL;
+	reprovider->announced = 0;
+	reprovider->running = 0;
+	pthread_mutex_init(&reprovider->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&reprovider->wake, &attr);
+	pthread_condattr_destroy(&attr);
+
+	size_t path_size = strlen(local_node->repo->path) + strlen(REPROVIDER_STATE_FILE) + 2;
+	reprovider->state_path = (char*) malloc(path_size);
+	if (reprovider->state_path == NULL || !os_utils_filepath_join(local_node->repo->path, REPROVIDER_STATE_FILE, reprovider->state_path, path_size)) {
+		ipfs_reprovider_free(reprovider);
+		return NULL;
+	}
+	if (ipfs_reprovider_load_state(reprovider))
+		libp2p_logger_debug("reprovider", "Resuming from %s.\n", reprovider->state_path);
+	return reprovider;
+}
+
+/***
+ * Start announcing in a background thread
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_reprovider_start(struct IpfsReprovider* reprovider) {
+	if (reprovider == NULL)
+		return 0;
+	pthread_mutex_lock(&reprovider->lock);
+	if (reprovider->running) {
+		pthread_mutex_unlock(&reprovider->lock);
+		return 1;
+	}
+	reprovider->running = 1;
+	if (pthread_create(&reprovider->thread, NULL, ipfs_reprovider_thread, reprovider) != 0) {
+		libp2p_logger_error("reprovider", "Unable to start the reprovider thread.\n");
+		reprovider->running = 0;
+	}
+	int retVal = reprovider->running;
+	pthread_mutex_unlock(&reprovider->lock);
+	return retVal;
+}
+
+/***
+ * Stop the background thread and wait for it to finish. Progress is saved.
+ * @param reprovider the IpfsReprovider
+ */
+void ipfs_reprovider_stop(struct IpfsReprovider* reprovider) {
+	if (reprovider == NULL)
+		return;
+	pthread_mutex_lock(&reprovider->lock);
+	int was_running = reprovider->running;
+	reprovider->running = 0;
+	pthread_cond_broadcast(&reprovider->wake);
+	pthread_mutex_unlock(&reprovider->lock);
+	if (was_running)
+		pthread_join(reprovider->thread, NULL);
+}
+
+/***
+ * Free the resources of an IpfsReprovider
+ * NOTE: stops it first if it is running
+ * @param reprovider the IpfsReprovider
+ */
+void ipfs_reprovider_free(struct IpfsReprovider* reprovider) {
+	if (reprovider != NULL) {
+		ipfs_reprovider_stop(reprovider);
+		lmdb_journal_record_free(reprovider->position);
+		free(reprovider->state_path);
+		pthread_cond_destroy(&reprovider->wake);
+		pthread_mutex_destroy(&reprovider->lock);
+		free(reprovider);
+	}
+}
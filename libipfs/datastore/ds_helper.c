@@ -60,9 +60,10 @@ int ipfs_datastore_helper_binary_from_ds_key(const unsigned char* ds_key, size_t
  * Add a record in the datastore based on a block
  * @param block the block
  * @param datastore the Datastore
+ * @param pin true(1) if the block is pinned (i.e. it was added by the user), false(0) if it can be collected
  * @reutrns true(1) on success, false(0) otherwise
  */
-int ipfs_datastore_helper_add_block_to_datastore(struct Block* block, struct Datastore* datastore) {
+int ipfs_datastore_helper_add_block_to_datastore(struct Block* block, struct Datastore* datastore, int pin) {
 	struct DatastoreRecord* rec = libp2p_datastore_record_new();
 	if (rec == NULL)
 		return 0;
@@ -74,6 +75,7 @@ int ipfs_datastore_helper_add_block_to_datastore(struct Block* block, struct Dat
 	}
 	memcpy(rec->key, block->cid->hash, rec->key_size);
 	rec->timestamp = 0;
+	rec->pin = pin;
 	// convert the key to base32, and store it in the DatabaseRecord->value section
 	size_t fs_key_length = 100;
 	uint8_t fs_key[fs_key_length];
@@ -0,0 +1,832 @@
+/*
+An in-process DNS client, used to look up the TXT records that hold
+dnslinks. It speaks just enough of RFC 1035 to ask for TXT records and
+read the answers:
+
+  - one UDP socket per name, all of them waited on with a single poll()
+  - the same query is sent to the next resolver if one does not answer
+  - a truncated answer is asked for again over TCP
+  - answers are cached for the smallest TTL in the answer, and "no such
+    name" is cached for the TTL of the SOA record in the authority section
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "dnslink/dns_client.h"
+
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_TXT 16
+#define DNS_TYPE_SOA 6
+#define DNS_TYPE_OPT 41
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_MAX_NAME 255
+
+struct dns_server {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+};
+
+// a cached answer. txt is one buffer of num_txt NULL terminated records.
+struct dns_cache_entry {
+    char *name;
+    char *txt;
+    size_t txt_size;
+    int num_txt;
+    int err; // 0 for an answer, otherwise the error to return
+    time_t expires;
+    struct dns_cache_entry *next;
+};
+
+// a lookup in progress
+struct dns_query {
+    char *name;
+    uint16_t id;
+    int fd;
+    int server;
+    int attempts;
+    struct timespec deadline;
+    int done;
+    int err;
+    char *txt;
+    size_t txt_size;
+    int num_txt;
+    uint32_t ttl;
+    // the resolvers, as they were when the lookup started
+    const struct dns_server *servers;
+    int num_servers;
+};
+
+static pthread_mutex_t dns_client_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_server dns_servers[DNS_CLIENT_MAX_SERVERS];
+static int dns_num_servers = -1; // -1 means not loaded yet
+static struct dns_cache_entry *dns_cache[DNS_CLIENT_CACHE_SIZE];
+static int dns_cache_count = 0;
+static uint16_t dns_next_id = 0; // only used if there is no /dev/urandom
+
+static time_t ipfs_dns_client_now ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// parse "ip", "ip:port" or "[ip6]:port" into a server
+static int ipfs_dns_client_parse_server (struct dns_server *server, const char *str, size_t len)
+{
+    char host[64];
+    int port = 53;
+    const char *p, *end = str + len;
+
+    memset(server, 0, sizeof(struct dns_server));
+    if (len == 0 || len >= sizeof(host)) {
+        return ErrInvalidParam;
+    }
+    if (*str == '[') {
+        p = memchr(str, ']', len);
+        if (!p || p - str - 1 >= sizeof(host)) {
+            return ErrInvalidParam;
+        }
+        memcpy(host, str + 1, p - str - 1);
+        host[p - str - 1] = '\0';
+        if (p + 1 < end && p[1] == ':') {
+            port = atoi(p + 2);
+        }
+    } else {
+        p = memchr(str, ':', len);
+        // more than one ':' is a bare IPv6 address
+        if (p && memchr(p + 1, ':', end - p - 1)) {
+            p = NULL;
+        }
+        memcpy(host, str, p ? p - str : len);
+        host[p ? p - str : len] = '\0';
+        if (p) {
+            port = atoi(p + 1);
+        }
+    }
+    if (port <= 0 || port > 65535) {
+        return ErrInvalidParam;
+    }
+    struct sockaddr_in *v4 = (struct sockaddr_in*)&server->addr;
+    struct sockaddr_in6 *v6 = (struct sockaddr_in6*)&server->addr;
+    if (inet_pton(AF_INET, host, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        server->addr_len = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, host, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        server->addr_len = sizeof(struct sockaddr_in6);
+    } else {
+        return ErrInvalidParam;
+    }
+    return 0;
+}
+
+// fill dns_servers from a list of servers. NOTE: caller must hold the lock
+static void ipfs_dns_client_load_list (const char *servers)
+{
+    const char *p = servers;
+    dns_num_servers = 0;
+    while (*p && dns_num_servers < DNS_CLIENT_MAX_SERVERS) {
+        while (*p == ' ' || *p == ',' || *p == '\t') {
+            p++;
+        }
+        size_t len = strcspn(p, " ,\t");
+        if (len > 0 && ipfs_dns_client_parse_server(&dns_servers[dns_num_servers], p, len) == 0) {
+            dns_num_servers++;
+        }
+        p += len;
+    }
+}
+
+// fill dns_servers from /etc/resolv.conf. NOTE: caller must hold the lock
+static void ipfs_dns_client_load_resolv_conf ()
+{
+    char line[256], list[DNS_CLIENT_MAX_SERVERS * 64] = "";
+    FILE *f = fopen("/etc/resolv.conf", "r");
+
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            char *p = line;
+            while (isspace((unsigned char)*p)) {
+                p++;
+            }
+            if (strncmp(p, "nameserver", 10) != 0 || !isspace((unsigned char)p[10])) {
+                continue;
+            }
+            p += 10;
+            while (isspace((unsigned char)*p)) {
+                p++;
+            }
+            p[strcspn(p, " \t\r\n%")] = '\0'; // drop any IPv6 zone
+            if (*p && strlen(list) + strlen(p) + 2 < sizeof(list)) {
+                strcat(list, p);
+                strcat(list, " ");
+            }
+        }
+        fclose(f);
+    }
+    ipfs_dns_client_load_list(list);
+    if (dns_num_servers == 0) {
+        // none there, or none we could read
+        ipfs_dns_client_load_list("127.0.0.1");
+    }
+}
+
+// pick a query id for each query, so answers cannot be guessed and forged
+static void ipfs_dns_client_random_ids (struct dns_query *queries, int count)
+{
+    uint16_t ids[DNS_CLIENT_MAX_PARALLEL];
+    size_t got = 0;
+    int i, fd = open("/dev/urandom", O_RDONLY);
+
+    if (fd >= 0) {
+        while (got < count * sizeof(uint16_t)) {
+            ssize_t r = read(fd, (unsigned char*)ids + got, count * sizeof(uint16_t) - got);
+            if (r <= 0) {
+                if (r < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            got += r;
+        }
+        close(fd);
+    }
+    for (i = 0 ; i < count ; i++) {
+        if (got == count * sizeof(uint16_t)) {
+            queries[i].id = ids[i];
+        } else {
+            // NOTE: caller holds the lock
+            if (dns_next_id == 0) {
+                dns_next_id = (uint16_t)(getpid() ^ time(NULL));
+            }
+            queries[i].id = ++dns_next_id;
+        }
+    }
+}
+
+static unsigned int ipfs_dns_client_hash (const char *name)
+{
+    unsigned int hash = 2166136261u;
+    for ( ; *name ; name++) {
+        hash ^= (unsigned char)tolower((unsigned char)*name);
+        hash *= 16777619u;
+    }
+    return hash % DNS_CLIENT_CACHE_SIZE;
+}
+
+static void ipfs_dns_client_cache_entry_free (struct dns_cache_entry *entry)
+{
+    free(entry->name);
+    free(entry->txt);
+    free(entry);
+}
+
+// remove expired entries, or if none are expired, the one closest to expiring
+// NOTE: caller must hold the lock
+static void ipfs_dns_client_cache_make_room (time_t now)
+{
+    struct dns_cache_entry **soonest = NULL;
+    int i;
+    for (i = 0 ; i < DNS_CLIENT_CACHE_SIZE ; i++) {
+        struct dns_cache_entry **current = &dns_cache[i];
+        while (*current) {
+            struct dns_cache_entry *entry = *current;
+            if (entry->expires <= now) {
+                *current = entry->next;
+                ipfs_dns_client_cache_entry_free(entry);
+                dns_cache_count--;
+                continue;
+            }
+            if (!soonest || entry->expires < (*soonest)->expires) {
+                soonest = current;
+            }
+            current = &entry->next;
+        }
+    }
+    if (dns_cache_count >= DNS_CLIENT_CACHE_SIZE && soonest) {
+        struct dns_cache_entry *entry = *soonest;
+        *soonest = entry->next;
+        ipfs_dns_client_cache_entry_free(entry);
+        dns_cache_count--;
+    }
+}
+
+// find a fresh cache entry. NOTE: caller must hold the lock
+static struct dns_cache_entry *ipfs_dns_client_cache_find (const char *name, time_t now)
+{
+    struct dns_cache_entry **current = &dns_cache[ipfs_dns_client_hash(name)];
+    while (*current) {
+        struct dns_cache_entry *entry = *current;
+        if (strcasecmp(entry->name, name) == 0) {
+            if (entry->expires > now) {
+                return entry;
+            }
+            *current = entry->next;
+            ipfs_dns_client_cache_entry_free(entry);
+            dns_cache_count--;
+            return NULL;
+        }
+        current = &entry->next;
+    }
+    return NULL;
+}
+
+// remember the result of a query. NOTE: caller must hold the lock
+static void ipfs_dns_client_cache_add (struct dns_query *q)
+{
+    time_t now = ipfs_dns_client_now();
+    struct dns_cache_entry *entry;
+    uint32_t ttl = q->ttl;
+
+    // only answers and "no such name" are cached, not timeouts
+    if (q->err && q->err != ErrNoRecord) {
+        return;
+    }
+    if (ttl < DNS_CLIENT_MIN_TTL) {
+        ttl = DNS_CLIENT_MIN_TTL;
+    } else if (ttl > DNS_CLIENT_MAX_TTL) {
+        ttl = DNS_CLIENT_MAX_TTL;
+    }
+    entry = ipfs_dns_client_cache_find(q->name, now);
+    if (entry) {
+        // someone else got here first; keep theirs
+        return;
+    }
+    if (dns_cache_count >= DNS_CLIENT_CACHE_SIZE) {
+        ipfs_dns_client_cache_make_room(now);
+    }
+    entry = calloc(1, sizeof(struct dns_cache_entry));
+    if (!entry) {
+        return;
+    }
+    entry->name = strdup(q->name);
+    if (q->txt_size) {
+        entry->txt = malloc(q->txt_size);
+    }
+    if (!entry->name || (q->txt_size && !entry->txt)) {
+        ipfs_dns_client_cache_entry_free(entry);
+        return;
+    }
+    if (q->txt_size) {
+        memcpy(entry->txt, q->txt, q->txt_size);
+    }
+    entry->txt_size = q->txt_size;
+    entry->num_txt = q->num_txt;
+    entry->err = q->err;
+    entry->expires = now + ttl;
+    unsigned int index = ipfs_dns_client_hash(q->name);
+    entry->next = dns_cache[index];
+    dns_cache[index] = entry;
+    dns_cache_count++;
+}
+
+// turn a buffer of NULL terminated records into a NULL terminated array
+static int ipfs_dns_client_make_array (char ***txt, const char *records, size_t size, int count)
+{
+    char *p;
+    int i;
+
+    *txt = calloc(count + 1, sizeof(char*));
+    if (!*txt) {
+        return ErrAllocFailed;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    p = malloc(size);
+    if (!p) {
+        free(*txt);
+        *txt = NULL;
+        return ErrAllocFailed;
+    }
+    memcpy(p, records, size);
+    for (i = 0 ; i < count ; i++) {
+        (*txt)[i] = p;
+        p += strlen(p) + 1;
+    }
+    return 0;
+}
+
+// build a TXT query for name. Returns the length, or 0 on error.
+static size_t ipfs_dns_client_build_query (unsigned char *buf, size_t max, const char *name, uint16_t id)
+{
+    size_t pos = DNS_HEADER_SIZE, len = strlen(name);
+    const char *label = name;
+
+    if (len == 0 || len > DNS_MAX_NAME || max < DNS_HEADER_SIZE + len + 2 + 4 + 11) {
+        return 0;
+    }
+    memset(buf, 0, DNS_HEADER_SIZE);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = DNS_FLAG_RD >> 8;
+    buf[5] = 1; // one question
+    buf[11] = 1; // one additional record (EDNS0)
+    while (*label) {
+        size_t label_len = strcspn(label, ".");
+        if (label_len == 0 || label_len > 63) {
+            return 0;
+        }
+        buf[pos++] = label_len;
+        memcpy(&buf[pos], label, label_len);
+        pos += label_len;
+        label += label_len;
+        if (*label == '.') {
+            label++;
+        }
+    }
+    buf[pos++] = 0;
+    buf[pos++] = 0; buf[pos++] = DNS_TYPE_TXT;
+    buf[pos++] = 0; buf[pos++] = DNS_CLASS_IN;
+    // OPT record: root name, type, udp size, extended rcode/flags, no data
+    buf[pos++] = 0;
+    buf[pos++] = 0; buf[pos++] = DNS_TYPE_OPT;
+    buf[pos++] = DNS_CLIENT_UDP_SIZE >> 8; buf[pos++] = DNS_CLIENT_UDP_SIZE & 0xff;
+    memset(&buf[pos], 0, 6);
+    pos += 6;
+    return pos;
+}
+
+// step over a (possibly compressed) name. Returns the new position, or 0 on error.
+static size_t ipfs_dns_client_skip_name (const unsigned char *buf, size_t size, size_t pos)
+{
+    while (pos < size) {
+        if (buf[pos] == 0) {
+            return pos + 1;
+        }
+        if ((buf[pos] & 0xc0) == 0xc0) {
+            return (pos + 2 <= size) ? pos + 2 : 0;
+        }
+        pos += buf[pos] + 1;
+    }
+    return 0;
+}
+
+static uint32_t ipfs_dns_client_read32 (const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// read an answer into q. Returns 1 if q is done, 0 if the answer was not for q,
+// or -1 if the answer was truncated and should be asked for over TCP
+static int ipfs_dns_client_parse_answer (struct dns_query *q, const unsigned char *buf, size_t size)
+{
+    size_t pos, txt_used = 0, txt_max = 0;
+    int i, qdcount, ancount, nscount, rcode, flags;
+    uint32_t min_ttl = DNS_CLIENT_MAX_TTL;
+    char *txt = NULL;
+
+    if (size < DNS_HEADER_SIZE || ((buf[0] << 8) | buf[1]) != q->id) {
+        return 0;
+    }
+    flags = (buf[2] << 8) | buf[3];
+    if (!(flags & DNS_FLAG_QR)) {
+        return 0;
+    }
+    if (flags & DNS_FLAG_TC) {
+        return -1;
+    }
+    rcode = flags & 0x0f;
+    qdcount = (buf[4] << 8) | buf[5];
+    ancount = (buf[6] << 8) | buf[7];
+    nscount = (buf[8] << 8) | buf[9];
+    pos = DNS_HEADER_SIZE;
+    for (i = 0 ; i < qdcount ; i++) {
+        pos = ipfs_dns_client_skip_name(buf, size, pos);
+        if (!pos || pos + 4 > size) {
+            goto bad;
+        }
+        pos += 4;
+    }
+    if (rcode != 0 && rcode != DNS_RCODE_NXDOMAIN) {
+        // server failure or refused. Let the next resolver try.
+        goto bad;
+    }
+    for (i = 0 ; i < ancount + nscount ; i++) {
+        pos = ipfs_dns_client_skip_name(buf, size, pos);
+        if (!pos || pos + 10 > size) {
+            goto bad;
+        }
+        int type = (buf[pos] << 8) | buf[pos+1];
+        uint32_t ttl = ipfs_dns_client_read32(&buf[pos+4]);
+        size_t rdlength = (buf[pos+8] << 8) | buf[pos+9];
+        pos += 10;
+        if (pos + rdlength > size) {
+            goto bad;
+        }
+        if (i < ancount && type == DNS_TYPE_TXT) {
+            // a record can be split into several strings; join them
+            size_t rpos = 0;
+            if (txt_used + rdlength + 1 > txt_max) {
+                size_t new_max = (txt_max + rdlength + 1) * 2;
+                char *new_txt = realloc(txt, new_max);
+                if (!new_txt) {
+                    goto bad;
+                }
+                txt = new_txt;
+                txt_max = new_max;
+            }
+            while (rpos < rdlength) {
+                size_t len = buf[pos + rpos];
+                if (rpos + 1 + len > rdlength) {
+                    goto bad;
+                }
+                memcpy(&txt[txt_used], &buf[pos + rpos + 1], len);
+                txt_used += len;
+                rpos += 1 + len;
+            }
+            txt[txt_used++] = '\0';
+            q->num_txt++;
+            if (ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+        } else if (i >= ancount && type == DNS_TYPE_SOA && rdlength >= 20) {
+            // negative answers are good for the smaller of the SOA ttl and minimum
+            uint32_t minimum = ipfs_dns_client_read32(&buf[pos + rdlength - 4]);
+            if (ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+            if (minimum < min_ttl) {
+                min_ttl = minimum;
+            }
+        }
+        pos += rdlength;
+    }
+    if (q->num_txt == 0) {
+        q->err = ErrNoRecord;
+        if (min_ttl == DNS_CLIENT_MAX_TTL) {
+            min_ttl = DNS_CLIENT_DEFAULT_NEGATIVE_TTL;
+        }
+    } else {
+        q->err = 0;
+    }
+    q->txt = txt;
+    q->txt_size = txt_used;
+    q->ttl = min_ttl;
+    q->done = 1;
+    return 1;
+
+bad:
+    free(txt);
+    q->num_txt = 0;
+    q->err = ErrResolveFailed;
+    return 0;
+}
+
+// ask again over TCP, for answers too big for UDP. Returns 1 if q is done.
+static int ipfs_dns_client_query_tcp (struct dns_query *q, const struct dns_server *server)
+{
+    unsigned char query[DNS_HEADER_SIZE + DNS_MAX_NAME + 32], len_buf[2], *answer = NULL;
+    size_t query_len = ipfs_dns_client_build_query(query + 2, sizeof(query) - 2, q->name, q->id), got = 0, answer_len;
+    struct timeval timeout = { DNS_CLIENT_TIMEOUT_MS / 1000, (DNS_CLIENT_TIMEOUT_MS % 1000) * 1000 };
+    struct pollfd pfd;
+    int fd, retVal = 0;
+
+    if (!query_len) {
+        return 0;
+    }
+    query[0] = query_len >> 8;
+    query[1] = query_len & 0xff;
+    fd = socket(server->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    // connect without blocking for longer than the timeout
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (connect(fd, (const struct sockaddr*)&server->addr, server->addr_len) != 0) {
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (errno != EINPROGRESS || poll(&pfd, 1, DNS_CLIENT_TIMEOUT_MS) != 1
+                || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0 || err != 0) {
+            goto exit;
+        }
+    }
+    fcntl(fd, F_SETFL, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (send(fd, query, query_len + 2, 0) != (ssize_t)(query_len + 2)) {
+        goto exit;
+    }
+    if (recv(fd, len_buf, 2, MSG_WAITALL) != 2) {
+        goto exit;
+    }
+    answer_len = (len_buf[0] << 8) | len_buf[1];
+    answer = malloc(answer_len ? answer_len : 1);
+    if (!answer) {
+        goto exit;
+    }
+    while (got < answer_len) {
+        ssize_t r = recv(fd, answer + got, answer_len - got, 0);
+        if (r <= 0) {
+            goto exit;
+        }
+        got += r;
+    }
+    retVal = (ipfs_dns_client_parse_answer(q, answer, answer_len) == 1);
+
+exit:
+    free(answer);
+    close(fd);
+    return retVal;
+}
+
+// send q to its next resolver. Returns 0 on success.
+static int ipfs_dns_client_send (struct dns_query *q)
+{
+    unsigned char query[DNS_HEADER_SIZE + DNS_MAX_NAME + 32];
+    size_t len;
+    const struct dns_server *server;
+
+    if (q->num_servers <= 0 || q->attempts >= DNS_CLIENT_ATTEMPTS * q->num_servers) {
+        return ErrResolveFailed;
+    }
+    q->server = q->attempts % q->num_servers;
+    q->attempts++;
+    server = &q->servers[q->server];
+    if (q->fd >= 0) {
+        close(q->fd);
+    }
+    q->fd = socket(server->addr.ss_family, SOCK_DGRAM, 0);
+    if (q->fd < 0) {
+        return ErrResolveFailed;
+    }
+    fcntl(q->fd, F_SETFL, O_NONBLOCK);
+    // connected, so only answers from this server are seen
+    if (connect(q->fd, (const struct sockaddr*)&server->addr, server->addr_len) != 0) {
+        return ErrResolveFailed;
+    }
+    len = ipfs_dns_client_build_query(query, sizeof(query), q->name, q->id);
+    if (!len || send(q->fd, query, len, 0) != (ssize_t)len) {
+        return ErrResolveFailed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &q->deadline);
+    q->deadline.tv_sec += DNS_CLIENT_TIMEOUT_MS / 1000;
+    q->deadline.tv_nsec += (DNS_CLIENT_TIMEOUT_MS % 1000) * 1000000L;
+    if (q->deadline.tv_nsec >= 1000000000L) {
+        q->deadline.tv_sec++;
+        q->deadline.tv_nsec -= 1000000000L;
+    }
+    return 0;
+}
+
+// move q on to the next resolver, or give up
+static void ipfs_dns_client_retry (struct dns_query *q)
+{
+    while (!q->done) {
+        if (q->num_servers <= 0 || q->attempts >= DNS_CLIENT_ATTEMPTS * q->num_servers) {
+            q->done = 1;
+            if (!q->err) {
+                q->err = ErrResolveFailed;
+            }
+            return;
+        }
+        if (ipfs_dns_client_send(q) == 0) {
+            return;
+        }
+    }
+}
+
+// run the queries until all are done
+static void ipfs_dns_client_run (struct dns_query *queries, int count)
+{
+    struct pollfd pfds[DNS_CLIENT_MAX_PARALLEL];
+    int map[DNS_CLIENT_MAX_PARALLEL];
+    unsigned char answer[DNS_CLIENT_UDP_SIZE];
+    int i;
+
+    for (i = 0 ; i < count ; i++) {
+        if (!queries[i].done) {
+            ipfs_dns_client_retry(&queries[i]);
+        }
+    }
+    while (1) {
+        struct timespec now;
+        long wait_ms = -1;
+        int n = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (i = 0 ; i < count ; i++) {
+            struct dns_query *q = &queries[i];
+            if (q->done) {
+                continue;
+            }
+            long left = (q->deadline.tv_sec - now.tv_sec) * 1000 + (q->deadline.tv_nsec - now.tv_nsec) / 1000000;
+            if (left <= 0) {
+                // no answer in time; try the next resolver
+                ipfs_dns_client_retry(q);
+                if (q->done) {
+                    continue;
+                }
+                left = DNS_CLIENT_TIMEOUT_MS;
+            }
+            if (wait_ms < 0 || left < wait_ms) {
+                wait_ms = left;
+            }
+            pfds[n].fd = q->fd;
+            pfds[n].events = POLLIN;
+            pfds[n].revents = 0;
+            map[n++] = i;
+        }
+        if (n == 0) {
+            return;
+        }
+        if (poll(pfds, n, wait_ms) < 0 && errno != EINTR) {
+            return;
+        }
+        for (i = 0 ; i < n ; i++) {
+            struct dns_query *q = &queries[map[i]];
+            if (pfds[i].revents & POLLIN) {
+                ssize_t r = recv(q->fd, answer, sizeof(answer), 0);
+                int parsed = (r > 0) ? ipfs_dns_client_parse_answer(q, answer, r) : 0;
+                if (parsed == -1 && !ipfs_dns_client_query_tcp(q, &q->servers[q->server])) {
+                    ipfs_dns_client_retry(q);
+                } else if (parsed == 0 && r > 0 && q->err == ErrResolveFailed) {
+                    // the server could not help
+                    ipfs_dns_client_retry(q);
+                }
+            } else if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                // i.e. port unreachable
+                ipfs_dns_client_retry(q);
+            }
+        }
+    }
+}
+
+int ipfs_dns_client_set_servers (const char *servers)
+{
+    int num_servers;
+
+    pthread_mutex_lock(&dns_client_lock);
+    if (servers) {
+        ipfs_dns_client_load_list(servers);
+        if (dns_num_servers == 0) {
+            // nothing usable; go back to /etc/resolv.conf
+            dns_num_servers = -1;
+        }
+        num_servers = dns_num_servers;
+    } else {
+        dns_num_servers = -1;
+        num_servers = 1;
+    }
+    pthread_mutex_unlock(&dns_client_lock);
+    ipfs_dns_client_cache_clear();
+    return num_servers < 0 ? ErrInvalidParam : 0;
+}
+
+void ipfs_dns_client_cache_clear ()
+{
+    int i;
+    pthread_mutex_lock(&dns_client_lock);
+    for (i = 0 ; i < DNS_CLIENT_CACHE_SIZE ; i++) {
+        while (dns_cache[i]) {
+            struct dns_cache_entry *next = dns_cache[i]->next;
+            ipfs_dns_client_cache_entry_free(dns_cache[i]);
+            dns_cache[i] = next;
+        }
+    }
+    dns_cache_count = 0;
+    pthread_mutex_unlock(&dns_client_lock);
+}
+
+int ipfs_dns_client_lookup_txt_multi (char ****txt, int *errs, char **names, int num_names)
+{
+    struct dns_query queries[DNS_CLIENT_MAX_PARALLEL];
+    struct dns_server servers[DNS_CLIENT_MAX_SERVERS];
+    int i, num_servers, found = 0;
+
+    if (!txt || !errs || !names || num_names <= 0 || num_names > DNS_CLIENT_MAX_PARALLEL) {
+        return ErrInvalidParam;
+    }
+    *txt = calloc(num_names, sizeof(char**));
+    if (!*txt) {
+        return ErrAllocFailed;
+    }
+    memset(queries, 0, sizeof(queries));
+
+    // answer what we can from the cache
+    pthread_mutex_lock(&dns_client_lock);
+    if (dns_num_servers < 0) {
+        ipfs_dns_client_load_resolv_conf();
+    }
+    // the list can change while we wait for answers, so work from a copy
+    num_servers = dns_num_servers;
+    memcpy(servers, dns_servers, num_servers * sizeof(struct dns_server));
+    ipfs_dns_client_random_ids(queries, num_names);
+    time_t now = ipfs_dns_client_now();
+    for (i = 0 ; i < num_names ; i++) {
+        struct dns_cache_entry *entry = names[i] ? ipfs_dns_client_cache_find(names[i], now) : NULL;
+        queries[i].fd = -1;
+        queries[i].name = names[i];
+        queries[i].servers = servers;
+        queries[i].num_servers = num_servers;
+        if (!names[i]) {
+            queries[i].done = 1;
+            queries[i].err = ErrInvalidParam;
+        } else if (entry) {
+            queries[i].done = 1;
+            queries[i].err = entry->err;
+            if (!entry->err) {
+                queries[i].err = ipfs_dns_client_make_array(&(*txt)[i], entry->txt, entry->txt_size, entry->num_txt);
+            }
+            // already in the cache; do not add it again
+            queries[i].ttl = 0;
+            queries[i].attempts = -1;
+        }
+    }
+    pthread_mutex_unlock(&dns_client_lock);
+
+    ipfs_dns_client_run(queries, num_names);
+
+    pthread_mutex_lock(&dns_client_lock);
+    for (i = 0 ; i < num_names ; i++) {
+        struct dns_query *q = &queries[i];
+        if (q->fd >= 0) {
+            close(q->fd);
+        }
+        if (q->attempts > 0) {
+            ipfs_dns_client_cache_add(q);
+            if (!q->err) {
+                q->err = ipfs_dns_client_make_array(&(*txt)[i], q->txt, q->txt_size, q->num_txt);
+            }
+        }
+        free(q->txt);
+        errs[i] = q->err;
+        if (!q->err) {
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&dns_client_lock);
+    return found ? 0 : ErrResolveFailed;
+}
+
+int ipfs_dns_client_lookup_txt (char ***txt, char *name)
+{
+    char ***results = NULL;
+    int err = 0;
+    int retVal = ipfs_dns_client_lookup_txt_multi(&results, &err, &name, 1);
+
+    if (retVal == ErrInvalidParam || retVal == ErrAllocFailed) {
+        return retVal;
+    }
+    *txt = results[0];
+    free(results);
+    return err;
+}
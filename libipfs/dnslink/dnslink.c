@@ -92,6 +92,7 @@ Expect these resolutions:
 #include "namesys/namesys.h"
 #define IPFS_DNSLINK_C
 #include "dnslink/dnslink.h"
+#include "dnslink/dns_client.h"
 #include "cid/cid.h"
 #include "path/path.h"
 
@@ -281,8 +282,8 @@ int ipfs_dnslink_resolve_n (char **p, char *d, int depth)
             }
             memcpy(p, buf, l); // transfer from buffer to allocated memory.
             for (i = 0 ; i < n ; i++) {
-                *txt[i] = p; // save position of current record at *txt array.
-                p = memchr(p, '\0', l - (p - *txt[0])) + 1; // find next record position after next \0
+                (*txt)[i] = p; // save position of current record at *txt array.
+                p = memchr(p, '\0', l - (p - (*txt)[0])) + 1; // find next record position after next \0
             }
         }
         return 0;
@@ -307,7 +308,7 @@ int ipfs_dnslink_resolve_once (char ***p, char *domain)
 
 #ifndef __MINGW32__
     if (!ipfs_dnslink_lookup_txt) { // if not set
-        ipfs_dnslink_lookup_txt = ipfs_dnslink_resolv_lookupTXT; // use default libresolv
+        ipfs_dnslink_lookup_txt = ipfs_dns_client_lookup_txt; // use the in-process client
     }
 
     err = ipfs_dnslink_lookup_txt (&txt, domain);
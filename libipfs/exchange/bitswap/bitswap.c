@@ -81,6 +81,7 @@ struct Exchange* ipfs_bitswap_new(struct IpfsNode* ipfs_node) {
 		}
 		bitswapContext->localWantlist = ipfs_bitswap_wantlist_queue_new();
 		bitswapContext->peerRequestQueue = ipfs_bitswap_peer_request_queue_new();
+		bitswapContext->rate_limiter = libp2p_net_ratelimit_new("/ipfs/bitswap/1.1.0");
 		bitswapContext->ipfsNode = ipfs_node;
 
 		exchange->exchangeContext = (void*) bitswapContext;
@@ -89,6 +90,7 @@ struct Exchange* ipfs_bitswap_new(struct IpfsNode* ipfs_node) {
 		exchange->HasBlock = ipfs_bitswap_has_block;
 		exchange->GetBlock = ipfs_bitswap_get_block;
 		exchange->GetBlockAsync = ipfs_bitswap_get_block_async;
+		exchange->GetBlockAsyncPinned = ipfs_bitswap_get_block_async_pinned;
 		exchange->GetBlocks = ipfs_bitswap_get_blocks;
 
 		// Start the threads for the network
@@ -117,6 +119,7 @@ int ipfs_bitswap_free(struct Exchange* exchange) {
 				ipfs_bitswap_peer_request_queue_free(bitswapContext->peerRequestQueue);
 				bitswapContext->peerRequestQueue = NULL;
 			}
+			libp2p_net_ratelimit_free(bitswapContext->rate_limiter);
 			free(exchange->exchangeContext);
 		}
 		free(exchange);
@@ -151,10 +154,11 @@ int ipfs_bitswap_has_block(struct Exchange* exchange, struct Block* block) {
 	struct BitswapContext* context = exchange->exchangeContext;
 	size_t bytes_written;
 	context->ipfsNode->blockstore->Put(context->ipfsNode->blockstore->blockstoreContext, block, &bytes_written);
-	// add it to the datastore
-	ipfs_datastore_helper_add_block_to_datastore(block, context->ipfsNode->repo->config->datastore);
-	// update requests
 	struct WantListQueueEntry* queueEntry = ipfs_bitswap_wantlist_queue_find(context->localWantlist, block->cid);
+	// add it to the datastore. Unless it was asked for pinned, the garbage collector can take it back.
+	int pin = (queueEntry != NULL && queueEntry->pin);
+	ipfs_datastore_helper_add_block_to_datastore(block, context->ipfsNode->repo->config->datastore, pin);
+	// update requests
 	if (queueEntry != NULL) {
 		queueEntry->block = block;
 	}
@@ -225,8 +229,7 @@ int ipfs_bitswap_get_block_async(struct Exchange* exchange, struct Cid* cid, str
 	struct BitswapContext* bitswapContext = (struct BitswapContext*)exchange->exchangeContext;
 	if (bitswapContext != NULL) {
 		// check locally first
-		struct Block* block;
-		if (bitswapContext->ipfsNode->blockstore->Get(bitswapContext->ipfsNode->blockstore->blockstoreContext, cid, &block)) {
+		if (bitswapContext->ipfsNode->blockstore->Get(bitswapContext->ipfsNode->blockstore->blockstoreContext, cid, block)) {
 			return 1;
 		}
 		// now ask the network
@@ -240,6 +243,39 @@ int ipfs_bitswap_get_block_async(struct Exchange* exchange, struct Cid* cid, str
 	return 0;
 }
 
+/**
+ * Implements the Exchange->GetBlockAsyncPinned method
+ * The block is pinned by ipfs_bitswap_has_block when it arrives.
+ * @param exchange the exchange
+ * @param cid the Cid to look for
+ * @returns true(1) if the block is here or has been asked for, false(0) otherwise
+ */
+int ipfs_bitswap_get_block_async_pinned(struct Exchange* exchange, struct Cid* cid) {
+	struct BitswapContext* bitswapContext = (struct BitswapContext*)exchange->exchangeContext;
+	if (bitswapContext == NULL)
+		return 0;
+	struct Datastore* datastore = bitswapContext->ipfsNode->repo->config->datastore;
+	// check locally first
+	struct Block* block = NULL;
+	if (bitswapContext->ipfsNode->blockstore->Get(bitswapContext->ipfsNode->blockstore->blockstoreContext, cid, &block)) {
+		int retVal = ipfs_datastore_helper_add_block_to_datastore(block, datastore, 1);
+		ipfs_block_free(block);
+		return retVal;
+	}
+	// now ask the network
+	struct WantListSession* wantlist_session = ipfs_bitswap_wantlist_session_new();
+	wantlist_session->type = WANTLIST_SESSION_TYPE_LOCAL;
+	wantlist_session->context = (void*)bitswapContext->ipfsNode;
+	struct WantListQueueEntry* entry = ipfs_bitswap_want_manager_add(bitswapContext, cid, wantlist_session);
+	if (entry == NULL)
+		return 0;
+	entry->pin = 1;
+	// it may have come in before we marked it
+	if (entry->block != NULL)
+		return ipfs_datastore_helper_add_block_to_datastore(entry->block, datastore, 1);
+	return 1;
+}
+
 /**
  * Implements the Exchange->GetBlocks method
  */
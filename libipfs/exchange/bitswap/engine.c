@@ -68,25 +68,27 @@ void* ipfs_bitswap_engine_wantlist_processor_start(void* ctx) {
  */
 void* ipfs_bitswap_engine_peer_request_processor_start(void* ctx) {
 	struct BitswapContext* context = (struct BitswapContext*)ctx;
-	// the loop
-	struct Libp2pLinkedList* current = context->ipfsNode->peerstore->head_entry;
+	// the loop walks a snapshot of the peerstore, and takes a new one after each pass
+	struct Libp2pVector* peers = NULL;
+	int current = 0;
 	int did_some_processing = 0;
 	while (1) {
 		if (context->bitswap_engine->shutting_down) // system shutting down
 			break;
 
-		if (current == NULL) { // the PeerStore is empty
+		if (peers == NULL || current >= peers->total) {
+			if (peers != NULL)
+				libp2p_utils_vector_free(peers);
+			peers = libp2p_peerstore_get_peers(context->ipfsNode->peerstore);
+			current = 0;
+		}
+		if (peers == NULL || peers->total == 0) { // the PeerStore is empty
 			libp2p_logger_debug("bitswap_engine", "Peerstore is empty. Pausing.\n");
 			sleep(1);
 			continue;
 		}
-		if (current->item == NULL) {
-			// error
-			libp2p_logger_error("bitswap_engine", "Peerstore has a null entry.\n");
-			break;
-		}
 		// see if they want something
-		struct Libp2pPeer* current_peer_entry = ((struct PeerEntry*)current->item)->peer;
+		struct Libp2pPeer* current_peer_entry = (struct Libp2pPeer*) libp2p_utils_vector_get(peers, current);
 		if (current_peer_entry == NULL) {
 			// error
 			libp2p_logger_error("bitswap_engine", "Peerstore has an item that is a null peer.\n");
@@ -143,20 +145,18 @@ void* ipfs_bitswap_engine_peer_request_processor_start(void* ctx) {
 					did_some_processing = 1;
 			}
 		}
-		// get next peer (or reset to head entry)
-		if (current->next == NULL) {
-			current = context->ipfsNode->peerstore->head_entry;
+		// get next peer (a new snapshot is taken at the top of the loop when we run out)
+		current++;
+		if (current >= peers->total) {
 			if (!did_some_processing) {
 				// we did nothing in this run through the peerstore. sleep for a sec
 				sleep(1);
 			}
 			did_some_processing = 0;
 		}
-		else {
-			//libp2p_logger_debug("bitswap_engine", "Moving on to the next peer.\n");
-			current = current->next;
-		}
 	}
+	if (peers != NULL)
+		libp2p_utils_vector_free(peers);
 	return NULL;
 }
 
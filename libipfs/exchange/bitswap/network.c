@@ -81,30 +81,15 @@ int ipfs_bitswap_network_adjust_cid_queue(struct Libp2pVector* collection, struc
 }
 
 /***
- * Handle a raw incoming bitswap message from the network
+ * Act on a message that was admitted
  * @param node us
+ * @param bitswapContext the context
  * @param sessionContext the connection context
- * @param bytes the message
- * @param bytes_size the size of the message
+ * @param message the decoded message (the caller frees it)
  * @returns true(1) on success, false(0) otherwise.
  */
-int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struct SessionContext* sessionContext, const uint8_t* bytes, size_t bytes_length) {
-	struct BitswapContext* bitswapContext = (struct BitswapContext*)node->exchange->exchangeContext;
-	// strip off the protocol header
-	int start = -1;
-	for(int i = 0; i < bytes_length; i++) {
-		if (bytes[i] == '\n') {
-			start = i+1;
-			break;
-		}
-	}
-	if (start == -1)
-		return 0;
-	// un-protobuf the message
-	struct BitswapMessage* message = NULL;
-	if (!ipfs_bitswap_message_protobuf_decode(&bytes[start], bytes_length - start, &message))
-		return 0;
-	// process the message
+static int ipfs_bitswap_network_process_message(const struct IpfsNode* node, struct BitswapContext* bitswapContext,
+		const struct SessionContext* sessionContext, struct BitswapMessage* message) {
 	// payload - what we want
 	if (message->payload != NULL) {
 		for(int i = 0; i < message->payload->total; i++) {
@@ -117,13 +102,11 @@ int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struc
 	if (message->wantlist != NULL && message->wantlist->entries != NULL && message->wantlist->entries->total > 0) {
 		// get the peer
 		if (sessionContext->remote_peer_id == NULL) {
-			ipfs_bitswap_message_free(message);
 			return 0;
 		}
 		struct Libp2pPeer* peer = libp2p_peerstore_get_or_add_peer_by_id(node->peerstore, (unsigned char*)sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
 		if (peer == NULL) {
 			libp2p_logger_error("bitswap_network", "Unable to find or add peer %s of length %d to peerstore.\n", sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
-			ipfs_bitswap_message_free(message);
 			return 0;
 		}
 		// find the queue (adds it if it is not there)
@@ -135,12 +118,48 @@ int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struc
 			if (!ipfs_cid_protobuf_decode(entry->block, entry->block_size, &cid) || cid->hash_length == 0) {
 				libp2p_logger_error("bitswap_network", "Message had invalid CID\n");
 				ipfs_cid_free(cid);
-				ipfs_bitswap_message_free(message);
 				return 0;
 			}
 			ipfs_bitswap_network_adjust_cid_queue(peerRequest->cids_they_want, cid, entry->cancel);
 		}
 	}
-	ipfs_bitswap_message_free(message);
 	return 1;
 }
+
+/***
+ * Handle a raw incoming bitswap message from the network
+ * @param node us
+ * @param sessionContext the connection context
+ * @param bytes the message
+ * @param bytes_size the size of the message
+ * @returns true(1) on success, false(0) otherwise.
+ */
+int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struct SessionContext* sessionContext, const uint8_t* bytes, size_t bytes_length) {
+	struct BitswapContext* bitswapContext = (struct BitswapContext*)node->exchange->exchangeContext;
+	// strip off the protocol header
+	int start = -1;
+	for(int i = 0; i < bytes_length; i++) {
+		if (bytes[i] == '\n') {
+			start = i+1;
+			break;
+		}
+	}
+	if (start == -1)
+		return 0;
+	// un-protobuf the message
+	struct BitswapMessage* message = NULL;
+	if (!ipfs_bitswap_message_protobuf_decode(&bytes[start], bytes_length - start, &message))
+		return 0;
+	// blocks are usually answers to what we asked for, so they go first. Wants make us queue work.
+	enum RateLimitPriority priority = (message->payload != NULL && message->payload->total > 0) ? RATELIMIT_PRIORITY_HIGH : RATELIMIT_PRIORITY_LOW;
+	const char* remote_peer_id = sessionContext->remote_peer_id;
+	if (!libp2p_net_ratelimit_admit(bitswapContext->rate_limiter, remote_peer_id, remote_peer_id == NULL ? 0 : strlen(remote_peer_id), priority)) {
+		libp2p_logger_debug("bitswap_network", "Too busy. Dropping message from %s.\n", remote_peer_id == NULL ? "unknown peer" : remote_peer_id);
+		ipfs_bitswap_message_free(message);
+		return 1;
+	}
+	int retVal = ipfs_bitswap_network_process_message(node, bitswapContext, sessionContext, message);
+	libp2p_net_ratelimit_release(bitswapContext->rate_limiter);
+	ipfs_bitswap_message_free(message);
+	return retVal;
+}
@@ -168,6 +168,7 @@ struct WantListQueueEntry* ipfs_bitswap_wantlist_queue_entry_new() {
 		entry->priority = 0;
 		entry->attempts = 0;
 		entry->asked_network = 0;
+		entry->pin = 0;
 	}
 	return entry;
 }
@@ -53,6 +53,24 @@ int ipfs_blockstore_delete(const struct BlockstoreContext* context, struct Cid*
  */
 int ipfs_blockstore_has(const struct BlockstoreContext* context, struct Cid* cid);
 
+/***
+ * Get the name of the file of a block: the base32 of its hash
+ * NOTE: the caller must free the results
+ * @param hash the hash of the block
+ * @param hash_length the length of the hash
+ * @returns the name, or NULL on error
+ */
+unsigned char* ipfs_blockstore_hash_to_base32(const unsigned char* hash, size_t hash_length);
+
+/***
+ * Get the full path of a file in the blockstore
+ * NOTE: the caller must free the results
+ * @param fs_repo the repo
+ * @param filename the name of the file
+ * @returns the path, or NULL on error
+ */
+char* ipfs_blockstore_path_get(const struct FSRepo* fs_repo, const char* filename);
+
 /***
  * Find a block based on its Cid
  * @param context the context
@@ -6,6 +6,7 @@
 #define __IPFS_CID_CID_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "protobuf/protobuf.h"
 
 // these are multicodec packed content types. They should match
@@ -43,9 +44,30 @@ struct Cid {
 	size_t hash_length; // the length of hash
 };
 
+/***
+ * A set of Cids, by their multihash. It is a hash table with open addressing.
+ * The Cids are copied into one growing arena, so adding one does not malloc.
+ */
+struct CidSetSlot {
+    size_t offset; // where the entry is in the arena, or one of the CID_SET_SLOT_ values
+    uint32_t hash; // the hash of the multihash, to skip most compares
+};
+
+// the slot has never been used
+#define CID_SET_SLOT_EMPTY 0
+// what was in the slot was removed
+#define CID_SET_SLOT_REMOVED 1
+// the first real offset (the arena is used from here on)
+#define CID_SET_SLOT_FIRST 2
+
 struct CidSet {
-    struct Cid *cid;
-    struct CidSet *next;
+    struct CidSetSlot *slots;
+    size_t capacity; // the number of slots (a power of 2)
+    size_t count; // the number of Cids in the set
+    size_t removed; // the number of slots marked CID_SET_SLOT_REMOVED
+    unsigned char *arena;
+    size_t arena_size;
+    size_t arena_used;
 };
 
 /***
@@ -147,6 +169,10 @@ int ipfs_cid_set_remove (struct CidSet *set, struct Cid *cid);
 int ipfs_cid_set_len (struct CidSet *set);
 unsigned char **ipfs_cid_set_keys (struct CidSet *set);
 int ipfs_cid_set_foreach (struct CidSet *set, int (*func)(struct Cid *));
+// Add many Cids, making room for all of them first.
+int ipfs_cid_set_add_all (struct CidSet *set, struct Cid **cids, int num_cids, int visit);
+// Empty the set, keeping its memory so it can be filled again.
+void ipfs_cid_set_clear (struct CidSet *set);
 
 /**
  * Compare two cids
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+#include "core/ipfs_node.h"
+#include "libp2p/utils/vector.h"
+
+/***
+ * The garbage collector removes the blocks that nothing pinned needs.
+ * It brings the pin index (see pin/pin.h) up to date, so it holds every
+ * block that can be reached from a pinned journal record, then sweeps the
+ * datastore in batches and deletes what is not in it, from both the
+ * datastore and the blockstore. Each batch is its own transaction, so blocks can be added
+ * while it runs. Anything stored after a run starts is never deleted by it.
+ * Blocks pinned while it runs (even ones that were already there) are
+ * marked, with what they link to, following links with several threads at
+ * once, before the next batch is swept.
+ * It runs by itself when the repo reaches StorageGCWatermark percent of
+ * StorageMax.
+ */
+
+// how often the size of the repo is checked
+#define GC_CHECK_INTERVAL (5 * 60)
+// the number of threads that follow links while marking
+#define GC_MARK_THREADS 4
+// the number of datastore keys swept at a time
+#define GC_SWEEP_BATCH_SIZE 128
+
+struct IpfsGarbageCollector {
+	struct IpfsNode* local_node;
+	unsigned long long storage_max; // in bytes
+	int watermark; // the percent of storage_max that starts a run
+	time_t check_interval_secs;
+	int mark_threads;
+	// the size of the repo after the last run. A run is not started again until it grows.
+	unsigned long long used_after_run;
+	// totals since start
+	unsigned long long runs;
+	unsigned long long blocks_deleted;
+	unsigned long long bytes_freed;
+	int requested; // run now, no matter the size
+	int collecting; // a run is in progress
+	int cancel; // stop the run in progress after its current batch
+	// JournalRecords of the blocks pinned since the run in progress last marked. NULL when not collecting.
+	struct Libp2pVector* barrier;
+	int running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+/***
+ * Convert a size from the config (i.e. "10GB" or "512MiB") into bytes
+ * @param size the size. Units can be B, KB, MB, GB, TB (powers of 1000) or KiB, MiB, GiB, TiB (powers of 1024)
+ * @param bytes where to put the results
+ * @returns true(1) on success, false(0) if it cannot be parsed
+ */
+int ipfs_gc_parse_size(const char* size, unsigned long long* bytes);
+
+/***
+ * Get the space used by the blockstore and the datastore
+ * @param fs_repo the repo
+ * @param bytes where to put the results
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_storage_used(const struct FSRepo* fs_repo, unsigned long long* bytes);
+
+/***
+ * Build a garbage collector using the settings in the config
+ * @param local_node the node whose repo is collected
+ * @returns the IpfsGarbageCollector, or NULL on error or if StorageMax cannot be parsed
+ */
+struct IpfsGarbageCollector* ipfs_gc_new(struct IpfsNode* local_node);
+
+/***
+ * Mark and sweep once, now, in the calling thread
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_run(struct IpfsGarbageCollector* gc);
+
+/***
+ * Start watching the size of the repo in a background thread
+ * @param gc the IpfsGarbageCollector
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_gc_start(struct IpfsGarbageCollector* gc);
+
+/***
+ * Have the background thread collect now, no matter the size of the repo
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_request(struct IpfsGarbageCollector* gc);
+
+/***
+ * Stop the background thread and wait for it to finish. A run in progress stops after its current batch.
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_stop(struct IpfsGarbageCollector* gc);
+
+/***
+ * Free the resources of an IpfsGarbageCollector
+ * NOTE: stops it first if it is running
+ * @param gc the IpfsGarbageCollector
+ */
+void ipfs_gc_free(struct IpfsGarbageCollector* gc);
@@ -41,6 +41,12 @@ struct IpfsNode {
 	struct ApiContext* api_context;
 	struct Dialer* dialer;
 	struct SwarmContext* swarm;
+	// what IPNS names resolved to recently
+	struct routingResolver* ipns_cache;
+	// sends our IPNS names again before they expire (NULL if not running)
+	struct IpnsRepublisher* republisher;
+	// keeps our replication peers up to date (NULL if not running)
+	struct ReplicationManager* replication_manager;
 	//struct Pinner pinning; // an interface
 	//struct Mount** mounts;
 	// TODO: Add more here
@@ -62,6 +68,12 @@ int ipfs_node_online_new(const char* repo_path, struct IpfsNode** node);
  */
 int ipfs_node_offline_new(const char* repo_path, struct IpfsNode** node);
 
+/***
+ * Log what the rate limiters have admitted and dropped, and how far behind each replication peer is
+ * @param node the node
+ */
+void ipfs_node_log_stats(struct IpfsNode* node);
+
 /***
  * Free resources from the creation of an IpfsNode
  * @param node the node to free
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/routing/dht_protocol.h"
+#include "core/ipfs_node.h"
+#include "repo/fsrepo/journalstore.h"
+
+/***
+ * The reprovider announces the contents of the local datastore to the
+ * network again before the remote providers forget about it. It walks
+ * the datastore in batches, groups the keys of each batch by the peers
+ * closest to them, and sends each peer all of its ADD_PROVIDER messages
+ * at once. Where it is in the walk is kept in a file in the repo, so a
+ * restart picks up where it left off.
+ */
+
+// the number of keys read from the datastore at a time
+#define REPROVIDER_BATCH_SIZE 64
+// the number of ADD_PROVIDER messages sent per second, on average
+#define REPROVIDER_DEFAULT_RATE 20
+// the number of ADD_PROVIDER messages that can be sent at once after being idle
+#define REPROVIDER_DEFAULT_BURST 100
+// the number of peers closest to a key that are told about it
+#define REPROVIDER_PEERS_PER_KEY DHT_PROTOCOL_K
+// how often to announce everything, if the config does not say
+#define REPROVIDER_DEFAULT_INTERVAL (12 * 60 * 60)
+
+enum ReproviderStrategy {
+	REPROVIDER_STRATEGY_ALL, // everything in the datastore
+	REPROVIDER_STRATEGY_PINNED, // what the journal says is pinned
+	REPROVIDER_STRATEGY_ROOTS // only the nodes that link to other blocks
+};
+
+struct IpfsReprovider {
+	struct IpfsNode* local_node;
+	enum ReproviderStrategy strategy;
+	time_t interval_secs;
+	int batch_size;
+	// the token bucket that limits the rate of announcements
+	double rate;
+	double burst;
+	double tokens;
+	struct timespec last_refill;
+	// where progress is saved
+	char* state_path;
+	// when the current round started (0 if never)
+	time_t round_started;
+	// the last record announced in this round, or NULL at the start of a round
+	// NOTE: for REPROVIDER_STRATEGY_PINNED this is a journal record, otherwise only the hash is used
+	struct JournalRecord* position;
+	// the number of keys announced since start
+	unsigned long long announced;
+	int running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+/***
+ * Convert a strategy name from the config into a ReproviderStrategy
+ * @param name "all", "pinned" or "roots"
+ * @param strategy where to put the results
+ * @returns true(1) on success, false(0) if the name is not known
+ */
+int ipfs_reprovider_parse_strategy(const char* name, enum ReproviderStrategy* strategy);
+
+/***
+ * Convert an interval from the config (i.e. "12h" or "1h30m") into seconds
+ * @param interval the interval. Units can be s, m, h or d. No unit means seconds
+ * @param secs where to put the results
+ * @returns true(1) on success, false(0) if it cannot be parsed
+ */
+int ipfs_reprovider_parse_interval(const char* interval, time_t* secs);
+
+/***
+ * Build a reprovider using the settings in the config, and load the saved progress
+ * @param local_node the node whose datastore is announced
+ * @returns the IpfsReprovider, or NULL on error or if reproviding is turned off
+ */
+struct IpfsReprovider* ipfs_reprovider_new(struct IpfsNode* local_node);
+
+/***
+ * Start announcing in a background thread
+ * @param reprovider the IpfsReprovider
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_reprovider_start(struct IpfsReprovider* reprovider);
+
+/***
+ * Stop the background thread and wait for it to finish. Progress is saved.
+ * @param reprovider the IpfsReprovider
+ */
+void ipfs_reprovider_stop(struct IpfsReprovider* reprovider);
+
+/***
+ * Free the resources of an IpfsReprovider
+ * NOTE: stops it first if it is running
+ * @param reprovider the IpfsReprovider
+ */
+void ipfs_reprovider_free(struct IpfsReprovider* reprovider);
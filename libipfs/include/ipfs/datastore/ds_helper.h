@@ -36,6 +36,7 @@ int ipfs_datastore_helper_binary_from_ds_key(const unsigned char* ds_key, size_t
  * Add a record in the datastore based on a block
  * @param block the block
  * @param datastore the Datastore
+ * @param pin true(1) if the block is pinned (i.e. it was added by the user), false(0) if it can be collected
  * @reutrns true(1) on success, false(0) otherwise
  */
-int ipfs_datastore_helper_add_block_to_datastore(struct Block* block, struct Datastore* datastore);
+int ipfs_datastore_helper_add_block_to_datastore(struct Block* block, struct Datastore* datastore, int pin);
@@ -0,0 +1,50 @@
+#ifndef DNS_CLIENT_H
+   #define DNS_CLIENT_H
+
+   #include <stdint.h>
+   #include <time.h>
+   #include "util/errs.h"
+
+   // An in-process DNS client for TXT lookups. Queries are sent over UDP
+   // straight to the resolvers in /etc/resolv.conf (or the ones set with
+   // ipfs_dns_client_set_servers), several names at once, without blocking
+   // on any one of them. Answers, and the lack of them, are cached for as
+   // long as the records say.
+
+   // how long to wait for an answer before asking the next resolver
+   #define DNS_CLIENT_TIMEOUT_MS 1000
+   // how many times each name is tried (spread over the resolvers)
+   #define DNS_CLIENT_ATTEMPTS 3
+   // the most resolvers used
+   #define DNS_CLIENT_MAX_SERVERS 4
+   // the most names looked up at the same time
+   #define DNS_CLIENT_MAX_PARALLEL 8
+   // the most names remembered
+   #define DNS_CLIENT_CACHE_SIZE 512
+   // bounds on how long an answer is remembered
+   #define DNS_CLIENT_MIN_TTL 1
+   #define DNS_CLIENT_MAX_TTL 86400
+   // how long "no such name" is remembered, if the server does not say
+   #define DNS_CLIENT_DEFAULT_NEGATIVE_TTL 60
+   // the biggest UDP answer we ask for (EDNS0)
+   #define DNS_CLIENT_UDP_SIZE 4096
+
+   // use these resolvers instead of the ones in /etc/resolv.conf
+   // servers is a space or comma separated list of ip or ip:port ([ip6]:port for IPv6)
+   // NULL goes back to /etc/resolv.conf. The cache is cleared.
+// Returns ErrInvalidParam, and goes back to /etc/resolv.conf, if none of them can be used.
+   int ipfs_dns_client_set_servers (const char *servers);
+
+   // look up the TXT records of several names at once.
+   // txt[i] gets a NULL terminated array of records, like ipfs_dns_client_lookup_txt.
+   // errs[i] gets 0 or the error for that name. Returns 0 if any name was found.
+   int ipfs_dns_client_lookup_txt_multi (char ****txt, int *errs, char **names, int num_names);
+
+   // look up the TXT records of a name. *txt is a NULL terminated array of
+   // records. Free with free(**txt); free(*txt); (all records share one buffer)
+   // Can be used as ipfs_dnslink_lookup_txt.
+   int ipfs_dns_client_lookup_txt (char ***txt, char *name);
+
+   // forget everything that was cached
+   void ipfs_dns_client_cache_clear ();
+#endif // DNS_CLIENT_H
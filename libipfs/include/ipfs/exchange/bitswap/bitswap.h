@@ -7,6 +7,7 @@
  */
 
 #include "libp2p/net/protocol.h"
+#include "libp2p/net/ratelimit.h"
 #include "core/ipfs_node.h"
 #include "exchange/exchange.h"
 #include "exchange/bitswap/engine.h"
@@ -20,6 +21,8 @@ struct BitswapContext {
 	struct WantListQueue* localWantlist;
 	struct PeerRequestQueue* peerRequestQueue;
 	struct BitswapEngine* bitswap_engine;
+	// admission control for incoming messages
+	struct Libp2pRateLimiter* rate_limiter;
 };
 
 /**
@@ -77,6 +80,14 @@ int ipfs_bitswap_get_block(struct Exchange* exchange, struct Cid* cid, struct Bl
  */
 int ipfs_bitswap_get_block_async(struct Exchange* exchange, struct Cid* cid, struct Block** block);
 
+/***
+ * Implements the Exchange->GetBlockAsyncPinned method
+ * @param exchange the exchange
+ * @param cid the Cid to look for
+ * @returns true(1) if the block is here or has been asked for, false(0) otherwise
+ */
+int ipfs_bitswap_get_block_async_pinned(struct Exchange* exchange, struct Cid* cid);
+
 /***
  * Retrieve a collection of blocks from the BitswapNetwork
  * Note: The return of false(0) means that not all blocks were found.
@@ -25,6 +25,8 @@ struct WantListQueueEntry {
 	struct Block* block;
 	int asked_network;
 	int attempts;
+	// true(1) if the block is to be pinned when it arrives
+	int pin;
 };
 
 struct WantListQueue {
@@ -39,6 +39,16 @@ struct Exchange {
 	 */
 	int (*GetBlockAsync)(struct Exchange* exchange, struct Cid* cid, struct Block** block);
 
+	/**
+	 * Retrieve a block from peers asynchronously, and pin it when it arrives
+	 * NOTE: If the block is already here, it is pinned now
+	 *
+	 * @param exchange the exchange
+	 * @param cid the hash of the block to retrieve
+	 * @returns true(1) on success, false(0) otherwise
+	 */
+	int (*GetBlockAsyncPinned)(struct Exchange* exchange, struct Cid* cid);
+
 	/**
 	 * Retrieve several blocks
 	 * @param context the context
@@ -10,6 +10,11 @@
  * The journal protocol attempts to keep a journal in sync with other (approved) nodes
  */
 
+// the most journal records sent in one message
+#define JOURNAL_SYNC_WINDOW 256
+// the most messages sent to a peer in one sync. What is left waits for the next one.
+#define JOURNAL_SYNC_MAX_WINDOWS 16
+
 /***
  * See if we can handle this message
  * @param incoming the incoming message
@@ -43,8 +48,10 @@ int ipfs_journal_handle_message(const struct StreamMessage* msg, struct Stream*
 struct Libp2pProtocolHandler* ipfs_journal_build_protocol_handler(const struct IpfsNode* local_node);
 
 /***
- * Send a journal message to a remote peer
- * @param replication_peer the peer to send it to
+ * Send a remote peer the journal records it has not been sent yet, in windows
+ * of JOURNAL_SYNC_WINDOW records, starting at its cursor (lastJournalTime and lastJournalHash)
+ * @param local_node the context
+ * @param replication_peer the peer to send it to. Its cursor is moved past what was sent.
  * @returns true(1) on success, false(0) otherwise.
  */
 int ipfs_journal_sync(struct IpfsNode* local_node, struct ReplicationPeer* replication_peer);
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "core/ipfs_node.h"
+#include "repo/config/replication.h"
+
+/***
+ * The replication manager keeps every replication peer up to date with our
+ * journal. Each peer has its own thread, so a slow or unreachable peer only
+ * holds up itself. A peer that fails is tried again later, waiting twice as
+ * long after each failure. Nothing is queued ahead of time: what a peer has
+ * not been sent yet is read from the journal at its cursor, one window at a
+ * time (see ipfs_journal_sync).
+ */
+
+// how often a peer that is up to date is checked, if the config does not say
+#define REPLICATION_DEFAULT_INTERVAL 60
+// the wait after the first failure, and the most it grows to
+#define REPLICATION_BACKOFF_MIN 5
+#define REPLICATION_BACKOFF_MAX (30 * 60)
+// the seconds to wait for a peer to connect
+#define REPLICATION_CONNECT_TIMEOUT 10
+
+/***
+ * How a replication peer is doing
+ */
+struct ReplicationStats {
+	unsigned long long last_success; // when a sync last worked (0 if never)
+	unsigned long long last_journal_time; // the time of the last journal record sent
+	unsigned long long lag_secs; // how far behind our newest journal record they are
+	unsigned long long attempts; // the number of syncs tried
+	unsigned long long failures; // the number of syncs that failed
+	int consecutive_failures; // the failures since the last success
+	unsigned long long next_attempt; // when the next sync is due
+};
+
+/***
+ * A thread that keeps one replication peer up to date
+ */
+struct ReplicationWorker {
+	struct ReplicationManager* manager;
+	struct ReplicationPeer* replication_peer;
+	pthread_t thread;
+	int started;
+	struct ReplicationStats stats;
+	// a journal record was moved back to rewind_time. If the cursor is past it, it goes back.
+	int rewind;
+	unsigned long long rewind_time;
+};
+
+struct ReplicationManager {
+	struct IpfsNode* local_node;
+	unsigned long long interval_secs;
+	struct Libp2pVector* workers; // ReplicationWorkers
+	int running;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	// while running, it listens to datastore puts (which write the journal), and passes them on to whoever listened before
+	void (*previous_listener)(const uint8_t* key, size_t key_size, void* listener_context);
+	void* previous_listener_context;
+};
+
+/***
+ * Build a replication manager for the replication peers in the config
+ * @param local_node the node whose journal is replicated
+ * @returns the ReplicationManager, or NULL on error or if there is nothing to replicate to
+ */
+struct ReplicationManager* ipfs_replication_manager_new(struct IpfsNode* local_node);
+
+/***
+ * Start a thread for each replication peer
+ * @param manager the ReplicationManager
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_replication_manager_start(struct ReplicationManager* manager);
+
+/***
+ * Sync every peer now, without waiting for its interval (peers backing off still wait).
+ * Called after each write to the journal while the manager is running.
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_notify(struct ReplicationManager* manager);
+
+/***
+ * A journal record was moved back in time (see JOURNAL_TIME_ADJUST). Peers whose
+ * cursor is past it are sent the journal again from there, so they do not miss it.
+ * @param manager the ReplicationManager
+ * @param timestamp the new time of the record
+ */
+void ipfs_replication_manager_rewind(struct ReplicationManager* manager, unsigned long long timestamp);
+
+/***
+ * Get how a replication peer is doing
+ * @param manager the ReplicationManager
+ * @param index which peer (0 to manager->workers->total - 1)
+ * @param stats where to put the results
+ * @returns true(1) on success, false(0) if there is no such peer
+ */
+int ipfs_replication_manager_get_stats(struct ReplicationManager* manager, int index, struct ReplicationStats* stats);
+
+/***
+ * Stop the threads and wait for them to finish
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_stop(struct ReplicationManager* manager);
+
+/***
+ * Free the resources of a ReplicationManager
+ * NOTE: stops it first if it is running
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_free(struct ReplicationManager* manager);
@@ -34,6 +34,14 @@ int ipfs_merkledag_get(const unsigned char* hash, size_t hash_size, struct Hasht
  */
 int ipfs_merkledag_get_by_multihash(const unsigned char* multihash, size_t multihash_length, struct HashtableNode** node, const struct FSRepo* fs_repo);
 
+/***
+ * Convert a HashtableNode into a Block
+ * @param node the node to convert
+ * @param blockResult where to put the results
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_merkledag_convert_node_to_block(struct HashtableNode* node, struct Block** blockResult);
+
 /***
  * Convert the data within a block to a HashtableNode
  * @param block the block
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "cid/cid.h"
+#include "repo/fsrepo/fs_repo.h"
+
+/***
+ * Walks a DAG from one or more roots without recursion. The blocks still
+ * to be loaded are kept in a list on the heap, so a deep DAG does not use
+ * up the stack. Every block is visited once, no matter how many paths lead
+ * to it. With more than one thread, blocks are loaded in parallel.
+ */
+
+// what a visit function returns
+#define MERKLEDAG_WALK_FOLLOW 1 // follow the links of the block
+#define MERKLEDAG_WALK_SKIP 0 // do not follow its links
+#define MERKLEDAG_WALK_STOP -1 // stop the walk
+
+/***
+ * Called once for each block the walk reaches
+ * NOTE: calls are never made at the same time, even with more than one thread
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @param context what was passed to ipfs_merkledag_walker_new
+ * @returns MERKLEDAG_WALK_FOLLOW, MERKLEDAG_WALK_SKIP or MERKLEDAG_WALK_STOP
+ */
+typedef int (*merkledag_walk_visit)(const unsigned char* hash, size_t hash_size, void* context);
+
+/***
+ * A block waiting for its links to be followed
+ */
+struct MerkledagWalkItem {
+	unsigned char* hash;
+	size_t hash_size;
+	struct MerkledagWalkItem* next;
+};
+
+struct MerkledagWalker {
+	const struct FSRepo* fs_repo;
+	merkledag_walk_visit visit;
+	void* context;
+	struct CidSet* visited; // every block reached so far
+	int owns_visited;
+	struct MerkledagWalkItem* todo; // the blocks whose links have not been followed yet
+	int busy; // the threads following links right now
+	int roots_done; // no more roots will be added
+	int stopped; // the walk was stopped, or failed
+	int num_threads;
+	pthread_t* threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+/***
+ * Build a walker. With more than one thread, the threads start right away and
+ * work on roots as they are added.
+ * @param fs_repo where the blocks are
+ * @param visited the blocks already visited (they, and what they link to, are skipped), or NULL to start empty
+ * @param threads the number of threads that load blocks. 1 or less means the walk happens in ipfs_merkledag_walker_wait
+ * @param visit called for each block, or NULL to follow everything
+ * @param context passed to visit
+ * @returns the MerkledagWalker, or NULL on error
+ */
+struct MerkledagWalker* ipfs_merkledag_walker_new(const struct FSRepo* fs_repo, struct CidSet* visited, int threads, merkledag_walk_visit visit, void* context);
+
+/***
+ * Add a root to walk from. Does nothing if it was visited already.
+ * @param walker the MerkledagWalker
+ * @param hash the hash of the root
+ * @param hash_size the size of hash
+ * @returns true(1) on success, false(0) on error or if the walk was stopped
+ */
+int ipfs_merkledag_walker_add(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size);
+
+/***
+ * Stop the walk. The blocks being loaded are finished, and the rest are left.
+ * @param walker the MerkledagWalker
+ */
+void ipfs_merkledag_walker_stop(struct MerkledagWalker* walker);
+
+/***
+ * Say no more roots will be added, and wait for the walk to finish
+ * @param walker the MerkledagWalker
+ * @returns true(1) if every block was reached, false(0) if the walk was stopped or failed
+ */
+int ipfs_merkledag_walker_wait(struct MerkledagWalker* walker);
+
+/***
+ * Free the resources of a MerkledagWalker
+ * NOTE: stops and waits for it first if it is still walking
+ * @param walker the MerkledagWalker
+ */
+void ipfs_merkledag_walker_free(struct MerkledagWalker* walker);
+
+/***
+ * Walk a DAG from one root
+ * @param fs_repo where the blocks are
+ * @param hash the hash of the root
+ * @param hash_size the size of hash
+ * @param visited the blocks already visited, or NULL to start empty
+ * @param threads the number of threads that load blocks
+ * @param visit called for each block
+ * @param context passed to visit
+ * @returns true(1) if every block was reached, false(0) if the walk was stopped or failed
+ */
+int ipfs_merkledag_walk(const struct FSRepo* fs_repo, const unsigned char* hash, size_t hash_size, struct CidSet* visited, int threads, merkledag_walk_visit visit, void* context);
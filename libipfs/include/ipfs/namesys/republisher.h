@@ -0,0 +1,115 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/routing/dht_protocol.h"
+#include "core/ipfs_node.h"
+
+/***
+ * The republisher sends the IPNS names we published to the network again
+ * before the peers that hold them let them expire. Every name is on a
+ * timing wheel, in the slot of the minute it is due. When slots come due,
+ * their names are grouped by the peers closest to them, and the peers are
+ * sent their PUT_VALUE messages a few at a time.
+ */
+
+// how often a name is sent again, at most
+#define IPNS_REPUBLISH_INTERVAL (4 * 60 * 60)
+// how long a published record is good for
+#define IPNS_RECORD_LIFETIME (24 * 60 * 60)
+// a name is always sent again at least this long before it expires
+#define IPNS_REPUBLISH_MARGIN (60 * 60)
+// how long to wait before trying again when no peer could be reached
+#define IPNS_REPUBLISH_RETRY (5 * 60)
+// the number of peers closest to a name that are sent it
+#define IPNS_REPUBLISH_PEERS DHT_PROTOCOL_K
+// the number of peers sent to at the same time
+#define IPNS_REPUBLISH_PARALLEL 8
+// the seconds in a slot of the timing wheel, and the number of slots
+#define IPNS_REPUBLISH_WHEEL_TICK 60
+#define IPNS_REPUBLISH_WHEEL_SLOTS 256
+// the number of hash buckets used to find a name
+#define IPNS_REPUBLISH_BUCKETS 256
+
+/***
+ * A published name
+ */
+struct IpnsRepublishEntry {
+	unsigned char* key; // the hash of the name
+	size_t key_size;
+	char* value; // what it points to (i.e. "/ipfs/Qm1234...")
+	time_t eol; // when the copies out there expire (0 if never sent)
+	time_t due; // when to send it again
+	int rounds; // the number of turns of the wheel before it is due
+	int slot; // where it is on the wheel, or -1 while being sent
+	int changed; // the value changed while it was being sent
+	int removed; // removed while it was being sent. It is no longer in the buckets, and is freed when the send is done.
+	struct IpnsRepublishEntry* slot_prev;
+	struct IpnsRepublishEntry* slot_next;
+	struct IpnsRepublishEntry* hash_next;
+};
+
+struct IpnsRepublisher {
+	struct IpfsNode* local_node;
+	time_t interval_secs;
+	time_t lifetime_secs;
+	// the timing wheel
+	struct IpnsRepublishEntry* wheel[IPNS_REPUBLISH_WHEEL_SLOTS];
+	time_t current_tick; // the last tick (time / IPNS_REPUBLISH_WHEEL_TICK) that was handled
+	// every entry, by the hash of its key
+	struct IpnsRepublishEntry* buckets[IPNS_REPUBLISH_BUCKETS];
+	int count;
+	// the number of PUT_VALUE messages sent since start
+	unsigned long long sent;
+	int running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+/***
+ * Build a republisher. The name of the local peer is added if it was published before.
+ * @param local_node the node that publishes
+ * @returns the IpnsRepublisher, or NULL on error
+ */
+struct IpnsRepublisher* ipfs_namesys_republisher_new(struct IpfsNode* local_node);
+
+/***
+ * Add a name, or change what it points to. It is sent right away.
+ * @param republisher the IpnsRepublisher
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @param value what it points to (i.e. "/ipfs/Qm1234...")
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_republisher_add(struct IpnsRepublisher* republisher, const unsigned char* key, size_t key_size, const char* value);
+
+/***
+ * Stop republishing a name
+ * @param republisher the IpnsRepublisher
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @returns true(1) if it was there, false(0) otherwise
+ */
+int ipfs_namesys_republisher_remove(struct IpnsRepublisher* republisher, const unsigned char* key, size_t key_size);
+
+/***
+ * Start republishing in a background thread
+ * @param republisher the IpnsRepublisher
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_republisher_start(struct IpnsRepublisher* republisher);
+
+/***
+ * Stop the background thread and wait for it to finish
+ * @param republisher the IpnsRepublisher
+ */
+void ipfs_namesys_republisher_stop(struct IpnsRepublisher* republisher);
+
+/***
+ * Free the resources of an IpnsRepublisher
+ * NOTE: stops it first if it is running
+ * @param republisher the IpnsRepublisher
+ */
+void ipfs_namesys_republisher_free(struct IpnsRepublisher* republisher);
@@ -1,7 +1,56 @@
 #pragma once
 
+#include <time.h>
 #include "core/ipfs_node.h"
 
+// the number of peers closest to a name that are asked for its record
+#define IPNS_RESOLVE_PEERS 20
+// the number of peers asked at the same time
+#define IPNS_RESOLVE_PARALLEL 4
+// stop asking once this many peers agree
+#define IPNS_RESOLVE_QUORUM 3
+// the most names followed when resolving recursively
+#define IPNS_RESOLVE_MAX_DEPTH 10
+// the number of names remembered
+#define IPNS_CACHE_SIZE 128
+
+/***
+ * Ask the peers closest to an IPNS name for its record, several at a time.
+ * Stops early once IPNS_RESOLVE_QUORUM of them agree, otherwise takes the
+ * value most of them sent. Fails if they split evenly.
+ * @param local_node the context
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @param results where to put the value (i.e. "/ipfs/Qm5678...")
+ * @param quorum set to true(1) if IPNS_RESOLVE_QUORUM peers agreed on the value
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_resolver_resolve_network(struct IpfsNode* local_node, const unsigned char* key, size_t key_size, char** results, int* quorum);
+
+/***
+ * Resolve an IPNS name, only to its next step. Tries the cache, then the
+ * network (when online), then the local datastore. What a quorum of the
+ * network agrees on is written to the cache and the datastore. A value
+ * without a quorum is returned, but not remembered.
+ * @param local_node the context
+ * @param path the ipns_path (i.e. "/ipns/Qm12345...")
+ * @param results where to store the results (i.e. "/ipns/Qm5678...")
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_resolver_resolve_once(struct IpfsNode* local_node, const char* path, char** results);
+
+/***
+ * Re-resolve a name over the network. Used by the IPNS cache to refresh
+ * stale names in the background (see ipfs_routing_cache_set_refresh).
+ * Without a quorum, the local record is used.
+ * @param value where to put the results
+ * @param eol when the results are no longer valid
+ * @param key the ipns path
+ * @param context the IpfsNode
+ * @returns 0 on success, otherwise an error code
+ */
+int ipfs_namesys_resolver_refresh(char** value, struct timespec* eol, char* key, void* context);
+
 /**
  * Resolve an IPNS name.
  * NOTE: if recursive is set to false, the result could be another ipns path
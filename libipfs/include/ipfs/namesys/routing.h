@@ -5,27 +5,68 @@
     #include "util/time.h"
     #include "namesys/pb.h"
 
+    #include <pthread.h>
+
     #define DefaultResolverCacheTTL 60 // a minute
+    // how long to wait before trying again when a background refresh fails
+    #define DefaultResolverRefreshRetry 10
+
+    // re-resolves a name in the background. Puts a newly allocated value in *value
+    // and when it is no longer valid in *eol (zero if the record does not say).
+    // Returns 0 on success, otherwise an error code.
+    typedef int (*routing_cache_refresh_func) (char **value, struct timespec *eol, char *key, void *context);
 
     struct cacheEntry {
         char *key;
         char *value;
-        struct timespec eol;
+        struct timespec fresh; // served without a refresh until then
+        struct timespec eol; // never served after then
+        int refreshing; // a refresh is queued or running
+        struct cacheEntry *hash_next;
+        struct cacheEntry *lru_prev; // most recently used side
+        struct cacheEntry *lru_next;
+    };
+
+    struct cacheRefresh {
+        char *key;
+        struct cacheRefresh *next;
     };
 
     struct routingResolver {
         int cachesize;
-        int next;
-        struct cacheEntry **data;
+        int next; // the number of entries
+        struct cacheEntry **data; // hash buckets
+        int num_buckets; // a power of 2
+        struct cacheEntry *lru_head;
+        struct cacheEntry *lru_tail;
+        pthread_mutex_t lock;
+        // stale-while-revalidate. Without a refresh function entries are dropped once stale.
+        routing_cache_refresh_func refresh;
+        void *refresh_context;
+        struct cacheRefresh *queue;
+        struct cacheRefresh *queue_tail;
+        int running;
+        pthread_t thread;
+        pthread_cond_t wake;
     };
 
     struct libp2p_routing_value_store { // dummy declaration, not implemented yet.
         void *missing;
     };
 
+    // returns a copy of the cached value (free it when done), or NULL if not
+    // cached or expired. A stale value is returned and refreshed in the background.
     char* ipfs_routing_cache_get (char *key, struct ipns_entry *ientry);
+    // caches a copy of key and value. The value is fresh for the ttl of the
+    // record (at most DefaultResolverCacheTTL), and expires at its validity (eol).
     void ipfs_routing_cache_set (char *key, char *value, struct ipns_entry *ientry);
+    // forget key, i.e. when it was published again locally. A refresh in progress does not bring it back.
+    void ipfs_routing_cache_delete (struct routingResolver *cache, char *key);
+    // turn on stale-while-revalidate, using refresh to resolve stale names again.
+    int ipfs_routing_cache_set_refresh (struct routingResolver *cache, routing_cache_refresh_func refresh, void *context);
     struct routingResolver* ipfs_namesys_new_routing_resolver (struct libp2p_routing_value_store *route, int cachesize);
+    // stops the background refresh and frees the cache
+    void ipfs_namesys_routing_resolver_free (struct routingResolver *cache);
     // ipfs_namesys_routing_resolve implements Resolver.
     int ipfs_namesys_routing_resolve (char **path, char *name, struct namesys_pb *pb);
     // ipfs_namesys_routing_resolve_n implements Resolver.
@@ -44,4 +44,15 @@
     int ipfs_pin_has_child (struct FSRepo *ds,
                             unsigned char *hash,  size_t hash_size,
                             unsigned char *child, size_t child_size);
+    // Add what was pinned since the last update to the pin index.
+    int ipfs_pin_index_update (struct FSRepo *fs_repo);
+    // Build the pin index again from the whole journal (i.e. after unpinning).
+    int ipfs_pin_index_rebuild (struct FSRepo *fs_repo);
+    // Find out if a block is pinned, by looking it up in the pin index.
+    // The index is updated first (see ipfs_pin_index_update), so this writes
+    // to the datastore, and walks whatever was pinned since the last update.
+    // mode is set to Recursive, Indirect or NotPinned (can be NULL).
+    int ipfs_pin_is_hash_pinned (struct FSRepo *fs_repo,
+                                 unsigned char *hash, size_t hash_size,
+                                 PinMode *mode);
 #endif // IPFS_PIN_H
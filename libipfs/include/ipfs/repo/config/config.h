@@ -28,7 +28,19 @@ struct Ipns {
 };
 
 struct Reprovider {
-	char* interval;
+	char* interval; // how often to announce everything again (i.e. "12h"), "0" to never
+	char* strategy; // what to announce: "all", "pinned" or "roots"
+};
+
+struct RateLimit {
+	// requests per second, and the most at once, for each protocol (kademlia and bitswap)
+	int global_rate;
+	int global_burst;
+	// requests per second, and the most at once, for one peer of a protocol
+	int peer_rate;
+	int peer_burst;
+	// the number of requests of a protocol that can be worked on at the same time
+	int max_in_flight;
 };
 
 struct RepoConfig {
@@ -45,6 +57,7 @@ struct RepoConfig {
 	//struct supernode_routing supernode_client_config;
 	//struct api api;
 	struct Reprovider reprovider;
+	struct RateLimit rate_limit;
 	struct Replication* replication;
 };
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include "libp2p/utils/vector.h"
 #include "libp2p/peer/peer.h"
 
@@ -7,6 +8,9 @@ struct ReplicationPeer {
 	struct Libp2pPeer* peer;
 	unsigned long long lastConnect;
 	unsigned long long lastJournalTime;
+	// with lastJournalTime, the last journal record sent (NULL if none)
+	uint8_t* lastJournalHash;
+	size_t lastJournalHashSize;
 };
 
 struct Replication {
@@ -28,6 +32,23 @@ struct ReplicationPeer* repo_config_replication_peer_new();
  */
 int repo_config_replication_peer_free(struct ReplicationPeer* rp);
 
+/***
+ * Save the journal cursor of a replication peer (lastJournalTime and lastJournalHash)
+ * in the repo, so a restart does not send the peer the whole journal again
+ * @param rp the ReplicationPeer
+ * @param repo_path the path to the repo
+ * @returns true(1) on success, false(0) otherwise
+ */
+int repo_config_replication_peer_save(const struct ReplicationPeer* rp, const char* repo_path);
+
+/***
+ * Load the journal cursor of a replication peer saved by repo_config_replication_peer_save
+ * @param rp the ReplicationPeer (its peer must be set)
+ * @param repo_path the path to the repo
+ * @returns true(1) if it was loaded, false(0) if there was none or it could not be read
+ */
+int repo_config_replication_peer_load(struct ReplicationPeer* rp, const char* repo_path);
+
 /***
  * allocate memory and initialize the replication struct
  * @param replication a pointer to the struct to be allocated
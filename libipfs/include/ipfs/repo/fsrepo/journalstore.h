@@ -9,10 +9,18 @@
 #include "lmdb.h"
 #include "libp2p/db/datastore.h"
 #include "repo/fsrepo/lmdb_cursor.h"
+#include "libp2p/utils/vector.h"
+
+// the journal table. Keys are the timestamp (big endian) followed by the hash
+#define JOURNALSTORE_TABLE "JOURNALSTORE_V2"
+// the table before that, keyed by the varint of the timestamp. Migrated on open.
+#define JOURNALSTORE_OLD_TABLE "JOURNALSTORE"
+// the bytes of the timestamp at the start of a key
+#define JOURNALSTORE_TIMESTAMP_SIZE 8
 
 struct JournalRecord {
 	unsigned long long timestamp; // the timestamp of the file
-	int pin; // true if it is to be stored, false if it is to be deleted
+	int pin; // true if it is pinned, false if the garbage collector can delete it
 	int pending; // true if we do not have this file yet
 	uint8_t *hash; // the hash of the block (file)
 	size_t hash_size; // the size of the hash
@@ -22,6 +30,15 @@ struct JournalRecord* lmdb_journal_record_new();
 
 int lmdb_journal_record_free(struct JournalRecord* rec);
 
+/***
+ * Build the key of a journal record: its timestamp, big endian, then its hash
+ * NOTE: the caller must free db_key->mv_data
+ * @param journal_record the record
+ * @param db_key where to store the key information
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_generate_key(const struct JournalRecord* journal_record, struct MDB_val *db_key);
+
 /**
  * Open a cursor to the journalstore table
  * @param db_handle a handle to the database (an MDB_env pointer)
@@ -31,10 +48,30 @@ int lmdb_journal_record_free(struct JournalRecord* rec);
 int lmdb_journalstore_cursor_open(void* db_handle, struct lmdb_trans_cursor **cursor, struct MDB_txn *trans_to_use);
 
 /**
- * Read a record from the cursor
+ * Read a record from the cursor, in key (time) order
+ * @param cursor the cursor
+ * @param op the cursor operation (i.e. CURSOR_FIRST, CURSOR_NEXT, CURSOR_LAST, CURSOR_PREVIOUS)
+ * @param record the record (will allocate a new one if *record is NULL, otherwise it is overwritten)
+ * @returns true(1) if something was found, false(0) otherwise
  */
 int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *cursor, enum DatastoreCursorOp op, struct JournalRecord** record);
 
+/***
+ * Move the cursor to the first record at or after a time
+ * @param cursor the cursor
+ * @param timestamp the time
+ * @param record where to put the record found (will allocate a new one if *record is NULL)
+ * @returns true(1) if a record was found, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_seek(struct lmdb_trans_cursor *cursor, unsigned long long timestamp, struct JournalRecord** record);
+
+/***
+ * Delete the record the cursor points to
+ * @param cursor the cursor
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_delete(struct lmdb_trans_cursor *cursor);
+
 /***
  * Write the record at the cursor
  * @param crsr the cursor
@@ -55,7 +92,7 @@ int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor,
 /***
  * Attempt to get a specific record identified by its timestamp and bytes
  * @param handle a handle to the database engine
- * @param journalstore_cursor the cursor (will be returned as a cursor that points to the record found
+ * @param journalstore_cursor the cursor (will be returned as a cursor that points to the record found, so it can be deleted)
  * @param journalstore_record where to put the results (can pass null). If data is within the struct, will use it as search criteria
  * @returns true(1) on success, false(0) otherwise
  */
@@ -63,9 +100,49 @@ int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journal
 
 /***
  * Convert the JournalRec struct into a lmdb key and lmdb value
+ * NOTE: the caller must free db_key->mv_data and db_value->mv_data
  * @param journal_record the record to convert
  * @param db_key where to store the key information
  * @param db_value where to store the value information
  */
 int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, struct MDB_val* db_key, struct MDB_val *db_value);
 
+/***
+ * Move the journal from JOURNALSTORE_OLD_TABLE to JOURNALSTORE_TABLE, and drop the old table
+ * NOTE: Does nothing if there is no old table
+ * @param mdb_txn the transaction to do it in
+ * @param journal_db the new table
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_migrate(struct MDB_txn* mdb_txn, MDB_dbi journal_db);
+
+
+/***
+ * Read a batch of journal records, in the order they are stored
+ * NOTE: Each call uses its own read-only transaction, so nothing is held open between batches
+ * @param handle a handle to the database (the datastore context)
+ * @param after start after this record, or NULL to start at the beginning
+ * @param max_records the most records to return
+ * @param records where to put the results, a vector of JournalRecords
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more records
+ */
+int lmdb_journalstore_get_records_after(void* handle, const struct JournalRecord* after, int max_records, struct Libp2pVector** records);
+
+/***
+ * Read a batch of the journal records at or after a time, in time order.
+ * Use lmdb_journalstore_get_records_after with the last record for the next batch.
+ * @param handle a handle to the database (the datastore context)
+ * @param timestamp the time to start at
+ * @param max_records the most records to return
+ * @param records where to put the results, a vector of JournalRecords
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more records
+ */
+int lmdb_journalstore_get_records_since(void* handle, unsigned long long timestamp, int max_records, struct Libp2pVector** records);
+
+/***
+ * Get the time of the newest journal record
+ * @param handle a handle to the database (the datastore context)
+ * @param timestamp where to put the time, 0 if the journal is empty
+ * @returns true(1) on success, false(0) on error
+ */
+int lmdb_journalstore_get_last_timestamp(void* handle, unsigned long long* timestamp);
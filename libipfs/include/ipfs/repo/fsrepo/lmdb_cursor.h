@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "lmdb.h"
 
 struct lmdb_context {
@@ -7,6 +9,11 @@ struct lmdb_context {
 	MDB_txn *current_transaction;
 	MDB_dbi *datastore_db;
 	MDB_dbi *journal_db;
+	MDB_dbi *pinindex_db;
+	// called by each put that pins, before it commits (can be NULL)
+	// NOTE: the put holds the write lock, so this must not wait on another transaction
+	void (*pin_listener)(const uint8_t* key, size_t key_size, void* listener_context);
+	void* pin_listener_context;
 };
 
 struct lmdb_trans_cursor {
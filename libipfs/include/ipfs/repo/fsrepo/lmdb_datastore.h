@@ -2,6 +2,7 @@
 
 #include "lmdb.h"
 #include "libp2p/db/datastore.h"
+#include "libp2p/utils/vector.h"
 
 /***
  * Places the LMDB methods into the datastore's function pointers
@@ -33,3 +34,51 @@ int repo_fsrepo_lmdb_close(struct Datastore* datastore);
  * @returns true(1) on success
  */
 int repo_fsrepo_lmdb_create_directory(struct Datastore* datastore);
+
+/***
+ * Read a batch of keys from the datastore, in key order
+ * NOTE: Each call uses its own read-only transaction, so nothing is held open between batches
+ * @param datastore the datastore
+ * @param after_key start after this key, or NULL to start at the beginning
+ * @param after_key_size the size of after_key
+ * @param max_keys the most keys to return
+ * @param keys where to put the results, a vector of DatastoreRecords with only the key filled in
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more keys
+ */
+int repo_fsrepo_lmdb_get_keys_after(const struct Datastore* datastore, const uint8_t* after_key, size_t after_key_size, int max_keys, struct Libp2pVector** keys);
+
+/***
+ * See which of several keys are in the datastore, and when they were stored,
+ * with one read-only transaction for all of them
+ * @param datastore the datastore
+ * @param num_keys the number of keys
+ * @param keys the keys to look for
+ * @param key_sizes the size of each key
+ * @param found where to put true(1) for each key found, false(0) otherwise
+ * @param timestamps where to put the timestamp of each key found
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_get_timestamps(const struct Datastore* datastore, int num_keys, uint8_t** keys, size_t* key_sizes, int* found, unsigned long long* timestamps);
+
+/***
+ * Delete a batch of blocks from the datastore, along with their journal records, in one transaction
+ * NOTE: Only records that point at a block, and that were stored before "before", are deleted
+ * @param datastore the datastore
+ * @param num_keys the number of keys
+ * @param keys the keys to delete
+ * @param key_sizes the size of each key
+ * @param before only delete records stored before this time
+ * @param proceed called once no put can commit until the transaction ends. Nothing is deleted if it returns false(0). (can be NULL)
+ * @param context passed to proceed
+ * @param deleted where to put true(1) for each key deleted, false(0) otherwise
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_delete_blocks(const struct Datastore* datastore, int num_keys, uint8_t** keys, size_t* key_sizes, unsigned long long before,
+		int (*proceed)(void* context), void* context, int* deleted);
+
+/***
+ * Wait for the put in progress, if any, to commit
+ * @param datastore the datastore
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_wait_for_puts(const struct Datastore* datastore);
@@ -0,0 +1,72 @@
+#pragma once
+/**
+ * Piggyback on the datastore to keep an index of everything that is pinned:
+ * the pinned blocks, and every block they link to, all the way down.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lmdb.h"
+#include "repo/fsrepo/lmdb_cursor.h"
+#include "repo/fsrepo/journalstore.h"
+
+// the pin index table. Keys are hashes, values are one of the PININDEX_ values below
+#define PININDEX_TABLE "PININDEX"
+// the block is pinned itself
+#define PININDEX_DIRECT 1
+// the block is linked to by something pinned
+#define PININDEX_INDIRECT 0
+// the key that holds the last journal record the index covers
+// (a multihash is never only 1 byte, so it cannot clash with a block)
+#define PININDEX_POSITION_KEY "\0"
+#define PININDEX_POSITION_KEY_SIZE 1
+
+/***
+ * Look for a block in the pin index
+ * @param handle a handle to the database (the datastore context)
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @param direct where to put true(1) if it is pinned itself, false(0) if it is linked to by something pinned (can be NULL)
+ * @returns true(1) if it is in the index, false(0) otherwise
+ */
+int lmdb_pinindex_get(void* handle, const uint8_t* hash, size_t hash_size, int* direct);
+
+/***
+ * Add blocks to the pin index, and move its position, in one transaction
+ * NOTE: blocks already in the index stay as they are, unless they are added as direct
+ * @param handle a handle to the database (the datastore context)
+ * @param num_hashes the number of blocks
+ * @param hashes the hashes of the blocks
+ * @param hash_sizes the size of each hash
+ * @param direct true(1) for each block that is pinned itself, false(0) otherwise
+ * @param from the position the blocks were read after (NULL if from the start). If the position was moved back since, it stays there.
+ * @param position the last journal record the index now covers
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_add(void* handle, int num_hashes, uint8_t** hashes, size_t* hash_sizes, int* direct, const struct JournalRecord* from, const struct JournalRecord* position);
+
+/***
+ * Get the last journal record the pin index covers
+ * @param handle a handle to the database (the datastore context)
+ * @param position where to put the record (only the timestamp and hash are filled in), or NULL if it covers nothing yet
+ * @returns true(1) on success, false(0) on error
+ */
+int lmdb_pinindex_get_position(void* handle, struct JournalRecord** position);
+
+/***
+ * Move the position of the pin index back to a pinned journal record written before it
+ * (i.e. its time was adjusted, or it was pinned after it was stored), so the next update covers it
+ * @param mdb_txn the transaction that wrote the record
+ * @param db_context the datastore context
+ * @param record the journal record
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_rewind(MDB_txn* mdb_txn, struct lmdb_context* db_context, const struct JournalRecord* record);
+
+/***
+ * Empty the pin index
+ * @param handle a handle to the database (the datastore context)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_clear(void* handle);
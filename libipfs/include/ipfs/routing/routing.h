@@ -83,6 +83,8 @@ ipfs_routing* ipfs_routing_new_offline (struct IpfsNode* local_node, struct RsaP
 // online using secio, should probably be deprecated
 ipfs_routing* ipfs_routing_new_online (struct IpfsNode* local_node, struct RsaPrivateKey* private_key);
 int ipfs_routing_online_free(ipfs_routing*);
+// a peer that represents the local node, to attach to outgoing messages
+struct Libp2pPeer* ipfs_routing_online_build_local_peer(struct IpfsRouting* routing);
 int ipfs_routing_offline_free(ipfs_routing* incoming);
 // online using DHT/kademlia, the recommended router
 ipfs_routing* ipfs_routing_new_kademlia(struct IpfsNode* local_node, struct RsaPrivateKey* private_key);
@@ -10,7 +10,9 @@
 #include "journal/journal_message.h"
 #include "journal/journal_entry.h"
 #include "repo/fsrepo/journalstore.h"
+#include "repo/fsrepo/lmdb_datastore.h"
 #include "repo/config/replication.h"
+#include "journal/replication_manager.h"
 
 /***
  * See if we can handle this message
@@ -82,11 +84,14 @@ struct Libp2pVector* ipfs_journal_get_last(struct Datastore* database, int n) {
 		do {
 			libp2p_logger_debug("journal", "Adding record to the vector.\n");
 			libp2p_utils_vector_add(vector, rec);
+			rec = NULL;
 			if (!lmdb_journalstore_cursor_get(cursor, CURSOR_PREVIOUS, &rec)) {
 				break;
 			}
 			i++;
 		} while(i < n);
+		// the one read past the end (if any)
+		lmdb_journal_record_free(rec);
 		libp2p_logger_debug("journal", "Closing journalstore cursor.\n");
 		lmdb_journalstore_cursor_close(cursor, 1);
 	} else {
@@ -130,8 +135,64 @@ int ipfs_journal_send_message(struct IpfsNode* node, struct Libp2pPeer* peer, st
 }
 
 /***
- * Send a journal message to a remote peer
- * @param replication_peer the peer to send it to
+ * Build a JournalMessage from a batch of journal records
+ * @param journal_records the JournalRecords
+ * @returns the JournalMessage, or NULL on error
+ */
+static struct JournalMessage* ipfs_journal_build_message(struct Libp2pVector* journal_records) {
+	struct JournalMessage* message = ipfs_journal_message_new();
+	if (message == NULL)
+		return NULL;
+	for(int i = 0; i < journal_records->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
+		if (rec->timestamp > message->end_epoch)
+			message->end_epoch = rec->timestamp;
+		if (message->start_epoch == 0 || rec->timestamp < message->start_epoch)
+			message->start_epoch = rec->timestamp;
+		struct JournalEntry* entry = ipfs_journal_entry_new();
+		if (entry == NULL) {
+			ipfs_journal_message_free(message);
+			return NULL;
+		}
+		entry->timestamp = rec->timestamp;
+		entry->pin = rec->pin;
+		entry->hash_size = rec->hash_size;
+		entry->hash = (uint8_t*) malloc(entry->hash_size);
+		if (entry->hash == NULL) {
+			// out of memory
+			ipfs_journal_entry_free(entry);
+			ipfs_journal_message_free(message);
+			return NULL;
+		}
+		memcpy(entry->hash, rec->hash, entry->hash_size);
+		libp2p_utils_vector_add(message->journal_entries, entry);
+	}
+	return message;
+}
+
+/***
+ * Move the cursor of a replication peer to a journal record
+ * @param replication_peer the peer
+ * @param rec the last record it was sent
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_set_cursor(struct ReplicationPeer* replication_peer, const struct JournalRecord* rec) {
+	uint8_t* hash = (uint8_t*) malloc(rec->hash_size);
+	if (hash == NULL)
+		return 0;
+	memcpy(hash, rec->hash, rec->hash_size);
+	free(replication_peer->lastJournalHash);
+	replication_peer->lastJournalHash = hash;
+	replication_peer->lastJournalHashSize = rec->hash_size;
+	replication_peer->lastJournalTime = rec->timestamp;
+	return 1;
+}
+
+/***
+ * Send a remote peer the journal records it has not been sent yet, in windows
+ * of JOURNAL_SYNC_WINDOW records, starting at its cursor (lastJournalTime and lastJournalHash)
+ * @param local_node the context
+ * @param replication_peer the peer to send it to. Its cursor is moved past what was sent.
  * @returns true(1) on success, false(0) otherwise.
  */
 int ipfs_journal_sync(struct IpfsNode* local_node, struct ReplicationPeer* replication_peer) {
@@ -152,51 +213,74 @@ int ipfs_journal_sync(struct IpfsNode* local_node, struct ReplicationPeer* repli
 		return 0;
 	}
 
-	// grab the last 10? files
-	struct Libp2pVector* journal_records = ipfs_journal_get_last(local_node->repo->config->datastore, 10);
-	if (journal_records == NULL || journal_records->total == 0) {
-		// nothing to do
-		libp2p_logger_debug("journal", "There are no journal records to process.\n");
-		replication_peer->lastConnect = os_utils_gmtime();
-		return 1;
-	}
-	// build the message
-	struct JournalMessage* message = ipfs_journal_message_new();
-	for(int i = 0; i < journal_records->total; i++) {
-		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
-		if (rec->timestamp > message->end_epoch)
-			message->end_epoch = rec->timestamp;
-		if (message->start_epoch == 0 || rec->timestamp < message->start_epoch)
-			message->start_epoch = rec->timestamp;
-		struct JournalEntry* entry = ipfs_journal_entry_new();
-		entry->timestamp = rec->timestamp;
-		entry->pin = 1;
-		entry->hash_size = rec->hash_size;
-		entry->hash = (uint8_t*) malloc(entry->hash_size);
-		if (entry->hash == NULL) {
-			// out of memory
-			ipfs_journal_message_free(message);
+	void* journal_context = local_node->repo->config->datastore->datastore_context;
+	int retVal = 1;
+	int windows = 0;
+	int records_sent = 0;
+	while (windows < JOURNAL_SYNC_MAX_WINDOWS) {
+		// everything after what they were sent last
+		struct Libp2pVector* journal_records = NULL;
+		int found = 0;
+		if (replication_peer->lastJournalHash == NULL) {
+			found = lmdb_journalstore_get_records_since(journal_context, replication_peer->lastJournalTime, JOURNAL_SYNC_WINDOW, &journal_records);
+		} else {
+			struct JournalRecord cursor;
+			cursor.timestamp = replication_peer->lastJournalTime;
+			cursor.hash = replication_peer->lastJournalHash;
+			cursor.hash_size = replication_peer->lastJournalHashSize;
+			cursor.pin = 0;
+			cursor.pending = 0;
+			found = lmdb_journalstore_get_records_after(journal_context, &cursor, JOURNAL_SYNC_WINDOW, &journal_records);
+		}
+		if (!found) {
+			libp2p_logger_error("journal", "Unable to read the journal.\n");
+			retVal = 0;
+			break;
+		}
+		int total = journal_records->total;
+		if (total == 0) {
+			// they have everything
 			ipfs_journal_free_records(journal_records);
-			return 0;
+			break;
 		}
-		memcpy(entry->hash, rec->hash, entry->hash_size);
-		libp2p_utils_vector_add(message->journal_entries, entry);
+		// build the message
+		struct JournalMessage* message = ipfs_journal_build_message(journal_records);
+		if (message == NULL) {
+			ipfs_journal_free_records(journal_records);
+			retVal = 0;
+			break;
+		}
+		// send the message
+		message->current_epoch = os_utils_gmtime();
+		libp2p_logger_debug("journal", "Sending %d journal records to %s.\n", total, libp2p_peer_id_to_string(peer));
+		retVal = ipfs_journal_send_message(local_node, peer, message);
+		if (retVal) {
+			replication_peer->lastConnect = message->current_epoch;
+			ipfs_journal_set_cursor(replication_peer, (struct JournalRecord*) libp2p_utils_vector_get(journal_records, total - 1));
+			// so a restart does not send it all again
+			if (!repo_config_replication_peer_save(replication_peer, local_node->repo->path))
+				libp2p_logger_error("journal", "Unable to save the journal cursor of %s.\n", libp2p_peer_id_to_string(peer));
+			records_sent += total;
+		}
+		// clean up
+		ipfs_journal_message_free(message);
+		ipfs_journal_free_records(journal_records);
+		windows++;
+		if (!retVal || total < JOURNAL_SYNC_WINDOW)
+			break;
 	}
-	// send the message
-	message->current_epoch = os_utils_gmtime();
-	libp2p_logger_debug("journal", "Sending message to %s.\n", libp2p_peer_id_to_string(peer));
-	int retVal = ipfs_journal_send_message(local_node, peer, message);
-	if (retVal) {
-		replication_peer->lastConnect = message->current_epoch;
-		replication_peer->lastJournalTime = message->end_epoch;
+	if (retVal && records_sent == 0) {
+		// nothing to do
+		libp2p_logger_debug("journal", "There are no journal records to process.\n");
+		replication_peer->lastConnect = os_utils_gmtime();
 	}
-	// clean up
-	ipfs_journal_message_free(message);
-	ipfs_journal_free_records(journal_records);
 
 	return retVal;
 }
 
+// NOTE: JOURNAL_TIME_ADJUST moves our journal record of a block back to the remote's
+// (earlier) time. Replication peers whose cursor is already past that time would never
+// be sent it, so their cursors are moved back too (see ipfs_replication_manager_rewind).
 enum JournalAction { JOURNAL_ENTRY_NEEDED, JOURNAL_TIME_ADJUST, JOURNAL_REMOTE_NEEDS };
 
 struct JournalToDo {
@@ -205,6 +289,7 @@ struct JournalToDo {
 	unsigned long long remote_timestamp; // what they have in their journal
 	uint8_t* hash; // the hash
 	size_t hash_size; // the size of the hash
+	int pin; // true(1) if the remote has it pinned
 };
 
 struct JournalToDo* ipfs_journal_todo_new() {
@@ -215,6 +300,7 @@ struct JournalToDo* ipfs_journal_todo_new() {
 		j->hash_size = 0;
 		j->local_timestamp = 0;
 		j->remote_timestamp = 0;
+		j->pin = 0;
 	}
 	return j;
 }
@@ -226,44 +312,93 @@ int ipfs_journal_todo_free(struct JournalToDo *in) {
 	return 1;
 }
 
+/***
+ * Free a vector of JournalToDo structs
+ * @param todos the vector (can be NULL)
+ * @returns true(1)
+ */
+static int ipfs_journal_todos_free(struct Libp2pVector* todos) {
+	if (todos != NULL) {
+		for(int i = 0; i < todos->total; i++)
+			ipfs_journal_todo_free((struct JournalToDo*) libp2p_utils_vector_get(todos, i));
+		libp2p_utils_vector_free(todos);
+	}
+	return 1;
+}
+
+/***
+ * Add what needs to change for a window of the incoming entries
+ * @param incoming the incoming JournalMessage
+ * @param start the index of the first entry of the window
+ * @param num_entries the number of entries in the window
+ * @param found for each entry, true(1) if we have it
+ * @param timestamps for each entry we have, our time for it
+ * @param todos where to add the JournalToDo structs
+ * @returns 0 on success, -1 on error
+ */
+static int ipfs_journal_build_todo_window(struct JournalMessage* incoming, int start, int num_entries, int* found, unsigned long long* timestamps, struct Libp2pVector* todos) {
+	for(int i = 0; i < num_entries; i++) {
+		struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, start + i);
+		if (!found[i]) {
+			struct JournalToDo* td = ipfs_journal_todo_new();
+			if (td == NULL)
+				return -1;
+			td->action = JOURNAL_ENTRY_NEEDED;
+			td->hash = entry->hash;
+			td->hash_size = entry->hash_size;
+			td->remote_timestamp = entry->timestamp;
+			td->pin = entry->pin;
+			libp2p_utils_vector_add(todos, td);
+		} else if ( (timestamps[i] == 0 && entry->timestamp != 0) ||
+				(entry->timestamp != 0 && entry->timestamp < timestamps[i]) ) {
+			// we need to adjust the time
+			struct JournalToDo* td = ipfs_journal_todo_new();
+			if (td == NULL)
+				return -1;
+			td->action = JOURNAL_TIME_ADJUST;
+			td->hash = entry->hash;
+			td->hash_size = entry->hash_size;
+			td->local_timestamp = timestamps[i];
+			td->remote_timestamp = entry->timestamp;
+			td->pin = entry->pin;
+			libp2p_utils_vector_add(todos, td);
+		}
+	}
+	return 0;
+}
+
 /***
  * Loop through the incoming message, looking for what may need to change
+ * NOTE: what we have is looked up JOURNAL_SYNC_WINDOW entries at a time
  * @param local_node the context
  * @param incoming the incoming JournalMessage
  * @param todo_vector a Libp2pVector that gets allocated and filled with JournalToDo structs
- * @returns true(1) on success, false(0) otherwise
+ * @returns 0 on success, -1 on error
  */
 int ipfs_journal_build_todo(struct IpfsNode* local_node, struct JournalMessage* incoming, struct Libp2pVector** todo_vector) {
 	*todo_vector = libp2p_utils_vector_new(1);
 	if (*todo_vector == NULL)
 		return -1;
 	struct Libp2pVector *todos = *todo_vector;
-	// for every file in message
-	for(int i = 0; i < incoming->journal_entries->total; i++) {
-		struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, i);
-		// do we have the file?
-		struct DatastoreRecord *datastore_record = NULL;
-		if (!local_node->repo->config->datastore->datastore_get(entry->hash, entry->hash_size, &datastore_record, local_node->repo->config->datastore)) {
-			struct JournalToDo* td = ipfs_journal_todo_new();
-			td->action = JOURNAL_ENTRY_NEEDED;
-			td->hash = entry->hash;
-			td->hash_size = entry->hash_size;
-			td->remote_timestamp = entry->timestamp;
-			libp2p_utils_vector_add(todos, td);
-		} else {
-			// do we need to adjust the time?
-			if ( 	(datastore_record->timestamp == 0 && entry->timestamp != 0) ||
-					(entry->timestamp != 0 && entry->timestamp < datastore_record->timestamp) ) {
-				struct JournalToDo* td = ipfs_journal_todo_new();
-				td->action = JOURNAL_TIME_ADJUST;
-				td->hash = entry->hash;
-				td->hash_size = entry->hash_size;
-				td->local_timestamp = datastore_record->timestamp;
-				td->remote_timestamp = entry->timestamp;
-				libp2p_utils_vector_add(todos, td);
-			}
+	// the remote decides how many entries there are, so they are not all looked up at once
+	uint8_t* keys[JOURNAL_SYNC_WINDOW];
+	size_t key_sizes[JOURNAL_SYNC_WINDOW];
+	int found[JOURNAL_SYNC_WINDOW];
+	unsigned long long timestamps[JOURNAL_SYNC_WINDOW];
+	for(int start = 0; start < incoming->journal_entries->total; start += JOURNAL_SYNC_WINDOW) {
+		int num_entries = incoming->journal_entries->total - start;
+		if (num_entries > JOURNAL_SYNC_WINDOW)
+			num_entries = JOURNAL_SYNC_WINDOW;
+		// do we have the files?
+		for(int i = 0; i < num_entries; i++) {
+			struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, start + i);
+			keys[i] = entry->hash;
+			key_sizes[i] = entry->hash_size;
 		}
-		libp2p_datastore_record_free(datastore_record);
+		if (!repo_fsrepo_lmdb_get_timestamps(local_node->repo->config->datastore, num_entries, keys, key_sizes, found, timestamps))
+			return -1;
+		if (ipfs_journal_build_todo_window(incoming, start, num_entries, found, timestamps, todos) != 0)
+			return -1;
 	}
 	// TODO: get all files of same second
 	// are they perhaps missing something?
@@ -272,7 +407,7 @@ int ipfs_journal_build_todo(struct IpfsNode* local_node, struct JournalMessage*
 }
 
 /***
- * Adjust the time in the journal
+ * Adjust the time in the journal, and pin what the remote has pinned
  * @param todo the JournalToDo struct that contains the new time
  * @param local_node the context
  * @returns true(1) if success, or if no change was needed, false(0) if there was an error
@@ -286,19 +421,23 @@ int ipfs_journal_adjust_time(struct JournalToDo* todo, struct IpfsNode* local_no
 		return 0;
 	}
 	// record found
-	if (todo->remote_timestamp != 0) {
-		if ( datastore_record == 0 || datastore_record->timestamp > todo->remote_timestamp) {
-			datastore_record->timestamp = todo->remote_timestamp;
-		} else {
-			// we don't need to change the time
-			return 1;
-		}
+	int changed = 0;
+	if (todo->remote_timestamp != 0 && datastore_record->timestamp > todo->remote_timestamp) {
+		datastore_record->timestamp = todo->remote_timestamp;
+		changed = 1;
+	}
+	if (todo->pin && !datastore_record->pin) {
+		// a backup is only a backup if our garbage collector keeps it
+		datastore_record->pin = 1;
+		changed = 1;
 	}
-	if (!local_node->repo->config->datastore->datastore_put(datastore_record, local_node->repo->config->datastore)) {
+	int retVal = 1;
+	if (changed && !local_node->repo->config->datastore->datastore_put(datastore_record, local_node->repo->config->datastore)) {
 		libp2p_logger_error("journal", "Attempted time_adjust put, but failed.\n");
-		return 0;
+		retVal = 0;
 	}
-	return 1;
+	libp2p_datastore_record_free(datastore_record);
+	return retVal;
 }
 
 /***
@@ -313,63 +452,80 @@ int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct
 	// remove protocol
 	uint8_t *incoming_pos = (uint8_t*) incoming_msg->data;
 	size_t pos_size = incoming_msg->data_size;
-	int second_read = 0;
 	for(int i = 0; i < incoming_msg->data_size; i++) {
 		if (incoming_msg->data[i] == '\n') {
 			if (incoming_msg->data_size > i + 1) {
 				incoming_pos = (uint8_t *)&incoming_msg->data[i+1];
-				pos_size = incoming_msg->data_size - i;
-				break;
+				pos_size = incoming_msg->data_size - i - 1;
 			} else {
 				// read next segment from network
 				if (!stream->read(stream->stream_context, &msg, 10)) {
 					return -1;
 				}
 				incoming_pos = msg->data;
-				second_read = 1;
+				pos_size = msg->data_size;
 			}
+			break;
 		}
-		libp2p_stream_message_free(msg);
-		msg = NULL;
 	}
 	struct IpfsNode* local_node = (struct IpfsNode*)protocol_context;
 	// un-protobuf the message
 	struct JournalMessage* message = NULL;
-	if (!ipfs_journal_message_decode(incoming_pos, pos_size, &message))
+	if (!ipfs_journal_message_decode(incoming_pos, pos_size, &message)) {
+		libp2p_stream_message_free(msg);
 		return -1;
+	}
+	libp2p_stream_message_free(msg);
 	// see if the remote's time is within 5 minutes of now
 	unsigned long long start_time = os_utils_gmtime();
 	long long our_time_diff = start_time - message->current_epoch;
 	// NOTE: If our_time_diff is negative, the remote's clock is faster than ours.
 	// if it is positive, our clock is faster than theirs.
 	if ( llabs(our_time_diff) > 300) {
-		if (second_read) {
-			free(incoming_pos);
-		}
 		ipfs_journal_message_free(message);
 		return -1;
 	}
 	struct Libp2pVector* todo_vector = NULL;
-	ipfs_journal_build_todo(local_node, message, &todo_vector);
+	if (ipfs_journal_build_todo(local_node, message, &todo_vector) != 0) {
+		libp2p_logger_error("journal", "Unable to compare the incoming journal with ours.\n");
+		ipfs_journal_todos_free(todo_vector);
+		ipfs_journal_message_free(message);
+		return -1;
+	}
+	// ask for everything we are missing first, so the blocks come in while we do the rest.
+	// What the remote pinned is pinned here when it arrives, so the garbage collector keeps it.
+	int wanted = 0;
+	for(int i = 0; i < todo_vector->total; i++) {
+		struct JournalToDo *curr = (struct JournalToDo*) libp2p_utils_vector_get(todo_vector, i);
+		if (curr->action == JOURNAL_ENTRY_NEEDED) {
+			struct Block* block = NULL;
+			struct Cid* cid = ipfs_cid_new(0, curr->hash, curr->hash_size, CID_DAG_PROTOBUF);
+			if (cid != NULL && curr->pin && local_node->exchange->GetBlockAsyncPinned(local_node->exchange, cid))
+				wanted++;
+			else if (cid != NULL && !curr->pin && local_node->exchange->GetBlockAsync(local_node->exchange, cid, &block))
+				wanted++;
+			ipfs_cid_free(cid);
+			ipfs_block_free(block);
+		}
+	}
+	if (wanted > 0)
+		libp2p_logger_debug("journal", "Requested %d missing block(s) from the network.\n", wanted);
 	// loop through todo items, and do the right thing
+	int rewind = 0;
+	unsigned long long rewind_time = 0;
 	for(int i = 0; i < todo_vector->total; i++) {
 		struct JournalToDo *curr = (struct JournalToDo*) libp2p_utils_vector_get(todo_vector, i);
 		switch (curr->action) {
 			case (JOURNAL_ENTRY_NEEDED): {
-				// go get a file
-				struct Block* block = NULL;
-				struct Cid* cid = ipfs_cid_new(0, curr->hash, curr->hash_size, CID_DAG_PROTOBUF);
-				if (local_node->exchange->GetBlockAsync(local_node->exchange, cid, &block)) {
-					// set timestamp (if we got the block already, but we probably didn't)
-					if (block != NULL)
-						ipfs_journal_adjust_time(curr, local_node);
-				}
-				ipfs_cid_free(cid);
-				ipfs_block_free(block);
+				// already requested above
 			}
 			break;
 			case (JOURNAL_TIME_ADJUST): {
-				ipfs_journal_adjust_time(curr, local_node);
+				if (ipfs_journal_adjust_time(curr, local_node) && curr->remote_timestamp != 0
+						&& (!rewind || curr->remote_timestamp < rewind_time)) {
+					rewind = 1;
+					rewind_time = curr->remote_timestamp;
+				}
 			}
 			break;
 			case (JOURNAL_REMOTE_NEEDS): {
@@ -378,12 +534,13 @@ int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct
 			break;
 		}
 	}
+	// records moved back may now be behind what our replication peers were sent
+	if (rewind && local_node->replication_manager != NULL)
+		ipfs_replication_manager_rewind(local_node->replication_manager, rewind_time);
 	//TODO: set new values in their ReplicationPeer struct
 
+	ipfs_journal_todos_free(todo_vector);
 	ipfs_journal_message_free(message);
 
-	if (second_read)
-		free(incoming_pos);
 	return 1;
 }
-
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/conn/dialer.h"
+#include "libp2p/os/utils.h"
+#include "libp2p/peer/peerstore.h"
+#include "libp2p/utils/logger.h"
+#include "journal/journal.h"
+#include "journal/replication_manager.h"
+#include "repo/fsrepo/journalstore.h"
+
+/***
+ * Wait until the lock is signaled or the number of seconds has passed
+ * NOTE: caller must hold the lock
+ * @param manager the ReplicationManager
+ * @param secs the most seconds to wait
+ */
+static void ipfs_replication_manager_wait(struct ReplicationManager* manager, unsigned long long secs) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += secs;
+	pthread_cond_timedwait(&manager->wake, &manager->lock, &deadline);
+}
+
+/***
+ * The time of the newest record in our journal
+ * @param manager the ReplicationManager
+ * @returns the time, or 0 if there is none
+ */
+static unsigned long long ipfs_replication_manager_newest(struct ReplicationManager* manager) {
+	unsigned long long newest = 0;
+	lmdb_journalstore_get_last_timestamp(manager->local_node->repo->config->datastore->datastore_context, &newest);
+	return newest;
+}
+
+/***
+ * Connect to the peer if need be, and send it what it has not been sent yet
+ * @param worker the ReplicationWorker
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_replication_worker_sync(struct ReplicationWorker* worker) {
+	struct IpfsNode* local_node = worker->manager->local_node;
+	struct ReplicationPeer* replication_peer = worker->replication_peer;
+
+	struct Libp2pPeer* peer = libp2p_peerstore_get_or_add_peer(local_node->peerstore, replication_peer->peer);
+	if (peer == NULL) {
+		libp2p_logger_error("replication", "Unable to add peer %s to the peerstore.\n", libp2p_peer_id_to_string(replication_peer->peer));
+		return 0;
+	}
+	if (peer->connection_type != CONNECTION_TYPE_CONNECTED
+			&& !libp2p_peer_connect(local_node->dialer, peer, local_node->peerstore, local_node->repo->config->datastore, REPLICATION_CONNECT_TIMEOUT)) {
+		libp2p_logger_debug("replication", "Unable to connect to %s.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	return ipfs_journal_sync(local_node, replication_peer);
+}
+
+/***
+ * The thread of one replication peer. Syncs it when it is due, and backs off when it fails.
+ * @param arg the ReplicationWorker
+ * @returns NULL
+ */
+static void* ipfs_replication_worker_run(void* arg) {
+	struct ReplicationWorker* worker = (struct ReplicationWorker*) arg;
+	struct ReplicationManager* manager = worker->manager;
+	struct ReplicationStats* stats = &worker->stats;
+
+	pthread_mutex_lock(&manager->lock);
+	while (manager->running) {
+		unsigned long long now = os_utils_gmtime();
+		if (now < stats->next_attempt) {
+			ipfs_replication_manager_wait(manager, stats->next_attempt - now);
+			continue;
+		}
+		if (worker->rewind) {
+			// only this thread moves the cursor, so it is done here
+			struct ReplicationPeer* replication_peer = worker->replication_peer;
+			if (replication_peer->lastJournalTime >= worker->rewind_time) {
+				replication_peer->lastJournalTime = worker->rewind_time;
+				free(replication_peer->lastJournalHash);
+				replication_peer->lastJournalHash = NULL;
+				replication_peer->lastJournalHashSize = 0;
+			}
+			worker->rewind = 0;
+		}
+		stats->attempts++;
+		pthread_mutex_unlock(&manager->lock);
+
+		int success = ipfs_replication_worker_sync(worker);
+		unsigned long long newest = ipfs_replication_manager_newest(manager);
+
+		pthread_mutex_lock(&manager->lock);
+		now = os_utils_gmtime();
+		stats->last_journal_time = worker->replication_peer->lastJournalTime;
+		stats->lag_secs = newest > stats->last_journal_time ? newest - stats->last_journal_time : 0;
+		if (success) {
+			stats->last_success = now;
+			stats->consecutive_failures = 0;
+			// a sync sends a bounded number of windows. If there is more, keep going.
+			stats->next_attempt = stats->lag_secs > 0 ? now : now + manager->interval_secs;
+		} else {
+			stats->failures++;
+			stats->consecutive_failures++;
+			unsigned long long backoff = REPLICATION_BACKOFF_MIN;
+			for(int i = 1; i < stats->consecutive_failures && backoff < REPLICATION_BACKOFF_MAX; i++)
+				backoff *= 2;
+			if (backoff > REPLICATION_BACKOFF_MAX)
+				backoff = REPLICATION_BACKOFF_MAX;
+			stats->next_attempt = now + backoff;
+			libp2p_logger_debug("replication", "Sync of %s failed %d time(s) in a row. Trying again in %llu seconds.\n",
+					libp2p_peer_id_to_string(worker->replication_peer->peer), stats->consecutive_failures, backoff);
+		}
+	}
+	pthread_mutex_unlock(&manager->lock);
+	return NULL;
+}
+
+/***
+ * Build a replication manager for the replication peers in the config
+ * @param local_node the node whose journal is replicated
+ * @returns the ReplicationManager, or NULL on error or if there is nothing to replicate to
+ */
+struct ReplicationManager* ipfs_replication_manager_new(struct IpfsNode* local_node) {
+	if (local_node == NULL || local_node->repo == NULL || local_node->repo->config == NULL)
+		return NULL;
+	struct Replication* replication = local_node->repo->config->replication;
+	if (replication == NULL || replication->replication_peers == NULL || replication->replication_peers->total == 0)
+		return NULL;
+
+	struct ReplicationManager* manager = (struct ReplicationManager*) malloc(sizeof(struct ReplicationManager));
+	if (manager == NULL)
+		return NULL;
+	manager->local_node = local_node;
+	manager->running = 0;
+	manager->previous_listener = NULL;
+	manager->previous_listener_context = NULL;
+	manager->interval_secs = replication->announce_minutes > 0 ? replication->announce_minutes * 60 : REPLICATION_DEFAULT_INTERVAL;
+	manager->workers = libp2p_utils_vector_new(replication->replication_peers->total);
+	if (manager->workers == NULL) {
+		free(manager);
+		return NULL;
+	}
+	pthread_mutex_init(&manager->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&manager->wake, &attr);
+	pthread_condattr_destroy(&attr);
+	for(int i = 0; i < replication->replication_peers->total; i++) {
+		struct ReplicationWorker* worker = (struct ReplicationWorker*) malloc(sizeof(struct ReplicationWorker));
+		if (worker == NULL) {
+			ipfs_replication_manager_free(manager);
+			return NULL;
+		}
+		worker->manager = manager;
+		worker->replication_peer = (struct ReplicationPeer*) libp2p_utils_vector_get(replication->replication_peers, i);
+		worker->started = 0;
+		worker->rewind = 0;
+		worker->rewind_time = 0;
+		memset(&worker->stats, 0, sizeof(struct ReplicationStats));
+		worker->stats.last_journal_time = worker->replication_peer->lastJournalTime;
+		libp2p_utils_vector_add(manager->workers, worker);
+	}
+	return manager;
+}
+
+/***
+ * Called after each datastore put. A put adds to the journal, so the peers have something new.
+ * @param key the key that was put
+ * @param key_size the size of key
+ * @param listener_context the ReplicationManager
+ */
+static void ipfs_replication_manager_datastore_listener(const uint8_t* key, size_t key_size, void* listener_context) {
+	struct ReplicationManager* manager = (struct ReplicationManager*) listener_context;
+	ipfs_replication_manager_notify(manager);
+	if (manager->previous_listener != NULL)
+		manager->previous_listener(key, key_size, manager->previous_listener_context);
+}
+
+/***
+ * Start a thread for each replication peer
+ * @param manager the ReplicationManager
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_replication_manager_start(struct ReplicationManager* manager) {
+	if (manager == NULL)
+		return 0;
+	pthread_mutex_lock(&manager->lock);
+	if (manager->running) {
+		pthread_mutex_unlock(&manager->lock);
+		return 1;
+	}
+	manager->running = 1;
+	int started = 0;
+	for(int i = 0; i < manager->workers->total; i++) {
+		struct ReplicationWorker* worker = (struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, i);
+		if (pthread_create(&worker->thread, NULL, ipfs_replication_worker_run, worker) == 0) {
+			worker->started = 1;
+			started++;
+		} else {
+			libp2p_logger_error("replication", "Unable to start the thread for %s.\n", libp2p_peer_id_to_string(worker->replication_peer->peer));
+		}
+	}
+	pthread_mutex_unlock(&manager->lock);
+	// sync as soon as something is written, instead of at the next interval
+	struct Datastore* datastore = manager->local_node->repo->config->datastore;
+	if (started > 0 && datastore->datastore_put_listener != ipfs_replication_manager_datastore_listener) {
+		manager->previous_listener = datastore->datastore_put_listener;
+		manager->previous_listener_context = datastore->datastore_put_listener_context;
+		datastore->datastore_put_listener = ipfs_replication_manager_datastore_listener;
+		datastore->datastore_put_listener_context = manager;
+	}
+	libp2p_logger_debug("replication", "Replicating to %d peer(s).\n", started);
+	return started > 0;
+}
+
+/***
+ * Sync every peer now, without waiting for its interval (peers backing off still wait)
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_notify(struct ReplicationManager* manager) {
+	if (manager == NULL)
+		return;
+	pthread_mutex_lock(&manager->lock);
+	for(int i = 0; i < manager->workers->total; i++) {
+		struct ReplicationWorker* worker = (struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, i);
+		if (worker->stats.consecutive_failures == 0)
+			worker->stats.next_attempt = 0;
+	}
+	pthread_cond_broadcast(&manager->wake);
+	pthread_mutex_unlock(&manager->lock);
+}
+
+/***
+ * A journal record was moved back in time (see JOURNAL_TIME_ADJUST). Peers whose
+ * cursor is past it are sent the journal again from there, so they do not miss it.
+ * @param manager the ReplicationManager
+ * @param timestamp the new time of the record
+ */
+void ipfs_replication_manager_rewind(struct ReplicationManager* manager, unsigned long long timestamp) {
+	if (manager == NULL)
+		return;
+	pthread_mutex_lock(&manager->lock);
+	for(int i = 0; i < manager->workers->total; i++) {
+		struct ReplicationWorker* worker = (struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, i);
+		if (!worker->rewind || timestamp < worker->rewind_time) {
+			worker->rewind = 1;
+			worker->rewind_time = timestamp;
+		}
+		if (worker->stats.consecutive_failures == 0)
+			worker->stats.next_attempt = 0;
+	}
+	pthread_cond_broadcast(&manager->wake);
+	pthread_mutex_unlock(&manager->lock);
+}
+
+/***
+ * Get how a replication peer is doing
+ * @param manager the ReplicationManager
+ * @param index which peer (0 to manager->workers->total - 1)
+ * @param stats where to put the results
+ * @returns true(1) on success, false(0) if there is no such peer
+ */
+int ipfs_replication_manager_get_stats(struct ReplicationManager* manager, int index, struct ReplicationStats* stats) {
+	if (manager == NULL || stats == NULL || index < 0 || index >= manager->workers->total)
+		return 0;
+	unsigned long long newest = ipfs_replication_manager_newest(manager);
+	pthread_mutex_lock(&manager->lock);
+	struct ReplicationWorker* worker = (struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, index);
+	*stats = worker->stats;
+	pthread_mutex_unlock(&manager->lock);
+	// the journal may have grown since the last sync
+	stats->lag_secs = newest > stats->last_journal_time ? newest - stats->last_journal_time : 0;
+	return 1;
+}
+
+/***
+ * Stop the threads and wait for them to finish
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_stop(struct ReplicationManager* manager) {
+	if (manager == NULL)
+		return;
+	struct Datastore* datastore = manager->local_node->repo->config->datastore;
+	if (datastore->datastore_put_listener_context == manager) {
+		datastore->datastore_put_listener = manager->previous_listener;
+		datastore->datastore_put_listener_context = manager->previous_listener_context;
+	}
+	pthread_mutex_lock(&manager->lock);
+	manager->running = 0;
+	pthread_cond_broadcast(&manager->wake);
+	pthread_mutex_unlock(&manager->lock);
+	for(int i = 0; i < manager->workers->total; i++) {
+		struct ReplicationWorker* worker = (struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, i);
+		if (worker->started) {
+			pthread_join(worker->thread, NULL);
+			worker->started = 0;
+		}
+	}
+}
+
+/***
+ * Free the resources of a ReplicationManager
+ * NOTE: stops it first if it is running
+ * @param manager the ReplicationManager
+ */
+void ipfs_replication_manager_free(struct ReplicationManager* manager) {
+	if (manager != NULL) {
+		ipfs_replication_manager_stop(manager);
+		for(int i = 0; i < manager->workers->total; i++)
+			free((struct ReplicationWorker*) libp2p_utils_vector_get(manager->workers, i));
+		libp2p_utils_vector_free(manager->workers);
+		pthread_cond_destroy(&manager->wake);
+		pthread_mutex_destroy(&manager->lock);
+		free(manager);
+	}
+}
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libp2p/utils/logger.h"
+#include "blocks/blockstore.h"
+#include "merkledag/node.h"
+#include "merkledag/walker.h"
+
+/***
+ * Visit a block, and add it to the list if its links are to be followed
+ * NOTE: caller must hold the lock
+ * @param walker the MerkledagWalker
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @returns true(1) on success, false(0) on error or if the walk was stopped
+ */
+static int ipfs_merkledag_walker_reach(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size) {
+	struct Cid cid;
+	cid.version = 0;
+	cid.codec = CID_DAG_PROTOBUF;
+	cid.hash = (unsigned char*)hash;
+	cid.hash_length = hash_size;
+	if (walker->stopped)
+		return 0;
+	if (ipfs_cid_set_has(walker->visited, &cid))
+		return 1;
+	if (ipfs_cid_set_add(walker->visited, &cid, 1) != 0) {
+		walker->stopped = 1;
+		return 0;
+	}
+	int action = walker->visit == NULL ? MERKLEDAG_WALK_FOLLOW : walker->visit(hash, hash_size, walker->context);
+	if (action == MERKLEDAG_WALK_STOP) {
+		walker->stopped = 1;
+		pthread_cond_broadcast(&walker->wake);
+		return 0;
+	}
+	if (action == MERKLEDAG_WALK_SKIP)
+		return 1;
+	struct MerkledagWalkItem* item = (struct MerkledagWalkItem*) malloc(sizeof(struct MerkledagWalkItem));
+	if (item == NULL) {
+		walker->stopped = 1;
+		return 0;
+	}
+	item->hash = (unsigned char*) malloc(hash_size);
+	if (item->hash == NULL) {
+		free(item);
+		walker->stopped = 1;
+		return 0;
+	}
+	memcpy(item->hash, hash, hash_size);
+	item->hash_size = hash_size;
+	item->next = walker->todo;
+	walker->todo = item;
+	pthread_cond_signal(&walker->wake);
+	return 1;
+}
+
+/***
+ * Take blocks off the list and follow their links, until the list is empty
+ * and nothing else can add to it
+ * NOTE: caller must hold the lock. It is let go while a block is loaded.
+ * @param walker the MerkledagWalker
+ */
+static void ipfs_merkledag_walker_work(struct MerkledagWalker* walker) {
+	while (!walker->stopped) {
+		if (walker->todo == NULL) {
+			if (walker->roots_done && walker->busy == 0)
+				break;
+			pthread_cond_wait(&walker->wake, &walker->lock);
+			continue;
+		}
+		struct MerkledagWalkItem* item = walker->todo;
+		walker->todo = item->next;
+		walker->busy++;
+		pthread_mutex_unlock(&walker->lock);
+
+		// blocks that are not nodes (or that we do not have) link to nothing
+		struct HashtableNode* node = NULL;
+		if (!ipfs_blockstore_get_node(item->hash, item->hash_size, &node, walker->fs_repo))
+			node = NULL;
+		free(item->hash);
+		free(item);
+
+		pthread_mutex_lock(&walker->lock);
+		for(struct NodeLink* link = node == NULL ? NULL : node->head_link; link != NULL; link = link->next) {
+			if (!ipfs_merkledag_walker_reach(walker, link->hash, link->hash_size))
+				break;
+		}
+		walker->busy--;
+		// the others may be waiting for the last busy thread to finish
+		if (walker->todo == NULL && walker->busy == 0)
+			pthread_cond_broadcast(&walker->wake);
+		if (node != NULL)
+			ipfs_hashtable_node_free(node);
+	}
+	// wake the others, in case this one is leaving because the walk stopped
+	pthread_cond_broadcast(&walker->wake);
+}
+
+/***
+ * A walker thread
+ * @param arg the MerkledagWalker
+ * @returns NULL
+ */
+static void* ipfs_merkledag_walker_run(void* arg) {
+	struct MerkledagWalker* walker = (struct MerkledagWalker*) arg;
+	pthread_mutex_lock(&walker->lock);
+	ipfs_merkledag_walker_work(walker);
+	pthread_mutex_unlock(&walker->lock);
+	return NULL;
+}
+
+/***
+ * Build a walker. With more than one thread, the threads start right away and
+ * work on roots as they are added.
+ * @param fs_repo where the blocks are
+ * @param visited the blocks already visited (they, and what they link to, are skipped), or NULL to start empty
+ * @param threads the number of threads that load blocks. 1 or less means the walk happens in ipfs_merkledag_walker_wait
+ * @param visit called for each block, or NULL to follow everything
+ * @param context passed to visit
+ * @returns the MerkledagWalker, or NULL on error
+ */
+struct MerkledagWalker* ipfs_merkledag_walker_new(const struct FSRepo* fs_repo, struct CidSet* visited, int threads, merkledag_walk_visit visit, void* context) {
+	if (fs_repo == NULL)
+		return NULL;
+	struct MerkledagWalker* walker = (struct MerkledagWalker*) malloc(sizeof(struct MerkledagWalker));
+	if (walker == NULL)
+		return NULL;
+	walker->fs_repo = fs_repo;
+	walker->visit = visit;
+	walker->context = context;
+	walker->visited = visited;
+	walker->owns_visited = 0;
+	walker->todo = NULL;
+	walker->busy = 0;
+	walker->roots_done = 0;
+	walker->stopped = 0;
+	walker->num_threads = 0;
+	walker->threads = NULL;
+	if (walker->visited == NULL) {
+		walker->visited = ipfs_cid_set_new();
+		if (walker->visited == NULL) {
+			free(walker);
+			return NULL;
+		}
+		walker->owns_visited = 1;
+	}
+	pthread_mutex_init(&walker->lock, NULL);
+	pthread_cond_init(&walker->wake, NULL);
+	if (threads > 1) {
+		walker->threads = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+		if (walker->threads == NULL) {
+			ipfs_merkledag_walker_free(walker);
+			return NULL;
+		}
+		for(int i = 0; i < threads; i++) {
+			if (pthread_create(&walker->threads[walker->num_threads], NULL, ipfs_merkledag_walker_run, walker) == 0)
+				walker->num_threads++;
+		}
+		if (walker->num_threads == 0)
+			libp2p_logger_error("merkledag", "Unable to start the walker threads. Walking in one.\n");
+	}
+	return walker;
+}
+
+/***
+ * Add a root to walk from. Does nothing if it was visited already.
+ * @param walker the MerkledagWalker
+ * @param hash the hash of the root
+ * @param hash_size the size of hash
+ * @returns true(1) on success, false(0) on error or if the walk was stopped
+ */
+int ipfs_merkledag_walker_add(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size) {
+	if (walker == NULL || hash == NULL)
+		return 0;
+	pthread_mutex_lock(&walker->lock);
+	int retVal = !walker->roots_done && ipfs_merkledag_walker_reach(walker, hash, hash_size);
+	pthread_mutex_unlock(&walker->lock);
+	return retVal;
+}
+
+/***
+ * Stop the walk. The blocks being loaded are finished, and the rest are left.
+ * @param walker the MerkledagWalker
+ */
+void ipfs_merkledag_walker_stop(struct MerkledagWalker* walker) {
+	if (walker == NULL)
+		return;
+	pthread_mutex_lock(&walker->lock);
+	walker->stopped = 1;
+	pthread_cond_broadcast(&walker->wake);
+	pthread_mutex_unlock(&walker->lock);
+}
+
+/***
+ * Say no more roots will be added, and wait for the walk to finish
+ * @param walker the MerkledagWalker
+ * @returns true(1) if every block was reached, false(0) if the walk was stopped or failed
+ */
+int ipfs_merkledag_walker_wait(struct MerkledagWalker* walker) {
+	if (walker == NULL)
+		return 0;
+	pthread_mutex_lock(&walker->lock);
+	walker->roots_done = 1;
+	pthread_cond_broadcast(&walker->wake);
+	if (walker->num_threads == 0)
+		ipfs_merkledag_walker_work(walker);
+	pthread_mutex_unlock(&walker->lock);
+	for(int i = 0; i < walker->num_threads; i++)
+		pthread_join(walker->threads[i], NULL);
+	walker->num_threads = 0;
+
+	// if it stopped, there may be some left
+	while (walker->todo != NULL) {
+		struct MerkledagWalkItem* item = walker->todo;
+		walker->todo = item->next;
+		free(item->hash);
+		free(item);
+	}
+	return !walker->stopped;
+}
+
+/***
+ * Free the resources of a MerkledagWalker
+ * NOTE: stops and waits for it first if it is still walking
+ * @param walker the MerkledagWalker
+ */
+void ipfs_merkledag_walker_free(struct MerkledagWalker* walker) {
+	if (walker != NULL) {
+		if (walker->num_threads > 0) {
+			ipfs_merkledag_walker_stop(walker);
+			ipfs_merkledag_walker_wait(walker);
+		}
+		while (walker->todo != NULL) {
+			struct MerkledagWalkItem* item = walker->todo;
+			walker->todo = item->next;
+			free(item->hash);
+			free(item);
+		}
+		if (walker->owns_visited)
+			ipfs_cid_set_destroy(&walker->visited);
+		free(walker->threads);
+		pthread_cond_destroy(&walker->wake);
+		pthread_mutex_destroy(&walker->lock);
+		free(walker);
+	}
+}
+
+/***
+ * Walk a DAG from one root
+ * @param fs_repo where the blocks are
+ * @param hash the hash of the root
+ * @param hash_size the size of hash
+ * @param visited the blocks already visited, or NULL to start empty
+ * @param threads the number of threads that load blocks
+ * @param visit called for each block
+ * @param context passed to visit
+ * @returns true(1) if every block was reached, false(0) if the walk was stopped or failed
+ */
+int ipfs_merkledag_walk(const struct FSRepo* fs_repo, const unsigned char* hash, size_t hash_size, struct CidSet* visited, int threads, merkledag_walk_visit visit, void* context) {
+	struct MerkledagWalker* walker = ipfs_merkledag_walker_new(fs_repo, visited, threads, visit, context);
+	if (walker == NULL)
+		return 0;
+	ipfs_merkledag_walker_add(walker, hash, hash_size);
+	int retVal = ipfs_merkledag_walker_wait(walker);
+	ipfs_merkledag_walker_free(walker);
+	return retVal;
+}
@@ -0,0 +1,366 @@
+/*
+The cache of IPNS resolutions. A hash table for lookups, with a list in
+least recently used order for evictions. Stale entries can be served
+while a background thread resolves them again.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "namesys/routing.h"
+#include "namesys/pb.h"
+#include "util/errs.h"
+#include "util/time.h"
+
+static int ipfs_routing_cache_before (struct timespec *a, struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static unsigned int ipfs_routing_cache_hash (struct routingResolver *cache, char *key)
+{
+    unsigned int hash = 2166136261u;
+    for ( ; *key ; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+    }
+    return hash & (cache->num_buckets - 1);
+}
+
+// NOTE: caller must hold the lock
+static struct cacheEntry* ipfs_routing_cache_find (struct routingResolver *cache, char *key)
+{
+    struct cacheEntry *e = cache->data[ipfs_routing_cache_hash(cache, key)];
+    while (e && strcmp(e->key, key) != 0) {
+        e = e->hash_next;
+    }
+    return e;
+}
+
+// NOTE: caller must hold the lock
+static void ipfs_routing_cache_lru_unlink (struct routingResolver *cache, struct cacheEntry *e)
+{
+    if (e->lru_prev) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        cache->lru_head = e->lru_next;
+    }
+    if (e->lru_next) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        cache->lru_tail = e->lru_prev;
+    }
+    e->lru_prev = e->lru_next = NULL;
+}
+
+// NOTE: caller must hold the lock
+static void ipfs_routing_cache_lru_push (struct routingResolver *cache, struct cacheEntry *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = e;
+    }
+    cache->lru_head = e;
+    if (!cache->lru_tail) {
+        cache->lru_tail = e;
+    }
+}
+
+// NOTE: caller must hold the lock
+static void ipfs_routing_cache_remove (struct routingResolver *cache, struct cacheEntry *e)
+{
+    struct cacheEntry **p = &cache->data[ipfs_routing_cache_hash(cache, e->key)];
+    while (*p && *p != e) {
+        p = &(*p)->hash_next;
+    }
+    if (*p) {
+        *p = e->hash_next;
+    }
+    ipfs_routing_cache_lru_unlink(cache, e);
+    cache->next--;
+    free(e->key);
+    free(e->value);
+    free(e);
+}
+
+// store value under key, replacing what was there.
+// NOTE: caller must hold the lock
+static void ipfs_routing_cache_store (struct routingResolver *cache, char *key, char *value, struct timespec *fresh, struct timespec *eol)
+{
+    struct cacheEntry *e = ipfs_routing_cache_find(cache, key);
+    char *v = strdup(value);
+
+    if (!v) {
+        return;
+    }
+    if (e) {
+        free(e->value);
+        ipfs_routing_cache_lru_unlink(cache, e);
+    } else {
+        if (cache->next >= cache->cachesize) {
+            ipfs_routing_cache_remove(cache, cache->lru_tail);
+        }
+        e = calloc(1, sizeof(struct cacheEntry));
+        if (!e || !(e->key = strdup(key))) {
+            free(e);
+            free(v);
+            return;
+        }
+        unsigned int i = ipfs_routing_cache_hash(cache, key);
+        e->hash_next = cache->data[i];
+        cache->data[i] = e;
+        cache->next++;
+    }
+    e->value = v;
+    e->fresh = *fresh;
+    e->eol = *eol;
+    ipfs_routing_cache_lru_push(cache, e);
+}
+
+// the background refresh thread
+static void* ipfs_routing_cache_refresher (void *param)
+{
+    struct routingResolver *cache = (struct routingResolver*)param;
+
+    pthread_mutex_lock(&cache->lock);
+    while (cache->running) {
+        struct cacheRefresh *job = cache->queue;
+        if (!job) {
+            pthread_cond_wait(&cache->wake, &cache->lock);
+            continue;
+        }
+        cache->queue = job->next;
+        if (!cache->queue) {
+            cache->queue_tail = NULL;
+        }
+        routing_cache_refresh_func refresh = cache->refresh;
+        void *context = cache->refresh_context;
+        pthread_mutex_unlock(&cache->lock);
+
+        char *value = NULL;
+        struct timespec now, fresh, eol = { 0, 0 };
+        int err = refresh ? refresh(&value, &eol, job->key, context) : ErrInvalidParam;
+
+        pthread_mutex_lock(&cache->lock);
+        timespec_get (&now, TIME_UTC);
+        struct cacheEntry *e = ipfs_routing_cache_find(cache, job->key);
+        if (!err && value) {
+            fresh = now;
+            fresh.tv_sec += DefaultResolverCacheTTL;
+            if (eol.tv_sec == 0) {
+                eol = fresh;
+            } else if (ipfs_routing_cache_before(&eol, &fresh)) {
+                fresh = eol;
+            }
+            if (e) {
+                // only refresh what is still cached, so the refresh does not bring back evicted names
+                e->refreshing = 0;
+                ipfs_routing_cache_store(cache, job->key, value, &fresh, &eol);
+            }
+        } else if (e) {
+            // keep serving it until its eol, and try again later
+            e->refreshing = 0;
+            e->fresh = now;
+            e->fresh.tv_sec += DefaultResolverRefreshRetry;
+        }
+        free(value);
+        free(job->key);
+        free(job);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+// queue a refresh of e. NOTE: caller must hold the lock
+static void ipfs_routing_cache_queue_refresh (struct routingResolver *cache, struct cacheEntry *e)
+{
+    struct cacheRefresh *job;
+
+    if (!cache->running) {
+        cache->running = 1;
+        if (pthread_create(&cache->thread, NULL, ipfs_routing_cache_refresher, cache) != 0) {
+            cache->running = 0;
+            return;
+        }
+    }
+    job = calloc(1, sizeof(struct cacheRefresh));
+    if (!job || !(job->key = strdup(e->key))) {
+        free(job);
+        return;
+    }
+    if (cache->queue_tail) {
+        cache->queue_tail->next = job;
+    } else {
+        cache->queue = job;
+    }
+    cache->queue_tail = job;
+    e->refreshing = 1;
+    pthread_cond_signal(&cache->wake);
+}
+
+char* ipfs_routing_cache_get (char *key, struct ipns_entry *ientry)
+{
+    struct routingResolver *cache;
+    struct cacheEntry *e;
+    struct timespec now;
+    char *ret = NULL;
+
+    if (!key || !ientry || !ientry->cache || ientry->cache->cachesize <= 0) {
+        return NULL;
+    }
+    cache = ientry->cache;
+    timespec_get (&now, TIME_UTC);
+    pthread_mutex_lock(&cache->lock);
+    e = ipfs_routing_cache_find(cache, key);
+    if (e) {
+        if (!ipfs_routing_cache_before(&now, &e->eol) ||
+                (!cache->refresh && !ipfs_routing_cache_before(&now, &e->fresh))) {
+            // expired
+            ipfs_routing_cache_remove(cache, e);
+        } else {
+            if (!ipfs_routing_cache_before(&now, &e->fresh) && !e->refreshing) {
+                // stale, but still valid. Serve it and refresh in the background
+                ipfs_routing_cache_queue_refresh(cache, e);
+            }
+            ipfs_routing_cache_lru_unlink(cache, e);
+            ipfs_routing_cache_lru_push(cache, e);
+            ret = strdup(e->value);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+void ipfs_routing_cache_set (char *key, char *value, struct ipns_entry *ientry)
+{
+    struct routingResolver *cache;
+    struct timespec fresh, eol;
+
+    if (!key || !value || !ientry || !ientry->cache || ientry->cache->cachesize <= 0) {
+        return;
+    }
+    cache = ientry->cache;
+    timespec_get (&fresh, TIME_UTC); // now
+    // the record's ttl (in nanoseconds) says how long before asking again
+    if (ientry->ttl && *ientry->ttl / 1000000000ULL < DefaultResolverCacheTTL) {
+        uint64_t ttl = *ientry->ttl;
+        fresh.tv_sec += ttl / 1000000000ULL;
+        fresh.tv_nsec += ttl % 1000000000ULL;
+        if (fresh.tv_nsec >= 1000000000L) {
+            fresh.tv_sec++;
+            fresh.tv_nsec -= 1000000000L;
+        }
+    } else {
+        fresh.tv_sec += DefaultResolverCacheTTL; // sum TTL seconds to time seconds.
+    }
+    // and its validity says when it may no longer be used
+    if (ientry->eol) {
+        eol = *ientry->eol;
+    } else if (!ientry->validityType || *ientry->validityType != IpnsEntry_EOL ||
+            !ientry->validity || ipfs_util_time_parse_RFC3339 (&eol, ientry->validity) != 0) {
+        eol = fresh;
+    }
+    if (ipfs_routing_cache_before(&eol, &fresh)) {
+        fresh = eol;
+    }
+    pthread_mutex_lock(&cache->lock);
+    ipfs_routing_cache_store(cache, key, value, &fresh, &eol);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void ipfs_routing_cache_delete (struct routingResolver *cache, char *key)
+{
+    struct cacheEntry *e;
+
+    if (!cache || !key || cache->cachesize <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    e = ipfs_routing_cache_find(cache, key);
+    if (e) {
+        ipfs_routing_cache_remove(cache, e);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+int ipfs_routing_cache_set_refresh (struct routingResolver *cache, routing_cache_refresh_func refresh, void *context)
+{
+    if (!cache) {
+        return ErrInvalidParam;
+    }
+    pthread_mutex_lock(&cache->lock);
+    cache->refresh = refresh;
+    cache->refresh_context = context;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+// NewRoutingResolver constructs a name resolver using the IPFS Routing system
+// to implement SFS-like naming on top.
+// cachesize is the limit of the number of entries in the lru cache. Setting it
+// to '0' will disable caching.
+struct routingResolver* ipfs_namesys_new_routing_resolver (struct libp2p_routing_value_store *route, int cachesize)
+{
+    struct routingResolver *ret;
+    pthread_condattr_t attr;
+
+    if (!route) {
+        fprintf(stderr, "attempt to create resolver with NULL routing system\n");
+        exit (1);
+    }
+
+    ret = calloc (1, sizeof (struct routingResolver));
+
+    if (!ret) {
+        return NULL;
+    }
+
+    // about two entries per bucket at most
+    ret->num_buckets = 1;
+    while (ret->num_buckets * 2 < cachesize) {
+        ret->num_buckets <<= 1;
+    }
+    ret->data = calloc(ret->num_buckets, sizeof(void*));
+    if (!ret->data) {
+        free (ret);
+        return NULL;
+    }
+
+    ret->cachesize = cachesize;
+    pthread_mutex_init(&ret->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ret->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    return ret;
+}
+
+void ipfs_namesys_routing_resolver_free (struct routingResolver *cache)
+{
+    if (!cache) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    int running = cache->running;
+    cache->running = 0;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
+    if (running) {
+        pthread_join(cache->thread, NULL);
+    }
+    while (cache->queue) {
+        struct cacheRefresh *next = cache->queue->next;
+        free(cache->queue->key);
+        free(cache->queue);
+        cache->queue = next;
+    }
+    while (cache->lru_head) {
+        ipfs_routing_cache_remove(cache, cache->lru_head);
+    }
+    pthread_cond_destroy(&cache->wake);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->data);
+    free(cache);
+}
@@ -1,15 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <poll.h>
-#include <errno.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/wait.h>
 #include "cid/cid.h"
 #include "path/path.h"
 #include "namesys/namesys.h"
 #include "dnslink/dnslink.h"
+#include "dnslink/dns_client.h"
 
 /*type LookupTXTFunc func(name string) (txt []string, err error)
 
@@ -51,10 +47,8 @@ type lookupRes struct {
 // encoded multihash.
 int ipfs_dns_resolver_resolve_once (char **path, char *name)
 {
-    char **segments, *domain, *dnslink, buf[500], dlprefix[] = "_dnslink.";
-    int p1[2], p2[2], r, l, c=2;
-    struct pollfd event[2], *e;
-    DNSResolver dnsr;
+    char **segments, *domain, *names[2], ***txt = NULL, dlprefix[] = "_dnslink.";
+    int errs[2], i, j, l, err;
 
     segments = ipfs_path_split_n(name, "/", 2);
     domain = segments[0];
@@ -62,85 +56,44 @@ int ipfs_dns_resolver_resolve_once (char **path, char *name)
     *path = NULL;
 
     if (!ipfs_isdomain_is_domain(domain)) {
+        ipfs_path_free_segments (&segments);
         return ErrInvalidDomain;
     }
     //log.Infof("DNSResolver resolving %s", domain);
 
-    if (pipe(p1) || pipe(p2)) {
-        return ErrPipe;
+    l = strlen(domain) + sizeof(dlprefix);
+    names[0] = malloc(l);
+    if (!names[0]) {
+        ipfs_path_free_segments (&segments);
+        return ErrAllocFailed;
     }
-
-    dnsr.lookupTXT = ipfs_dnslink_resolv_lookupTXT;
-
-    r = fork();
-    switch(r) {
-        case -1:
-            return ErrPipe;
-        case 0: // child
-            close(p1[STDIN_FILENO]); // we don't need to read at child process.
-            return ipfs_dns_work_domain (p1[STDOUT_FILENO], &dnsr, domain);
+    snprintf(names[0], l, "%s%s", dlprefix, domain);
+    names[1] = domain;
+
+    // ask for both at once, the _dnslink answer wins.
+    err = ipfs_dns_client_lookup_txt_multi (&txt, errs, names, 2);
+    free (names[0]);
+    if (err == ErrInvalidParam || err == ErrAllocFailed) {
+        ipfs_path_free_segments (&segments);
+        return err;
     }
-    close(p1[STDOUT_FILENO]); // we don't need to write at main process.
-    r = fork();
-    switch(r) {
-        case -1:
-            return ErrPipe;
-        case 0: // child
-            close(p2[STDIN_FILENO]); // we don't need to read at child process.
-
-            l = strlen(domain) + sizeof(dlprefix);
-            dnslink = malloc(l);
-            if (!dnslink) {
-                return ErrAllocFailed;
-            }
-            dnslink[--l] = '\0';
-            strncpy (dnslink, dlprefix, l);
-            strncat (dnslink, domain, l - strlen(dnslink));
 
-            return ipfs_dns_work_domain (p2[STDOUT_FILENO], &dnsr, dnslink);
-    }
-    close(p2[STDOUT_FILENO]); // we don't need to write at main process.
-
-    memset(&event, 0, sizeof(struct pollfd));
-    event[0].fd = p1[STDIN_FILENO];
-    event[0].events = POLLIN | POLLERR | POLLHUP | POLLNVAL;
-    event[1].fd = p2[STDIN_FILENO];
-    event[1].events = POLLIN | POLLERR | POLLHUP | POLLNVAL;
-    e = event;
-
-    do {
-        r = poll(e, c, -1);
-        if (r == -1) {
-            return ErrPoll;
+    for (i = 0 ; i < 2 ; i++) {
+        if (errs[i] || !txt[i]) {
+            continue;
         }
-        for (r = 0 ; r < c ; r++) {
-            if (e[r].revents & POLLIN) {
-                r = read(e[r].fd, buf, sizeof(buf));
-                if (r > 0) {
-                    buf[r] = '\0';
-                    *path = malloc(r+1);
-                    if (*path) {
-                        *path[r] = '\0';
-                        strncpy(*path, buf, r);
-                    }
-                } else if (r <= 0) {
-                    return ErrPoll;
-                }
+        for (j = 0 ; !*path && txt[i][j] ; j++) {
+            if (ipfs_dns_parse_entry (path, txt[i][j]) != 0) {
+                *path = NULL;
             }
         }
-        if (event[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-            event[0].events = 0;
-            e++; c--;
-            wait(&r);
-        }
-        if (event[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-            event[1].events = 0;
-            c--;
-            wait(&r);
-        }
-    } while (c); // wait for child process finish.
+        free (txt[i][0]);
+        free (txt[i]);
+    }
+    free (txt);
 
     if (!*path) {
+        ipfs_path_free_segments (&segments);
         return ErrResolveFailed;
     }
 
@@ -153,6 +106,7 @@ int ipfs_dns_resolver_resolve_once (char **path, char *name)
         *path = ipfs_path_from_segments (name, segments+1);
         free (name);
         if (!*path) {
+            ipfs_path_free_segments (&segments);
             return ErrResolveFailed;
         }
     }
@@ -160,29 +114,6 @@ int ipfs_dns_resolver_resolve_once (char **path, char *name)
     return 0;
 }
 
-int ipfs_dns_work_domain (int output, DNSResolver *r, char *name)
-{
-    char **txt, *path;
-    int i, err = r->lookupTXT(&txt, name);
-
-    if (err) {
-        return err;
-    }
-
-    for (i = 0 ; txt[i] ; i++) {
-        err = ipfs_dns_parse_entry (&path, txt[i]);
-        if (!err) {
-            err = (write (output, path, strlen(path)) != strlen(path));
-            free (path);
-            if (err) {
-                return ErrPipe;
-            }
-            return 0;
-        }
-    }
-    return ErrResolveFailed;
-}
-
 int ipfs_dns_parse_entry (char **path, char *txt)
 {
     char buf[500];
@@ -203,19 +134,19 @@ int ipfs_dns_parse_entry (char **path, char *txt)
 int ipfs_dns_try_parse_dns_link(char **path, char *txt)
 {
     char **parts = ipfs_path_split_n(txt, "=", 2), buf[500];
-    int err;
+    int err = ErrInvalidDNSLink;
 
     if (ipfs_path_segments_length(parts) == 2 && strcmp(parts[0], "dnslink")==0) {
         err = ipfs_path_parse(buf, parts[1]);
         if (err == 0) {
-            *parts = malloc(strlen(buf) + 1);
-            if (! *parts) {
-                return ErrAllocFailed;
+            *path = malloc(strlen(buf) + 1);
+            if (! *path) {
+                err = ErrAllocFailed;
+            } else {
+                memcpy(*path, buf, strlen(buf) + 1);
             }
-            memcpy(*parts, buf, strlen(buf) + 1);
-            return 0;
         }
-        return err;
     }
-    return ErrInvalidDNSLink;
+    ipfs_path_free_segments(&parts);
+    return err;
 }
@@ -6,6 +6,8 @@
 #include "util/time.h"
 #include "namesys/pb.h"
 #include "namesys/publisher.h"
+#include "namesys/routing.h"
+#include "namesys/republisher.h"
 
 /**
  * Convert an ipns_entry into a char array
@@ -213,10 +215,28 @@ int ipfs_namesys_publisher_publish(struct IpfsNode* local_node, char* path) {
 	}
 	libp2p_datastore_record_free(record);
 
+	// what it resolved to before is wrong now
+	if (local_node->ipns_cache != NULL) {
+		char* ipns_path = (char*) malloc(local_node->identity->peer->id_size + 7);
+		if (ipns_path != NULL) {
+			strcpy(ipns_path, "/ipns/");
+			memcpy(&ipns_path[6], local_node->identity->peer->id, local_node->identity->peer->id_size);
+			ipns_path[local_node->identity->peer->id_size + 6] = 0;
+			ipfs_routing_cache_delete(local_node->ipns_cache, ipns_path);
+			free(ipns_path);
+		}
+	}
+
 	// for now, even if what is below fails because of not being connected, return TRUE
 	retVal = 1;
 
 	// propagate to network
+	if (local_node->republisher != NULL) {
+		// it will be sent in the background, with everything else that is due
+		ipfs_namesys_republisher_add(local_node->republisher, local_peer->hash, local_peer->hash_length, path);
+		ipfs_cid_free(local_peer);
+		return retVal;
+	}
 	// build the KademliaMessage
 	struct KademliaMessage* msg = libp2p_message_new();
 	if (msg == NULL) {
@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/conn/dialer.h"
+#include "libp2p/peer/peerstore.h"
+#include "libp2p/record/message.h"
+#include "libp2p/record/record.h"
+#include "libp2p/routing/dht_protocol.h"
+#include "libp2p/utils/linked_list.h"
+#include "libp2p/utils/logger.h"
+#include "libp2p/utils/vector.h"
+#include "cid/cid.h"
+#include "namesys/republisher.h"
+
+// the seconds to wait for a peer to connect
+#define IPNS_REPUBLISH_CONNECT_TIMEOUT 5
+
+/***
+ * A PUT_VALUE, encoded once and sent to every peer close to the name
+ */
+struct IpnsRepublishMessage {
+	struct IpnsRepublishEntry* entry;
+	// a copy of the key of the entry, for the sending threads, which do not hold the lock
+	unsigned char* key;
+	size_t key_size;
+	unsigned char* protobuf;
+	size_t protobuf_size;
+	int peers_sent; // the number of peers that were sent it
+};
+
+/***
+ * The messages of a batch that go to one peer
+ */
+struct IpnsRepublishTarget {
+	struct Libp2pPeer* peer; // the peer in the peerstore
+	struct Libp2pVector* messages; // IpnsRepublishMessages (owned by the batch)
+};
+
+/***
+ * A batch being sent, shared by the sending threads
+ */
+struct IpnsRepublishBatch {
+	struct IpfsNode* local_node;
+	struct Libp2pVector* targets;
+	int next_target;
+	pthread_mutex_t lock;
+};
+
+/***
+ * The hash bucket of a key
+ * @param key the key
+ * @param key_size the size of key
+ * @returns the index into buckets
+ */
+static unsigned int ipfs_namesys_republisher_bucket(const unsigned char* key, size_t key_size) {
+	unsigned int hash = 2166136261u;
+	for(size_t i = 0; i < key_size; i++) {
+		hash ^= key[i];
+		hash *= 16777619u;
+	}
+	return hash % IPNS_REPUBLISH_BUCKETS;
+}
+
+/***
+ * Find the entry of a key
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param key the key
+ * @param key_size the size of key
+ * @returns the entry, or NULL if it is not there
+ */
+static struct IpnsRepublishEntry* ipfs_namesys_republisher_find(struct IpnsRepublisher* republisher, const unsigned char* key, size_t key_size) {
+	struct IpnsRepublishEntry* current = republisher->buckets[ipfs_namesys_republisher_bucket(key, key_size)];
+	while (current != NULL && (current->key_size != key_size || memcmp(current->key, key, key_size) != 0))
+		current = current->hash_next;
+	return current;
+}
+
+/***
+ * Put an entry on the wheel, in the slot of its due time
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param entry the entry
+ */
+static void ipfs_namesys_republisher_schedule(struct IpnsRepublisher* republisher, struct IpnsRepublishEntry* entry) {
+	time_t tick = entry->due / IPNS_REPUBLISH_WHEEL_TICK;
+	if (tick < republisher->current_tick)
+		tick = republisher->current_tick;
+	entry->rounds = (tick - republisher->current_tick) / IPNS_REPUBLISH_WHEEL_SLOTS;
+	entry->slot = tick % IPNS_REPUBLISH_WHEEL_SLOTS;
+	entry->slot_prev = NULL;
+	entry->slot_next = republisher->wheel[entry->slot];
+	if (entry->slot_next != NULL)
+		entry->slot_next->slot_prev = entry;
+	republisher->wheel[entry->slot] = entry;
+}
+
+/***
+ * Take an entry off the wheel
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param entry the entry
+ */
+static void ipfs_namesys_republisher_unschedule(struct IpnsRepublisher* republisher, struct IpnsRepublishEntry* entry) {
+	if (entry->slot < 0)
+		return;
+	if (entry->slot_prev != NULL)
+		entry->slot_prev->slot_next = entry->slot_next;
+	else
+		republisher->wheel[entry->slot] = entry->slot_next;
+	if (entry->slot_next != NULL)
+		entry->slot_next->slot_prev = entry->slot_prev;
+	entry->slot_prev = entry->slot_next = NULL;
+	entry->slot = -1;
+}
+
+/***
+ * Take the entries of a slot that are due
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param slot the slot
+ * @param now the time
+ * @param turned true(1) if the wheel turned to this slot, false(0) if we are only looking for what was added since
+ * @param due where to put the entries
+ */
+static void ipfs_namesys_republisher_take_slot(struct IpnsRepublisher* republisher, int slot, time_t now, int turned, struct Libp2pVector* due) {
+	struct IpnsRepublishEntry* current = republisher->wheel[slot];
+	while (current != NULL) {
+		struct IpnsRepublishEntry* next = current->slot_next;
+		if (current->due <= now || (turned && current->rounds == 0)) {
+			ipfs_namesys_republisher_unschedule(republisher, current);
+			libp2p_utils_vector_add(due, current);
+		} else if (turned) {
+			current->rounds--;
+		}
+		current = next;
+	}
+}
+
+/***
+ * Remove an entry from the hash buckets
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param entry the entry
+ */
+static void ipfs_namesys_republisher_unlink(struct IpnsRepublisher* republisher, struct IpnsRepublishEntry* entry) {
+	struct IpnsRepublishEntry** current = &republisher->buckets[ipfs_namesys_republisher_bucket(entry->key, entry->key_size)];
+	while (*current != NULL && *current != entry)
+		current = &(*current)->hash_next;
+	if (*current != NULL)
+		*current = entry->hash_next;
+	entry->hash_next = NULL;
+	republisher->count--;
+}
+
+/***
+ * Remove an entry from the hash buckets (unless it was already) and free it
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param entry the entry (not on the wheel)
+ */
+static void ipfs_namesys_republisher_entry_free(struct IpnsRepublisher* republisher, struct IpnsRepublishEntry* entry) {
+	if (!entry->removed)
+		ipfs_namesys_republisher_unlink(republisher, entry);
+	free(entry->key);
+	free(entry->value);
+	free(entry);
+}
+
+/***
+ * Build and encode the PUT_VALUE of an entry
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param entry the entry
+ * @returns the IpnsRepublishMessage, or NULL on error
+ */
+static struct IpnsRepublishMessage* ipfs_namesys_republisher_encode(struct IpnsRepublisher* republisher, struct IpnsRepublishEntry* entry) {
+	struct IpnsRepublishMessage* result = NULL;
+	struct KademliaMessage* msg = libp2p_message_new();
+	if (msg == NULL)
+		return NULL;
+	msg->message_type = MESSAGE_TYPE_PUT_VALUE;
+	msg->provider_peer_head = libp2p_utils_linked_list_new();
+	msg->record = libp2p_record_new();
+	if (msg->provider_peer_head == NULL || msg->record == NULL)
+		goto exit;
+	msg->provider_peer_head->item = libp2p_peer_copy(republisher->local_node->identity->peer);
+	size_t value_size = strlen(entry->value);
+	msg->record->author = (char*) malloc(entry->key_size);
+	msg->record->key = (char*) malloc(entry->key_size);
+	msg->record->value = (unsigned char*) malloc(value_size);
+	if (msg->record->author == NULL || msg->record->key == NULL || msg->record->value == NULL)
+		goto exit;
+	memcpy(msg->record->author, entry->key, entry->key_size);
+	msg->record->author_size = entry->key_size;
+	memcpy(msg->record->key, entry->key, entry->key_size);
+	msg->record->key_size = entry->key_size;
+	memcpy(msg->record->value, entry->value, value_size);
+	msg->record->value_size = value_size;
+
+	result = (struct IpnsRepublishMessage*) malloc(sizeof(struct IpnsRepublishMessage));
+	if (result == NULL)
+		goto exit;
+	result->entry = entry;
+	result->peers_sent = 0;
+	result->key_size = entry->key_size;
+	result->key = (unsigned char*) malloc(entry->key_size);
+	if (result->key != NULL)
+		memcpy(result->key, entry->key, entry->key_size);
+	result->protobuf_size = libp2p_message_protobuf_encode_size(msg);
+	result->protobuf = (unsigned char*) malloc(result->protobuf_size);
+	if (result->key == NULL || result->protobuf == NULL || !libp2p_message_protobuf_encode(msg, result->protobuf, result->protobuf_size, &result->protobuf_size)) {
+		free(result->key);
+		free(result->protobuf);
+		free(result);
+		result = NULL;
+	}
+	exit:
+	libp2p_message_free(msg);
+	return result;
+}
+
+/***
+ * Find the target for a peer, adding one if it is not there
+ * @param targets the vector of IpnsRepublishTargets
+ * @param peer the peer
+ * @returns the IpnsRepublishTarget, or NULL on error
+ */
+static struct IpnsRepublishTarget* ipfs_namesys_republisher_get_target(struct Libp2pVector* targets, struct Libp2pPeer* peer) {
+	for(int i = 0; i < targets->total; i++) {
+		struct IpnsRepublishTarget* target = (struct IpnsRepublishTarget*) libp2p_utils_vector_get(targets, i);
+		if (target->peer == peer)
+			return target;
+	}
+	struct IpnsRepublishTarget* target = (struct IpnsRepublishTarget*) malloc(sizeof(struct IpnsRepublishTarget));
+	if (target == NULL)
+		return NULL;
+	target->peer = peer;
+	target->messages = libp2p_utils_vector_new(1);
+	if (target->messages == NULL) {
+		free(target);
+		return NULL;
+	}
+	libp2p_utils_vector_add(targets, target);
+	return target;
+}
+
+/***
+ * A sending thread. Takes the next peer of the batch, and sends it all of its messages.
+ * @param arg the IpnsRepublishBatch
+ * @returns NULL
+ */
+static void* ipfs_namesys_republisher_send_worker(void* arg) {
+	struct IpnsRepublishBatch* batch = (struct IpnsRepublishBatch*) arg;
+	struct IpfsNode* local_node = batch->local_node;
+
+	pthread_mutex_lock(&batch->lock);
+	while (batch->next_target < batch->targets->total) {
+		struct IpnsRepublishTarget* target = (struct IpnsRepublishTarget*) libp2p_utils_vector_get(batch->targets, batch->next_target++);
+		pthread_mutex_unlock(&batch->lock);
+
+		struct Libp2pPeer* peer = target->peer;
+		int sent = 0;
+		if (libp2p_peer_is_connected(peer)
+				|| libp2p_peer_connect(local_node->dialer, peer, local_node->peerstore, local_node->repo->config->datastore, IPNS_REPUBLISH_CONNECT_TIMEOUT)) {
+			for(; sent < target->messages->total; sent++) {
+				struct IpnsRepublishMessage* msg = (struct IpnsRepublishMessage*) libp2p_utils_vector_get(target->messages, sent);
+				if (!libp2p_routing_dht_send_encoded(peer->sessionContext, msg->protobuf, msg->protobuf_size))
+					break;
+			}
+		} else {
+			libp2p_logger_debug("republisher", "Unable to connect to %s.\n", libp2p_peer_id_to_string(peer));
+		}
+
+		pthread_mutex_lock(&batch->lock);
+		for(int i = 0; i < sent; i++)
+			((struct IpnsRepublishMessage*) libp2p_utils_vector_get(target->messages, i))->peers_sent++;
+	}
+	pthread_mutex_unlock(&batch->lock);
+	return NULL;
+}
+
+/***
+ * Send each message to the peers closest to its name, IPNS_REPUBLISH_PARALLEL peers at a time
+ * @param republisher the IpnsRepublisher
+ * @param messages the IpnsRepublishMessages
+ */
+static void ipfs_namesys_republisher_send(struct IpnsRepublisher* republisher, struct Libp2pVector* messages) {
+	struct IpnsRepublishBatch batch;
+	pthread_t threads[IPNS_REPUBLISH_PARALLEL];
+	int num_threads = 0;
+
+	batch.local_node = republisher->local_node;
+	batch.next_target = 0;
+	batch.targets = libp2p_utils_vector_new(IPNS_REPUBLISH_PEERS);
+	if (batch.targets == NULL)
+		return;
+	pthread_mutex_init(&batch.lock, NULL);
+
+	// group the names by the peers closest to them
+	for(int i = 0; i < messages->total; i++) {
+		struct IpnsRepublishMessage* msg = (struct IpnsRepublishMessage*) libp2p_utils_vector_get(messages, i);
+		struct Libp2pVector* closest = libp2p_routing_dht_closest_peers(republisher->local_node->peerstore, msg->key, msg->key_size, IPNS_REPUBLISH_PEERS);
+		if (closest == NULL)
+			continue;
+		for(int j = 0; j < closest->total; j++) {
+			struct IpnsRepublishTarget* target = ipfs_namesys_republisher_get_target(batch.targets, (struct Libp2pPeer*) libp2p_utils_vector_get(closest, j));
+			if (target != NULL)
+				libp2p_utils_vector_add(target->messages, msg);
+		}
+		libp2p_utils_vector_free(closest);
+	}
+
+	for(int i = 0; i < IPNS_REPUBLISH_PARALLEL && i < batch.targets->total; i++) {
+		if (pthread_create(&threads[num_threads], NULL, ipfs_namesys_republisher_send_worker, &batch) == 0)
+			num_threads++;
+	}
+	if (num_threads == 0) {
+		// do it ourselves, one at a time
+		ipfs_namesys_republisher_send_worker(&batch);
+	}
+	for(int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	for(int i = 0; i < batch.targets->total; i++) {
+		struct IpnsRepublishTarget* target = (struct IpnsRepublishTarget*) libp2p_utils_vector_get(batch.targets, i);
+		libp2p_utils_vector_free(target->messages);
+		free(target);
+	}
+	libp2p_utils_vector_free(batch.targets);
+	pthread_mutex_destroy(&batch.lock);
+}
+
+/***
+ * Send what is due, and put it back on the wheel for next time
+ * NOTE: caller must hold the lock. It is let go while sending.
+ * @param republisher the IpnsRepublisher
+ * @param due the IpnsRepublishEntries that are due
+ */
+static void ipfs_namesys_republisher_publish(struct IpnsRepublisher* republisher, struct Libp2pVector* due) {
+	struct Libp2pVector* messages = libp2p_utils_vector_new(due->total);
+	if (messages == NULL) {
+		// try again on the next tick
+		for(int i = 0; i < due->total; i++)
+			ipfs_namesys_republisher_schedule(republisher, (struct IpnsRepublishEntry*) libp2p_utils_vector_get(due, i));
+		return;
+	}
+	for(int i = 0; i < due->total; i++) {
+		struct IpnsRepublishEntry* entry = (struct IpnsRepublishEntry*) libp2p_utils_vector_get(due, i);
+		struct IpnsRepublishMessage* msg = ipfs_namesys_republisher_encode(republisher, entry);
+		if (msg != NULL) {
+			libp2p_utils_vector_add(messages, msg);
+		} else {
+			entry->due = time(NULL) + IPNS_REPUBLISH_RETRY;
+			ipfs_namesys_republisher_schedule(republisher, entry);
+		}
+	}
+	pthread_mutex_unlock(&republisher->lock);
+
+	ipfs_namesys_republisher_send(republisher, messages);
+
+	pthread_mutex_lock(&republisher->lock);
+	time_t now = time(NULL);
+	for(int i = 0; i < messages->total; i++) {
+		struct IpnsRepublishMessage* msg = (struct IpnsRepublishMessage*) libp2p_utils_vector_get(messages, i);
+		struct IpnsRepublishEntry* entry = msg->entry;
+		republisher->sent += msg->peers_sent;
+		if (entry->removed) {
+			// removed while it was being sent
+			ipfs_namesys_republisher_entry_free(republisher, entry);
+		} else if (entry->changed) {
+			// changed while it was being sent. Send the new value right away.
+			entry->changed = 0;
+			ipfs_namesys_republisher_schedule(republisher, entry);
+		} else if (msg->peers_sent > 0) {
+			libp2p_logger_debug("republisher", "Sent a name to %d peer(s).\n", msg->peers_sent);
+			entry->eol = now + republisher->lifetime_secs;
+			time_t wait = republisher->interval_secs;
+			if (republisher->lifetime_secs - IPNS_REPUBLISH_MARGIN < wait)
+				wait = republisher->lifetime_secs - IPNS_REPUBLISH_MARGIN;
+			entry->due = now + (wait > IPNS_REPUBLISH_WHEEL_TICK ? wait : IPNS_REPUBLISH_WHEEL_TICK);
+			ipfs_namesys_republisher_schedule(republisher, entry);
+		} else {
+			libp2p_logger_debug("republisher", "No peers could be sent a name. Trying again later.\n");
+			entry->due = now + IPNS_REPUBLISH_RETRY;
+			ipfs_namesys_republisher_schedule(republisher, entry);
+		}
+		free(msg->key);
+		free(msg->protobuf);
+		free(msg);
+	}
+	libp2p_utils_vector_free(messages);
+}
+
+/***
+ * Wait until the lock is signaled or the number of seconds has passed
+ * NOTE: caller must hold the lock
+ * @param republisher the IpnsRepublisher
+ * @param secs the most seconds to wait
+ */
+static void ipfs_namesys_republisher_wait(struct IpnsRepublisher* republisher, time_t secs) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += secs;
+	pthread_cond_timedwait(&republisher->wake, &republisher->lock, &deadline);
+}
+
+/***
+ * The background thread. Turns the wheel once a tick, and sends what is due.
+ * @param arg the IpnsRepublisher
+ * @returns NULL
+ */
+static void* ipfs_namesys_republisher_thread(void* arg) {
+	struct IpnsRepublisher* republisher = (struct IpnsRepublisher*) arg;
+
+	pthread_mutex_lock(&republisher->lock);
+	while (republisher->running) {
+		struct Libp2pVector* due = libp2p_utils_vector_new(1);
+		if (due == NULL) {
+			ipfs_namesys_republisher_wait(republisher, IPNS_REPUBLISH_WHEEL_TICK);
+			continue;
+		}
+		time_t now = time(NULL);
+		time_t tick = now / IPNS_REPUBLISH_WHEEL_TICK;
+		// after a long sleep, one turn of the wheel catches up on everything
+		if (tick - republisher->current_tick >= IPNS_REPUBLISH_WHEEL_SLOTS)
+			republisher->current_tick = tick - IPNS_REPUBLISH_WHEEL_SLOTS + 1;
+		while (republisher->current_tick <= tick) {
+			ipfs_namesys_republisher_take_slot(republisher, republisher->current_tick % IPNS_REPUBLISH_WHEEL_SLOTS, now, 1, due);
+			republisher->current_tick++;
+		}
+		// names added since are in the next slot
+		ipfs_namesys_republisher_take_slot(republisher, republisher->current_tick % IPNS_REPUBLISH_WHEEL_SLOTS, now, 0, due);
+
+		if (due->total > 0) {
+			libp2p_logger_debug("republisher", "Republishing %d of %d name(s).\n", due->total, republisher->count);
+			ipfs_namesys_republisher_publish(republisher, due);
+		}
+		libp2p_utils_vector_free(due);
+
+		if (republisher->running) {
+			now = time(NULL);
+			time_t next_tick = republisher->current_tick * IPNS_REPUBLISH_WHEEL_TICK;
+			ipfs_namesys_republisher_wait(republisher, next_tick > now ? next_tick - now : 1);
+		}
+	}
+	pthread_mutex_unlock(&republisher->lock);
+	return NULL;
+}
+
+/***
+ * Add a name, or change what it points to. It is sent right away.
+ * @param republisher the IpnsRepublisher
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @param value what it points to (i.e. "/ipfs/Qm1234...")
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_republisher_add(struct IpnsRepublisher* republisher, const unsigned char* key, size_t key_size, const char* value) {
+	if (republisher == NULL || key == NULL || key_size == 0 || value == NULL)
+		return 0;
+	char* new_value = (char*) malloc(strlen(value) + 1);
+	if (new_value == NULL)
+		return 0;
+	strcpy(new_value, value);
+
+	pthread_mutex_lock(&republisher->lock);
+	struct IpnsRepublishEntry* entry = ipfs_namesys_republisher_find(republisher, key, key_size);
+	int created = (entry == NULL);
+	if (created) {
+		entry = (struct IpnsRepublishEntry*) calloc(1, sizeof(struct IpnsRepublishEntry));
+		if (entry != NULL)
+			entry->key = (unsigned char*) malloc(key_size);
+		if (entry == NULL || entry->key == NULL) {
+			pthread_mutex_unlock(&republisher->lock);
+			free(entry);
+			free(new_value);
+			return 0;
+		}
+		memcpy(entry->key, key, key_size);
+		entry->key_size = key_size;
+		entry->slot = -1;
+		unsigned int bucket = ipfs_namesys_republisher_bucket(key, key_size);
+		entry->hash_next = republisher->buckets[bucket];
+		republisher->buckets[bucket] = entry;
+		republisher->count++;
+	}
+	free(entry->value);
+	entry->value = new_value;
+	entry->due = time(NULL);
+	if (entry->slot >= 0) {
+		ipfs_namesys_republisher_unschedule(republisher, entry);
+		ipfs_namesys_republisher_schedule(republisher, entry);
+	} else if (created) {
+		ipfs_namesys_republisher_schedule(republisher, entry);
+	} else {
+		// it is being sent. It goes back on the wheel when that is done.
+		entry->changed = 1;
+	}
+	pthread_cond_broadcast(&republisher->wake);
+	pthread_mutex_unlock(&republisher->lock);
+	return 1;
+}
+
+/***
+ * Stop republishing a name
+ * @param republisher the IpnsRepublisher
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @returns true(1) if it was there, false(0) otherwise
+ */
+int ipfs_namesys_republisher_remove(struct IpnsRepublisher* republisher, const unsigned char* key, size_t key_size) {
+	if (republisher == NULL || key == NULL)
+		return 0;
+	pthread_mutex_lock(&republisher->lock);
+	struct IpnsRepublishEntry* entry = ipfs_namesys_republisher_find(republisher, key, key_size);
+	if (entry != NULL) {
+		if (entry->slot >= 0) {
+			ipfs_namesys_republisher_unschedule(republisher, entry);
+			ipfs_namesys_republisher_entry_free(republisher, entry);
+		} else {
+			// it is being sent. The thread frees it when done.
+			ipfs_namesys_republisher_unlink(republisher, entry);
+			entry->removed = 1;
+		}
+	}
+	pthread_mutex_unlock(&republisher->lock);
+	return entry != NULL;
+}
+
+/***
+ * Build a republisher. The name of the local peer is added if it was published before.
+ * @param local_node the node that publishes
+ * @returns the IpnsRepublisher, or NULL on error
+ */
+struct IpnsRepublisher* ipfs_namesys_republisher_new(struct IpfsNode* local_node) {
+	if (local_node == NULL || local_node->repo == NULL || local_node->identity == NULL)
+		return NULL;
+	struct IpnsRepublisher* republisher = (struct IpnsRepublisher*) calloc(1, sizeof(struct IpnsRepublisher));
+	if (republisher == NULL)
+		return NULL;
+	republisher->local_node = local_node;
+	republisher->interval_secs = IPNS_REPUBLISH_INTERVAL;
+	republisher->lifetime_secs = IPNS_RECORD_LIFETIME;
+	republisher->current_tick = time(NULL) / IPNS_REPUBLISH_WHEEL_TICK;
+	pthread_mutex_init(&republisher->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&republisher->wake, &attr);
+	pthread_condattr_destroy(&attr);
+
+	// what we published before we were restarted
+	struct Cid* local_peer = NULL;
+	struct DatastoreRecord* record = NULL;
+	struct Datastore* datastore = local_node->repo->config->datastore;
+	if (ipfs_cid_decode_hash_from_base58((unsigned char*)local_node->identity->peer->id, local_node->identity->peer->id_size, &local_peer)) {
+		if (datastore->datastore_get(local_peer->hash, local_peer->hash_length, &record, datastore)) {
+			char value[record->value_size + 1];
+			memcpy(value, record->value, record->value_size);
+			value[record->value_size] = 0;
+			if (strncmp(value, "/ipfs/", 6) == 0 || strncmp(value, "/ipns/", 6) == 0)
+				ipfs_namesys_republisher_add(republisher, local_peer->hash, local_peer->hash_length, value);
+			libp2p_datastore_record_free(record);
+		}
+		ipfs_cid_free(local_peer);
+	}
+	return republisher;
+}
+
+/***
+ * Start republishing in a background thread
+ * @param republisher the IpnsRepublisher
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_republisher_start(struct IpnsRepublisher* republisher) {
+	if (republisher == NULL)
+		return 0;
+	pthread_mutex_lock(&republisher->lock);
+	if (republisher->running) {
+		pthread_mutex_unlock(&republisher->lock);
+		return 1;
+	}
+	republisher->running = 1;
+	if (pthread_create(&republisher->thread, NULL, ipfs_namesys_republisher_thread, republisher) != 0) {
+		libp2p_logger_error("republisher", "Unable to start the republisher thread.\n");
+		republisher->running = 0;
+	}
+	int retVal = republisher->running;
+	pthread_mutex_unlock(&republisher->lock);
+	return retVal;
+}
+
+/***
+ * Stop the background thread and wait for it to finish
+ * @param republisher the IpnsRepublisher
+ */
+void ipfs_namesys_republisher_stop(struct IpnsRepublisher* republisher) {
+	if (republisher == NULL)
+		return;
+	pthread_mutex_lock(&republisher->lock);
+	int was_running = republisher->running;
+	republisher->running = 0;
+	pthread_cond_broadcast(&republisher->wake);
+	pthread_mutex_unlock(&republisher->lock);
+	if (was_running)
+		pthread_join(republisher->thread, NULL);
+}
+
+/***
+ * Free the resources of an IpnsRepublisher
+ * NOTE: stops it first if it is running
+ * @param republisher the IpnsRepublisher
+ */
+void ipfs_namesys_republisher_free(struct IpnsRepublisher* republisher) {
+	if (republisher != NULL) {
+		ipfs_namesys_republisher_stop(republisher);
+		for(int i = 0; i < IPNS_REPUBLISH_BUCKETS; i++) {
+			while (republisher->buckets[i] != NULL) {
+				struct IpnsRepublishEntry* entry = republisher->buckets[i];
+				ipfs_namesys_republisher_unschedule(republisher, entry);
+				ipfs_namesys_republisher_entry_free(republisher, entry);
+			}
+		}
+		pthread_cond_destroy(&republisher->wake);
+		pthread_mutex_destroy(&republisher->lock);
+		free(republisher);
+	}
+}
@@ -1,7 +1,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
+
 #include "libp2p/utils/logger.h"
+#include "libp2p/utils/vector.h"
+#include "libp2p/routing/dht_protocol.h"
+#include "libp2p/record/message.h"
+#include "libp2p/conn/dialer.h"
+#include "libp2p/yamux/yamux.h"
+#include "util/errs.h"
+#include "namesys/publisher.h"
+#include "namesys/routing.h"
 #include "namesys/resolver.h"
 
 /**
@@ -23,6 +33,287 @@ int is_ipns_string(char* path) {
 	return 0;
 }
 
+/***
+ * Is this something an IPNS name can point to?
+ * @param value the value of a record (not NULL terminated)
+ * @param value_size the size of value
+ * @returns true(1) if it is an "/ipfs/" or "/ipns/" path
+ */
+static int ipfs_namesys_resolver_is_valid_value(const unsigned char* value, size_t value_size) {
+	if (value == NULL || value_size <= 6 || memchr(value, 0, value_size) != NULL)
+		return 0;
+	return memcmp(value, "/ipfs/", 6) == 0 || memcmp(value, "/ipns/", 6) == 0;
+}
+
+/***
+ * The state of a network resolution, shared by the query threads
+ */
+struct IpnsLookup {
+	struct IpfsNode* local_node;
+	struct KademliaMessage* message;
+	// the peers to ask, closest to the name first
+	struct Libp2pVector* peers;
+	int next_peer;
+	// the different valid values sent back, and how many peers sent each
+	char* values[IPNS_RESOLVE_PEERS];
+	int counts[IPNS_RESOLVE_PEERS];
+	int num_values;
+	// the index in values that reached the quorum, or -1
+	int winner;
+	pthread_mutex_t lock;
+};
+
+/***
+ * Ask one peer for the record, connecting to it if necessary
+ * NOTE: This is done on a kademlia stream of our own. The session's default
+ * stream belongs to the swarm listener, which would take the answer.
+ * @param lookup the lookup
+ * @param peer the peer
+ * @param value where to put the value (NULL terminated)
+ * @returns true(1) if the peer sent back a valid value, false(0) otherwise
+ */
+static int ipfs_namesys_resolver_ask(struct IpnsLookup* lookup, struct Libp2pPeer* peer, char** value) {
+	struct IpfsNode* local_node = lookup->local_node;
+	struct KademliaMessage* response = NULL;
+	struct StreamMessage* answer = NULL;
+	int retVal = 0;
+
+	if (!libp2p_peer_is_connected(peer)) {
+		if (peer->addr_head == NULL || !libp2p_peer_connect(local_node->dialer, peer, local_node->peerstore, local_node->repo->config->datastore, 5))
+			return 0;
+	}
+	struct Stream* kademlia_stream = libp2p_conn_dialer_get_stream(local_node->dialer, peer, "kademlia");
+	if (kademlia_stream == NULL) {
+		libp2p_logger_debug("resolver", "Unable to open a kademlia stream to %s.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	size_t protobuf_size = libp2p_message_protobuf_encode_size(lookup->message);
+	unsigned char* protobuf = (unsigned char*) malloc(protobuf_size);
+	if (protobuf == NULL)
+		goto exit;
+	libp2p_message_protobuf_encode(lookup->message, protobuf, protobuf_size, &protobuf_size);
+	struct StreamMessage outgoing;
+	outgoing.data = protobuf;
+	outgoing.data_size = protobuf_size;
+	outgoing.error_number = 0;
+	int written = kademlia_stream->write(kademlia_stream->stream_context, &outgoing);
+	free(protobuf);
+	if (!written
+			|| !kademlia_stream->read(kademlia_stream->stream_context, &answer, 5) || answer == NULL
+			|| !libp2p_message_protobuf_decode(answer->data, answer->data_size, &response) || response == NULL) {
+		libp2p_logger_debug("resolver", "Unable to get a record from %s.\n", libp2p_peer_id_to_string(peer));
+		goto exit;
+	}
+	if (response->record != NULL && ipfs_namesys_resolver_is_valid_value(response->record->value, response->record->value_size)) {
+		*value = (char*) malloc(response->record->value_size + 1);
+		if (*value != NULL) {
+			memcpy(*value, response->record->value, response->record->value_size);
+			(*value)[response->record->value_size] = 0;
+			retVal = 1;
+		}
+	}
+	exit:
+	if (response != NULL)
+		libp2p_message_free(response);
+	libp2p_stream_message_free(answer);
+	// done with the channel. It is the parent of the kademlia stream, and takes it with it.
+	libp2p_yamux_channel_abandon(kademlia_stream->parent_stream);
+	return retVal;
+}
+
+/***
+ * A query thread of a network resolution. Asks the next closest peer
+ * until a quorum agrees or everyone has been asked.
+ * @param arg the IpnsLookup
+ * @returns NULL
+ */
+static void* ipfs_namesys_resolver_worker(void* arg) {
+	struct IpnsLookup* lookup = (struct IpnsLookup*) arg;
+
+	pthread_mutex_lock(&lookup->lock);
+	while (lookup->winner < 0 && lookup->next_peer < lookup->peers->total) {
+		struct Libp2pPeer* peer = (struct Libp2pPeer*) libp2p_utils_vector_get(lookup->peers, lookup->next_peer++);
+		pthread_mutex_unlock(&lookup->lock);
+
+		char* value = NULL;
+		int found = ipfs_namesys_resolver_ask(lookup, peer, &value);
+
+		pthread_mutex_lock(&lookup->lock);
+		if (!found)
+			continue;
+		int i = 0;
+		while (i < lookup->num_values && strcmp(lookup->values[i], value) != 0)
+			i++;
+		if (i == lookup->num_values) {
+			lookup->values[lookup->num_values++] = value;
+		} else {
+			free(value);
+		}
+		lookup->counts[i]++;
+		if (lookup->counts[i] >= IPNS_RESOLVE_QUORUM && lookup->winner < 0)
+			lookup->winner = i;
+	}
+	pthread_mutex_unlock(&lookup->lock);
+	return NULL;
+}
+
+/***
+ * Ask the peers closest to an IPNS name for its record. The peers are
+ * asked IPNS_RESOLVE_PARALLEL at a time. No more are asked once
+ * IPNS_RESOLVE_QUORUM of them agree. If they never do, the value sent
+ * back by the most peers is used, and quorum is left false. If that is a
+ * tie, nothing is, and the caller should fall back to the local record.
+ * @param local_node the context
+ * @param key the hash of the name
+ * @param key_size the size of key
+ * @param results where to put the value (i.e. "/ipfs/Qm5678...")
+ * @param quorum set to true(1) if IPNS_RESOLVE_QUORUM peers agreed on the value
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_namesys_resolver_resolve_network(struct IpfsNode* local_node, const unsigned char* key, size_t key_size, char** results, int* quorum) {
+	struct IpnsLookup lookup;
+	pthread_t threads[IPNS_RESOLVE_PARALLEL];
+	int num_threads = 0, retVal = 0;
+
+	*quorum = 0;
+	if (local_node->dialer == NULL || local_node->peerstore == NULL)
+		return 0;
+
+	memset(&lookup, 0, sizeof(struct IpnsLookup));
+	lookup.local_node = local_node;
+	lookup.winner = -1;
+	lookup.peers = libp2p_routing_dht_closest_peers(local_node->peerstore, key, key_size, IPNS_RESOLVE_PEERS);
+	if (lookup.peers == NULL)
+		return 0;
+	if (lookup.peers->total == 0) {
+		libp2p_utils_vector_free(lookup.peers);
+		return 0;
+	}
+	lookup.message = libp2p_message_new();
+	if (lookup.message == NULL) {
+		libp2p_utils_vector_free(lookup.peers);
+		return 0;
+	}
+	lookup.message->message_type = MESSAGE_TYPE_GET_VALUE;
+	lookup.message->key_size = key_size;
+	lookup.message->key = malloc(key_size);
+	if (lookup.message->key == NULL)
+		goto exit;
+	memcpy(lookup.message->key, key, key_size);
+	pthread_mutex_init(&lookup.lock, NULL);
+
+	for(int i = 0; i < IPNS_RESOLVE_PARALLEL && i < lookup.peers->total; i++) {
+		if (pthread_create(&threads[num_threads], NULL, ipfs_namesys_resolver_worker, &lookup) == 0)
+			num_threads++;
+	}
+	if (num_threads == 0) {
+		// do it ourselves, one at a time
+		ipfs_namesys_resolver_worker(&lookup);
+	}
+	for(int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&lookup.lock);
+
+	int best = lookup.winner;
+	if (best < 0) {
+		// no quorum. Go with what most of them said, if they did not split evenly
+		int tie = 0;
+		for(int i = 0; i < lookup.num_values; i++) {
+			if (best < 0 || lookup.counts[i] > lookup.counts[best]) {
+				best = i;
+				tie = 0;
+			} else if (lookup.counts[i] == lookup.counts[best]) {
+				tie = 1;
+			}
+		}
+		if (tie) {
+			libp2p_logger_debug("resolver", "The peers do not agree on a value.\n");
+			best = -1;
+		}
+	}
+	if (best >= 0) {
+		libp2p_logger_debug("resolver", "%d of %d peer(s) agree on %s.\n", lookup.counts[best], lookup.next_peer, lookup.values[best]);
+		*results = lookup.values[best];
+		lookup.values[best] = NULL;
+		*quorum = (best == lookup.winner);
+		retVal = 1;
+	}
+
+	exit:
+	for(int i = 0; i < lookup.num_values; i++)
+		free(lookup.values[i]);
+	libp2p_message_free(lookup.message);
+	libp2p_utils_vector_free(lookup.peers);
+	return retVal;
+}
+
+/***
+ * Remember what an IPNS name resolved to, in the cache and the datastore
+ * @param local_node the context
+ * @param path the ipns path
+ * @param cid the name
+ * @param value what it resolved to
+ */
+static void ipfs_namesys_resolver_store(struct IpfsNode* local_node, const char* path, struct Cid* cid, const char* value) {
+	struct ipns_entry entry;
+	memset(&entry, 0, sizeof(struct ipns_entry));
+	entry.cache = local_node->ipns_cache;
+	ipfs_routing_cache_set((char*)path, (char*)value, &entry);
+
+	struct DatastoreRecord* record = libp2p_datastore_record_new();
+	if (record == NULL)
+		return;
+	record->key = (uint8_t*) malloc(cid->hash_length);
+	record->value = (uint8_t*) malloc(strlen(value));
+	if (record->key != NULL && record->value != NULL) {
+		memcpy(record->key, cid->hash, cid->hash_length);
+		record->key_size = cid->hash_length;
+		memcpy(record->value, value, strlen(value));
+		record->value_size = strlen(value);
+		struct Datastore* datastore = local_node->repo->config->datastore;
+		if (!datastore->datastore_put(record, datastore))
+			libp2p_logger_error("resolver", "Unable to store the record for %s.\n", path);
+	}
+	libp2p_datastore_record_free(record);
+}
+
+/***
+ * Is this name ours?
+ * @param local_node the context
+ * @param cid the name
+ * @returns true(1) if the name is the local peer id
+ */
+static int ipfs_namesys_resolver_is_local_name(struct IpfsNode* local_node, struct Cid* cid) {
+	struct Cid* local_peer = NULL;
+	if (!ipfs_cid_decode_hash_from_base58((unsigned char*)local_node->identity->peer->id, local_node->identity->peer->id_size, &local_peer))
+		return 0;
+	int retVal = local_peer->hash_length == cid->hash_length && memcmp(local_peer->hash, cid->hash, cid->hash_length) == 0;
+	ipfs_cid_free(local_peer);
+	return retVal;
+}
+
+/***
+ * Look for the record of an IPNS name in the local datastore
+ * @param local_node the context
+ * @param cid the name
+ * @param results where to put the value (NULL terminated)
+ * @returns true(1) if it was found, false(0) otherwise
+ */
+static int ipfs_namesys_resolver_resolve_local(struct IpfsNode* local_node, struct Cid* cid, char** results) {
+	struct DatastoreRecord* record = NULL;
+	struct Datastore* datastore = local_node->repo->config->datastore;
+
+	if (!datastore->datastore_get(cid->hash, cid->hash_length, &record, datastore))
+		return 0;
+	*results = (char*) malloc(record->value_size + 1);
+	if (*results != NULL) {
+		memcpy(*results, record->value, record->value_size);
+		(*results)[record->value_size] = 0;
+	}
+	libp2p_datastore_record_free(record);
+	return *results != NULL;
+}
+
 /***
  * Resolve an IPNS name, only to its next step
  * @param local_node the context
@@ -32,30 +323,77 @@ int is_ipns_string(char* path) {
  */
 int ipfs_namesys_resolver_resolve_once(struct IpfsNode* local_node, const char* path, char** results) {
 	struct Cid* cid = NULL;
+	struct ipns_entry entry;
+
+	// a recent answer
+	memset(&entry, 0, sizeof(struct ipns_entry));
+	entry.cache = local_node->ipns_cache;
+	*results = ipfs_routing_cache_get((char*)path, &entry);
+	if (*results != NULL)
+		return 1;
+
 	if (!ipfs_cid_decode_hash_from_ipfs_ipns_string(path, &cid)) {
 		return 0;
 	}
 
+	// our own names are only known locally
+	int is_local = local_node->identity != NULL && local_node->identity->peer != NULL
+			&& ipfs_namesys_resolver_is_local_name(local_node, cid);
+
+	// ask the network. Only what a quorum agrees on is remembered. Anything less
+	// could come from one peer, so it is used this time only.
+	int quorum = 0;
+	if (!is_local && local_node->mode == MODE_ONLINE && ipfs_namesys_resolver_resolve_network(local_node, cid->hash, cid->hash_length, results, &quorum)) {
+		if (quorum)
+			ipfs_namesys_resolver_store(local_node, path, cid, *results);
+		else
+			libp2p_logger_debug("resolver", "No quorum for %s. Not remembering %s.\n", path, *results);
+		ipfs_cid_free(cid);
+		return 1;
+	}
+
 	// look locally
-	struct DatastoreRecord* record;
-	if (local_node->repo->config->datastore->datastore_get(cid->hash, cid->hash_length, &record, local_node->repo->config->datastore)) {
-		// we are able to handle this locally... return the results
-		*results = (char*) malloc(record->value_size + 1);
-		if (*results == NULL) {
-			ipfs_cid_free(cid);
-			return 0;
-		}
-		memset(*results, 0, record->value_size + 1);
-		memcpy(*results, record->value, record->value_size);
+	if (ipfs_namesys_resolver_resolve_local(local_node, cid, results)) {
+		ipfs_routing_cache_set((char*)path, *results, &entry);
 		ipfs_cid_free(cid);
 		return 1;
 	}
 
-	//TODO: ask the network
 	ipfs_cid_free(cid);
 	return 0;
 }
 
+/***
+ * Re-resolve a name in the background for the IPNS cache
+ * @param value where to put the results
+ * @param eol when the results are no longer valid (left at 0, the cache decides)
+ * @param key the ipns path
+ * @param context the IpfsNode
+ * @returns 0 on success, otherwise an error code
+ */
+int ipfs_namesys_resolver_refresh(char** value, struct timespec* eol, char* key, void* context) {
+	struct IpfsNode* local_node = (struct IpfsNode*) context;
+	struct Cid* cid = NULL;
+
+	if (!ipfs_cid_decode_hash_from_ipfs_ipns_string(key, &cid))
+		return ErrInvalidParam;
+	int is_local = local_node->identity != NULL && local_node->identity->peer != NULL
+			&& ipfs_namesys_resolver_is_local_name(local_node, cid);
+	int quorum = 0;
+	int found = !is_local && ipfs_namesys_resolver_resolve_network(local_node, cid->hash, cid->hash_length, value, &quorum);
+	// what goes in the cache is served again and again, so it needs a quorum
+	if (found && !quorum) {
+		free(*value);
+		*value = NULL;
+		found = 0;
+	}
+	// our own names, or no agreement on the network
+	if (!found)
+		found = ipfs_namesys_resolver_resolve_local(local_node, cid, value);
+	ipfs_cid_free(cid);
+	return found ? 0 : ErrResolveFailed;
+}
+
 /**
  * Resolve an IPNS name.
  * NOTE: if recursive is set to false, the result could be another ipns path
@@ -66,34 +404,28 @@ int ipfs_namesys_resolver_resolve_once(struct IpfsNode* local_node, const char*
  * @returns true(1) on success, false(0) otherwise
  */
 int ipfs_namesys_resolver_resolve(struct IpfsNode* local_node, const char* path, int recursive, char** results) {
-	char* result = NULL;
-	char* current_path = (char*) malloc(strlen(path) + 1);
-	if (current_path == NULL) {
-		return 0;
-	}
-	strcpy(current_path, path);
-
-	// if we go more than 10 deep, bail
+	char* current_path = NULL;
+	const char* next = path;
 	int counter = 0;
 
 	do {
-		if (counter > 10) {
+		// if we go more than 10 deep, bail
+		if (counter > IPNS_RESOLVE_MAX_DEPTH) {
 			libp2p_logger_error("resolver", "Resolver looped %d times. Infinite loop? Last result: %s.\n", counter, current_path);
 			free(current_path);
 			return 0;
 		}
 		// resolve the current path
-		if (!ipfs_namesys_resolver_resolve_once(local_node, current_path, &result)) {
-			libp2p_logger_error("resolver", "Resolver returned false searching for %s.\n", current_path);
+		char* result = NULL;
+		if (!ipfs_namesys_resolver_resolve_once(local_node, next, &result)) {
+			libp2p_logger_error("resolver", "Resolver returned false searching for %s.\n", next);
 			free(current_path);
 			return 0;
 		}
-		// result will not be NULL
+		// result will not be NULL, and is ours to keep
 		free(current_path);
-		current_path = (char*) malloc(strlen(result)+1);
-		if (current_path != NULL)
-			strcpy(current_path, result);
-		free(result);
+		current_path = result;
+		next = current_path;
 		counter++;
 	} while(recursive && is_ipns_string(current_path));
 
@@ -9,12 +9,20 @@
 #include "cid/cid.h"
 #include "datastore/key.h"
 #include "merkledag/merkledag.h"
+#include "merkledag/walker.h"
+#include "repo/fsrepo/journalstore.h"
+#include "repo/fsrepo/pinindex.h"
+#include "libp2p/utils/vector.h"
 #include "util/errs.h"
 
 // package pin implements structures and methods to keep track of
 // which objects a user wants to keep stored locally.
 
 #define PIN_DATASTOREKEY_SIZE 100
+// the number of journal records added to the pin index at a time
+#define PIN_INDEX_BATCH_SIZE 64
+// the number of threads that load blocks while building the pin index
+#define PIN_INDEX_THREADS 4
 char *pinDatastoreKey = NULL;
 size_t pinDatastoreKeySize = 0;
 
@@ -114,34 +122,266 @@ char *ipfs_pin_pinned_msg (struct Pinned *p)
     return ret;
 }
 
+struct PinChildSearch {
+    unsigned char *child;
+    size_t child_size;
+    int found;
+};
+
+static int ipfs_pin_has_child_visit (const unsigned char *hash, size_t hash_size, void *context)
+{
+    struct PinChildSearch *search = (struct PinChildSearch*) context;
+
+    if ((hash_size == search->child_size) &&
+        (memcmp (hash, search->child, hash_size) == 0)) {
+        search->found = 1;
+        return MERKLEDAG_WALK_STOP;
+    }
+    return MERKLEDAG_WALK_FOLLOW;
+}
+
 // Find out if the child is in the hash.
+// Shared subtrees are only walked once, and deep DAGs do not use up the stack.
 int ipfs_pin_has_child (struct FSRepo *ds,
                         unsigned char *hash,  size_t hash_size,
                         unsigned char *child, size_t child_size)
 {
-    struct HashtableNode *node;
-    struct NodeLink *node_link;
-
-    if (ipfs_merkledag_get (hash, hash_size, &node, ds)) {
-        if (node) {
-            if ((node->hash_size == child_size) &&
-                (memcmp (node->hash, child, child_size) == 0)) {
-                return 1;
+    struct PinChildSearch search;
+
+    search.child = child;
+    search.child_size = child_size;
+    search.found = 0;
+    ipfs_merkledag_walk (ds, hash, hash_size, NULL, 1, ipfs_pin_has_child_visit, &search);
+    return search.found;
+}
+
+// The blocks reached while adding a batch of pinned records to the index.
+struct PinIndexBatch {
+    void *handle;
+    // the blocks walked from. Their links are followed even if they are in the index.
+    struct CidSet *roots;
+    uint8_t **hashes;
+    size_t *hash_sizes;
+    int *direct;
+    int count;
+    int capacity;
+};
+
+static int ipfs_pin_index_batch_add (struct PinIndexBatch *batch, const unsigned char *hash, size_t hash_size, int direct)
+{
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity == 0 ? PIN_INDEX_BATCH_SIZE : batch->capacity * 2;
+        uint8_t **hashes = realloc (batch->hashes, sizeof (uint8_t*) * capacity);
+        if (!hashes) {
+            return 0;
+        }
+        batch->hashes = hashes;
+        size_t *hash_sizes = realloc (batch->hash_sizes, sizeof (size_t) * capacity);
+        if (!hash_sizes) {
+            return 0;
+        }
+        batch->hash_sizes = hash_sizes;
+        int *flags = realloc (batch->direct, sizeof (int) * capacity);
+        if (!flags) {
+            return 0;
+        }
+        batch->direct = flags;
+        batch->capacity = capacity;
+    }
+    batch->hashes[batch->count] = malloc (hash_size);
+    if (!batch->hashes[batch->count]) {
+        return 0;
+    }
+    memcpy (batch->hashes[batch->count], hash, hash_size);
+    batch->hash_sizes[batch->count] = hash_size;
+    batch->direct[batch->count] = direct;
+    batch->count++;
+    return 1;
+}
+
+static void ipfs_pin_index_batch_free (struct PinIndexBatch *batch)
+{
+    ipfs_cid_set_destroy (&batch->roots);
+    for (int i = 0 ; i < batch->count ; i++) {
+        free (batch->hashes[i]);
+    }
+    free (batch->hashes);
+    free (batch->hash_sizes);
+    free (batch->direct);
+}
+
+static int ipfs_pin_index_visit (const unsigned char *hash, size_t hash_size, void *context)
+{
+    struct PinIndexBatch *batch = (struct PinIndexBatch*) context;
+    struct Cid cid;
+
+    if (!lmdb_pinindex_get (batch->handle, hash, hash_size, NULL)) {
+        if (!ipfs_pin_index_batch_add (batch, hash, hash_size, 0)) {
+            return MERKLEDAG_WALK_STOP;
+        }
+        return MERKLEDAG_WALK_FOLLOW;
+    }
+    // already in the index. Everything below it is too, unless it was not
+    // stored when it was reached. Then it is a root now, as its record came in.
+    cid.version = 0;
+    cid.codec = CID_DAG_PROTOBUF;
+    cid.hash = (unsigned char*) hash;
+    cid.hash_length = hash_size;
+    return ipfs_cid_set_has (batch->roots, &cid) ? MERKLEDAG_WALK_FOLLOW : MERKLEDAG_WALK_SKIP;
+}
+
+// Decide what a batch of journal records is walked from: the pinned blocks,
+// and the blocks that were in the index before they were stored, so what they
+// link to was never reached.
+static int ipfs_pin_index_batch_roots (struct PinIndexBatch *batch, struct Libp2pVector *records)
+{
+    struct Cid cid;
+
+    batch->roots = ipfs_cid_set_new ();
+    if (!batch->roots) {
+        return 0;
+    }
+    cid.version = 0;
+    cid.codec = CID_DAG_PROTOBUF;
+    for (int i = 0 ; i < records->total ; i++) {
+        struct JournalRecord *rec = (struct JournalRecord*) libp2p_utils_vector_get (records, i);
+        if (rec->pin || lmdb_pinindex_get (batch->handle, rec->hash, rec->hash_size, NULL)) {
+            cid.hash = rec->hash;
+            cid.hash_length = rec->hash_size;
+            if (ipfs_cid_set_add (batch->roots, &cid, 1) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Add what was pinned since the last update to the pin index, along with
+// everything it links to. Each batch of journal records is added in one
+// transaction, together with the position, so the index is never missing
+// part of what a pinned block links to. A pinned record written before the
+// position (its time was adjusted, or it was pinned later) moves the
+// position back to it, so it is picked up here too.
+// A link to a block that is not stored yet is indexed, and what that block
+// links to is added when its record comes in.
+// NOTE: unpinning is not picked up. Use ipfs_pin_index_rebuild.
+int ipfs_pin_index_update (struct FSRepo *fs_repo)
+{
+    struct JournalRecord *position = NULL;
+    struct Libp2pVector *records = NULL;
+    int retVal = 0;
+
+    if (!fs_repo || !fs_repo->config || !fs_repo->config->datastore) {
+        return 0;
+    }
+    void *handle = fs_repo->config->datastore->datastore_context;
+    if (!lmdb_pinindex_get_position (handle, &position)) {
+        return 0;
+    }
+    for (;;) {
+        if (!lmdb_journalstore_get_records_after (handle, position, PIN_INDEX_BATCH_SIZE, &records)) {
+            goto exit;
+        }
+        if (records->total == 0) {
+            break;
+        }
+        struct PinIndexBatch batch;
+        memset (&batch, 0, sizeof (batch));
+        batch.handle = handle;
+        // the roots are all known before the walker threads start looking at them
+        if (!ipfs_pin_index_batch_roots (&batch, records)) {
+            ipfs_pin_index_batch_free (&batch);
+            goto exit;
+        }
+        struct MerkledagWalker *walker = ipfs_merkledag_walker_new (fs_repo, NULL, PIN_INDEX_THREADS, ipfs_pin_index_visit, &batch);
+        if (!walker) {
+            ipfs_pin_index_batch_free (&batch);
+            goto exit;
+        }
+        struct Cid cid;
+        cid.version = 0;
+        cid.codec = CID_DAG_PROTOBUF;
+        for (int i = 0 ; i < records->total ; i++) {
+            struct JournalRecord *rec = (struct JournalRecord*) libp2p_utils_vector_get (records, i);
+            cid.hash = rec->hash;
+            cid.hash_length = rec->hash_size;
+            if (ipfs_cid_set_has (batch.roots, &cid)) {
+                ipfs_merkledag_walker_add (walker, rec->hash, rec->hash_size);
             }
-            // browse the node links.
-            for (node_link = node->head_link ; node_link ; node_link = node_link->next) {
-                if ((node_link->hash_size == child_size) &&
-                    (memcmp (node_link->hash, child, child_size) != 0) &&
-                     ipfs_pin_has_child (ds, node_link->hash, node_link->hash_size,
-                                             child, child_size)) {
-                    return 1;
-                }
-                if ((node_link->hash_size == child_size) &&
-                    (memcmp (node_link->hash, child, child_size) == 0)) {
-                    return 1; // child is a child of the hash node.
-                }
+        }
+        int walked = ipfs_merkledag_walker_wait (walker);
+        ipfs_merkledag_walker_free (walker);
+        // the pinned blocks themselves go last, so they are stored as direct.
+        for (int i = 0 ; walked && i < records->total ; i++) {
+            struct JournalRecord *rec = (struct JournalRecord*) libp2p_utils_vector_get (records, i);
+            if (rec->pin && !ipfs_pin_index_batch_add (&batch, rec->hash, rec->hash_size, 1)) {
+                walked = 0;
             }
         }
+        struct JournalRecord *last = (struct JournalRecord*) libp2p_utils_vector_get (records, records->total - 1);
+        if (walked) {
+            walked = lmdb_pinindex_add (handle, batch.count, batch.hashes, batch.hash_sizes, batch.direct, position, last);
+        }
+        ipfs_pin_index_batch_free (&batch);
+        if (!walked) {
+            goto exit;
+        }
+        for (int i = 0 ; i < records->total ; i++) {
+            lmdb_journal_record_free ((struct JournalRecord*) libp2p_utils_vector_get (records, i));
+        }
+        libp2p_utils_vector_free (records);
+        records = NULL;
+        // read it again, as a pinned record may have been written before it meanwhile
+        lmdb_journal_record_free (position);
+        if (!lmdb_pinindex_get_position (handle, &position)) {
+            goto exit;
+        }
     }
-    return 0;
+    retVal = 1;
+exit:
+    if (records) {
+        for (int i = 0 ; i < records->total ; i++) {
+            lmdb_journal_record_free ((struct JournalRecord*) libp2p_utils_vector_get (records, i));
+        }
+        libp2p_utils_vector_free (records);
+    }
+    lmdb_journal_record_free (position);
+    return retVal;
+}
+
+// Build the pin index again from the whole journal.
+int ipfs_pin_index_rebuild (struct FSRepo *fs_repo)
+{
+    if (!fs_repo || !fs_repo->config || !fs_repo->config->datastore) {
+        return 0;
+    }
+    if (!lmdb_pinindex_clear (fs_repo->config->datastore->datastore_context)) {
+        return 0;
+    }
+    return ipfs_pin_index_update (fs_repo);
+}
+
+// Find out if a block is pinned, either itself (Recursive) or by something
+// that links to it (Indirect). The index is brought up to date first, which
+// writes to the datastore, and walks whatever was pinned since the last update.
+int ipfs_pin_is_hash_pinned (struct FSRepo *fs_repo,
+                             unsigned char *hash, size_t hash_size,
+                             PinMode *mode)
+{
+    int direct = 0;
+
+    if (mode) {
+        *mode = NotPinned;
+    }
+    // catch up with what was pinned since the last time. Usually there is nothing to do.
+    if (!ipfs_pin_index_update (fs_repo)) {
+        return 0;
+    }
+    if (!lmdb_pinindex_get (fs_repo->config->datastore->datastore_context, hash, hash_size, &direct)) {
+        return 0;
+    }
+    if (mode) {
+        *mode = direct ? Recursive : Indirect;
+    }
+    return 1;
 }
@@ -8,6 +8,7 @@
 #include "repo/config/bootstrap_peers.h"
 #include "repo/config/swarm.h"
 #include "libp2p/db/filestore.h"
+#include "libp2p/net/ratelimit.h"
 #include "multiaddr/multiaddr.h"
 
 /***
@@ -177,7 +178,12 @@ int ipfs_repo_config_init(struct RepoConfig* config, unsigned int num_bits_for_k
 	
 	config->ipns.resolve_cache_size = 128;
 	
-	config->reprovider.interval = "12h";
+	config->reprovider.interval = malloc(4);
+	if (config->reprovider.interval != NULL)
+		strcpy(config->reprovider.interval, "12h");
+	config->reprovider.strategy = malloc(4);
+	if (config->reprovider.strategy != NULL)
+		strcpy(config->reprovider.strategy, "all");
 	
 	config->gateway->root_redirect = "";
 	config->gateway->writable = 0;
@@ -205,6 +211,14 @@ int ipfs_repo_config_new(struct RepoConfig** config) {
 
 	// set initial values
 	(*config)->bootstrap_peers = NULL;
+	(*config)->reprovider.interval = NULL;
+	(*config)->reprovider.strategy = NULL;
+	// a config file without a RateLimit section gets the defaults
+	(*config)->rate_limit.global_rate = RATELIMIT_DEFAULT_GLOBAL_RATE;
+	(*config)->rate_limit.global_burst = RATELIMIT_DEFAULT_GLOBAL_BURST;
+	(*config)->rate_limit.peer_rate = RATELIMIT_DEFAULT_PEER_RATE;
+	(*config)->rate_limit.peer_burst = RATELIMIT_DEFAULT_PEER_BURST;
+	(*config)->rate_limit.max_in_flight = RATELIMIT_DEFAULT_MAX_IN_FLIGHT;
 
 	int retVal = 1;
 	retVal = repo_config_identity_new(&((*config)->identity));
@@ -252,6 +266,8 @@ int ipfs_repo_config_free(struct RepoConfig* config) {
 			repo_config_gateway_free(config->gateway);
 		if (config->replication != NULL)
 			repo_config_replication_free(config->replication);
+		free(config->reprovider.interval);
+		free(config->reprovider.strategy);
 		free(config);
 	}
 	return 1;
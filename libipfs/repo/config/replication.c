@@ -1,10 +1,17 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "multiaddr/multiaddr.h"
 #include "libp2p/utils/linked_list.h"
 #include "libp2p/utils/logger.h"
 #include "repo/config/replication.h"
 
+// where the journal cursors are kept, under the repo directory. One file per peer, named by its id
+#define REPLICATION_CURSOR_DIRECTORY "replication"
+
 /**
  * Allocate a new ReplicationPeer struct
  * @returns the new struct
@@ -14,6 +21,8 @@ struct ReplicationPeer* repo_config_replication_peer_new() {
 	if (rp != NULL) {
 		rp->lastConnect = 0;
 		rp->lastJournalTime = 0;
+		rp->lastJournalHash = NULL;
+		rp->lastJournalHashSize = 0;
 		rp->peer = NULL;
 	}
 	return rp;
@@ -28,11 +37,138 @@ int repo_config_replication_peer_free(struct ReplicationPeer* rp) {
 	if (rp != NULL) {
 		// we allocated the peer structure, so we must remove it
 		libp2p_peer_free(rp->peer);
+		free(rp->lastJournalHash);
 		free(rp);
 	}
 	return 1;
 }
 
+/***
+ * The file the journal cursor of a replication peer is kept in
+ * @param rp the ReplicationPeer
+ * @param repo_path the path to the repo
+ * @param directory true(1) for only the directory the files are in
+ * @returns the path (free it when done), or NULL on error
+ */
+static char* repo_config_replication_cursor_path(const struct ReplicationPeer* rp, const char* repo_path, int directory) {
+	if (rp->peer == NULL || rp->peer->id == NULL || rp->peer->id_size == 0)
+		return NULL;
+	size_t size = strlen(repo_path) + strlen(REPLICATION_CURSOR_DIRECTORY) + rp->peer->id_size + 3;
+	char* path = (char*) malloc(size);
+	if (path == NULL)
+		return NULL;
+	sprintf(path, "%s/%s", repo_path, REPLICATION_CURSOR_DIRECTORY);
+	if (!directory) {
+		size_t pos = strlen(path);
+		path[pos++] = '/';
+		memcpy(&path[pos], rp->peer->id, rp->peer->id_size);
+		path[pos + rp->peer->id_size] = 0;
+		// a peer id is base58, but it came from the config file
+		if (strchr(&path[pos], '/') != NULL || strchr(&path[pos], '.') != NULL) {
+			free(path);
+			return NULL;
+		}
+	}
+	return path;
+}
+
+/***
+ * Save the journal cursor of a replication peer (lastJournalTime and lastJournalHash)
+ * in the repo, so a restart does not send the peer the whole journal again
+ * @param rp the ReplicationPeer
+ * @param repo_path the path to the repo
+ * @returns true(1) on success, false(0) otherwise
+ */
+int repo_config_replication_peer_save(const struct ReplicationPeer* rp, const char* repo_path) {
+	if (rp == NULL || repo_path == NULL)
+		return 0;
+	char* directory = repo_config_replication_cursor_path(rp, repo_path, 1);
+	if (directory == NULL)
+		return 0;
+#ifdef __MINGW32__
+	int rc = mkdir(directory);
+#else
+	int rc = mkdir(directory, S_IRWXU);
+#endif
+	free(directory);
+	if (rc != 0 && errno != EEXIST)
+		return 0;
+	char* path = repo_config_replication_cursor_path(rp, repo_path, 0);
+	if (path == NULL)
+		return 0;
+	char temp_path[strlen(path) + 5];
+	sprintf(temp_path, "%s.tmp", path);
+	FILE* out = fopen(temp_path, "w");
+	if (out == NULL) {
+		free(path);
+		return 0;
+	}
+	// the time, then the hash in hex ("-" if there is none)
+	fprintf(out, "%llu ", rp->lastJournalTime);
+	if (rp->lastJournalHash == NULL || rp->lastJournalHashSize == 0)
+		fprintf(out, "-");
+	for(size_t i = 0; rp->lastJournalHash != NULL && i < rp->lastJournalHashSize; i++)
+		fprintf(out, "%02x", rp->lastJournalHash[i]);
+	fprintf(out, "\n");
+	int retVal = (fclose(out) == 0);
+	// replace the old one in one step, so a crash leaves one or the other
+	if (retVal)
+		retVal = (rename(temp_path, path) == 0);
+	if (!retVal)
+		remove(temp_path);
+	free(path);
+	return retVal;
+}
+
+/***
+ * Load the journal cursor of a replication peer saved by repo_config_replication_peer_save
+ * @param rp the ReplicationPeer (its peer must be set)
+ * @param repo_path the path to the repo
+ * @returns true(1) if it was loaded, false(0) if there was none or it could not be read
+ */
+int repo_config_replication_peer_load(struct ReplicationPeer* rp, const char* repo_path) {
+	unsigned long long timestamp = 0;
+	char hex[257];
+
+	if (rp == NULL || repo_path == NULL)
+		return 0;
+	char* path = repo_config_replication_cursor_path(rp, repo_path, 0);
+	if (path == NULL)
+		return 0;
+	FILE* in = fopen(path, "r");
+	free(path);
+	if (in == NULL)
+		return 0;
+	int fields = fscanf(in, "%llu %256s", &timestamp, hex);
+	fclose(in);
+	if (fields != 2)
+		return 0;
+	uint8_t* hash = NULL;
+	size_t hash_size = 0;
+	if (strcmp(hex, "-") != 0) {
+		size_t hex_size = strlen(hex);
+		if (hex_size % 2 != 0)
+			return 0;
+		hash_size = hex_size / 2;
+		hash = (uint8_t*) malloc(hash_size);
+		if (hash == NULL)
+			return 0;
+		for(size_t i = 0; i < hash_size; i++) {
+			unsigned int byte;
+			if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+				free(hash);
+				return 0;
+			}
+			hash[i] = byte;
+		}
+	}
+	free(rp->lastJournalHash);
+	rp->lastJournalTime = timestamp;
+	rp->lastJournalHash = hash;
+	rp->lastJournalHashSize = hash_size;
+	return 1;
+}
+
 /***
  * allocate memory and initialize the replication struct
  * @param replication a pointer to the struct to be allocated
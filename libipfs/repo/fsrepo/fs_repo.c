@@ -95,6 +95,15 @@ int repo_config_write_config_file(char* full_filename, struct RepoConfig* config
 	fprintf(out_file, "  \"RepublishedPeriod\": \"\",\n");
 	fprintf(out_file, "  \"RecordLifetime\": \"\",\n");
 	fprintf(out_file, "  \"ResolveCacheSize\": %d\n", config->ipns.resolve_cache_size);
+	fprintf(out_file, " },\n \"Reprovider\": {\n");
+	fprintf(out_file, "  \"Interval\": \"%s\",\n", config->reprovider.interval != NULL ? config->reprovider.interval : "12h");
+	fprintf(out_file, "  \"Strategy\": \"%s\"\n", config->reprovider.strategy != NULL ? config->reprovider.strategy : "all");
+	fprintf(out_file, " },\n \"RateLimit\": {\n");
+	fprintf(out_file, "  \"GlobalRate\": %d,\n", config->rate_limit.global_rate);
+	fprintf(out_file, "  \"GlobalBurst\": %d,\n", config->rate_limit.global_burst);
+	fprintf(out_file, "  \"PeerRate\": %d,\n", config->rate_limit.peer_rate);
+	fprintf(out_file, "  \"PeerBurst\": %d,\n", config->rate_limit.peer_burst);
+	fprintf(out_file, "  \"MaxInFlight\": %d\n", config->rate_limit.max_in_flight);
 	fprintf(out_file, " },\n \"Bootstrap\": [\n");
 	for(int i = 0; i < config->bootstrap_peers->total; i++) {
 		const struct MultiAddress* peer = (const struct MultiAddress*)libp2p_utils_vector_get(config->bootstrap_peers, i);
@@ -387,15 +396,16 @@ int fs_repo_open_config(struct FSRepo* repo) {
 	// the next should be the array, then string "PeerID"
 	//NOTE: the code below compares the peer id of the file with the peer id generated
 	// by the key. If they don't match, we fail.
-	unsigned char* test_peer_id = NULL;
-	_get_json_string_value(data, tokens, num_tokens, curr_pos, "PeerID", (char**)&test_peer_id);
-	char* priv_key_base64;
+	// NOTE: written through a char**, so it has to be a char* (strict aliasing)
+	char* test_peer_id = NULL;
+	_get_json_string_value(data, tokens, num_tokens, curr_pos, "PeerID", &test_peer_id);
+	char* priv_key_base64 = NULL;
 	// then PrivKey
 	_get_json_string_value(data, tokens, num_tokens, curr_pos, "PrivKey", &priv_key_base64);
-	retVal = repo_config_identity_build_private_key(repo->config->identity, priv_key_base64);
-	if (retVal == 0
-			|| strlen((char*)test_peer_id) != repo->config->identity->peer->id_size
-			|| strcmp((char*)test_peer_id, repo->config->identity->peer->id) != 0) {
+	retVal = priv_key_base64 != NULL && repo_config_identity_build_private_key(repo->config->identity, priv_key_base64);
+	if (retVal == 0 || test_peer_id == NULL
+			|| strlen(test_peer_id) != repo->config->identity->peer->id_size
+			|| strcmp(test_peer_id, repo->config->identity->peer->id) != 0) {
 		free(data);
 		free(priv_key_base64);
 		free(test_peer_id);
@@ -481,6 +491,33 @@ int fs_repo_open_config(struct FSRepo* repo) {
 		}
 	}
 
+	// reprovider
+	int reprovider_pos = _find_token(data, tokens, num_tokens, 0, "Reprovider");
+	if (reprovider_pos >= 0) {
+		reprovider_pos++;
+		char* val = NULL;
+		if (_get_json_string_value(data, tokens, num_tokens, reprovider_pos, "Interval", &val) && val != NULL) {
+			free(repo->config->reprovider.interval);
+			repo->config->reprovider.interval = val;
+		}
+		val = NULL;
+		if (_get_json_string_value(data, tokens, num_tokens, reprovider_pos, "Strategy", &val) && val != NULL) {
+			free(repo->config->reprovider.strategy);
+			repo->config->reprovider.strategy = val;
+		}
+	}
+
+	// rate limits of inbound requests
+	int rate_limit_pos = _find_token(data, tokens, num_tokens, 0, "RateLimit");
+	if (rate_limit_pos >= 0) {
+		rate_limit_pos++;
+		_get_json_int_value(data, tokens, num_tokens, rate_limit_pos, "GlobalRate", &repo->config->rate_limit.global_rate);
+		_get_json_int_value(data, tokens, num_tokens, rate_limit_pos, "GlobalBurst", &repo->config->rate_limit.global_burst);
+		_get_json_int_value(data, tokens, num_tokens, rate_limit_pos, "PeerRate", &repo->config->rate_limit.peer_rate);
+		_get_json_int_value(data, tokens, num_tokens, rate_limit_pos, "PeerBurst", &repo->config->rate_limit.peer_burst);
+		_get_json_int_value(data, tokens, num_tokens, rate_limit_pos, "MaxInFlight", &repo->config->rate_limit.max_in_flight);
+	}
+
 	// replication
 	curr_pos = _find_token(data, tokens, num_tokens, curr_pos, "Replication");
 	if (curr_pos >= 0) {
@@ -508,6 +545,8 @@ int fs_repo_open_config(struct FSRepo* repo) {
 					multiaddress_free(cur);
 					struct ReplicationPeer* rp = repo_config_replication_peer_new();
 					rp->peer = peer;
+					// where we were in sending them the journal
+					repo_config_replication_peer_load(rp, repo->path);
 					libp2p_logger_debug("fs_repo", "Adding %s to replication_peers.\n", libp2p_peer_id_to_string(rp->peer));
 					libp2p_utils_vector_add(repo->config->replication->replication_peers, rp);
 					free(val);
@@ -709,6 +748,7 @@ int fs_repo_write_config_file(char* path, struct RepoConfig* config) {
 
 /***
  * Write a block to the datastore and blockstore
+ * NOTE: the block is pinned, so the garbage collector keeps it
  * @param block the block to write
  * @param fs_repo the repo to write to
  * @returns true(1) on success
@@ -727,7 +767,7 @@ int ipfs_repo_fsrepo_block_write(struct Block* block, const struct FSRepo* fs_re
 	ipfs_blockstore_free(blockstore);
 	if (retVal == 0)
 		return 0;
-	retVal = ipfs_datastore_helper_add_block_to_datastore(block, fs_repo->config->datastore);
+	retVal = ipfs_datastore_helper_add_block_to_datastore(block, fs_repo->config->datastore, 1);
 	if (retVal == 0)
 		return 0;
 	return 1;
@@ -14,11 +14,14 @@
 #include "libp2p/utils/logger.h"
 #include "libp2p/crypto/encoding/base58.h"
 #include "libp2p/os/utils.h"
+#include "libp2p/utils/vector.h"
 #include "libp2p/db/datastore.h"
 #include "repo/fsrepo/lmdb_datastore.h"
 #include "repo/fsrepo/journalstore.h"
+#include "repo/fsrepo/pinindex.h"
 #include "libp2p/db/datastore.h"
 #include "protobuf/varint.h"
+#include "datastore/ds_helper.h"
 
 /**
  * Build a "value" section for a datastore record
@@ -151,6 +154,243 @@ int repo_fsrepo_lmdb_get(const unsigned char* key, size_t key_size, struct Datas
 	return retVal;
 }
 
+/***
+ * Read a batch of keys from the datastore, in key order
+ * NOTE: Each call uses its own read-only transaction, so nothing is held open
+ * between batches, and writers are never blocked.
+ * @param datastore the datastore
+ * @param after_key start after this key, or NULL to start at the beginning
+ * @param after_key_size the size of after_key
+ * @param max_keys the most keys to return
+ * @param keys where to put the results, a vector of DatastoreRecords with only the key filled in
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more keys
+ */
+int repo_fsrepo_lmdb_get_keys_after(const struct Datastore* datastore, const uint8_t* after_key, size_t after_key_size, int max_keys, struct Libp2pVector** keys) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_cursor* cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	MDB_cursor_op op = MDB_FIRST;
+	int retVal = 0;
+
+	if (datastore == NULL || datastore->datastore_context == NULL || keys == NULL || max_keys <= 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context->db_environment == NULL)
+		return 0;
+
+	*keys = libp2p_utils_vector_new(max_keys);
+	if (*keys == NULL)
+		return 0;
+
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_datastore", "get_keys_after: Unable to begin a transaction.\n");
+		mdb_txn = NULL;
+		goto exit;
+	}
+	if (mdb_cursor_open(mdb_txn, *db_context->datastore_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_datastore", "get_keys_after: Unable to open cursor.\n");
+		cursor = NULL;
+		goto exit;
+	}
+
+	if (after_key != NULL) {
+		db_key.mv_size = after_key_size;
+		db_key.mv_data = (void*)after_key;
+		int rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_SET_RANGE);
+		if (rc == MDB_NOTFOUND) {
+			// nothing after after_key
+			retVal = 1;
+			goto exit;
+		}
+		if (rc != 0)
+			goto exit;
+		// SET_RANGE lands on after_key itself if it is still there
+		if (db_key.mv_size == after_key_size && memcmp(db_key.mv_data, after_key, after_key_size) == 0)
+			op = MDB_NEXT_NODUP;
+		else
+			op = MDB_GET_CURRENT;
+	}
+
+	while ((*keys)->total < max_keys && mdb_cursor_get(cursor, &db_key, &db_value, op) == 0) {
+		struct DatastoreRecord* rec = libp2p_datastore_record_new();
+		if (rec == NULL)
+			goto exit;
+		rec->key = (uint8_t*) malloc(db_key.mv_size);
+		if (rec->key == NULL) {
+			libp2p_datastore_record_free(rec);
+			goto exit;
+		}
+		memcpy(rec->key, db_key.mv_data, db_key.mv_size);
+		rec->key_size = db_key.mv_size;
+		libp2p_utils_vector_add(*keys, rec);
+		op = MDB_NEXT_NODUP;
+	}
+	retVal = 1;
+	exit:
+	if (cursor != NULL)
+		mdb_cursor_close(cursor);
+	if (mdb_txn != NULL)
+		mdb_txn_abort(mdb_txn);
+	if (!retVal) {
+		for(int i = 0; i < (*keys)->total; i++)
+			libp2p_datastore_record_free((struct DatastoreRecord*) libp2p_utils_vector_get(*keys, i));
+		libp2p_utils_vector_free(*keys);
+		*keys = NULL;
+	}
+	return retVal;
+}
+
+/***
+ * See which of several keys are in the datastore, and when they were stored,
+ * with one read-only transaction for all of them
+ * @param datastore the datastore
+ * @param num_keys the number of keys
+ * @param keys the keys to look for
+ * @param key_sizes the size of each key
+ * @param found where to put true(1) for each key found, false(0) otherwise
+ * @param timestamps where to put the timestamp of each key found
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_get_timestamps(const struct Datastore* datastore, int num_keys, uint8_t** keys, size_t* key_sizes, int* found, unsigned long long* timestamps) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+
+	if (datastore == NULL || datastore->datastore_context == NULL || num_keys < 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context->db_environment == NULL)
+		return 0;
+
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_datastore", "get_timestamps: Unable to begin a transaction.\n");
+		return 0;
+	}
+	for(int i = 0; i < num_keys; i++) {
+		found[i] = 0;
+		timestamps[i] = 0;
+		db_key.mv_size = key_sizes[i];
+		db_key.mv_data = keys[i];
+		if (mdb_get(mdb_txn, *db_context->datastore_db, &db_key, &db_value) == 0) {
+			size_t varint_size = 0;
+			found[i] = 1;
+			timestamps[i] = varint_decode(db_value.mv_data, db_value.mv_size, &varint_size);
+		}
+	}
+	mdb_txn_abort(mdb_txn);
+	return 1;
+}
+
+/***
+ * Delete a batch of blocks from the datastore, along with their journal records,
+ * in one transaction.
+ * NOTE: Only records that point at a block (their value is the base32 of their key)
+ * are deleted, and only if they were stored before "before". A block stored (or
+ * stored again) since then is left alone.
+ * @param datastore the datastore
+ * @param num_keys the number of keys
+ * @param keys the keys to delete
+ * @param key_sizes the size of each key
+ * @param before only delete records stored before this time
+ * @param deleted where to put true(1) for each key deleted, false(0) otherwise
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_delete_blocks(const struct Datastore* datastore, int num_keys, uint8_t** keys, size_t* key_sizes, unsigned long long before,
+		int (*proceed)(void* context), void* context, int* deleted) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	MDB_val journal_key;
+	struct JournalRecord journal_record;
+	uint8_t block_key[100];
+	size_t block_key_size = 0;
+	int retVal = 0;
+
+	if (datastore == NULL || datastore->datastore_context == NULL || num_keys < 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context->db_environment == NULL)
+		return 0;
+
+	for(int i = 0; i < num_keys; i++)
+		deleted[i] = 0;
+
+	if (mdb_txn_begin(db_context->db_environment, NULL, 0, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_datastore", "delete_blocks: Unable to begin a transaction.\n");
+		return 0;
+	}
+	// no put can commit while this transaction is open
+	if (proceed != NULL && !proceed(context)) {
+		mdb_txn_abort(mdb_txn);
+		return 1;
+	}
+	for(int i = 0; i < num_keys; i++) {
+		db_key.mv_size = key_sizes[i];
+		db_key.mv_data = keys[i];
+		if (mdb_get(mdb_txn, *db_context->datastore_db, &db_key, &db_value) != 0)
+			continue;
+		size_t varint_size = 0;
+		unsigned long long timestamp = varint_decode(db_value.mv_data, db_value.mv_size, &varint_size);
+		if (timestamp >= before)
+			continue;
+		// is it a block?
+		block_key_size = sizeof(block_key);
+		if (!ipfs_datastore_helper_ds_key_from_binary(keys[i], key_sizes[i], block_key, block_key_size, &block_key_size))
+			continue;
+		if (db_value.mv_size - varint_size != block_key_size || memcmp((uint8_t*)db_value.mv_data + varint_size, block_key, block_key_size) != 0)
+			continue;
+		if (mdb_del(mdb_txn, *db_context->datastore_db, &db_key, NULL) != 0)
+			goto exit;
+		deleted[i] = 1;
+		// the journal record is keyed by the same timestamp
+		journal_record.timestamp = timestamp;
+		journal_record.hash = keys[i];
+		journal_record.hash_size = key_sizes[i];
+		if (!lmdb_journalstore_generate_key(&journal_record, &journal_key))
+			goto exit;
+		int rc = mdb_del(mdb_txn, *db_context->journal_db, &journal_key, NULL);
+		free(journal_key.mv_data);
+		if (rc != 0 && rc != MDB_NOTFOUND)
+			goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (retVal) {
+		if (mdb_txn_commit(mdb_txn) != 0) {
+			libp2p_logger_error("lmdb_datastore", "delete_blocks: transaction commit failed.\n");
+			retVal = 0;
+		}
+	} else {
+		mdb_txn_abort(mdb_txn);
+	}
+	if (!retVal) {
+		for(int i = 0; i < num_keys; i++)
+			deleted[i] = 0;
+	}
+	return retVal;
+}
+
+/***
+ * Wait for the put in progress, if any, to commit
+ * @param datastore the datastore
+ * @returns true(1) on success, false(0) on error
+ */
+int repo_fsrepo_lmdb_wait_for_puts(const struct Datastore* datastore) {
+	MDB_txn* mdb_txn = NULL;
+
+	if (datastore == NULL || datastore->datastore_context == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context->db_environment == NULL)
+		return 0;
+	// there is only one writer at a time, so this waits for it
+	if (mdb_txn_begin(db_context->db_environment, NULL, 0, &mdb_txn) != 0)
+		return 0;
+	mdb_txn_abort(mdb_txn);
+	return 1;
+}
+
 /**
  * Open the database and create a new transaction
  * @param mdb_env the database handle
@@ -225,9 +465,12 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 			return 0;
 		}
 		memcpy(journalstore_record->hash, datastore_record->key, datastore_record->key_size);
-		journalstore_record->timestamp = datastore_record->timestamp;
+		journalstore_record->timestamp = existingRecord->timestamp;
 		// look up the corresponding journalstore record for possible updating
-		lmdb_journalstore_get_record(db_context, journalstore_cursor, &journalstore_record);
+		if (!lmdb_journalstore_get_record(db_context, journalstore_cursor, &journalstore_record)) {
+			lmdb_journal_record_free(journalstore_record);
+			journalstore_record = NULL;
+		}
 	}
 
 	// Put in the timestamp if it isn't there already (or is newer)
@@ -257,13 +500,21 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 	if (retVal == 0) {
 		// Successfully added the datastore record. Now work with the journalstore.
 		if (journalstore_record != NULL) {
-			if (journalstore_record->timestamp != datastore_record->timestamp) {
-				// we need to update
+			// a put can pin what is already there, but never unpin it
+			int pin = journalstore_record->pin || datastore_record->pin;
+			if (journalstore_record->timestamp != datastore_record->timestamp || journalstore_record->pin != pin) {
+				// we need to update. The timestamp is part of the key, so move it.
+				lmdb_journalstore_cursor_delete(journalstore_cursor);
 				journalstore_record->timestamp = datastore_record->timestamp;
+				journalstore_record->pin = pin;
 				retVal = lmdb_journalstore_cursor_put(journalstore_cursor, journalstore_record);
-				lmdb_journalstore_cursor_close(journalstore_cursor, 0);
-				lmdb_journal_record_free(journalstore_record);
+				if (retVal && pin && !lmdb_pinindex_rewind(child_transaction, db_context, journalstore_record))
+					libp2p_logger_error("lmdb_datastore", "put: Unable to move the pin index back. Continuing.\n");
+			} else {
+				retVal = 1;
 			}
+			lmdb_journalstore_cursor_close(journalstore_cursor, 0);
+			lmdb_journal_record_free(journalstore_record);
 		} else {
 			// add it to the journalstore
 			journalstore_record = lmdb_journal_record_new();
@@ -277,9 +528,11 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 				journalstore_record->hash_size = datastore_record->key_size;
 				journalstore_record->timestamp = datastore_record->timestamp;
 				journalstore_record->pending = 1; // TODO: Calculate this correctly
-				journalstore_record->pin = 1;
+				journalstore_record->pin = datastore_record->pin;
 				if (!lmdb_journalstore_journal_add(journalstore_cursor, journalstore_record)) {
 					libp2p_logger_error("lmdb_datastore", "Datastore record was added, but problem adding Journalstore record. Continuing.\n");
+				} else if (journalstore_record->pin && !lmdb_pinindex_rewind(child_transaction, db_context, journalstore_record)) {
+					libp2p_logger_error("lmdb_datastore", "put: Unable to move the pin index back. Continuing.\n");
 				}
 				lmdb_journalstore_cursor_close(journalstore_cursor, 0);
 				lmdb_journal_record_free(journalstore_record);
@@ -288,6 +541,8 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 		}
 	} else {
 		// datastore record was unable to be added.
+		lmdb_journalstore_cursor_close(journalstore_cursor, 0);
+		lmdb_journal_record_free(journalstore_record);
 		if (retVal == MDB_KEYEXIST) {
 			// duplicate key.. Is this an error?
 		} else {
@@ -296,9 +551,16 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 		}
 	}
 
+	// tell the garbage collector before it can see the record, so a run in progress keeps it
+	// (a put of something already there keeps its old timestamp, so the run would not know it is new)
+	if (retVal && datastore_record->pin && db_context->pin_listener != NULL)
+		db_context->pin_listener(datastore_record->key, datastore_record->key_size, db_context->pin_listener_context);
+
 	// cleanup
 	if (mdb_txn_commit(child_transaction) != 0) {
 		libp2p_logger_error("lmdb_datastore", "lmdb_put: transaction commit failed.\n");
+	} else if (retVal && datastore->datastore_put_listener != NULL) {
+		datastore->datastore_put_listener(datastore_record->key, datastore_record->key_size, datastore->datastore_put_listener_context);
 	}
 	free(record);
 	libp2p_datastore_record_free(existingRecord);
@@ -321,8 +583,8 @@ int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore) {
 		return 0;
 	}
 
-	// at most, 2 databases will be opened. The datastore and the journal.
-	MDB_dbi dbs = 2;
+	// at most, 4 databases will be opened. The datastore, the journal, the pin index, and the old journal (to migrate it)
+	MDB_dbi dbs = 4;
 	if (mdb_env_set_maxdbs(mdb_env, dbs) != 0) {
 		mdb_env_close(mdb_env);
 		return 0;
@@ -341,6 +603,8 @@ int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore) {
 	}
 	datastore->datastore_context = (void*) db_context;
 	db_context->db_environment = (void*)mdb_env;
+	db_context->pin_listener = NULL;
+	db_context->pin_listener_context = NULL;
 	db_context->datastore_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
 	if (db_context->datastore_db == NULL) {
 		mdb_env_close(mdb_env);
@@ -354,8 +618,16 @@ int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore) {
 		mdb_env_close(mdb_env);
 		return 0;
 	}
+	db_context->pinindex_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
+	if (db_context->pinindex_db == NULL) {
+		free(db_context->journal_db);
+		free(db_context->datastore_db);
+		free(db_context);
+		mdb_env_close(mdb_env);
+		return 0;
+	}
 
-	// open the 2 databases
+	// open the databases
 	if (mdb_txn_begin(mdb_env, NULL, 0, &db_context->current_transaction) != 0) {
 		mdb_env_close(mdb_env);
 		db_context->db_environment = NULL;
@@ -367,7 +639,19 @@ int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore) {
 		db_context->db_environment = NULL;
 		return 0;
 	}
-	if (mdb_dbi_open(db_context->current_transaction, "JOURNALSTORE", MDB_DUPSORT | MDB_CREATE, db_context->journal_db) != 0) {
+	if (mdb_dbi_open(db_context->current_transaction, JOURNALSTORE_TABLE, MDB_CREATE, db_context->journal_db) != 0) {
+		mdb_txn_abort(db_context->current_transaction);
+		mdb_env_close(mdb_env);
+		db_context->db_environment = NULL;
+		return 0;
+	}
+	if (mdb_dbi_open(db_context->current_transaction, PININDEX_TABLE, MDB_CREATE, db_context->pinindex_db) != 0) {
+		mdb_txn_abort(db_context->current_transaction);
+		mdb_env_close(mdb_env);
+		db_context->db_environment = NULL;
+		return 0;
+	}
+	if (!lmdb_journalstore_migrate(db_context->current_transaction, *db_context->journal_db)) {
 		mdb_txn_abort(db_context->current_transaction);
 		mdb_env_close(mdb_env);
 		db_context->db_environment = NULL;
@@ -397,6 +681,7 @@ int repo_fsrepo_lmdb_close(struct Datastore* datastore) {
 
 	free(db_context->datastore_db);
 	free(db_context->journal_db);
+	free(db_context->pinindex_db);
 
 	free(db_context);
 
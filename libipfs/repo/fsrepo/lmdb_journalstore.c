@@ -7,6 +7,7 @@
 #include "libp2p/crypto/encoding/base58.h"
 #include "repo/fsrepo/journalstore.h"
 #include "repo/fsrepo/lmdb_datastore.h"
+#include "libp2p/utils/vector.h"
 
 struct JournalRecord* lmdb_journal_record_new() {
 	struct JournalRecord* rec = (struct JournalRecord*) malloc(sizeof(struct JournalRecord));
@@ -30,40 +31,57 @@ int lmdb_journal_record_free(struct JournalRecord* rec) {
 	return 1;
 }
 
+/***
+ * Build the lmdb key of a journal record. The key is the timestamp as
+ * JOURNALSTORE_TIMESTAMP_SIZE big endian bytes, followed by the hash, so
+ * lmdb keeps the records in time order.
+ * NOTE: the caller must free db_key->mv_data
+ * @param journal_record the record
+ * @param db_key where to store the key information
+ * @returns true(1) on success, false(0) otherwise
+ */
 int lmdb_journalstore_generate_key(const struct JournalRecord* journal_record, struct MDB_val *db_key) {
-	// build the key
-	uint8_t time_varint[8];
-	size_t time_varint_size = 0;
-	varint_encode(journal_record->timestamp, &time_varint[0], 8, &time_varint_size);
-
-	db_key->mv_size = time_varint_size;
-	db_key->mv_data = time_varint;
+	size_t key_size = JOURNALSTORE_TIMESTAMP_SIZE + journal_record->hash_size;
+	uint8_t* key = (uint8_t*) malloc(key_size);
+	if (key == NULL)
+		return 0;
+	unsigned long long timestamp = journal_record->timestamp;
+	for(int i = JOURNALSTORE_TIMESTAMP_SIZE - 1; i >= 0; i--) {
+		key[i] = timestamp & 0xff;
+		timestamp >>= 8;
+	}
+	if (journal_record->hash_size > 0)
+		memcpy(&key[JOURNALSTORE_TIMESTAMP_SIZE], journal_record->hash, journal_record->hash_size);
+	db_key->mv_data = key;
+	db_key->mv_size = key_size;
 	return 1;
 }
 
 /***
  * Convert the JournalRec struct into a lmdb key and lmdb value
+ * NOTE: the caller must free db_key->mv_data and db_value->mv_data
  * @param journal_record the record to convert
  * @param db_key where to store the key information
  * @param db_value where to store the value information
  */
 int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, struct MDB_val* db_key, struct MDB_val *db_value) {
-	// build the record, which is a timestamp as a key
-
 	// build the key
-	lmdb_journalstore_generate_key(journal_record, db_key);
+	if (!lmdb_journalstore_generate_key(journal_record, db_key))
+		return 0;
 
 	// build the value
-	size_t record_size = journal_record->hash_size + 2;
-	uint8_t record[record_size];
+	uint8_t *record = (uint8_t*) malloc(2);
+	if (record == NULL) {
+		free(db_key->mv_data);
+		db_key->mv_data = NULL;
+		return 0;
+	}
 	// Field 1: pin flag
 	record[0] = journal_record->pin;
 	// Field 2: pending flag
 	record[1] = journal_record->pending;
-	// field 3: hash
-	memcpy(&record[2], journal_record->hash, journal_record->hash_size);
 
-	db_value->mv_size = record_size;
+	db_value->mv_size = 2;
 	db_value->mv_data = record;
 
 	return 1;
@@ -77,6 +95,10 @@ int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_r
  * @reutrns true(1) on success, false(0) on error
  */
 int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MDB_val *db_value, struct JournalRecord **journal_record) {
+	if (db_key->mv_size < JOURNALSTORE_TIMESTAMP_SIZE || db_value->mv_size < 2) {
+		libp2p_logger_error("lmdb_journalstore", "build_record: Invalid journalstore record.\n");
+		return 0;
+	}
 	if (*journal_record == NULL) {
 		*journal_record = lmdb_journal_record_new();
 		if (*journal_record == NULL) {
@@ -86,9 +108,11 @@ int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MD
 	}
 
 	struct JournalRecord *rec = *journal_record;
+	uint8_t* key = (uint8_t*)db_key->mv_data;
 	// timestamp
-	size_t varint_size = 0;
-	rec->timestamp = varint_decode(db_key->mv_data, db_key->mv_size, &varint_size);
+	rec->timestamp = 0;
+	for(int i = 0; i < JOURNALSTORE_TIMESTAMP_SIZE; i++)
+		rec->timestamp = (rec->timestamp << 8) | key[i];
 	// pin flag
 	rec->pin = ((uint8_t*)db_value->mv_data)[0];
 	// pending flag
@@ -99,18 +123,83 @@ int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MD
 		rec->hash = NULL;
 		rec->hash_size = 0;
 	}
-	rec->hash_size = db_value->mv_size - 2;
+	rec->hash_size = db_key->mv_size - JOURNALSTORE_TIMESTAMP_SIZE;
 	rec->hash = malloc(rec->hash_size);
 	if (rec->hash != NULL) {
-		uint8_t *val = (uint8_t*)db_value->mv_data;
-		memcpy(rec->hash, &val[2], rec->hash_size);
+		memcpy(rec->hash, &key[JOURNALSTORE_TIMESTAMP_SIZE], rec->hash_size);
 	} else {
+		rec->hash_size = 0;
 		return 0;
 	}
 
 	return 1;
 }
 
+/***
+ * Move the journal from JOURNALSTORE_OLD_TABLE, which was keyed by the
+ * varint of the timestamp (that does not sort in time order), to
+ * JOURNALSTORE_TABLE. The old table is dropped when done.
+ * NOTE: Does nothing if there is no old table
+ * @param mdb_txn the transaction to do it in
+ * @param journal_db the new table
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_migrate(struct MDB_txn* mdb_txn, MDB_dbi journal_db) {
+	MDB_dbi old_db;
+	MDB_cursor* cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int count = 0;
+
+	int rc = mdb_dbi_open(mdb_txn, JOURNALSTORE_OLD_TABLE, MDB_DUPSORT, &old_db);
+	if (rc == MDB_NOTFOUND)
+		return 1;
+	if (rc != 0) {
+		libp2p_logger_error("lmdb_journalstore", "migrate: Unable to open the old journal.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(mdb_txn, old_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "migrate: Unable to open cursor.\n");
+		return 0;
+	}
+	rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_FIRST);
+	while (rc == 0) {
+		// old key: varint timestamp. old value: pin, pending, hash
+		if (db_value.mv_size >= 2) {
+			struct JournalRecord rec;
+			size_t varint_size = 0;
+			MDB_val new_key;
+			MDB_val new_value;
+			rec.timestamp = varint_decode(db_key.mv_data, db_key.mv_size, &varint_size);
+			rec.pin = ((uint8_t*)db_value.mv_data)[0];
+			rec.pending = ((uint8_t*)db_value.mv_data)[1];
+			rec.hash = &((uint8_t*)db_value.mv_data)[2];
+			rec.hash_size = db_value.mv_size - 2;
+			if (!lmdb_journalstore_build_key_value_pair(&rec, &new_key, &new_value)) {
+				mdb_cursor_close(cursor);
+				return 0;
+			}
+			rc = mdb_put(mdb_txn, journal_db, &new_key, &new_value, 0);
+			free(new_key.mv_data);
+			free(new_value.mv_data);
+			if (rc != 0) {
+				libp2p_logger_error("lmdb_journalstore", "migrate: Put failed with error %d.\n", rc);
+				mdb_cursor_close(cursor);
+				return 0;
+			}
+			count++;
+		}
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT);
+	}
+	mdb_cursor_close(cursor);
+	if (rc != MDB_NOTFOUND || mdb_drop(mdb_txn, old_db, 1) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "migrate: Unable to finish the migration.\n");
+		return 0;
+	}
+	libp2p_logger_debug("lmdb_journalstore", "Migrated %d journal records.\n", count);
+	return 1;
+}
+
 /***
  * Write a journal record
  * @param mbd_txn the transaction
@@ -136,7 +225,10 @@ int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor,
 		createdTransaction = 1;
 	}
 
-	if (mdb_put(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, &journalstore_value, 0) != 0) {
+	int put_result = mdb_put(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, &journalstore_value, 0);
+	free(journalstore_key.mv_data);
+	free(journalstore_value.mv_data);
+	if (put_result != 0) {
 		libp2p_logger_error("lmdb_journalstore", "Unable to add to JOURNALSTORE database.\n");
 		return 0;
 	}
@@ -154,7 +246,7 @@ int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor,
 /***
  * Attempt to get a specific record identified by its timestamp and bytes
  * @param handle a handle to the database engine
- * @param journalstore_cursor the cursor (will be returned as a cursor that points to the record found)
+ * @param journalstore_cursor the cursor (will be returned as a cursor that points to the record found, so it can be deleted)
  * @param journalstore_record where to put the results (can pass null). If data is within the struct, will use it as search criteria
  * @returns true(1) on success, false(0) otherwise
  */
@@ -181,13 +273,28 @@ int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journal
 			return 0;
 		}
 	}
-	// search for the timestamp
-	if (!lmdb_journalstore_cursor_get(journalstore_cursor, CURSOR_FIRST, journalstore_record)) {
-		libp2p_logger_debug("lmdb_journalstore", "Unable to find any records in table.\n");
-		return 0;
+	if (*journalstore_record == NULL || (*journalstore_record)->hash_size == 0) {
+		// nothing to search for, so return the first one
+		if (!lmdb_journalstore_cursor_get(journalstore_cursor, CURSOR_FIRST, journalstore_record)) {
+			libp2p_logger_debug("lmdb_journalstore", "Unable to find any records in table.\n");
+			return 0;
+		}
+		return 1;
 	}
 
-	return 1;
+	// search for the timestamp and hash
+	MDB_val db_key;
+	MDB_val db_value;
+	if (!lmdb_journalstore_generate_key(*journalstore_record, &db_key))
+		return 0;
+	void* key_data = db_key.mv_data;
+	int rc = mdb_cursor_get(journalstore_cursor->cursor, &db_key, &db_value, MDB_SET_KEY);
+	free(key_data);
+	if (rc != 0) {
+		libp2p_logger_debug("lmdb_journalstore", "get_record: Record not found.\n");
+		return 0;
+	}
+	return lmdb_journalstore_build_record(&db_key, &db_value, journalstore_record);
 }
 
 /**
@@ -237,39 +344,11 @@ int lmdb_journalstore_cursor_open(void *handle, struct lmdb_trans_cursor **crsr,
 
 }
 
-int lmdb_journalstore_composite_key_compare(struct JournalRecord *a, struct JournalRecord *b) {
-	if (a == NULL && b == NULL)
-		return 0;
-	if (a == NULL && b != NULL)
-		return 1;
-	if (a != NULL && b == NULL)
-		return -1;
-	if (a->timestamp != b->timestamp) {
-		if (a->timestamp > b->timestamp)
-			return -1;
-		else
-			return 1;
-	}
-	if (a->hash_size != b->hash_size) {
-		if (a->hash_size > b->hash_size)
-			return -1;
-		else
-			return 1;
-	}
-	for(int i = 0; i < a->hash_size; i++) {
-		if (a->hash[i] != b->hash[i]) {
-			return b->hash[i] - a->hash[i];
-		}
-	}
-	return 0;
-}
-
 /**
- * Read a record from the cursor. If (record) contains a key, it will look for the exact record.
- * If not, it will return the first matching record.
+ * Read a record from the cursor, in key (time) order
  * @param crsr the lmdb_trans_cursor
  * @param op the cursor operation (i.e. CURSOR_FIRST, CURSOR_NEXT, CURSOR_LAST, CURSOR_PREVIOUS)
- * @param record the record (will allocate a new one if *record is NULL)
+ * @param record the record (will allocate a new one if *record is NULL, otherwise it is overwritten)
  * @returns true(1) if something was found, false(0) otherwise)
  */
 int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *tc, enum DatastoreCursorOp op, struct JournalRecord** record) {
@@ -287,10 +366,6 @@ int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *tc, enum DatastoreCur
 		else if (op == CURSOR_PREVIOUS)
 			co = MDB_PREV;
 
-		if (*record != NULL) {
-			lmdb_journalstore_generate_key(*record, &mdb_key);
-		}
-
 		int retVal = mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, co);
 		if (retVal != 0) {
 			if (retVal == MDB_NOTFOUND) {
@@ -301,52 +376,52 @@ int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *tc, enum DatastoreCur
 			return 0;
 		}
 
-		if (*record == NULL) {
-			// make a new record and pass it back
-			if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, record))
-				return 0;
-			return 1;
-		}
-
-		// see if the passed in record has a specific record in mind (take care of duplicate keys)
-		if ( (*record)->hash_size > 0) {
-			struct JournalRecord* curr_record = NULL;
-			if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, &curr_record)) {
-				libp2p_logger_error("lmdb_journalstore", "Unable to convert journalstore record into a JournalRecord struct.\n");
-				return 0;
-			}
-			// we are looking for a specific record. Flip through the records looking for the exact record
-			while (lmdb_journalstore_composite_key_compare(*record, curr_record) != 0) {
-				if ( (*record)->timestamp != curr_record->timestamp) {
-					//we've exhausted all records for this timestamp. Exit.
-					lmdb_journal_record_free(curr_record);
-					curr_record = NULL;
-					break;
-				}
-				// we did not find the exact record. Skip to the next one
-				lmdb_journal_record_free(curr_record);
-				curr_record = NULL;
-				mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, MDB_NEXT);
-				if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, &curr_record)) {
-					libp2p_logger_error("lmdb_journalstore", "Unable to convert journalstore record into a JournalRecord struct.\n");
-					return 0;
-				}
-			}
-			if (curr_record != NULL) {
-				// we found the exact record. merge it into the *record
-				(*record)->pending = curr_record->pending;
-				(*record)->pin = curr_record->pin;
-				lmdb_journal_record_free(curr_record);
-				return 1;
-			}
-		} else {
-			// we're not looking for any particular record. Return the first one found.
-			return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
-		}
+		return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
 	}
 	return 0;
 }
 
+/***
+ * Move the cursor to the first record at or after a time
+ * @param tc the cursor
+ * @param timestamp the time
+ * @param record where to put the record found (will allocate a new one if *record is NULL)
+ * @returns true(1) if a record was found, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_seek(struct lmdb_trans_cursor *tc, unsigned long long timestamp, struct JournalRecord** record) {
+	if (tc == NULL || tc->cursor == NULL)
+		return 0;
+	struct JournalRecord start;
+	MDB_val mdb_key;
+	MDB_val mdb_value;
+	start.timestamp = timestamp;
+	start.hash = NULL;
+	start.hash_size = 0;
+	if (!lmdb_journalstore_generate_key(&start, &mdb_key))
+		return 0;
+	void* key_data = mdb_key.mv_data;
+	int retVal = mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, MDB_SET_RANGE);
+	free(key_data);
+	if (retVal != 0)
+		return 0;
+	return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
+}
+
+/***
+ * Delete the record the cursor points to
+ * @param tc the cursor
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_delete(struct lmdb_trans_cursor *tc) {
+	if (tc == NULL || tc->cursor == NULL)
+		return 0;
+	if (mdb_cursor_del(tc->cursor, 0) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "Unable to delete journalstore record.\n");
+		return 0;
+	}
+	return 1;
+}
+
 /***
  * Write the record at the cursor
  * @param crsr the cursor
@@ -363,6 +438,8 @@ int lmdb_journalstore_cursor_put(struct lmdb_trans_cursor *crsr, struct JournalR
 		return 0;
 	}
 	int retVal = mdb_cursor_put(cursor, &db_key, &db_value, 0);
+	free(db_key.mv_data);
+	free(db_value.mv_data);
 	if (retVal != 0) {
 		char* result = "";
 		switch (retVal) {
@@ -405,3 +482,153 @@ int lmdb_journalstore_cursor_close(struct lmdb_trans_cursor *cursor, int commitT
 	}
 	return 1;
 }
+
+/***
+ * Read a batch of journal records in key (time) order, starting at a key
+ * @param handle a handle to the database (the datastore context)
+ * @param start the record to start at (only the timestamp and hash are used)
+ * @param skip_start true(1) to skip the record at start if it is there
+ * @param max_records the most records to return
+ * @param records where to put the results, a vector of JournalRecords
+ * @returns true(1) on success, false(0) on error
+ */
+static int lmdb_journalstore_read_batch(void* handle, const struct JournalRecord* start, int skip_start, int max_records, struct Libp2pVector** records) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_cursor* cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	MDB_val start_key;
+	MDB_cursor_op op = MDB_SET_RANGE;
+	int retVal = 0;
+
+	if (handle == NULL || records == NULL || max_records <= 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+
+	if (!lmdb_journalstore_generate_key(start, &start_key))
+		return 0;
+
+	*records = libp2p_utils_vector_new(max_records);
+	if (*records == NULL) {
+		free(start_key.mv_data);
+		return 0;
+	}
+
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "read_batch: Unable to begin a transaction.\n");
+		mdb_txn = NULL;
+		goto exit;
+	}
+	if (mdb_cursor_open(mdb_txn, *db_context->journal_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "read_batch: Unable to open cursor.\n");
+		cursor = NULL;
+		goto exit;
+	}
+
+	db_key = start_key;
+	int rc = mdb_cursor_get(cursor, &db_key, &db_value, op);
+	if (rc == 0 && skip_start && db_key.mv_size == start_key.mv_size && memcmp(db_key.mv_data, start_key.mv_data, start_key.mv_size) == 0)
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT);
+	while (rc == 0 && (*records)->total < max_records) {
+		struct JournalRecord* rec = NULL;
+		if (!lmdb_journalstore_build_record(&db_key, &db_value, &rec)) {
+			lmdb_journal_record_free(rec);
+			goto exit;
+		}
+		libp2p_utils_vector_add(*records, rec);
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT);
+	}
+	if (rc != 0 && rc != MDB_NOTFOUND)
+		goto exit;
+	retVal = 1;
+	exit:
+	free(start_key.mv_data);
+	if (cursor != NULL)
+		mdb_cursor_close(cursor);
+	if (mdb_txn != NULL)
+		mdb_txn_abort(mdb_txn);
+	if (!retVal) {
+		for(int i = 0; i < (*records)->total; i++)
+			lmdb_journal_record_free((struct JournalRecord*) libp2p_utils_vector_get(*records, i));
+		libp2p_utils_vector_free(*records);
+		*records = NULL;
+	}
+	return retVal;
+}
+
+/***
+ * Read a batch of journal records, in the order they are stored
+ * NOTE: Each call uses its own read-only transaction, so nothing is held open
+ * between batches, and writers are never blocked.
+ * @param handle a handle to the database (the datastore context)
+ * @param after start after this record, or NULL to start at the beginning
+ * @param max_records the most records to return
+ * @param records where to put the results, a vector of JournalRecords
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more records
+ */
+int lmdb_journalstore_get_records_after(void* handle, const struct JournalRecord* after, int max_records, struct Libp2pVector** records) {
+	if (after == NULL)
+		return lmdb_journalstore_get_records_since(handle, 0, max_records, records);
+	return lmdb_journalstore_read_batch(handle, after, 1, max_records, records);
+}
+
+/***
+ * Read a batch of the journal records at or after a time, in time order.
+ * Use lmdb_journalstore_get_records_after with the last record for the next batch.
+ * @param handle a handle to the database (the datastore context)
+ * @param timestamp the time to start at
+ * @param max_records the most records to return
+ * @param records where to put the results, a vector of JournalRecords
+ * @returns true(1) on success, false(0) on error. An empty vector means there are no more records
+ */
+int lmdb_journalstore_get_records_since(void* handle, unsigned long long timestamp, int max_records, struct Libp2pVector** records) {
+	struct JournalRecord start;
+	start.timestamp = timestamp;
+	start.hash = NULL;
+	start.hash_size = 0;
+	return lmdb_journalstore_read_batch(handle, &start, 0, max_records, records);
+}
+
+/***
+ * Get the time of the newest journal record
+ * @param handle a handle to the database (the datastore context)
+ * @param timestamp where to put the time, 0 if the journal is empty
+ * @returns true(1) on success, false(0) on error
+ */
+int lmdb_journalstore_get_last_timestamp(void* handle, unsigned long long* timestamp) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_cursor* cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	*timestamp = 0;
+	if (handle == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "get_last_timestamp: Unable to begin a transaction.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(mdb_txn, *db_context->journal_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "get_last_timestamp: Unable to open cursor.\n");
+		mdb_txn_abort(mdb_txn);
+		return 0;
+	}
+	int rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_LAST);
+	if (rc == 0 && db_key.mv_size >= JOURNALSTORE_TIMESTAMP_SIZE) {
+		uint8_t* key = (uint8_t*)db_key.mv_data;
+		for(int i = 0; i < JOURNALSTORE_TIMESTAMP_SIZE; i++)
+			*timestamp = (*timestamp << 8) | key[i];
+		retVal = 1;
+	} else if (rc == MDB_NOTFOUND) {
+		retVal = 1;
+	}
+	mdb_cursor_close(cursor);
+	mdb_txn_abort(mdb_txn);
+	return retVal;
+}
@@ -0,0 +1,240 @@
+#include <string.h>
+
+#include "lmdb.h"
+#include "libp2p/utils/logger.h"
+#include "repo/fsrepo/pinindex.h"
+#include "repo/fsrepo/journalstore.h"
+
+/***
+ * Look for a block in the pin index
+ * @param handle a handle to the database (the datastore context)
+ * @param hash the hash of the block
+ * @param hash_size the size of hash
+ * @param direct where to put true(1) if it is pinned itself, false(0) if it is linked to by something pinned (can be NULL)
+ * @returns true(1) if it is in the index, false(0) otherwise
+ */
+int lmdb_pinindex_get(void* handle, const uint8_t* hash, size_t hash_size, int* direct) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	if (handle == NULL || hash == NULL || hash_size <= PININDEX_POSITION_KEY_SIZE)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_pinindex", "get: Unable to begin a transaction.\n");
+		return 0;
+	}
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	if (mdb_get(mdb_txn, *db_context->pinindex_db, &db_key, &db_value) == 0 && db_value.mv_size == 1) {
+		if (direct != NULL)
+			*direct = ((uint8_t*)db_value.mv_data)[0] == PININDEX_DIRECT;
+		retVal = 1;
+	}
+	mdb_txn_abort(mdb_txn);
+	return retVal;
+}
+
+/***
+ * Add blocks to the pin index, and move its position, in one transaction
+ * NOTE: blocks already in the index stay as they are, unless they are added as direct
+ * @param handle a handle to the database (the datastore context)
+ * @param num_hashes the number of blocks
+ * @param hashes the hashes of the blocks
+ * @param hash_sizes the size of each hash
+ * @param direct true(1) for each block that is pinned itself, false(0) otherwise
+ * @param from the position the blocks were read after (NULL if from the start). If the position was moved back since, it stays there.
+ * @param position the last journal record the index now covers
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_add(void* handle, int num_hashes, uint8_t** hashes, size_t* hash_sizes, int* direct, const struct JournalRecord* from, const struct JournalRecord* position) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	uint8_t value;
+	int moved = 0;
+	int retVal = 0;
+
+	if (handle == NULL || num_hashes < 0 || position == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+	if (mdb_txn_begin(db_context->db_environment, NULL, 0, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_pinindex", "add: Unable to begin a transaction.\n");
+		return 0;
+	}
+	for(int i = 0; i < num_hashes; i++) {
+		if (hash_sizes[i] <= PININDEX_POSITION_KEY_SIZE)
+			continue;
+		value = direct[i] ? PININDEX_DIRECT : PININDEX_INDIRECT;
+		db_key.mv_size = hash_sizes[i];
+		db_key.mv_data = hashes[i];
+		db_value.mv_size = 1;
+		db_value.mv_data = &value;
+		int rc = mdb_put(mdb_txn, *db_context->pinindex_db, &db_key, &db_value, direct[i] ? 0 : MDB_NOOVERWRITE);
+		if (rc != 0 && rc != MDB_KEYEXIST) {
+			libp2p_logger_error("lmdb_pinindex", "add: mdb_put returned %d.\n", rc);
+			goto exit;
+		}
+	}
+	// the position is stored the same way as a journal key
+	db_key.mv_size = PININDEX_POSITION_KEY_SIZE;
+	db_key.mv_data = PININDEX_POSITION_KEY;
+	int rc = mdb_get(mdb_txn, *db_context->pinindex_db, &db_key, &db_value);
+	if (rc != 0 && rc != MDB_NOTFOUND)
+		goto exit;
+	if (from == NULL) {
+		moved = rc == 0;
+	} else {
+		MDB_val from_key;
+		if (!lmdb_journalstore_generate_key(from, &from_key))
+			goto exit;
+		moved = rc != 0 || from_key.mv_size != db_value.mv_size || memcmp(from_key.mv_data, db_value.mv_data, db_value.mv_size) != 0;
+		free(from_key.mv_data);
+	}
+	if (moved) {
+		// a record was written before what this batch covers. Leave the position there.
+		retVal = 1;
+		goto exit;
+	}
+	if (!lmdb_journalstore_generate_key(position, &db_value))
+		goto exit;
+	rc = mdb_put(mdb_txn, *db_context->pinindex_db, &db_key, &db_value, 0);
+	free(db_value.mv_data);
+	if (rc != 0) {
+		libp2p_logger_error("lmdb_pinindex", "add: Unable to store the position. mdb_put returned %d.\n", rc);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (retVal) {
+		if (mdb_txn_commit(mdb_txn) != 0) {
+			libp2p_logger_error("lmdb_pinindex", "add: transaction commit failed.\n");
+			retVal = 0;
+		}
+	} else {
+		mdb_txn_abort(mdb_txn);
+	}
+	return retVal;
+}
+
+/***
+ * Get the last journal record the pin index covers
+ * @param handle a handle to the database (the datastore context)
+ * @param position where to put the record (only the timestamp and hash are filled in), or NULL if it covers nothing yet
+ * @returns true(1) on success, false(0) on error
+ */
+int lmdb_pinindex_get_position(void* handle, struct JournalRecord** position) {
+	MDB_txn* mdb_txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	*position = NULL;
+	if (handle == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+	if (mdb_txn_begin(db_context->db_environment, NULL, MDB_RDONLY, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_pinindex", "get_position: Unable to begin a transaction.\n");
+		return 0;
+	}
+	db_key.mv_size = PININDEX_POSITION_KEY_SIZE;
+	db_key.mv_data = PININDEX_POSITION_KEY;
+	int rc = mdb_get(mdb_txn, *db_context->pinindex_db, &db_key, &db_value);
+	if (rc == MDB_NOTFOUND) {
+		retVal = 1;
+	} else if (rc == 0 && db_value.mv_size >= JOURNALSTORE_TIMESTAMP_SIZE) {
+		*position = lmdb_journal_record_new();
+		if (*position != NULL) {
+			uint8_t* value = (uint8_t*)db_value.mv_data;
+			for(int i = 0; i < JOURNALSTORE_TIMESTAMP_SIZE; i++)
+				(*position)->timestamp = ((*position)->timestamp << 8) | value[i];
+			(*position)->hash_size = db_value.mv_size - JOURNALSTORE_TIMESTAMP_SIZE;
+			(*position)->hash = (uint8_t*) malloc((*position)->hash_size);
+			if ((*position)->hash != NULL || (*position)->hash_size == 0) {
+				memcpy((*position)->hash, &value[JOURNALSTORE_TIMESTAMP_SIZE], (*position)->hash_size);
+				retVal = 1;
+			} else {
+				lmdb_journal_record_free(*position);
+				*position = NULL;
+			}
+		}
+	}
+	mdb_txn_abort(mdb_txn);
+	return retVal;
+}
+
+/***
+ * Move the position of the pin index back to a pinned journal record written before it
+ * (i.e. its time was adjusted, or it was pinned after it was stored), so the next update covers it
+ * @param mdb_txn the transaction that wrote the record
+ * @param db_context the datastore context
+ * @param record the journal record
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_rewind(MDB_txn* mdb_txn, struct lmdb_context* db_context, const struct JournalRecord* record) {
+	MDB_val db_key;
+	MDB_val db_value;
+	MDB_val record_key;
+	struct JournalRecord start;
+
+	if (mdb_txn == NULL || db_context == NULL || record == NULL)
+		return 0;
+	db_key.mv_size = PININDEX_POSITION_KEY_SIZE;
+	db_key.mv_data = PININDEX_POSITION_KEY;
+	int rc = mdb_get(mdb_txn, *db_context->pinindex_db, &db_key, &db_value);
+	if (rc == MDB_NOTFOUND)
+		return 1; // the index has not started, so it will get there
+	if (rc != 0)
+		return 0;
+	if (!lmdb_journalstore_generate_key(record, &record_key))
+		return 0;
+	rc = mdb_cmp(mdb_txn, *db_context->journal_db, &record_key, &db_value);
+	free(record_key.mv_data);
+	if (rc > 0)
+		return 1; // the next update gets to it
+	// the next update starts with the first record at this time
+	start.timestamp = record->timestamp;
+	start.hash = NULL;
+	start.hash_size = 0;
+	if (!lmdb_journalstore_generate_key(&start, &db_value))
+		return 0;
+	rc = mdb_put(mdb_txn, *db_context->pinindex_db, &db_key, &db_value, 0);
+	free(db_value.mv_data);
+	if (rc != 0) {
+		libp2p_logger_error("lmdb_pinindex", "rewind: mdb_put returned %d.\n", rc);
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Empty the pin index
+ * @param handle a handle to the database (the datastore context)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinindex_clear(void* handle) {
+	MDB_txn* mdb_txn = NULL;
+
+	if (handle == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	if (db_context->db_environment == NULL)
+		return 0;
+	if (mdb_txn_begin(db_context->db_environment, NULL, 0, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_pinindex", "clear: Unable to begin a transaction.\n");
+		return 0;
+	}
+	if (mdb_drop(mdb_txn, *db_context->pinindex_db, 0) != 0) {
+		mdb_txn_abort(mdb_txn);
+		return 0;
+	}
+	return mdb_txn_commit(mdb_txn) == 0;
+}
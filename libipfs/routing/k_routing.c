@@ -2,6 +2,7 @@
 
 #include "routing/routing.h"
 #include "libp2p/routing/kademlia.h"
+#include "libp2p/os/utils.h"
 #include "libp2p/peer/providerstore.h"
 #include "libp2p/utils/vector.h"
 #include "ipfsaddr/ipfs_addr.h"
@@ -178,6 +179,10 @@ struct IpfsRouting* ipfs_routing_new_kademlia(struct IpfsNode* local_node, struc
 	// connect to nodes and listen for connections
 	struct MultiAddress* address = multiaddress_new_from_string(local_node->repo->config->addresses->api);
 	if (address != NULL && multiaddress_is_ip(address)) {
+		// remember the routing table between runs
+		char cache_path[1024];
+		if (os_utils_filepath_join(local_node->repo->path, "kademlia_nodes", cache_path, sizeof(cache_path)))
+			set_kademlia_cache_path(cache_path);
 		start_kademlia_multiaddress(address, kademlia_id, 10, local_node->repo->config->bootstrap_peers);
 	}
 	local_node->routing = routing;
@@ -38,8 +38,221 @@ struct KademliaMessage* ipfs_routing_online_send_receive_message(struct SessionC
 	return return_message;
 }
 
+// the number of peers asked at the same time during a lookup (kademlia's alpha)
+#define ONLINE_LOOKUP_ALPHA 3
+// a lookup ends when this many of the closest peers have been asked (kademlia's k)
+#define ONLINE_LOOKUP_K DHT_PROTOCOL_K
+
+enum LookupPeerState {
+	LOOKUP_PEER_WAITING,
+	LOOKUP_PEER_ASKING,
+	LOOKUP_PEER_ASKED,
+	LOOKUP_PEER_FAILED
+};
+
+/***
+ * A peer on the shortlist of a lookup
+ */
+struct LookupPeer {
+	struct Libp2pPeer* peer; // the peer in the peerstore
+	unsigned char kad_id[DHT_PROTOCOL_ID_SIZE];
+	enum LookupPeerState state;
+};
+
+/***
+ * The state of an iterative lookup for providers, shared by the query threads
+ */
+struct ProviderLookup {
+	struct IpfsRouting* routing;
+	struct KademliaMessage* message;
+	unsigned char target[DHT_PROTOCOL_ID_SIZE];
+	// the peers we know of, closest to the target first
+	struct LookupPeer* shortlist;
+	int shortlist_size;
+	int shortlist_capacity;
+	// the number of queries that have not come back yet
+	int in_flight;
+	// the providers found, or NULL if none yet
+	struct Libp2pVector* providers;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+/***
+ * Add a peer to the shortlist, keeping it sorted by distance to the target
+ * NOTE: caller must hold the lock
+ * @param lookup the lookup
+ * @param peer the peer (from the peerstore)
+ * @returns true(1) if it was added, false(0) if it was already there or on error
+ */
+static int ipfs_routing_online_lookup_add(struct ProviderLookup* lookup, struct Libp2pPeer* peer) {
+	unsigned char kad_id[DHT_PROTOCOL_ID_SIZE];
+	if (peer == NULL || peer->is_local || !libp2p_routing_dht_kademlia_id((unsigned char*)peer->id, peer->id_size, kad_id))
+		return 0;
+	int pos = lookup->shortlist_size;
+	for(int i = 0; i < lookup->shortlist_size; i++) {
+		if (lookup->shortlist[i].peer == peer)
+			return 0;
+		if (pos == lookup->shortlist_size && libp2p_routing_dht_xor_compare(kad_id, lookup->shortlist[i].kad_id, lookup->target) < 0)
+			pos = i;
+	}
+	if (lookup->shortlist_size == lookup->shortlist_capacity) {
+		int capacity = lookup->shortlist_capacity == 0 ? ONLINE_LOOKUP_K : lookup->shortlist_capacity * 2;
+		struct LookupPeer* bigger = (struct LookupPeer*) realloc(lookup->shortlist, sizeof(struct LookupPeer) * capacity);
+		if (bigger == NULL)
+			return 0;
+		lookup->shortlist = bigger;
+		lookup->shortlist_capacity = capacity;
+	}
+	memmove(&lookup->shortlist[pos+1], &lookup->shortlist[pos], sizeof(struct LookupPeer) * (lookup->shortlist_size - pos));
+	lookup->shortlist[pos].peer = peer;
+	memcpy(lookup->shortlist[pos].kad_id, kad_id, DHT_PROTOCOL_ID_SIZE);
+	lookup->shortlist[pos].state = LOOKUP_PEER_WAITING;
+	lookup->shortlist_size++;
+	return 1;
+}
+
 /***
- * Ask the network for anyone that can provide a hash
+ * Find the closest peer that has not been asked yet. Only the closest
+ * ONLINE_LOOKUP_K peers that have not failed are considered.
+ * NOTE: caller must hold the lock
+ * @param lookup the lookup
+ * @returns the entry on the shortlist, or NULL if there is nobody left to ask
+ */
+static struct LookupPeer* ipfs_routing_online_lookup_next(struct ProviderLookup* lookup) {
+	int considered = 0;
+	for(int i = 0; i < lookup->shortlist_size && considered < ONLINE_LOOKUP_K; i++) {
+		struct LookupPeer* current = &lookup->shortlist[i];
+		if (current->state == LOOKUP_PEER_FAILED)
+			continue;
+		if (current->state == LOOKUP_PEER_WAITING)
+			return current;
+		considered++;
+	}
+	return NULL;
+}
+
+/***
+ * Turn the peers of a response into peers in the peerstore
+ * @param routing the context
+ * @param head the peers from the response
+ * @returns a vector of peers in the peerstore, or NULL if there were none
+ */
+static struct Libp2pVector* ipfs_routing_online_lookup_to_peerstore(struct IpfsRouting* routing, struct Libp2pLinkedList* head) {
+	struct Libp2pVector* results = NULL;
+	for(struct Libp2pLinkedList* current = head; current != NULL; current = current->next) {
+		struct Libp2pPeer* current_peer = (struct Libp2pPeer*) current->item;
+		if (current_peer == NULL || current_peer->id_size == 0)
+			continue;
+		// what the remote thinks of the connection says nothing about ours
+		current_peer->connection_type = CONNECTION_TYPE_NOT_CONNECTED;
+		// if we can find the peer in the peerstore, use that one instead
+		struct Libp2pPeer* peerstorePeer = libp2p_peerstore_get_or_add_peer(routing->local_node->peerstore, current_peer);
+		if (peerstorePeer == NULL)
+			continue;
+		if (results == NULL)
+			results = libp2p_utils_vector_new(1);
+		if (results != NULL)
+			libp2p_utils_vector_add(results, peerstorePeer);
+	}
+	return results;
+}
+
+/***
+ * Ask one peer for providers, connecting to it if necessary
+ * @param lookup the lookup
+ * @param peer the peer to ask
+ * @returns the response, or NULL on error
+ */
+static struct KademliaMessage* ipfs_routing_online_lookup_ask(struct ProviderLookup* lookup, struct Libp2pPeer* peer) {
+	struct IpfsNode* local_node = lookup->routing->local_node;
+	if (!libp2p_peer_is_connected(peer)) {
+		if (peer->addr_head == NULL || !libp2p_peer_connect(local_node->dialer, peer, local_node->peerstore, local_node->repo->config->datastore, 5))
+			return NULL;
+	}
+	libp2p_logger_debug("online", "FindRemoteProviders: Asking %s who can provide\n", libp2p_peer_id_to_string(peer));
+	return ipfs_routing_online_send_receive_message(peer->sessionContext, lookup->message);
+}
+
+/***
+ * A query thread of a lookup. Keeps asking the closest peer that has not
+ * been asked until providers are found or nobody closer is left.
+ * @param arg the ProviderLookup
+ * @returns NULL
+ */
+static void* ipfs_routing_online_lookup_worker(void* arg) {
+	struct ProviderLookup* lookup = (struct ProviderLookup*) arg;
+	pthread_mutex_lock(&lookup->lock);
+	while (lookup->providers == NULL) {
+		struct LookupPeer* next = ipfs_routing_online_lookup_next(lookup);
+		if (next == NULL) {
+			if (lookup->in_flight == 0)
+				break;
+			// someone may still come back with closer peers
+			pthread_cond_wait(&lookup->changed, &lookup->lock);
+			continue;
+		}
+		next->state = LOOKUP_PEER_ASKING;
+		struct Libp2pPeer* peer = next->peer;
+		lookup->in_flight++;
+		pthread_mutex_unlock(&lookup->lock);
+
+		struct Libp2pVector* providers = NULL;
+		struct Libp2pVector* closer = NULL;
+		struct KademliaMessage* response = ipfs_routing_online_lookup_ask(lookup, peer);
+		if (response != NULL) {
+			providers = ipfs_routing_online_lookup_to_peerstore(lookup->routing, response->provider_peer_head);
+			closer = ipfs_routing_online_lookup_to_peerstore(lookup->routing, response->closer_peer_head);
+			libp2p_message_free(response);
+		}
+
+		pthread_mutex_lock(&lookup->lock);
+		lookup->in_flight--;
+		// the shortlist may have moved while we were away
+		for(int i = 0; i < lookup->shortlist_size; i++) {
+			if (lookup->shortlist[i].peer == peer) {
+				lookup->shortlist[i].state = response == NULL ? LOOKUP_PEER_FAILED : LOOKUP_PEER_ASKED;
+				break;
+			}
+		}
+		if (providers != NULL) {
+			libp2p_logger_debug("online", "FindRemoteProviders: %s returned %d provider(s).\n", libp2p_peer_id_to_string(peer), providers->total);
+			if (lookup->providers == NULL) {
+				lookup->providers = providers;
+				providers = NULL;
+			} else {
+				for(int i = 0; i < providers->total; i++) {
+					struct Libp2pPeer* provider = (struct Libp2pPeer*) libp2p_utils_vector_get(providers, i);
+					int j = 0;
+					while (j < lookup->providers->total && libp2p_utils_vector_get(lookup->providers, j) != provider)
+						j++;
+					if (j == lookup->providers->total)
+						libp2p_utils_vector_add(lookup->providers, provider);
+				}
+			}
+		}
+		for(int i = 0; closer != NULL && i < closer->total; i++) {
+			struct Libp2pPeer* closer_peer = (struct Libp2pPeer*) libp2p_utils_vector_get(closer, i);
+			if (closer_peer->addr_head != NULL || libp2p_peer_is_connected(closer_peer))
+				ipfs_routing_online_lookup_add(lookup, closer_peer);
+		}
+		if (providers != NULL)
+			libp2p_utils_vector_free(providers);
+		if (closer != NULL)
+			libp2p_utils_vector_free(closer);
+		pthread_cond_broadcast(&lookup->changed);
+	}
+	// let the others know we're done
+	pthread_cond_broadcast(&lookup->changed);
+	pthread_mutex_unlock(&lookup->lock);
+	return NULL;
+}
+
+/***
+ * Ask the network for anyone that can provide a hash. This is an iterative
+ * kademlia lookup: ONLINE_LOOKUP_ALPHA peers are asked at a time, closest to
+ * the key first, and the closer peers they send back are asked next. It stops
+ * when providers are found, or when the closest peers have all been asked.
  * @param routing the context
  * @param key the hash to look for
  * @param key_size the size of the hash
@@ -48,8 +261,14 @@ struct KademliaMessage* ipfs_routing_online_send_receive_message(struct SessionC
  */
 int ipfs_routing_online_find_remote_providers(struct IpfsRouting* routing, const unsigned char* key, size_t key_size, struct Libp2pVector** peers) {
 	int found = 0;
+	struct ProviderLookup lookup;
+	pthread_t threads[ONLINE_LOOKUP_ALPHA];
+	int num_threads = 0;
+
 	// build the message to be transmitted
 	struct KademliaMessage* message = libp2p_message_new();
+	if (message == NULL)
+		return 0;
 	message->message_type = MESSAGE_TYPE_GET_PROVIDERS;
 	message->key_size = key_size;
 	message->key = malloc(message->key_size);
@@ -67,46 +286,49 @@ int ipfs_routing_online_find_remote_providers(struct IpfsRouting* routing, const
 			free(b58key);
 		}
 	}
-	// loop through the connected peers, asking for the hash
-	struct Libp2pLinkedList* current_entry = routing->local_node->peerstore->head_entry;
-	while (current_entry != NULL) {
-		struct Libp2pPeer* peer = ((struct PeerEntry*)current_entry->item)->peer;
-		if (peer->connection_type == CONNECTION_TYPE_CONNECTED) {
-			// Ask for hash, if it has it, break out of the loop and stop looking
-			libp2p_logger_debug("online", "FindRemoteProviders: Asking for who can provide\n");
-			struct KademliaMessage* return_message = ipfs_routing_online_send_receive_message(peer->sessionContext, message);
-			if (return_message != NULL && return_message->provider_peer_head != NULL) {
-				libp2p_logger_debug("online", "FindRemoteProviders: Return value is not null\n");
-				found = 1;
-				*peers = libp2p_utils_vector_new(1);
-				struct Libp2pLinkedList * current_provider_peer_list_item = return_message->provider_peer_head;
-				while (current_provider_peer_list_item != NULL) {
-					struct Libp2pPeer *current_peer = current_provider_peer_list_item->item;
-					// if we can find the peer in the peerstore, use that one instead
-					struct Libp2pPeer* peerstorePeer = libp2p_peerstore_get_peer(routing->local_node->peerstore, (unsigned char*)current_peer->id, current_peer->id_size);
-					if (peerstorePeer == NULL) {
-						// add it to the peerstore
-						libp2p_peerstore_add_peer(routing->local_node->peerstore, current_peer);
-						peerstorePeer = libp2p_peerstore_get_peer(routing->local_node->peerstore, (unsigned char*)current_peer->id, current_peer->id_size);
-					}
-					current_peer = peerstorePeer;
-					libp2p_utils_vector_add(*peers, current_peer);
-					current_provider_peer_list_item = current_provider_peer_list_item->next;
-				}
-				libp2p_message_free(return_message);
-				break;
-			} else {
-				libp2p_logger_debug("online", "FindRemoteProviders: Return value is null or providers are empty.\n");
-			}
-			libp2p_message_free(return_message);
-			// TODO: Make this multithreaded
-		}
-		if (found)
-			current_entry = NULL;
-		else
-			current_entry = current_entry->next;
+
+	memset(&lookup, 0, sizeof(struct ProviderLookup));
+	lookup.routing = routing;
+	lookup.message = message;
+	if (!libp2p_routing_dht_kademlia_id(key, key_size, lookup.target)) {
+		libp2p_message_free(message);
+		return 0;
+	}
+	pthread_mutex_init(&lookup.lock, NULL);
+	pthread_cond_init(&lookup.changed, NULL);
+
+	// start with the peers we already know how to reach
+	struct Libp2pVector* known_peers = libp2p_peerstore_get_peers(routing->local_node->peerstore);
+	for(int i = 0; known_peers != NULL && i < known_peers->total; i++) {
+		struct Libp2pPeer* peer = (struct Libp2pPeer*) libp2p_utils_vector_get(known_peers, i);
+		if (peer->addr_head != NULL || libp2p_peer_is_connected(peer))
+			ipfs_routing_online_lookup_add(&lookup, peer);
 	}
+	if (known_peers != NULL)
+		libp2p_utils_vector_free(known_peers);
+
+	for(int i = 0; i < ONLINE_LOOKUP_ALPHA; i++) {
+		if (pthread_create(&threads[num_threads], NULL, ipfs_routing_online_lookup_worker, &lookup) == 0)
+			num_threads++;
+	}
+	if (num_threads == 0) {
+		// do it ourselves, one at a time
+		ipfs_routing_online_lookup_worker(&lookup);
+	}
+	for(int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	if (lookup.providers != NULL) {
+		found = 1;
+		*peers = lookup.providers;
+	} else {
+		libp2p_logger_debug("online", "FindRemoteProviders: None of the %d peer(s) on the shortlist can provide.\n", lookup.shortlist_size);
+	}
+
 	// clean up
+	free(lookup.shortlist);
+	pthread_cond_destroy(&lookup.changed);
+	pthread_mutex_destroy(&lookup.lock);
 	libp2p_message_free(message);
 	return found;
 }
@@ -212,15 +434,14 @@ int ipfs_routing_online_find_peer(struct IpfsRouting* routing, const unsigned ch
 	}
 	//ask the swarm to find the peer
 	// TODO: Multithread
-	struct Libp2pLinkedList *current = peerstore->head_entry;
-	while(current != NULL) {
-		struct Libp2pPeer *current_peer = ((struct PeerEntry*)current->item)->peer;
+	struct Libp2pVector* known_peers = libp2p_peerstore_get_peers(peerstore);
+	for(int i = 0; known_peers != NULL && i < known_peers->total && *result == NULL; i++) {
+		struct Libp2pPeer *current_peer = (struct Libp2pPeer*) libp2p_utils_vector_get(known_peers, i);
 		ipfs_routing_online_ask_peer_for_peer(current_peer, peer_id, peer_id_size, result);
-		if (*result != NULL)
-			return 1;
-		current = current->next;
 	}
-	return 0;
+	if (known_peers != NULL)
+		libp2p_utils_vector_free(known_peers);
+	return *result != NULL;
 }
 
 struct Libp2pPeer* ipfs_routing_online_build_local_peer(struct IpfsRouting* routing) {
@@ -264,10 +485,9 @@ int ipfs_routing_online_provide(struct IpfsRouting* routing, const unsigned char
 	msg->provider_peer_head->item = local_peer;
 
 	// loop through all peers in peerstore, and let them know (if we're still connected)
-	struct Libp2pLinkedList *current = routing->local_node->peerstore->head_entry;
-	while (current != NULL) {
-		struct PeerEntry* current_peer_entry = (struct PeerEntry*)current->item;
-		struct Libp2pPeer* current_peer = current_peer_entry->peer;
+	struct Libp2pVector* known_peers = libp2p_peerstore_get_peers(routing->local_node->peerstore);
+	for(int i = 0; known_peers != NULL && i < known_peers->total; i++) {
+		struct Libp2pPeer* current_peer = (struct Libp2pPeer*) libp2p_utils_vector_get(known_peers, i);
 		if (current_peer->is_local) {
 			// don't bother adding it
 		} else {
@@ -279,8 +499,9 @@ int ipfs_routing_online_provide(struct IpfsRouting* routing, const unsigned char
 					libp2p_message_free(rslt);
 			}
 		}
-		current = current->next;
 	}
+	if (known_peers != NULL)
+		libp2p_utils_vector_free(known_peers);
 
 	// this will take care of freeing local_peer too
 	libp2p_message_free(msg);
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cid/cid.h"
+
+/***
+ * Build a Cid for the tests
+ * @param cid the Cid to fill in
+ * @param hash where to put the hash
+ * @param n the number that makes the hash unique
+ */
+static void test_cid_set_fill(struct Cid* cid, unsigned char* hash, int n) {
+	memset(hash, 0, 34);
+	hash[0] = 0x12;
+	hash[1] = 32;
+	memcpy(&hash[2], &n, sizeof(int));
+	cid->version = 0;
+	cid->codec = CID_DAG_PROTOBUF;
+	cid->hash = hash;
+	cid->hash_length = 34;
+}
+
+/***
+ * See if a range of numbers are (or are not) in the set
+ * @param set the set
+ * @param from the first number
+ * @param to one past the last number
+ * @param expected true(1) if they should be in the set, false(0) otherwise
+ * @returns true(1) if they all are as expected, false(0) otherwise
+ */
+static int test_cid_set_check(struct CidSet* set, int from, int to, int expected) {
+	unsigned char hash[34];
+	struct Cid cid;
+	for(int i = from; i < to; i++) {
+		test_cid_set_fill(&cid, hash, i);
+		if (ipfs_cid_set_has(set, &cid) != expected) {
+			fprintf(stderr, "%d should%s be in the set.\n", i, expected ? "" : " not");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/***
+ * Add, remove and look up Cids, with enough of them to grow the table
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_cid_set_add_remove_has() {
+	unsigned char hash[34];
+	struct Cid cid;
+	int retVal = 0;
+
+	struct CidSet* set = ipfs_cid_set_new();
+	if (set == NULL)
+		return 0;
+	if (!test_cid_set_check(set, 0, 10, 0))
+		goto exit;
+	for(int i = 0; i < 1000; i++) {
+		test_cid_set_fill(&cid, hash, i);
+		if (ipfs_cid_set_add(set, &cid, 1) != 0)
+			goto exit;
+	}
+	// adding again changes nothing
+	test_cid_set_fill(&cid, hash, 5);
+	if (ipfs_cid_set_add(set, &cid, 1) != 0 || ipfs_cid_set_len(set) != 1000)
+		goto exit;
+	if (!test_cid_set_check(set, 0, 1000, 1) || !test_cid_set_check(set, 1000, 1100, 0))
+		goto exit;
+	for(int i = 0; i < 1000; i += 2) {
+		test_cid_set_fill(&cid, hash, i);
+		if (ipfs_cid_set_remove(set, &cid) != 1)
+			goto exit;
+	}
+	test_cid_set_fill(&cid, hash, 0);
+	if (ipfs_cid_set_remove(set, &cid) != 0 || ipfs_cid_set_len(set) != 500)
+		goto exit;
+	for(int i = 0; i < 1000; i++) {
+		if (!test_cid_set_check(set, i, i + 1, i % 2))
+			goto exit;
+	}
+	retVal = 1;
+	exit:
+	ipfs_cid_set_destroy(&set);
+	return retVal;
+}
+
+/***
+ * Keep a few Cids in the set while many come and go, so the table is rebuilt
+ * at the same size to drop the removed slots
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_cid_set_churn() {
+	unsigned char hash[34];
+	struct Cid cid;
+	int retVal = 0;
+
+	struct CidSet* set = ipfs_cid_set_new();
+	if (set == NULL)
+		return 0;
+	for(int i = 0; i < 5000; i++) {
+		test_cid_set_fill(&cid, hash, i);
+		if (ipfs_cid_set_add(set, &cid, 1) != 0)
+			goto exit;
+		if (i >= 5) {
+			test_cid_set_fill(&cid, hash, i - 5);
+			if (ipfs_cid_set_remove(set, &cid) != 1)
+				goto exit;
+		}
+		int first = i >= 5 ? i - 4 : 0;
+		if (ipfs_cid_set_len(set) != i + 1 - first || !test_cid_set_check(set, first, i + 1, 1) || !test_cid_set_check(set, 0, first, 0))
+			goto exit;
+	}
+	retVal = 1;
+	exit:
+	ipfs_cid_set_destroy(&set);
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	const char* names[] = { "test_cid_set_add_remove_has", "test_cid_set_churn" };
+	int (*funcs[])(void) = { test_cid_set_add_remove_has, test_cid_set_churn };
+	int failed = 0;
+	for(int i = 0; i < 2; i++) {
+		int passed = funcs[i]();
+		printf("%s: %s\n", names[i], passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}
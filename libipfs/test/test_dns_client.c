@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dnslink/dns_client.h"
+
+/***
+ * A DNS server on 127.0.0.1 that answers TXT queries, over UDP and TCP,
+ * the way the test asks it to for each name:
+ *   found.test   - one TXT record
+ *   missing.test - NXDOMAIN, with an SOA record
+ *   big.test     - truncated over UDP, one TXT record over TCP
+ *   spoof.test   - first an answer with the wrong id, then the real one
+ */
+struct StubServer {
+	int udp_fd;
+	int tcp_fd;
+	int port;
+	volatile int running;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	// how many queries came in for each name
+	int found_count;
+	int missing_count;
+	int big_udp_count;
+	int big_tcp_count;
+	int spoof_count;
+};
+
+/***
+ * Read the name out of a query
+ * @param query the query
+ * @param query_size the size of the query
+ * @param name where to put the name
+ * @param name_size the size of name
+ * @returns the position just past the question, or 0 on error
+ */
+static size_t test_dns_client_query_name(const unsigned char* query, size_t query_size, char* name, size_t name_size) {
+	size_t pos = 12, used = 0;
+	while (pos < query_size && query[pos] != 0) {
+		size_t len = query[pos];
+		if (pos + 1 + len > query_size || used + len + 2 > name_size)
+			return 0;
+		if (used > 0)
+			name[used++] = '.';
+		memcpy(&name[used], &query[pos + 1], len);
+		used += len;
+		pos += 1 + len;
+	}
+	name[used] = 0;
+	if (pos + 5 > query_size)
+		return 0;
+	return pos + 5;
+}
+
+/***
+ * Add a resource record that points at the name in the question
+ * @param buf the answer being built
+ * @param pos where the record goes
+ * @param type the type of record
+ * @param ttl the time to live
+ * @param rdata the data of the record
+ * @param rdata_size the size of rdata
+ * @returns the position after the record
+ */
+static size_t test_dns_client_add_record(unsigned char* buf, size_t pos, int type, unsigned int ttl, const unsigned char* rdata, size_t rdata_size) {
+	buf[pos++] = 0xc0;
+	buf[pos++] = 12;
+	buf[pos++] = 0;
+	buf[pos++] = type;
+	buf[pos++] = 0;
+	buf[pos++] = 1;
+	buf[pos++] = ttl >> 24;
+	buf[pos++] = ttl >> 16;
+	buf[pos++] = ttl >> 8;
+	buf[pos++] = ttl;
+	buf[pos++] = rdata_size >> 8;
+	buf[pos++] = rdata_size;
+	memcpy(&buf[pos], rdata, rdata_size);
+	return pos + rdata_size;
+}
+
+/***
+ * Build an answer to a query
+ * @param query the query
+ * @param question_end where the question ends in the query
+ * @param id the id to put in the answer
+ * @param rcode the response code
+ * @param truncated true(1) to set the TC flag
+ * @param txt the TXT record to answer with (or NULL)
+ * @param with_soa true(1) to put an SOA record in the authority section
+ * @param answer where to put the answer
+ * @returns the size of the answer
+ */
+static size_t test_dns_client_build_answer(const unsigned char* query, size_t question_end, int id, int rcode, int truncated,
+		const char* txt, int with_soa, unsigned char* answer) {
+	memset(answer, 0, 12);
+	answer[0] = id >> 8;
+	answer[1] = id;
+	answer[2] = 0x81 | (truncated ? 0x02 : 0);
+	answer[3] = 0x80 | rcode;
+	answer[5] = 1;
+	answer[7] = (txt != NULL);
+	answer[9] = (with_soa != 0);
+	memcpy(&answer[12], &query[12], question_end - 12);
+	size_t pos = question_end;
+	if (txt != NULL) {
+		unsigned char rdata[256];
+		rdata[0] = strlen(txt);
+		memcpy(&rdata[1], txt, rdata[0]);
+		pos = test_dns_client_add_record(answer, pos, 16, 300, rdata, rdata[0] + 1);
+	}
+	if (with_soa) {
+		// root mname and rname, then serial, refresh, retry, expire and minimum
+		unsigned char rdata[22];
+		memset(rdata, 0, sizeof(rdata));
+		rdata[21] = 30;
+		pos = test_dns_client_add_record(answer, pos, 6, 60, rdata, sizeof(rdata));
+	}
+	return pos;
+}
+
+/***
+ * Answer one query that came in over UDP
+ * @param server the server
+ */
+static void test_dns_client_handle_udp(struct StubServer* server) {
+	unsigned char query[512], answer[1024];
+	struct sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	char name[256];
+	ssize_t size = recvfrom(server->udp_fd, query, sizeof(query), 0, (struct sockaddr*)&from, &from_len);
+	if (size < 12)
+		return;
+	size_t question_end = test_dns_client_query_name(query, size, name, sizeof(name));
+	if (question_end == 0)
+		return;
+	int id = (query[0] << 8) | query[1];
+	size_t answer_size = 0;
+	pthread_mutex_lock(&server->lock);
+	if (strcmp(name, "found.test") == 0) {
+		server->found_count++;
+		answer_size = test_dns_client_build_answer(query, question_end, id, 0, 0, "dnslink=/ipfs/found", 0, answer);
+	} else if (strcmp(name, "missing.test") == 0) {
+		server->missing_count++;
+		answer_size = test_dns_client_build_answer(query, question_end, id, 3, 0, NULL, 1, answer);
+	} else if (strcmp(name, "big.test") == 0) {
+		server->big_udp_count++;
+		answer_size = test_dns_client_build_answer(query, question_end, id, 0, 1, NULL, 0, answer);
+	} else if (strcmp(name, "spoof.test") == 0) {
+		server->spoof_count++;
+		answer_size = test_dns_client_build_answer(query, question_end, id ^ 0x5a5a, 0, 0, "dnslink=/ipfs/forged", 0, answer);
+		sendto(server->udp_fd, answer, answer_size, 0, (struct sockaddr*)&from, from_len);
+		answer_size = test_dns_client_build_answer(query, question_end, id, 0, 0, "dnslink=/ipfs/real", 0, answer);
+	}
+	pthread_mutex_unlock(&server->lock);
+	if (answer_size > 0)
+		sendto(server->udp_fd, answer, answer_size, 0, (struct sockaddr*)&from, from_len);
+}
+
+/***
+ * Answer one query that came in over TCP
+ * @param server the server
+ */
+static void test_dns_client_handle_tcp(struct StubServer* server) {
+	unsigned char query[514], answer[1026];
+	char name[256];
+	int fd = accept(server->tcp_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+	ssize_t size = recv(fd, query, 2, MSG_WAITALL);
+	size_t query_size = (size == 2) ? (size_t)((query[0] << 8) | query[1]) : 0;
+	if (query_size >= 12 && query_size <= sizeof(query) - 2 && recv(fd, &query[2], query_size, MSG_WAITALL) == (ssize_t)query_size) {
+		size_t question_end = test_dns_client_query_name(&query[2], query_size, name, sizeof(name));
+		if (question_end > 0 && strcmp(name, "big.test") == 0) {
+			pthread_mutex_lock(&server->lock);
+			server->big_tcp_count++;
+			pthread_mutex_unlock(&server->lock);
+			int id = (query[2] << 8) | query[3];
+			size_t answer_size = test_dns_client_build_answer(&query[2], question_end, id, 0, 0, "dnslink=/ipfs/big", 0, &answer[2]);
+			answer[0] = answer_size >> 8;
+			answer[1] = answer_size;
+			send(fd, answer, answer_size + 2, 0);
+		}
+	}
+	close(fd);
+}
+
+/***
+ * The thread of the stub server
+ * @param arg the StubServer
+ */
+static void* test_dns_client_serve(void* arg) {
+	struct StubServer* server = (struct StubServer*) arg;
+	while (server->running) {
+		struct pollfd fds[2];
+		fds[0].fd = server->udp_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = server->tcp_fd;
+		fds[1].events = POLLIN;
+		if (poll(fds, 2, 100) <= 0)
+			continue;
+		if (fds[0].revents & POLLIN)
+			test_dns_client_handle_udp(server);
+		if (fds[1].revents & POLLIN)
+			test_dns_client_handle_tcp(server);
+	}
+	return NULL;
+}
+
+/***
+ * Start the stub server, and point the dns client at it
+ * @param server the server to start
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int test_dns_client_start(struct StubServer* server) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	char servers[32];
+
+	memset(server, 0, sizeof(struct StubServer));
+	server->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	server->tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (server->udp_fd < 0 || server->tcp_fd < 0)
+		goto error;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server->udp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+			|| getsockname(server->udp_fd, (struct sockaddr*)&addr, &addr_len) != 0)
+		goto error;
+	// TCP answers on the same port
+	int on = 1;
+	setsockopt(server->tcp_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(server->tcp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server->tcp_fd, 4) != 0)
+		goto error;
+	server->port = ntohs(addr.sin_port);
+	pthread_mutex_init(&server->lock, NULL);
+	server->running = 1;
+	if (pthread_create(&server->thread, NULL, test_dns_client_serve, server) != 0)
+		goto error;
+	sprintf(servers, "127.0.0.1:%d", server->port);
+	if (ipfs_dns_client_set_servers(servers) != 0) {
+		server->running = 0;
+		pthread_join(server->thread, NULL);
+		goto error;
+	}
+	return 1;
+	error:
+	if (server->udp_fd >= 0)
+		close(server->udp_fd);
+	if (server->tcp_fd >= 0)
+		close(server->tcp_fd);
+	return 0;
+}
+
+/***
+ * Stop the stub server, and put the dns client back the way it was
+ * @param server the server
+ */
+static void test_dns_client_stop(struct StubServer* server) {
+	server->running = 0;
+	pthread_join(server->thread, NULL);
+	close(server->udp_fd);
+	close(server->tcp_fd);
+	pthread_mutex_destroy(&server->lock);
+	ipfs_dns_client_set_servers(NULL);
+}
+
+/***
+ * Look up a name, and see if the answer is one TXT record
+ * @param name the name
+ * @param expected the record that should come back
+ * @returns true(1) if it did, false(0) otherwise
+ */
+static int test_dns_client_expect_txt(char* name, const char* expected) {
+	char** txt = NULL;
+	int err = ipfs_dns_client_lookup_txt(&txt, name);
+	if (err != 0) {
+		fprintf(stderr, "Lookup of %s returned %d.\n", name, err);
+		return 0;
+	}
+	int retVal = (txt[0] != NULL && strcmp(txt[0], expected) == 0 && txt[1] == NULL);
+	if (!retVal)
+		fprintf(stderr, "Lookup of %s returned %s instead of %s.\n", name, txt[0] == NULL ? "nothing" : txt[0], expected);
+	free(*txt);
+	free(txt);
+	return retVal;
+}
+
+/***
+ * A TXT answer is returned, and the next lookup comes from the cache
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_dns_client_txt_and_cache() {
+	struct StubServer server;
+	int retVal = 0;
+	if (!test_dns_client_start(&server))
+		return 0;
+	if (!test_dns_client_expect_txt("found.test", "dnslink=/ipfs/found"))
+		goto exit;
+	if (!test_dns_client_expect_txt("found.test", "dnslink=/ipfs/found"))
+		goto exit;
+	if (server.found_count != 1) {
+		fprintf(stderr, "The server was asked %d times.\n", server.found_count);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	test_dns_client_stop(&server);
+	return retVal;
+}
+
+/***
+ * NXDOMAIN is returned as no record, and remembered
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_dns_client_negative_cache() {
+	struct StubServer server;
+	int retVal = 0;
+	char** txt = NULL;
+	if (!test_dns_client_start(&server))
+		return 0;
+	for(int i = 0; i < 2; i++) {
+		int err = ipfs_dns_client_lookup_txt(&txt, "missing.test");
+		if (err != ErrNoRecord) {
+			fprintf(stderr, "Lookup of a missing name returned %d.\n", err);
+			goto exit;
+		}
+	}
+	if (server.missing_count != 1) {
+		fprintf(stderr, "The server was asked %d times.\n", server.missing_count);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	test_dns_client_stop(&server);
+	return retVal;
+}
+
+/***
+ * A truncated answer is asked for again over TCP
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_dns_client_truncated() {
+	struct StubServer server;
+	int retVal = 0;
+	if (!test_dns_client_start(&server))
+		return 0;
+	if (!test_dns_client_expect_txt("big.test", "dnslink=/ipfs/big"))
+		goto exit;
+	if (server.big_udp_count != 1 || server.big_tcp_count != 1) {
+		fprintf(stderr, "The server was asked %d times over UDP and %d times over TCP.\n", server.big_udp_count, server.big_tcp_count);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	test_dns_client_stop(&server);
+	return retVal;
+}
+
+/***
+ * An answer with the wrong id is ignored, and the real one is used
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_dns_client_wrong_id() {
+	struct StubServer server;
+	int retVal = 0;
+	if (!test_dns_client_start(&server))
+		return 0;
+	if (!test_dns_client_expect_txt("spoof.test", "dnslink=/ipfs/real"))
+		goto exit;
+	if (server.spoof_count != 1) {
+		fprintf(stderr, "The server was asked %d times.\n", server.spoof_count);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	test_dns_client_stop(&server);
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	const char* names[] = { "test_dns_client_txt_and_cache", "test_dns_client_negative_cache", "test_dns_client_truncated", "test_dns_client_wrong_id" };
+	int (*funcs[])(void) = { test_dns_client_txt_and_cache, test_dns_client_negative_cache, test_dns_client_truncated, test_dns_client_wrong_id };
+	int failed = 0;
+	for(int i = 0; i < 4; i++) {
+		int passed = funcs[i]();
+		printf("%s: %s\n", names[i], passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libp2p/crypto/sha256.h"
+#include "blocks/block.h"
+#include "blocks/blockstore.h"
+#include "datastore/ds_helper.h"
+#include "merkledag/merkledag.h"
+#include "merkledag/node.h"
+#include "pin/pin.h"
+#include "repo/fsrepo/fs_repo.h"
+#include "repo/init.h"
+
+/***
+ * Build a node for the tests, with its hash
+ * @param text what goes in the node
+ * @param child the node it links to, or NULL
+ * @returns the HashtableNode, or NULL on error
+ */
+static struct HashtableNode* test_pin_index_node(const char* text, struct HashtableNode* child) {
+	struct HashtableNode* node = NULL;
+	struct NodeLink* link = NULL;
+	if (!ipfs_hashtable_node_new_from_data((unsigned char*)text, strlen(text), &node))
+		return NULL;
+	if (child != NULL) {
+		if (!ipfs_node_link_create("child", child->hash, child->hash_size, &link)
+				|| !ipfs_hashtable_node_add_link(node, link)) {
+			ipfs_node_link_free(link);
+			ipfs_hashtable_node_free(node);
+			return NULL;
+		}
+	}
+	size_t protobuf_size = ipfs_hashtable_node_protobuf_encode_size(node);
+	unsigned char protobuf[protobuf_size];
+	unsigned char hash[32];
+	if (!ipfs_hashtable_node_protobuf_encode(node, protobuf, protobuf_size, &protobuf_size)
+			|| !libp2p_crypto_hashing_sha256(protobuf, protobuf_size, hash)
+			|| !ipfs_hashtable_node_set_hash(node, hash, 32)) {
+		ipfs_hashtable_node_free(node);
+		return NULL;
+	}
+	return node;
+}
+
+/***
+ * Store a node, as bitswap or the user would
+ * @param fs_repo the repo
+ * @param node the node
+ * @param pin true(1) to pin it
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int test_pin_index_store(struct FSRepo* fs_repo, struct HashtableNode* node, int pin) {
+	struct Block* block = NULL;
+	size_t bytes_written = 0;
+	int retVal = 0;
+	struct Blockstore* blockstore = ipfs_blockstore_new(fs_repo);
+	if (blockstore == NULL)
+		return 0;
+	if (!ipfs_merkledag_convert_node_to_block(node, &block))
+		goto exit;
+	if (!blockstore->Put(blockstore->blockstoreContext, block, &bytes_written))
+		goto exit;
+	retVal = ipfs_datastore_helper_add_block_to_datastore(block, fs_repo->config->datastore, pin);
+	exit:
+	ipfs_block_free(block);
+	ipfs_blockstore_free(blockstore);
+	return retVal;
+}
+
+/***
+ * A pinned node links to one that is not stored yet. When that one comes in,
+ * what it links to must be added to the pin index too.
+ * @param pin_child true(1) if the node that comes in later is pinned itself
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int test_pin_index_dangling_link(int pin_child) {
+	int retVal = 0;
+	char repo_path[] = "/tmp/test_pin_index_XXXXXX";
+	char* peer_id = NULL;
+	struct FSRepo* fs_repo = NULL;
+	PinMode mode = NotPinned;
+	struct HashtableNode* leaf = test_pin_index_node("the leaf", NULL);
+	struct HashtableNode* middle = test_pin_index_node("the middle", leaf);
+	struct HashtableNode* root = test_pin_index_node("the root", middle);
+
+	if (leaf == NULL || middle == NULL || root == NULL)
+		goto exit;
+	if (mkdtemp(repo_path) == NULL)
+		goto exit;
+	if (!make_ipfs_repository(repo_path, 4001, NULL, &peer_id))
+		goto exit;
+	if (!ipfs_repo_fsrepo_new(repo_path, NULL, &fs_repo) || !ipfs_repo_fsrepo_open(fs_repo))
+		goto exit;
+
+	// the root is pinned, but the middle has not arrived
+	if (!test_pin_index_store(fs_repo, leaf, 0) || !test_pin_index_store(fs_repo, root, 1))
+		goto exit;
+	if (!ipfs_pin_is_hash_pinned(fs_repo, middle->hash, middle->hash_size, &mode) || mode != Indirect) {
+		fprintf(stderr, "The missing middle should be in the index.\n");
+		goto exit;
+	}
+	if (ipfs_pin_is_hash_pinned(fs_repo, leaf->hash, leaf->hash_size, &mode)) {
+		fprintf(stderr, "The leaf cannot be reached yet.\n");
+		goto exit;
+	}
+
+	// journal records are in order of time, so the middle comes after what the index covers
+	sleep(1);
+	if (!test_pin_index_store(fs_repo, middle, pin_child))
+		goto exit;
+	if (!ipfs_pin_is_hash_pinned(fs_repo, leaf->hash, leaf->hash_size, &mode) || mode != Indirect) {
+		fprintf(stderr, "The leaf was not added when the middle came in.\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	ipfs_repo_fsrepo_free(fs_repo);
+	ipfs_hashtable_node_free(root);
+	ipfs_hashtable_node_free(middle);
+	ipfs_hashtable_node_free(leaf);
+	free(peer_id);
+	if (repo_path[strlen(repo_path) - 1] != 'X') {
+		char command[100];
+		sprintf(command, "rm -rf %s", repo_path);
+		system(command);
+	}
+	return retVal;
+}
+
+int test_pin_index_dangling_link_stored() {
+	return test_pin_index_dangling_link(0);
+}
+
+int test_pin_index_dangling_link_pinned() {
+	return test_pin_index_dangling_link(1);
+}
+
+int main(int argc, char** argv) {
+	const char* names[] = { "test_pin_index_dangling_link_stored", "test_pin_index_dangling_link_pinned" };
+	int (*funcs[])(void) = { test_pin_index_dangling_link_stored, test_pin_index_dangling_link_pinned };
+	int failed = 0;
+	for(int i = 0; i < 2; i++) {
+		int passed = funcs[i]();
+		printf("%s: %s\n", names[i], passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libp2p/os/utils.h"
+#include "libp2p/net/stream.h"
+#include "blocks/block.h"
+#include "core/gc.h"
+#include "core/ipfs_node.h"
+#include "journal/journal.h"
+#include "journal/journal_entry.h"
+#include "journal/journal_message.h"
+#include "repo/init.h"
+
+/***
+ * Build a block for the tests
+ * @param text what goes in the block
+ * @returns the Block, or NULL on error
+ */
+static struct Block* test_replication_pin_block(const char* text) {
+	struct Block* block = ipfs_block_new();
+	if (block == NULL)
+		return NULL;
+	if (!ipfs_blocks_block_add_data((const unsigned char*)text, strlen(text), block)) {
+		ipfs_block_free(block);
+		return NULL;
+	}
+	return block;
+}
+
+/***
+ * Add an entry for a block to a journal message
+ * @param message the JournalMessage
+ * @param block the block
+ * @param timestamp when the remote stored it
+ * @param pin true(1) if the remote has it pinned
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int test_replication_pin_add_entry(struct JournalMessage* message, struct Block* block, unsigned long long timestamp, int pin) {
+	struct JournalEntry* entry = ipfs_journal_entry_new();
+	if (entry == NULL)
+		return 0;
+	entry->timestamp = timestamp;
+	entry->pin = pin;
+	entry->hash_size = block->cid->hash_length;
+	entry->hash = (uint8_t*) malloc(entry->hash_size);
+	if (entry->hash == NULL) {
+		ipfs_journal_entry_free(entry);
+		return 0;
+	}
+	memcpy(entry->hash, block->cid->hash, entry->hash_size);
+	libp2p_utils_vector_add(message->journal_entries, entry);
+	return 1;
+}
+
+/***
+ * Hand a journal message to the node, as if a replication peer sent it
+ * @param local_node the node
+ * @param message the JournalMessage
+ * @returns true(1) if the node took it, false(0) otherwise
+ */
+static int test_replication_pin_send(struct IpfsNode* local_node, struct JournalMessage* message) {
+	const char* header = "/ipfs/journalio/1.0.0\n";
+	int retVal = 0;
+	size_t header_size = strlen(header);
+	size_t max_size = ipfs_journal_message_encode_size(message);
+	size_t bytes_used = 0;
+	struct StreamMessage* msg = libp2p_stream_message_new();
+	if (msg == NULL)
+		return 0;
+	msg->data = (uint8_t*) malloc(header_size + max_size);
+	if (msg->data == NULL)
+		goto exit;
+	memcpy(msg->data, header, header_size);
+	if (!ipfs_journal_message_encode(message, &msg->data[header_size], max_size, &bytes_used))
+		goto exit;
+	msg->data_size = header_size + bytes_used;
+	retVal = ipfs_journal_handle_message(msg, NULL, local_node) == 1;
+	exit:
+	libp2p_stream_message_free(msg);
+	return retVal;
+}
+
+/***
+ * A block the remote pinned is fetched through bitswap, and must survive the garbage collector
+ * on this side. A block the remote did not pin is collected.
+ * @returns true(1) on success, false(0) otherwise
+ */
+int test_replication_pin_survives_gc() {
+	int retVal = 0;
+	char repo_path[] = "/tmp/test_replication_pin_XXXXXX";
+	char* peer_id = NULL;
+	struct IpfsNode* local_node = NULL;
+	struct IpfsGarbageCollector* gc = NULL;
+	struct JournalMessage* message = NULL;
+	struct Block* pinned = test_replication_pin_block("a block the remote has pinned");
+	struct Block* unpinned = test_replication_pin_block("a block the remote has not pinned");
+	struct Block* found = NULL;
+
+	if (pinned == NULL || unpinned == NULL)
+		goto exit;
+	if (mkdtemp(repo_path) == NULL)
+		goto exit;
+	if (!make_ipfs_repository(repo_path, 4001, NULL, &peer_id))
+		goto exit;
+	if (!ipfs_node_offline_new(repo_path, &local_node))
+		goto exit;
+
+	// the remote tells us about two blocks that we do not have
+	unsigned long long now = os_utils_gmtime();
+	message = ipfs_journal_message_new();
+	if (message == NULL)
+		goto exit;
+	message->current_epoch = now;
+	message->start_epoch = now - 10;
+	message->end_epoch = now;
+	if (!test_replication_pin_add_entry(message, pinned, now - 5, 1)
+			|| !test_replication_pin_add_entry(message, unpinned, now - 5, 0))
+		goto exit;
+	if (!test_replication_pin_send(local_node, message)) {
+		fprintf(stderr, "The journal message was not handled.\n");
+		goto exit;
+	}
+
+	// the blocks come in through bitswap
+	local_node->exchange->HasBlock(local_node->exchange, ipfs_block_copy(pinned));
+	local_node->exchange->HasBlock(local_node->exchange, ipfs_block_copy(unpinned));
+
+	// anything stored after a run starts is kept by it
+	sleep(2);
+	gc = ipfs_gc_new(local_node);
+	if (gc == NULL || !ipfs_gc_run(gc))
+		goto exit;
+
+	if (!local_node->blockstore->Get(local_node->blockstore->blockstoreContext, pinned->cid, &found)) {
+		fprintf(stderr, "The pinned block was collected.\n");
+		goto exit;
+	}
+	ipfs_block_free(found);
+	found = NULL;
+	if (local_node->blockstore->Get(local_node->blockstore->blockstoreContext, unpinned->cid, &found)) {
+		fprintf(stderr, "The unpinned block was not collected.\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	ipfs_block_free(found);
+	ipfs_gc_free(gc);
+	ipfs_journal_message_free(message);
+	ipfs_node_free(local_node);
+	ipfs_block_free(pinned);
+	ipfs_block_free(unpinned);
+	free(peer_id);
+	if (repo_path[strlen(repo_path) - 1] != 'X') {
+		char command[100];
+		sprintf(command, "rm -rf %s", repo_path);
+		system(command);
+	}
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	const char* names[] = { "test_replication_pin_survives_gc" };
+	int (*funcs[])(void) = { test_replication_pin_survives_gc };
+	int failed = 0;
+	for(int i = 0; i < 1; i++) {
+		int passed = funcs[i]();
+		printf("%s: %s\n", names[i], passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}
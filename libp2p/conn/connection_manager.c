@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/conn/connection_manager.h"
+#include "libp2p/conn/session.h"
+#include "libp2p/peer/peerstore.h"
+#include "libp2p/utils/logger.h"
+
+/***
+ * Allocate a new entry for a peer
+ * @param peer the peer
+ * @returns the new entry, or NULL on error
+ */
+static struct ConnectionManagerEntry* libp2p_conn_manager_entry_new(const struct Libp2pPeer* peer) {
+	struct ConnectionManagerEntry* entry = (struct ConnectionManagerEntry*) malloc(sizeof(struct ConnectionManagerEntry));
+	if (entry != NULL) {
+		entry->peer_id = (char*) malloc(peer->id_size);
+		if (entry->peer_id == NULL) {
+			free(entry);
+			return NULL;
+		}
+		memcpy(entry->peer_id, peer->id, peer->id_size);
+		entry->peer_id_size = peer->id_size;
+		entry->session_context = NULL;
+		entry->dialing = 0;
+		entry->connected = 0;
+		entry->waiters = 0;
+		entry->connected_at = 0;
+		entry->last_used = 0;
+	}
+	return entry;
+}
+
+static void libp2p_conn_manager_entry_free(struct ConnectionManagerEntry* entry) {
+	if (entry != NULL) {
+		free(entry->peer_id);
+		free(entry);
+	}
+}
+
+/***
+ * Find the entry for a peer
+ * NOTE: caller must hold the lock
+ * @param manager the ConnectionManager
+ * @param peer the peer
+ * @returns the entry, or NULL if not found
+ */
+static struct ConnectionManagerEntry* libp2p_conn_manager_find(struct ConnectionManager* manager, const struct Libp2pPeer* peer) {
+	struct Libp2pLinkedList* current = manager->entries;
+	while (current != NULL) {
+		struct ConnectionManagerEntry* entry = (struct ConnectionManagerEntry*) current->item;
+		if (entry->peer_id_size == peer->id_size && memcmp(entry->peer_id, peer->id, peer->id_size) == 0)
+			return entry;
+		current = current->next;
+	}
+	return NULL;
+}
+
+/***
+ * Remove an entry from the list and free it
+ * NOTE: caller must hold the lock
+ * @param manager the ConnectionManager
+ * @param entry the entry to remove
+ */
+static void libp2p_conn_manager_remove(struct ConnectionManager* manager, struct ConnectionManagerEntry* entry) {
+	struct Libp2pLinkedList* previous = NULL;
+	struct Libp2pLinkedList* current = manager->entries;
+	while (current != NULL) {
+		if (current->item == entry) {
+			if (previous == NULL)
+				manager->entries = current->next;
+			else
+				previous->next = current->next;
+			free(current);
+			libp2p_conn_manager_entry_free(entry);
+			return;
+		}
+		previous = current;
+		current = current->next;
+	}
+}
+
+/***
+ * Create a new ConnectionManager
+ * @param low_water trimming stops at this number of connections
+ * @param high_water trimming starts above this number of connections
+ * @returns the ConnectionManager, or NULL on error
+ */
+struct ConnectionManager* libp2p_conn_manager_new(int low_water, int high_water) {
+	struct ConnectionManager* manager = (struct ConnectionManager*) malloc(sizeof(struct ConnectionManager));
+	if (manager != NULL) {
+		pthread_mutex_init(&manager->lock, NULL);
+		pthread_cond_init(&manager->dial_complete, NULL);
+		manager->entries = NULL;
+		manager->low_water = low_water;
+		manager->high_water = high_water;
+		manager->grace_period_secs = CONNECTION_MANAGER_DEFAULT_GRACE_PERIOD;
+	}
+	return manager;
+}
+
+/***
+ * Free resources of the ConnectionManager
+ * NOTE: This does not close the connections
+ * @param manager the ConnectionManager
+ */
+void libp2p_conn_manager_free(struct ConnectionManager* manager) {
+	if (manager != NULL) {
+		struct Libp2pLinkedList* current = manager->entries;
+		while (current != NULL) {
+			struct Libp2pLinkedList* next = current->next;
+			libp2p_conn_manager_entry_free((struct ConnectionManagerEntry*) current->item);
+			free(current);
+			current = next;
+		}
+		pthread_cond_destroy(&manager->dial_complete);
+		pthread_mutex_destroy(&manager->lock);
+		free(manager);
+	}
+}
+
+/***
+ * Announce that we want to dial a peer
+ * NOTE: If another thread is already dialing this peer, this blocks until that dial
+ * completes. On success, the session of that dial is given to peer if it has none.
+ * @param manager the ConnectionManager
+ * @param peer the peer to dial
+ * @returns the ConnectionManagerDialStatus
+ */
+enum ConnectionManagerDialStatus libp2p_conn_manager_begin_dial(struct ConnectionManager* manager, struct Libp2pPeer* peer) {
+	if (manager == NULL || peer == NULL || peer->id_size == 0)
+		return CONNECTION_MANAGER_DIAL_OWNER;
+	enum ConnectionManagerDialStatus retVal = CONNECTION_MANAGER_DIAL_OWNER;
+	pthread_mutex_lock(&manager->lock);
+	struct ConnectionManagerEntry* entry = libp2p_conn_manager_find(manager, peer);
+	if (entry == NULL) {
+		entry = libp2p_conn_manager_entry_new(peer);
+		struct Libp2pLinkedList* item = libp2p_utils_linked_list_new();
+		if (entry == NULL || item == NULL) {
+			// we can't track it, but the caller can still dial
+			libp2p_conn_manager_entry_free(entry);
+			free(item);
+			pthread_mutex_unlock(&manager->lock);
+			return CONNECTION_MANAGER_DIAL_OWNER;
+		}
+		item->item = entry;
+		item->next = manager->entries;
+		manager->entries = item;
+	}
+	struct SessionContext* session = NULL;
+	struct SessionContext* to_release = NULL;
+	// a dial is in flight, or has just finished and not all of its waiters have woken up
+	if (entry->dialing || entry->waiters > 0) {
+		libp2p_logger_debug("connection_manager", "Already dialing %s. Waiting for that dial to finish.\n", libp2p_peer_id_to_string(peer));
+		entry->waiters++;
+		while (entry->dialing)
+			pthread_cond_wait(&manager->dial_complete, &manager->lock);
+		entry->waiters--;
+		if (entry->connected && entry->session_context != NULL) {
+			session = libp2p_session_context_retain(entry->session_context);
+			entry->last_used = time(NULL);
+			retVal = CONNECTION_MANAGER_DIAL_JOINED;
+		} else {
+			retVal = CONNECTION_MANAGER_DIAL_FAILED;
+		}
+		// the last waiter lets go of the entry's hold on the session
+		if (entry->waiters == 0) {
+			to_release = entry->session_context;
+			entry->session_context = NULL;
+		}
+	} else {
+		entry->dialing = 1;
+	}
+	pthread_mutex_unlock(&manager->lock);
+	if (session != NULL) {
+		// the peer may be the one that did the dial, and have it already
+		if (peer->sessionContext == NULL)
+			peer->sessionContext = session;
+		else
+			libp2p_session_context_free(session);
+		peer->connection_type = CONNECTION_TYPE_CONNECTED;
+	}
+	libp2p_session_context_free(to_release);
+	return retVal;
+}
+
+/***
+ * Record the result of a dial started with libp2p_conn_manager_begin_dial
+ * NOTE: This wakes up the threads waiting on the dial
+ * @param manager the ConnectionManager
+ * @param peer the peer that was dialed
+ * @param success true(1) if the connection was made
+ */
+void libp2p_conn_manager_end_dial(struct ConnectionManager* manager, struct Libp2pPeer* peer, int success) {
+	if (manager == NULL || peer == NULL)
+		return;
+	pthread_mutex_lock(&manager->lock);
+	struct ConnectionManagerEntry* entry = libp2p_conn_manager_find(manager, peer);
+	if (entry != NULL) {
+		entry->dialing = 0;
+		entry->connected = success;
+		// hold on to the session until the waiters have their own hold on it
+		entry->session_context = (success && entry->waiters > 0) ? libp2p_session_context_retain(peer->sessionContext) : NULL;
+		if (success) {
+			entry->connected_at = time(NULL);
+			entry->last_used = entry->connected_at;
+		}
+		pthread_cond_broadcast(&manager->dial_complete);
+	}
+	pthread_mutex_unlock(&manager->lock);
+}
+
+/***
+ * Mark a connection as recently used, so that it is trimmed last
+ * @param manager the ConnectionManager
+ * @param peer the peer
+ */
+void libp2p_conn_manager_touch(struct ConnectionManager* manager, const struct Libp2pPeer* peer) {
+	if (manager == NULL || peer == NULL)
+		return;
+	pthread_mutex_lock(&manager->lock);
+	struct ConnectionManagerEntry* entry = libp2p_conn_manager_find(manager, peer);
+	if (entry != NULL)
+		entry->last_used = time(NULL);
+	pthread_mutex_unlock(&manager->lock);
+}
+
+/***
+ * Close the least recently used connections if there are more than high_water
+ * NOTE: The peers are marked not connected and their sessions are shut down, so
+ * reads and writes on them fail. The sessions stay on the peers, as others use them
+ * without a lock, and are freed by whoever lets go last (i.e. the peer when it reconnects).
+ * @param manager the ConnectionManager
+ * @param peerstore where to find the peers that own the connections
+ * @returns the number of connections closed
+ */
+int libp2p_conn_manager_trim(struct ConnectionManager* manager, struct Peerstore* peerstore) {
+	if (manager == NULL || peerstore == NULL)
+		return 0;
+	int closed = 0;
+	int total = 0;
+	pthread_mutex_lock(&manager->lock);
+	// first clean out the entries that are no longer connected
+	struct Libp2pLinkedList* current = manager->entries;
+	while (current != NULL) {
+		struct ConnectionManagerEntry* entry = (struct ConnectionManagerEntry*) current->item;
+		current = current->next;
+		if (entry->dialing || entry->waiters > 0)
+			continue;
+		struct Libp2pPeer* peer = libp2p_peerstore_get_peer(peerstore, (unsigned char*)entry->peer_id, entry->peer_id_size);
+		if (!entry->connected || peer == NULL || !libp2p_peer_is_connected(peer)) {
+			libp2p_conn_manager_remove(manager, entry);
+			continue;
+		}
+		total++;
+	}
+	// the sessions to let go of once the lock is released
+	int max_closing = total - manager->low_water;
+	struct SessionContext** closing = NULL;
+	if (total > manager->high_water)
+		closing = (struct SessionContext**) malloc(sizeof(struct SessionContext*) * max_closing);
+	if (closing != NULL) {
+		time_t now = time(NULL);
+		while (total > manager->low_water) {
+			// find the least recently used connection that is past its grace period
+			struct ConnectionManagerEntry* oldest = NULL;
+			struct Libp2pPeer* oldest_peer = NULL;
+			time_t oldest_used = 0;
+			for (current = manager->entries; current != NULL; current = current->next) {
+				struct ConnectionManagerEntry* entry = (struct ConnectionManagerEntry*) current->item;
+				if (entry->dialing || entry->waiters > 0 || !entry->connected)
+					continue;
+				if (now - entry->connected_at < manager->grace_period_secs)
+					continue;
+				struct Libp2pPeer* peer = libp2p_peerstore_get_peer(peerstore, (unsigned char*)entry->peer_id, entry->peer_id_size);
+				// traffic on the connection counts as use too
+				time_t used = entry->last_used;
+				if (peer != NULL && (time_t)libp2p_peer_last_comm(peer) > used)
+					used = (time_t)libp2p_peer_last_comm(peer);
+				if (oldest == NULL || used < oldest_used) {
+					oldest = entry;
+					oldest_peer = peer;
+					oldest_used = used;
+				}
+			}
+			if (oldest == NULL)
+				break;
+			if (oldest_peer != NULL) {
+				// others read the session of a peer without a lock, so it stays on the peer.
+				// The peer lets go of it when it reconnects or is freed.
+				pthread_rwlock_wrlock(&peerstore->lock);
+				if (oldest_peer->sessionContext != NULL) {
+					libp2p_logger_debug("connection_manager", "Closing idle connection to %s.\n", libp2p_peer_id_to_string(oldest_peer));
+					oldest_peer->connection_type = CONNECTION_TYPE_NOT_CONNECTED;
+					closing[closed] = libp2p_session_context_retain(oldest_peer->sessionContext);
+					closed++;
+				}
+				pthread_rwlock_unlock(&peerstore->lock);
+			}
+			libp2p_conn_manager_remove(manager, oldest);
+			total--;
+		}
+	}
+	pthread_mutex_unlock(&manager->lock);
+	// others may still be using these, so they are shut down, and only our hold is let go of
+	for (int i = 0; i < closed; i++) {
+		libp2p_session_context_shutdown(closing[i]);
+		libp2p_session_context_free(closing[i]);
+	}
+	free(closing);
+	return closed;
+}
@@ -1,4 +1,9 @@
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 /**
  * Functions for handling the local dialer
  */
@@ -6,10 +11,14 @@
 #include "libp2p/crypto/encoding/x509.h"
 #include "libp2p/conn/dialer.h"
 #include "libp2p/conn/connection.h"
+#include "libp2p/conn/connection_manager.h"
 #include "libp2p/conn/transport_dialer.h"
 #include "libp2p/crypto/key.h"
 #include "libp2p/utils/linked_list.h"
 #include "libp2p/utils/logger.h"
+#include "libp2p/utils/thread_pool.h"
+#include "libp2p/net/p2pnet.h"
+#include "libp2p/net/connectionstream.h"
 #include "multiaddr/multiaddr.h"
 #include "libp2p/net/multistream.h"
 #include "libp2p/secio/secio.h"
@@ -34,6 +43,7 @@ struct Dialer* libp2p_conn_dialer_new(struct Libp2pPeer* peer, struct Peerstore*
 		dialer->peer_id = NULL;
 		dialer->fallback_dialer = libp2p_conn_tcp_transport_dialer_new(dialer->peer_id, rsa_private_key);
 		dialer->swarm = swarm;
+		dialer->connection_manager = libp2p_conn_manager_new(CONNECTION_MANAGER_DEFAULT_LOW_WATER, CONNECTION_MANAGER_DEFAULT_HIGH_WATER);
 		if (peer != NULL) {
 			dialer->peer_id = malloc(peer->id_size + 1);
 			memset(dialer->peer_id, 0, peer->id_size + 1);
@@ -66,6 +76,7 @@ void libp2p_conn_dialer_free(struct Dialer* in) {
 		}
 		if (in->fallback_dialer != NULL)
 			libp2p_conn_transport_dialer_free((struct TransportDialer*)in->fallback_dialer);
+		libp2p_conn_manager_free(in->connection_manager);
 		free(in);
 	}
 	return;
@@ -87,120 +98,483 @@ struct Stream* libp2p_conn_dialer_get_connection(const struct Dialer* dialer, co
 	return conn;
 }
 
+/***
+ * Open a new yamux channel on an existing connection, and get multistream going on it
+ * @param peer the connected peer
+ * @param timeout_secs how long to wait for multistream
+ * @returns a multistream Stream over the new channel, or NULL on error
+ */
+static struct Stream* libp2p_conn_dialer_open_channel(struct Libp2pPeer* peer, int timeout_secs) {
+	if (peer->sessionContext == NULL || peer->sessionContext->default_stream == NULL)
+		return NULL;
+	if (peer->sessionContext->default_stream->stream_type != STREAM_TYPE_YAMUX) {
+		libp2p_logger_error("dialer", "Expected a yamux context, but got a context of type %d.\n", peer->sessionContext->default_stream->stream_type);
+		return NULL;
+	}
+	struct YamuxContext* ctx = libp2p_yamux_get_context(peer->sessionContext->default_stream->stream_context);
+	// first get a new frame. It should be ready to go
+	struct Stream* new_channel = yamux_channel_new(ctx, 0, NULL);
+	if (new_channel == NULL || new_channel->channel <= 0) {
+		libp2p_logger_error("dialer", "Unable to open a new yamux channel.\n");
+		libp2p_yamux_channel_abandon(new_channel);
+		return NULL;
+	}
+	// then get a multistream
+	struct Stream* yamux_multistream = libp2p_net_multistream_stream_new(new_channel, 0);
+	if (yamux_multistream == NULL || !libp2p_net_multistream_ready(new_channel->stream_context, timeout_secs)) {
+		libp2p_logger_error("dialer", "Unable to get multistream over yamux into the ready status.\n");
+		// this frees the multistream too
+		libp2p_yamux_channel_abandon(new_channel);
+		return NULL;
+	}
+	return yamux_multistream;
+}
+
+/***
+ * The current time in milliseconds, for measuring dial deadlines
+ */
+static long long libp2p_conn_dialer_now_ms() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/***
+ * The number of whole seconds left before the deadline
+ * @param deadline_ms the deadline
+ * @returns the number of seconds remaining, or -1 if the deadline has passed
+ */
+static int libp2p_conn_dialer_remaining_secs(long long deadline_ms) {
+	long long remaining = deadline_ms - libp2p_conn_dialer_now_ms();
+	if (remaining <= 0)
+		return -1;
+	return (int)((remaining + 999) / 1000);
+}
+
+/***
+ * A connection attempt to one of the peer's addresses
+ */
+struct DialAttempt {
+	struct MultiAddress* address;
+	const struct TransportDialer* transport;
+	int fd;
+	long long start_ms;
+	// 0 = waiting to start, 1 = in flight, -1 = failed
+	int state;
+};
+
+/***
+ * Find the transport dialer that can race connections to an address
+ * @param dialer the dialer
+ * @param ma the address
+ * @returns the TransportDialer, or NULL if none can
+ */
+static const struct TransportDialer* libp2p_conn_dialer_find_transport(const struct Dialer* dialer, const struct MultiAddress* ma) {
+	const struct TransportDialer* transport = libp2p_conn_transport_dialer_find(dialer->transport_dialers, ma);
+	if (transport == NULL && dialer->fallback_dialer != NULL && dialer->fallback_dialer->dial_start != NULL
+			&& dialer->fallback_dialer->can_handle(ma))
+		transport = dialer->fallback_dialer;
+	return transport;
+}
+
+/***
+ * Connect to all addresses of a peer at once, starting each one a little
+ * after the one before it (or right away if the others have failed).
+ * The first to connect wins, and the others are closed.
+ * @param dialer the dialer, whose transport dialers make the connections
+ * @param peer the peer to dial
+ * @param deadline_ms when to give up
+ * @param winner the address that connected
+ * @returns a connected socket descriptor, or -1
+ */
+static int libp2p_conn_dialer_race(const struct Dialer* dialer, struct Libp2pPeer* peer, long long deadline_ms, struct MultiAddress** winner) {
+	struct DialAttempt attempts[DIALER_MAX_PARALLEL_DIALS];
+	int num_attempts = 0;
+	int winning_fd = -1;
+	long long now = libp2p_conn_dialer_now_ms();
+
+	// gather the addresses we can dial
+	for (struct Libp2pLinkedList* current = peer->addr_head; current != NULL && num_attempts < DIALER_MAX_PARALLEL_DIALS; current = current->next) {
+		struct MultiAddress* ma = (struct MultiAddress*) current->item;
+		const struct TransportDialer* transport = (ma == NULL ? NULL : libp2p_conn_dialer_find_transport(dialer, ma));
+		if (transport == NULL)
+			continue;
+		struct DialAttempt* attempt = &attempts[num_attempts];
+		attempt->address = ma;
+		attempt->transport = transport;
+		attempt->fd = -1;
+		attempt->start_ms = now + (long long)num_attempts * DIALER_STAGGER_MS;
+		attempt->state = 0;
+		num_attempts++;
+	}
+
+	while (winning_fd < 0) {
+		now = libp2p_conn_dialer_now_ms();
+		if (now >= deadline_ms)
+			break;
+		// start the attempts that are due
+		int in_flight = 0;
+		int waiting = 0;
+		long long next_start = deadline_ms;
+		for (int i = 0; i < num_attempts; i++) {
+			struct DialAttempt* attempt = &attempts[i];
+			if (attempt->state == 0 && attempt->start_ms <= now) {
+				int connected = 0;
+				attempt->fd = attempt->transport->dial_start(attempt->transport, attempt->address, &connected);
+				if (attempt->fd >= 0 && connected) {
+					winning_fd = attempt->fd;
+					*winner = attempt->address;
+					attempt->fd = -1;
+					break;
+				}
+				attempt->state = (attempt->fd >= 0 ? 1 : -1);
+			}
+			if (attempt->state == 1)
+				in_flight++;
+			if (attempt->state == 0) {
+				waiting++;
+				if (attempt->start_ms < next_start)
+					next_start = attempt->start_ms;
+			}
+		}
+		if (winning_fd >= 0)
+			break;
+		if (in_flight == 0) {
+			if (waiting == 0)
+				break;
+			// nothing is in flight, so don't wait to start the next one
+			for (int i = 0; i < num_attempts; i++) {
+				if (attempts[i].state == 0 && attempts[i].start_ms == next_start) {
+					attempts[i].start_ms = now;
+					break;
+				}
+			}
+			continue;
+		}
+		// wait for something to connect, or for the next attempt to be due
+		struct pollfd fds[DIALER_MAX_PARALLEL_DIALS];
+		int fd_index[DIALER_MAX_PARALLEL_DIALS];
+		int num_fds = 0;
+		for (int i = 0; i < num_attempts; i++) {
+			if (attempts[i].state == 1) {
+				fds[num_fds].fd = attempts[i].fd;
+				fds[num_fds].events = POLLOUT;
+				fds[num_fds].revents = 0;
+				fd_index[num_fds] = i;
+				num_fds++;
+			}
+		}
+		int wait_ms = (int)(next_start - now);
+		if (poll(fds, num_fds, wait_ms) <= 0)
+			continue;
+		for (int i = 0; i < num_fds && winning_fd < 0; i++) {
+			if (fds[i].revents == 0)
+				continue;
+			struct DialAttempt* attempt = &attempts[fd_index[i]];
+			if (attempt->transport->dial_finish(attempt->transport, attempt->fd) == 0) {
+				winning_fd = attempt->fd;
+				*winner = attempt->address;
+				attempt->fd = -1;
+			} else {
+				libp2p_logger_debug("dialer", "Connection to %s failed.\n", attempt->address->string);
+				close(attempt->fd);
+				attempt->fd = -1;
+				attempt->state = -1;
+				// the next address should start right away
+				for (int j = 0; j < num_attempts; j++) {
+					if (attempts[j].state == 0) {
+						if (attempts[j].start_ms > now)
+							attempts[j].start_ms = now;
+						break;
+					}
+				}
+			}
+		}
+	}
+	// cancel the losers
+	for (int i = 0; i < num_attempts; i++) {
+		if (attempts[i].fd >= 0)
+			close(attempts[i].fd);
+	}
+	return winning_fd;
+}
+
+/***
+ * Dial a peer and negotiate several protocols. Called by join_swarm, which makes
+ * sure only one of these is running per peer.
+ * @param dialer the dialer
+ * @param peer the peer to join
+ * @param deadline_ms the time by which the whole pipeline must be finished
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int libp2p_conn_dialer_dial_peer(const struct Dialer* dialer, struct Libp2pPeer* peer, long long deadline_ms) {
+	// race the addresses
+	struct MultiAddress* ma = NULL;
+	int fd = libp2p_conn_dialer_race(dialer, peer, deadline_ms, &ma);
+	if (fd < 0) {
+		libp2p_logger_debug("dialer", "Unable to connect to any address of %s.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	char* ip = NULL;
+	multiaddress_get_ip_address(ma, &ip);
+	struct Stream* conn_stream = libp2p_net_connection_established(fd, ip, multiaddress_get_ip_port(ma), NULL);
+	if (conn_stream == NULL) {
+		close(fd);
+		free(ip);
+		return 0;
+	}
+	if (peer->sessionContext == NULL)
+		peer->sessionContext = libp2p_session_context_new();
+	struct ConnectionContext* conn_ctx = conn_stream->stream_context;
+	conn_ctx->session_context = peer->sessionContext;
+	peer->sessionContext->insecure_stream = conn_stream;
+	peer->sessionContext->default_stream = conn_stream;
+	peer->sessionContext->port = multiaddress_get_ip_port(ma);
+	// the session may be left from an earlier connection
+	if (peer->sessionContext->host != NULL)
+		free(peer->sessionContext->host);
+	peer->sessionContext->host = ip;
+	// the number of seconds left for the next step
+	int secs = 0;
+	int retVal = 0;
+	// secio over multistream. The header and the protocol id go out in one write,
+	// and we read the answer ourselves, as the swarm is not listening yet
+	if (!libp2p_net_multistream_propose(conn_stream, "/secio/1.0.0\n")
+			|| (secs = libp2p_conn_dialer_remaining_secs(deadline_ms)) < 0
+			|| !libp2p_net_multistream_accept_proposal(conn_stream, "/secio/1.0.0\n", secs)) {
+		libp2p_logger_error("dialer", "Unable to do secio/multistream negotiation.\n");
+		goto exit;
+	}
+	// built over multistream, like the listening side, so that handle_upgrade
+	// puts each protocol on the stream below multistream. Secio and yamux
+	// frames are therefore never varint prefixed, on either side.
+	struct Stream* multistream = libp2p_net_multistream_stream_new_negotiated(conn_stream);
+	struct Stream* secio_stream = NULL;
+	if (multistream != NULL) {
+		secio_stream = libp2p_secio_stream_new_negotiated(multistream, dialer->peerstore, dialer->private_key);
+		libp2p_net_multistream_stream_discard(multistream);
+	}
+	if (secio_stream == NULL || !libp2p_secio_handshake(secio_stream)) {
+		libp2p_logger_error("dialer", "Unable to do secio negotiation.\n");
+		goto exit;
+	}
+	libp2p_logger_debug("dialer", "We successfully negotiated secio.\n");
+	// yamux over multistream over secio, again in one write
+	if (!libp2p_net_multistream_propose(secio_stream, "/yamux/1.0.0\n")
+			|| (secs = libp2p_conn_dialer_remaining_secs(deadline_ms)) < 0
+			|| !libp2p_net_multistream_accept_proposal(secio_stream, "/yamux/1.0.0\n", secs)) {
+		libp2p_logger_error("dialer", "Unable to do yamux/multistream negotiation.\n");
+		goto exit;
+	}
+	multistream = libp2p_net_multistream_stream_new_negotiated(secio_stream);
+	struct Stream* yamux_stream = NULL;
+	if (multistream != NULL) {
+		yamux_stream = libp2p_yamux_stream_new_negotiated(multistream, 0, dialer->swarm->protocol_handlers);
+		libp2p_net_multistream_stream_discard(multistream);
+	}
+	if (yamux_stream == NULL) {
+		libp2p_logger_error("dialer", "Unable to do yamux negotiation.\n");
+		goto exit;
+	}
+	libp2p_logger_debug("dialer", "We successfully negotiated yamux.\n");
+	// we're connected. start listening for responses
+	libp2p_swarm_add_peer(dialer->swarm, peer);
+	// the rest should be done on another thread
+	// we have our swarm connection. Now we ask for some "channels"
+	// id over multistream over yamux
+	const struct Libp2pProtocolHandler* handler = libp2p_protocol_get_handler(dialer->swarm->protocol_handlers, "/ipfs/id/1.0.0\n");
+	if (handler != NULL) {
+		Identify* identify = handler->context;
+		struct Stream* yamux_multistream = libp2p_conn_dialer_open_channel(peer, 10);
+		// then get an identify
+		if (yamux_multistream != NULL)
+			libp2p_identify_stream_new(yamux_multistream, identify, 1);
+	}
+	// kademlia over yamux
+	//libp2p_yamux_stream_add(new_stream->stream_context, libp2p_kademlia_stream_new(new_stream));
+	// circuit relay over yamux
+	//libp2p_yamux_stream_add(new_stream->stream_context, libp2p_circuit_relay_stream_new(new_stream));
+	retVal = 1;
+	exit:
+	if (!retVal) {
+		// the swarm is not listening on this connection yet, so closing it is up to us.
+		// The default stream is the top of the stack, and closing it closes conn_stream.
+		libp2p_peer_handle_connection_error(peer);
+	}
+	return retVal;
+}
+
 /***
  * Attempt to connect to a particular peer. This will negotiate several protocols
+ * NOTE: An existing connection is reused, and if another thread is already dialing
+ * this peer, we wait for its result instead of dialing again.
  * @param dialer the dialer
  * @param peer the peer to join
+ * @param timeout_secs the deadline for connecting and negotiating all protocols (must be positive)
  * @returns true(1) on success, false(0) otherwise
  */
 int libp2p_conn_dialer_join_swarm(const struct Dialer* dialer, struct Libp2pPeer* peer, int timeout_secs) {
 	if (dialer == NULL || peer == NULL)
 		return 0;
-	// find the right Multiaddress
-	struct Libp2pLinkedList* current_entry = peer->addr_head;
-	struct Stream* conn_stream = NULL;
-	while (current_entry != NULL) {
-		struct MultiAddress* ma = current_entry->item;
-		conn_stream = libp2p_conn_dialer_get_connection(dialer, ma);
-		if (conn_stream != NULL) {
-			if (peer->sessionContext == NULL) {
-				peer->sessionContext = libp2p_session_context_new();
-				struct ConnectionContext* conn_ctx = conn_stream->stream_context;
-				conn_ctx->session_context = peer->sessionContext;
-			}
-			peer->sessionContext->insecure_stream = conn_stream;
-			peer->sessionContext->default_stream = conn_stream;
-			peer->sessionContext->port = multiaddress_get_ip_port(ma);
-			multiaddress_get_ip_address(ma, &peer->sessionContext->host);
+	if (libp2p_peer_is_connected(peer)) {
+		libp2p_conn_manager_touch(dialer->connection_manager, peer);
+		return 1;
+	}
+	if (timeout_secs <= 0) {
+		libp2p_logger_error("dialer", "Invalid dial deadline of %d seconds.\n", timeout_secs);
+		return 0;
+	}
+	switch (libp2p_conn_manager_begin_dial(dialer->connection_manager, peer)) {
+		case CONNECTION_MANAGER_DIAL_JOINED:
+			return 1;
+		case CONNECTION_MANAGER_DIAL_FAILED:
+			return 0;
+		default:
 			break;
-		}
-		current_entry = current_entry->next;
 	}
-	if (conn_stream == NULL)
+	int retVal = libp2p_conn_dialer_dial_peer(dialer, peer, libp2p_conn_dialer_now_ms() + (long long)timeout_secs * 1000);
+	if (retVal)
+		peer->connection_type = CONNECTION_TYPE_CONNECTED;
+	libp2p_conn_manager_end_dial(dialer->connection_manager, peer, retVal);
+	if (retVal)
+		libp2p_conn_manager_trim(dialer->connection_manager, dialer->peerstore);
+	return retVal;
+}
+
+/***
+ * Passes the details of an asynchronous dial to the worker
+ * NOTE: The peer is kept by id, and found again in the peerstore when the dial starts
+ */
+struct DialerAsyncJob {
+	const struct Dialer* dialer;
+	unsigned char* peer_id;
+	size_t peer_id_size;
+	int timeout_secs;
+	libp2p_conn_dialer_callback callback;
+	void* callback_arg;
+};
+
+static threadpool dialer_pool = NULL;
+static pthread_once_t dialer_pool_once = PTHREAD_ONCE_INIT;
+
+static void libp2p_conn_dialer_pool_init() {
+	dialer_pool = thpool_init(DIALER_THREADS);
+	if (dialer_pool == NULL)
+		libp2p_logger_error("dialer", "Unable to create the dialer thread pool.\n");
+}
+
+/***
+ * Free a DialerAsyncJob
+ * @param job the job
+ */
+static void libp2p_conn_dialer_async_job_free(struct DialerAsyncJob* job) {
+	if (job != NULL) {
+		free(job->peer_id);
+		free(job);
+	}
+}
+
+/***
+ * Runs on the dialer pool to do the dial
+ * @param args a DialerAsyncJob
+ */
+static void libp2p_conn_dialer_async_job(void* args) {
+	struct DialerAsyncJob* job = (struct DialerAsyncJob*) args;
+	struct Libp2pPeer* peer = libp2p_peerstore_get_peer(job->dialer->peerstore, job->peer_id, job->peer_id_size);
+	int retVal = 0;
+	if (peer == NULL)
+		libp2p_logger_debug("dialer", "The peer to dial is no longer in the peerstore.\n");
+	else
+		retVal = libp2p_conn_dialer_join_swarm(job->dialer, peer, job->timeout_secs);
+	if (job->callback != NULL)
+		job->callback(peer, retVal, job->callback_arg);
+	libp2p_conn_dialer_async_job_free(job);
+}
+
+/***
+ * Attempt to connect to a particular peer without blocking the caller
+ * NOTE: The peer must be in the dialer's peerstore
+ * @param dialer the dialer
+ * @param peer the peer to join
+ * @param timeout_secs the deadline for connecting and negotiating all protocols (must be positive)
+ * @param callback called on a dialer thread when the dial is complete, with a NULL peer if it left the peerstore (can be NULL)
+ * @param callback_arg passed to the callback
+ * @returns true(1) if the dial was started, false(0) otherwise
+ */
+int libp2p_conn_dialer_join_swarm_async(const struct Dialer* dialer, struct Libp2pPeer* peer, int timeout_secs,
+		libp2p_conn_dialer_callback callback, void* callback_arg) {
+	if (dialer == NULL || dialer->peerstore == NULL || peer == NULL || peer->id == NULL)
 		return 0;
-	// we're connected. start listening for responses
-	libp2p_swarm_add_peer(dialer->swarm, peer);
-	// wait for multistream
-	if (!libp2p_net_multistream_ready(peer->sessionContext, 5)) {
+	if (timeout_secs <= 0) {
+		libp2p_logger_error("dialer", "Invalid dial deadline of %d seconds.\n", timeout_secs);
 		return 0;
 	}
-	struct Stream* new_stream = peer->sessionContext->default_stream;
-	if (new_stream != NULL) {
-		// secio over multistream
-		new_stream = libp2p_secio_stream_new(new_stream, dialer->peerstore, dialer->private_key);
-		if (new_stream != NULL) {
-			if (!libp2p_secio_ready(peer->sessionContext, 10) ) {
-				return 0;
-			}
-			libp2p_logger_debug("dialer", "We successfully negotiated secio.\n");
-			// multistream over secio
-			// Don't bother, as the other side requests multistream
-			//new_stream = libp2p_net_multistream_stream_new(new_stream, 0);
-			if (new_stream != NULL) {
-				if (!libp2p_net_multistream_ready(peer->sessionContext, 5))
-					return 0;
-				libp2p_logger_debug("dialer", "We successfully negotiated multistream over secio.\n");
-				// yamux over multistream
-				new_stream = libp2p_yamux_stream_new(peer->sessionContext->default_stream, 0, dialer->swarm->protocol_handlers);
-				if (new_stream != NULL) {
-					if (!libp2p_yamux_stream_ready(peer->sessionContext, 5)) {
-						libp2p_logger_error("dialer", "Unable to get yamux into the ready status.\n");
-						return 0;
-					}
-					libp2p_logger_debug("dialer", "We successfully negotiated yamux.\n");
-					// the rest should be done on another thread
-					// we have our swarm connection. Now we ask for some "channels"
-					// id over multistream over yamux
-					const struct Libp2pProtocolHandler* handler = libp2p_protocol_get_handler(dialer->swarm->protocol_handlers, "/ipfs/id/1.0.0\n");
-					if (handler != NULL) {
-						Identify* identify = handler->context;
-						if (peer->sessionContext->default_stream->stream_type == STREAM_TYPE_YAMUX) {
-							struct YamuxContext* ctx = libp2p_yamux_get_context(peer->sessionContext->default_stream->stream_context);
-							// first get a new frame. It should be ready to go
-							struct Stream* new_channel = yamux_channel_new(ctx, 0, NULL);
-							if (new_channel != NULL && new_channel->channel > 0) {
-								// then get a multistream
-								struct Stream* yamux_multistream = libp2p_net_multistream_stream_new(new_channel, 0);
-								if (!libp2p_net_multistream_ready(new_channel->stream_context, 10)) {
-									libp2p_logger_error("dialer", "Unable to get multistream over yamux into the ready status.\n");
-									return 0;
-								}
-								// then get an identify
-								libp2p_identify_stream_new(yamux_multistream, identify, 1);
-							}
-						} else {
-							libp2p_logger_error("dialer", "Expected a yamux context, but got a context of type %d.\n", peer->sessionContext->default_stream->stream_type);
-						}
-					}
-					// kademlia over yamux
-					//libp2p_yamux_stream_add(new_stream->stream_context, libp2p_kademlia_stream_new(new_stream));
-					// circuit relay over yamux
-					//libp2p_yamux_stream_add(new_stream->stream_context, libp2p_circuit_relay_stream_new(new_stream));
-					return 1;
-				} else {
-					libp2p_logger_error("dialer", "Unable to do yamux negotiation.\n");
-				}
-			} else {
-				libp2p_logger_error("dialer", "Unable to do secio/multistream negotiation.\n");
-			}
-		} else {
-			libp2p_logger_error("dialer", "Unable to do secio negotiation.\n");
-		}
-	} else {
-		libp2p_logger_error("dialer", "Unable to do initial multistream negotiation.\n");
+	pthread_once(&dialer_pool_once, libp2p_conn_dialer_pool_init);
+	if (dialer_pool == NULL)
+		return 0;
+	struct DialerAsyncJob* job = (struct DialerAsyncJob*) malloc(sizeof(struct DialerAsyncJob));
+	if (job == NULL)
+		return 0;
+	job->peer_id = (unsigned char*) malloc(peer->id_size);
+	if (job->peer_id == NULL) {
+		free(job);
+		return 0;
 	}
-
-	return 0;
+	memcpy(job->peer_id, peer->id, peer->id_size);
+	job->peer_id_size = peer->id_size;
+	job->dialer = dialer;
+	job->timeout_secs = timeout_secs;
+	job->callback = callback;
+	job->callback_arg = callback_arg;
+	if (thpool_add_work(dialer_pool, libp2p_conn_dialer_async_job, job) != 0) {
+		libp2p_conn_dialer_async_job_free(job);
+		return 0;
+	}
+	return 1;
 }
 
 /**
  * return a Stream that is already set up to use the passed in protocol
+ * NOTE: This connects to the peer if necessary. The stream is a new yamux channel
+ * on the connection to the peer.
  * @param dialer the dialer to use
- * @param multiaddress the host to dial
- * @param protocol the protocol to use (right now only 'multistream' is supported)
- * @returns the ready-to-use stream
+ * @param peer the host
+ * @param protocol the protocol to use ('multistream', 'kademlia' or a protocol id such as "/ipfs/kad/1.0.0\n")
+ * @returns the ready-to-use stream, or NULL on error
  */
 struct Stream* libp2p_conn_dialer_get_stream(const struct Dialer* dialer, const struct Libp2pPeer* peer, const char* protocol) {
-	// TODO: Implement this method
-	return NULL;
+	if (dialer == NULL || peer == NULL)
+		return NULL;
+	struct Libp2pPeer* remote = (struct Libp2pPeer*)peer;
+	if (!libp2p_conn_dialer_join_swarm(dialer, remote, 10))
+		return NULL;
+	libp2p_conn_manager_touch(dialer->connection_manager, peer);
+	struct Stream* stream = libp2p_conn_dialer_open_channel(remote, 10);
+	if (stream == NULL || protocol == NULL || strcmp(protocol, "multistream") == 0)
+		return stream;
+	// ask for the protocol on the new channel
+	const char* protocol_id = protocol;
+	if (strcmp(protocol, "kademlia") == 0)
+		protocol_id = "/ipfs/kad/1.0.0\n";
+	struct StreamMessage outgoing;
+	outgoing.data = (uint8_t*)protocol_id;
+	outgoing.data_size = strlen(protocol_id);
+	outgoing.error_number = 0;
+	if (!stream->write(stream->stream_context, &outgoing)) {
+		libp2p_logger_error("dialer", "get_stream: Unable to request protocol %s.\n", protocol);
+		// the channel is the parent of the multistream, and takes it with it
+		libp2p_yamux_channel_abandon(stream->parent_stream);
+		return NULL;
+	}
+	struct StreamMessage* results = NULL;
+	if (!stream->read(stream->stream_context, &results, 5) || results == NULL
+			|| results->data_size != outgoing.data_size
+			|| strncmp((char*)results->data, protocol_id, results->data_size) != 0) {
+		libp2p_logger_error("dialer", "get_stream: Remote did not agree to protocol %s.\n", protocol);
+		libp2p_stream_message_free(results);
+		libp2p_yamux_channel_abandon(stream->parent_stream);
+		return NULL;
+	}
+	libp2p_stream_message_free(results);
+	return stream;
 }
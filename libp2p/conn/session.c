@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include "multiaddr/multiaddr.h"
 #include "libp2p/crypto/ephemeral.h"
 #include "libp2p/conn/session.h"
@@ -37,12 +38,52 @@ struct SessionContext* libp2p_session_context_new() {
 		context->shared_key = NULL;
 		context->shared_key_size = 0;
 		context->traffic_type = TCP;
+		context->references = 1;
+		context->closed = 0;
 	}
 	return context;
 }
 
+/***
+ * Hold on to a SessionContext, so that it is not freed until
+ * libp2p_session_context_free is called for this holder as well
+ * @param session the SessionContext
+ * @returns the SessionContext
+ */
+struct SessionContext* libp2p_session_context_retain(struct SessionContext* session) {
+	if (session != NULL)
+		__sync_add_and_fetch(&session->references, 1);
+	return session;
+}
+
+/***
+ * Shut down the connection of a SessionContext. Nothing is freed, so it is safe
+ * while others hold it, but their reads and writes fail from now on.
+ * @param session the SessionContext
+ */
+void libp2p_session_context_shutdown(struct SessionContext* session) {
+	if (session == NULL)
+		return;
+	session->closed = 1;
+	struct Stream* base_stream = session->default_stream;
+	while (base_stream != NULL && base_stream->parent_stream != NULL)
+		base_stream = base_stream->parent_stream;
+	if (base_stream != NULL && base_stream->stream_type == STREAM_TYPE_RAW) {
+		struct ConnectionContext* ctx = (struct ConnectionContext*)base_stream->stream_context;
+		if (ctx != NULL && ctx->socket_descriptor > 0)
+			shutdown(ctx->socket_descriptor, SHUT_RDWR);
+	}
+}
+
+/**
+ * Let go of a SessionContext. The resources are freed when the last holder lets go.
+ * @param context the SessionContext
+ * @returns true(1)
+ */
 int libp2p_session_context_free(struct SessionContext* context) {
 	if (context != NULL) {
+		if (__sync_sub_and_fetch(&context->references, 1) > 0)
+			return 1;
 		if (context->default_stream != NULL)
 			context->default_stream->close(context->default_stream);
 		context->default_stream = NULL;
@@ -84,6 +125,10 @@ int libp2p_session_context_free(struct SessionContext* context) {
 			libp2p_crypto_ephemeral_key_free(context->ephemeral_private_key);
 			context->ephemeral_private_key = NULL;
 		}
+		if (context->host != NULL) {
+			free(context->host);
+			context->host = NULL;
+		}
 		free(context);
 	}
 	return 1;
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <unistd.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 
@@ -30,9 +31,50 @@ struct Stream* libp2p_conn_tcp_dial(const struct TransportDialer* transport_dial
 	return stream;
 }
 
+/***
+ * Begin a non-blocking tcp connection
+ * @param transport_dialer the TransportDialer
+ * @param addr where to connect
+ * @param connected set to true(1) if the connection was made right away
+ * @returns the socket descriptor, or -1 on error
+ */
+int libp2p_conn_tcp_dial_start(const struct TransportDialer* transport_dialer, const struct MultiAddress* addr, int* connected) {
+	char* ip = NULL;
+	*connected = 0;
+	// only ip4 for now
+	if (!multiaddress_is_ip4(addr) || !multiaddress_get_ip_address(addr, &ip))
+		return -1;
+	uint32_t address = hostname_to_ip(ip);
+	free(ip);
+	int socket_descriptor = socket_open4();
+	if (socket_descriptor < 0)
+		return -1;
+	int retVal = socket_connect4_start(socket_descriptor, address, multiaddress_get_ip_port(addr));
+	if (retVal == 0)
+		retVal = (socket_connect4_finish(socket_descriptor) == 0 ? 0 : -1);
+	if (retVal < 0) {
+		close(socket_descriptor);
+		return -1;
+	}
+	*connected = (retVal == 0);
+	return socket_descriptor;
+}
+
+/***
+ * Complete a tcp connection begun with libp2p_conn_tcp_dial_start
+ * @param transport_dialer the TransportDialer
+ * @param socket_descriptor the socket
+ * @returns 0 on success, -1 on error
+ */
+int libp2p_conn_tcp_dial_finish(const struct TransportDialer* transport_dialer, int socket_descriptor) {
+	return socket_connect4_finish(socket_descriptor);
+}
+
 struct TransportDialer* libp2p_conn_tcp_transport_dialer_new(char* peer_id, struct RsaPrivateKey* private_key) {
 	struct TransportDialer* out = libp2p_conn_transport_dialer_new(peer_id, private_key);
 	out->can_handle = libp2p_conn_tcp_can_handle;
 	out->dial = libp2p_conn_tcp_dial;
+	out->dial_start = libp2p_conn_tcp_dial_start;
+	out->dial_finish = libp2p_conn_tcp_dial_finish;
 	return out;
 }
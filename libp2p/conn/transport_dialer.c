@@ -8,6 +8,10 @@ struct TransportDialer* libp2p_conn_transport_dialer_new(char* peer_id, struct R
 	if (out != NULL) {
 		out->peer_id = NULL;
 		out->private_key = NULL;
+		out->can_handle = NULL;
+		out->dial = NULL;
+		out->dial_start = NULL;
+		out->dial_finish = NULL;
 		if (peer_id != NULL) {
 			out->peer_id = malloc(strlen(peer_id) + 1);
 			strcpy(out->peer_id, peer_id);
@@ -55,3 +59,18 @@ struct Stream* libp2p_conn_transport_dialer_get(const struct Libp2pLinkedList* t
 
 	return NULL;
 }
+
+/**
+ * Given a list of dialers, find the one that can start a non-blocking connection to this multiaddress
+ * @param transport_dialers a list of dialers
+ * @param multiaddr the address
+ * @returns the TransportDialer, or NULL if none can
+ */
+const struct TransportDialer* libp2p_conn_transport_dialer_find(const struct Libp2pLinkedList* transport_dialers, const struct MultiAddress* multiaddr) {
+	for (const struct Libp2pLinkedList* current = transport_dialers; current != NULL; current = current->next) {
+		const struct TransportDialer* t_dialer = (const struct TransportDialer*)current->item;
+		if (t_dialer != NULL && t_dialer->dial_start != NULL && t_dialer->can_handle(multiaddr))
+			return t_dialer;
+	}
+	return NULL;
+}
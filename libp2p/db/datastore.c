@@ -46,6 +46,8 @@ int libp2p_datastore_new(struct Datastore** datastore) {
 	(*datastore)->storage_max = NULL;
 	(*datastore)->gc_period = NULL;
 	(*datastore)->params = NULL;
+	(*datastore)->datastore_put_listener = NULL;
+	(*datastore)->datastore_put_listener_context = NULL;
 	return 1;
 }
 
@@ -82,6 +84,7 @@ struct DatastoreRecord* libp2p_datastore_record_new() {
 		rec->timestamp = 0;
 		rec->value = NULL;
 		rec->value_size = 0;
+		rec->pin = 0;
 	}
 	return rec;
 }
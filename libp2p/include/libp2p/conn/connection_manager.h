@@ -0,0 +1,106 @@
+#pragma once
+
+/***
+ * Keeps track of the connections made by the Dialer.
+ *
+ * Only one dial per peer is in flight at a time. Other callers that
+ * want the same peer wait for that dial to finish and share its result.
+ * When the number of connections goes above the high water mark, the
+ * least recently used are closed until the low water mark is reached.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/peer/peer.h"
+#include "libp2p/utils/linked_list.h"
+
+#define CONNECTION_MANAGER_DEFAULT_LOW_WATER 64
+#define CONNECTION_MANAGER_DEFAULT_HIGH_WATER 128
+// new connections are not trimmed until they are this old
+#define CONNECTION_MANAGER_DEFAULT_GRACE_PERIOD 20
+
+enum ConnectionManagerDialStatus {
+	// the caller should do the dial, then call libp2p_conn_manager_end_dial
+	CONNECTION_MANAGER_DIAL_OWNER,
+	// another thread did the dial, and it succeeded
+	CONNECTION_MANAGER_DIAL_JOINED,
+	// another thread did the dial, and it failed
+	CONNECTION_MANAGER_DIAL_FAILED
+};
+
+struct ConnectionManagerEntry {
+	char* peer_id;
+	size_t peer_id_size;
+	// the session of the last successful dial, held until every waiter has its own hold on it
+	struct SessionContext* session_context;
+	// true(1) while a dial is in flight
+	int dialing;
+	// true(1) if the last dial was successful
+	int connected;
+	// the number of threads waiting for the dial to finish
+	int waiters;
+	time_t connected_at;
+	time_t last_used;
+};
+
+struct ConnectionManager {
+	pthread_mutex_t lock;
+	pthread_cond_t dial_complete;
+	struct Libp2pLinkedList* entries;
+	int low_water;
+	int high_water;
+	int grace_period_secs;
+};
+
+/***
+ * Create a new ConnectionManager
+ * @param low_water trimming stops at this number of connections
+ * @param high_water trimming starts above this number of connections
+ * @returns the ConnectionManager, or NULL on error
+ */
+struct ConnectionManager* libp2p_conn_manager_new(int low_water, int high_water);
+
+/***
+ * Free resources of the ConnectionManager
+ * NOTE: This does not close the connections
+ * @param manager the ConnectionManager
+ */
+void libp2p_conn_manager_free(struct ConnectionManager* manager);
+
+/***
+ * Announce that we want to dial a peer
+ * NOTE: If another thread is already dialing this peer, this blocks until that dial
+ * completes. On success, the session of that dial is given to peer if it has none.
+ * @param manager the ConnectionManager
+ * @param peer the peer to dial
+ * @returns the ConnectionManagerDialStatus
+ */
+enum ConnectionManagerDialStatus libp2p_conn_manager_begin_dial(struct ConnectionManager* manager, struct Libp2pPeer* peer);
+
+/***
+ * Record the result of a dial started with libp2p_conn_manager_begin_dial
+ * NOTE: This wakes up the threads waiting on the dial
+ * @param manager the ConnectionManager
+ * @param peer the peer that was dialed
+ * @param success true(1) if the connection was made
+ */
+void libp2p_conn_manager_end_dial(struct ConnectionManager* manager, struct Libp2pPeer* peer, int success);
+
+/***
+ * Mark a connection as recently used, so that it is trimmed last
+ * @param manager the ConnectionManager
+ * @param peer the peer
+ */
+void libp2p_conn_manager_touch(struct ConnectionManager* manager, const struct Libp2pPeer* peer);
+
+/***
+ * Close the least recently used connections if there are more than high_water
+ * NOTE: The peers are marked not connected and their sessions are shut down, so
+ * reads and writes on them fail. The sessions stay on the peers, as others use them
+ * without a lock, and are freed by whoever lets go last (i.e. the peer when it reconnects).
+ * @param manager the ConnectionManager
+ * @param peerstore where to find the peers that own the connections
+ * @returns the number of connections closed
+ */
+int libp2p_conn_manager_trim(struct ConnectionManager* manager, struct Peerstore* peerstore);
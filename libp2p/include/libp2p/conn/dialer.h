@@ -17,6 +17,22 @@
 #include "libp2p/conn/transport_dialer.h"
 #include "libp2p/peer/peer.h"
 #include "libp2p/swarm/swarm.h"
+#include "libp2p/conn/connection_manager.h"
+
+// the most addresses of a peer that are tried at the same time
+#define DIALER_MAX_PARALLEL_DIALS 8
+// the delay before the next address is tried
+#define DIALER_STAGGER_MS 250
+// the number of threads that do asynchronous dials
+#define DIALER_THREADS 4
+
+/***
+ * Called when an asynchronous dial completes
+ * @param peer the peer that was dialed, or NULL if it is no longer in the peerstore
+ * @param success true(1) if we are connected
+ * @param arg what was passed to libp2p_conn_dialer_join_swarm_async
+ */
+typedef void (*libp2p_conn_dialer_callback)(struct Libp2pPeer* peer, int success, void* arg);
 
 struct Dialer {
 	/**
@@ -36,6 +52,7 @@ struct Dialer {
 
 	struct TransportDialer* fallback_dialer; // the default dialer. NOTE: this should not be in the list of transport_dialers
 	struct SwarmContext* swarm;
+	struct ConnectionManager* connection_manager; // de-duplicates dials and trims idle connections
 };
 
 /**
@@ -57,13 +74,29 @@ void libp2p_conn_dialer_free(struct Dialer* in);
 
 /***
  * Attempt to connect to a particular peer
+ * NOTE: An existing connection is reused, and simultaneous dials to the same peer are combined.
+ * All addresses of the peer are tried at once, with staggered starts, through the
+ * transport dialers (or the fallback dialer).
  * @param dialer the dialer
  * @param peer the peer to join
- * @param timeout_secs network timeout in seconds
+ * @param timeout_secs the deadline for connecting and negotiating all protocols (must be positive)
  * @returns true(1) on success, false(0) otherwise
  */
 int libp2p_conn_dialer_join_swarm(const struct Dialer* dialer, struct Libp2pPeer* peer, int timeout_secs);
 
+/***
+ * Attempt to connect to a particular peer without blocking the caller
+ * NOTE: The peer must be in the dialer's peerstore, as that is where the dialer thread finds it
+ * @param dialer the dialer
+ * @param peer the peer to join
+ * @param timeout_secs the deadline for connecting and negotiating all protocols (must be positive)
+ * @param callback called on a dialer thread when the dial is complete (can be NULL)
+ * @param callback_arg passed to the callback
+ * @returns true(1) if the dial was started, false(0) otherwise
+ */
+int libp2p_conn_dialer_join_swarm_async(const struct Dialer* dialer, struct Libp2pPeer* peer, int timeout_secs,
+		libp2p_conn_dialer_callback callback, void* callback_arg);
+
 /**
  * Retrieve a Connection struct from the dialer
  * @param dialer the dialer to use
@@ -76,8 +109,8 @@ struct Stream* libp2p_conn_dialer_get_connection(const struct Dialer* dialer, co
  * return a Stream that is already set up to use the passed in protocol
  * @param dialer the dialer to use
  * @param peer the host
- * @param protocol the protocol to use (right now only 'multistream' is supported)
- * @returns the ready-to-use stream
+ * @param protocol the protocol to use ('multistream', 'kademlia' or a protocol id)
+ * @returns the ready-to-use stream on a new yamux channel
  */
 struct Stream* libp2p_conn_dialer_get_stream(const struct Dialer* dialer, const struct Libp2pPeer* peer, const char* protocol);
 
@@ -62,6 +62,10 @@ struct SessionContext {
 	struct StretchedKey* remote_stretched_key;
 	unsigned char* remote_ephemeral_public_key;
 	size_t remote_ephemeral_public_key_size;
+	// the number of holders (peers, the swarm listener). Freed when the last one lets go.
+	int references;
+	// true(1) once the connection has been shut down
+	volatile int closed;
 };
 
 /***
@@ -70,12 +74,27 @@ struct SessionContext {
  */
 struct SessionContext* libp2p_session_context_new();
 /**
- * Free resources of a SessionContext struct
+ * Let go of a SessionContext. The resources are freed when the last holder lets go.
  * @param context the SessionContext
  * @returns true(1)
  */
 int libp2p_session_context_free(struct SessionContext* session);
 
+/***
+ * Hold on to a SessionContext, so that it is not freed until
+ * libp2p_session_context_free is called for this holder as well
+ * @param session the SessionContext
+ * @returns the SessionContext
+ */
+struct SessionContext* libp2p_session_context_retain(struct SessionContext* session);
+
+/***
+ * Shut down the connection of a SessionContext. Nothing is freed, so it is safe
+ * while others hold it, but their reads and writes fail from now on.
+ * @param session the SessionContext
+ */
+void libp2p_session_context_shutdown(struct SessionContext* session);
+
 /***
  * Compare 2 SessionContext structs for equality
  * @param a side A
@@ -9,9 +9,32 @@ struct TransportDialer {
 	struct RsaPrivateKey* private_key;
 	int (*can_handle)(const struct MultiAddress* multiaddr);
 	struct Stream* (*dial)(const struct TransportDialer* transport_dialer, const struct MultiAddress* multiaddr);
+	/**
+	 * Begin a connection without blocking, so that several can be raced (can be NULL)
+	 * @param transport_dialer this TransportDialer
+	 * @param multiaddr where to connect
+	 * @param connected set to true(1) if the connection was made right away
+	 * @returns the socket descriptor, or -1 on error
+	 */
+	int (*dial_start)(const struct TransportDialer* transport_dialer, const struct MultiAddress* multiaddr, int* connected);
+	/**
+	 * Complete a connection begun with dial_start, once the socket is writable
+	 * @param transport_dialer this TransportDialer
+	 * @param socket_descriptor what dial_start returned
+	 * @returns 0 on success, -1 on error
+	 */
+	int (*dial_finish)(const struct TransportDialer* transport_dialer, int socket_descriptor);
 };
 
 struct TransportDialer* libp2p_conn_transport_dialer_new(char* peer_id, struct RsaPrivateKey* private_key);
 void libp2p_conn_transport_dialer_free(struct TransportDialer* in);
 
 struct Stream* libp2p_conn_transport_dialer_get(const struct Libp2pLinkedList* transport_dialers, const struct MultiAddress* multiaddr);
+
+/**
+ * Given a list of dialers, find the one that can start a non-blocking connection to this multiaddress
+ * @param transport_dialers a list of dialers
+ * @param multiaddr the address
+ * @returns the TransportDialer, or NULL if none can
+ */
+const struct TransportDialer* libp2p_conn_transport_dialer_find(const struct Libp2pLinkedList* transport_dialers, const struct MultiAddress* multiaddr);
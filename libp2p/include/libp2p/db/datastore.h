@@ -14,6 +14,7 @@ struct DatastoreRecord {
 	uint8_t *value;
 	size_t value_size;
 	unsigned long long timestamp;
+	int pin; // true(1) if a put should pin it. A put never unpins.
 };
 
 struct Datastore {
@@ -37,6 +38,10 @@ struct Datastore {
 	int (*datastore_cursor_get)(unsigned char** key, int* key_length, unsigned char** value, int* value_length, enum DatastoreCursorOp op, struct Datastore* datastore);
 	// generic connection and status variables for the datastore
 	void* datastore_context; // a handle to a context that holds connectivity information
+	// called after each successful put, so caches can forget the key (can be NULL)
+	// NOTE: there is only one listener
+	void (*datastore_put_listener)(const uint8_t* key, size_t key_size, void* listener_context);
+	void* datastore_put_listener_context;
 };
 
 /***
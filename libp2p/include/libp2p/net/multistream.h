@@ -111,6 +111,28 @@ struct KademliaMessage* libp2p_net_multistream_get_message(struct Stream* stream
  */
 struct StreamMessage* libp2p_net_multistream_prepare_to_send(struct StreamMessage* incoming);
 
+/***
+ * Send the multistream header and a protocol id in one write, without waiting
+ * for the remote to answer the header first (multistream-select "lazy")
+ * NOTE: Use libp2p_net_multistream_accept_proposal to read the answer
+ * @param parent_stream the stream to negotiate on (a raw connection or secio)
+ * @param protocol_id the protocol we want (i.e. "/secio/1.0.0\n")
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_net_multistream_propose(struct Stream* parent_stream, const char* protocol_id);
+
+/***
+ * Read the answer to libp2p_net_multistream_propose. The remote sends its
+ * multistream header, and then either echoes the protocol id or sends "na".
+ * NOTE: Nothing else should be reading from parent_stream while this runs. Bytes
+ * that come after the answer in the same read are put back with parent_stream->unread.
+ * @param parent_stream the stream the proposal was sent on
+ * @param protocol_id the protocol that was proposed
+ * @param timeout_secs the number of seconds to wait for each read
+ * @returns true(1) if the remote accepted the protocol, false(0) otherwise
+ */
+int libp2p_net_multistream_accept_proposal(struct Stream* parent_stream, const char* protocol_id, int timeout_secs);
+
 /**
  * Create a new MultiStream structure
  * @param parent_stream the stream
@@ -121,6 +143,24 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
 
 void libp2p_net_multistream_stream_free(struct Stream* stream);
 
+/***
+ * Create a MultiStream structure when the negotiation has already been done
+ * (see libp2p_net_multistream_propose). Nothing is sent.
+ * NOTE: A protocol built on this stream is moved onto parent_stream by
+ * handle_upgrade, the same as on the listening side. Its frames are not
+ * varint prefixed. Free this stream with libp2p_net_multistream_stream_discard
+ * after that.
+ * @param parent_stream the stream the negotiation was done on
+ * @returns the new Stream, or NULL on error
+ */
+struct Stream* libp2p_net_multistream_stream_new_negotiated(struct Stream* parent_stream);
+
+/***
+ * Free a MultiStream that a protocol has been upgraded over. The parent is left open.
+ * @param stream the multistream
+ */
+void libp2p_net_multistream_stream_discard(struct Stream* stream);
+
 /***
  * Wait for multistream stream to become ready
  * @param context the session context to check, can also be a YamuxChannelContext
@@ -11,6 +11,16 @@ int socket_accept4(int s, uint32_t *ip, uint16_t *port);
 int socket_local4(int s, uint32_t *ip, uint16_t *port);
 int socket_connect4(int s, uint32_t ip, uint16_t port);
 int socket_connect4_with_timeout(int s, uint32_t ip, uint16_t port, int timeout_secs);
+/***
+ * Begin a non-blocking client connection
+ * @returns 0 if connected, 1 if the connection is in progress, -1 on error
+ */
+int socket_connect4_start(int s, uint32_t ip, uint16_t port);
+/***
+ * Complete a connection started with socket_connect4_start
+ * @returns 0 on success, otherwise -1
+ */
+int socket_connect4_finish(int s);
 int socket_listen(int s, uint32_t *localip, uint16_t *localport);
 
 /***
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+/***
+ * Admission control for inbound requests of one protocol. Each protocol
+ * has a global token bucket, a token bucket per remote peer, and a limit
+ * on the number of requests being worked on at once. When the global
+ * bucket runs low, or most of the slots are busy, lower priority requests
+ * are turned away first. Nothing waits for a slot.
+ */
+
+// how many requests per second the whole protocol can handle, on average
+#define RATELIMIT_DEFAULT_GLOBAL_RATE 200
+#define RATELIMIT_DEFAULT_GLOBAL_BURST 400
+// how many requests per second one peer can make, on average
+#define RATELIMIT_DEFAULT_PEER_RATE 20
+#define RATELIMIT_DEFAULT_PEER_BURST 40
+// the number of requests that can be worked on at the same time
+#define RATELIMIT_DEFAULT_MAX_IN_FLIGHT 32
+// the most peers tracked at once. Past this, untracked peers share one bucket
+#define RATELIMIT_MAX_PEERS 1024
+#define RATELIMIT_PEER_BUCKETS 256
+// how often (in seconds) the drop counters are logged, if something was dropped
+#define RATELIMIT_REPORT_SECS 60
+
+enum RateLimitPriority {
+	RATELIMIT_PRIORITY_HIGH, // cheap, or needed to keep the network working (i.e. ping)
+	RATELIMIT_PRIORITY_NORMAL, // lookups
+	RATELIMIT_PRIORITY_LOW, // requests that make us store or queue something
+	RATELIMIT_PRIORITY_COUNT
+};
+
+/***
+ * The counters of a rate limiter
+ */
+struct RateLimitStats {
+	unsigned long long admitted[RATELIMIT_PRIORITY_COUNT];
+	// the peer went over its own limit
+	unsigned long long dropped_peer[RATELIMIT_PRIORITY_COUNT];
+	// the protocol as a whole was too busy for this priority
+	unsigned long long dropped_global[RATELIMIT_PRIORITY_COUNT];
+	// too many requests were being worked on
+	unsigned long long dropped_busy[RATELIMIT_PRIORITY_COUNT];
+};
+
+struct RateLimitBucket {
+	double tokens;
+	struct timespec last_refill;
+};
+
+/***
+ * The bucket of one remote peer
+ */
+struct RateLimitPeer {
+	char* peer_id;
+	size_t peer_id_size;
+	struct RateLimitBucket bucket;
+	// the next peer in the same hash bucket
+	struct RateLimitPeer* next;
+};
+
+struct Libp2pRateLimiter {
+	char* protocol_id;
+	double global_rate;
+	double global_burst;
+	double peer_rate;
+	double peer_burst;
+	int max_in_flight;
+	struct RateLimitBucket global;
+	struct RateLimitPeer* peers[RATELIMIT_PEER_BUCKETS];
+	int num_peers;
+	// shared by the peers that did not fit in the table
+	struct RateLimitBucket overflow;
+	int in_flight;
+	struct RateLimitStats stats;
+	time_t last_report;
+	unsigned long long dropped_at_last_report;
+	pthread_mutex_t lock;
+};
+
+/***
+ * Create a rate limiter with the default limits
+ * @param protocol_id the protocol this limits (used in log messages)
+ * @returns the limiter, or NULL on error
+ */
+struct Libp2pRateLimiter* libp2p_net_ratelimit_new(const char* protocol_id);
+
+/***
+ * Change the limits of a rate limiter
+ * @param limiter the limiter
+ * @param global_rate requests per second for everyone
+ * @param global_burst the most requests at once for everyone
+ * @param peer_rate requests per second for one peer
+ * @param peer_burst the most requests at once for one peer
+ * @param max_in_flight the number of requests that can be worked on at the same time
+ */
+void libp2p_net_ratelimit_set_limits(struct Libp2pRateLimiter* limiter, double global_rate, double global_burst,
+		double peer_rate, double peer_burst, int max_in_flight);
+
+/***
+ * Ask to work on a request. If admitted, libp2p_net_ratelimit_release must be
+ * called when the work is done.
+ * NOTE: This does not wait. Only a request that is admitted uses up tokens.
+ * @param limiter the limiter
+ * @param peer_id the remote peer (can be NULL if not known)
+ * @param peer_id_size the size of peer_id
+ * @param priority how important the request is
+ * @returns true(1) if the request can be worked on, false(0) if it should be dropped
+ */
+int libp2p_net_ratelimit_admit(struct Libp2pRateLimiter* limiter, const char* peer_id, size_t peer_id_size, enum RateLimitPriority priority);
+
+/***
+ * Give back the slot of an admitted request
+ * @param limiter the limiter
+ */
+void libp2p_net_ratelimit_release(struct Libp2pRateLimiter* limiter);
+
+/***
+ * Get a copy of the counters
+ * @param limiter the limiter
+ * @param stats where to put the counters
+ */
+void libp2p_net_ratelimit_get_stats(struct Libp2pRateLimiter* limiter, struct RateLimitStats* stats);
+
+/***
+ * Free the resources of a rate limiter
+ * @param limiter the limiter
+ */
+void libp2p_net_ratelimit_free(struct Libp2pRateLimiter* limiter);
@@ -92,6 +92,15 @@ struct Stream {
 	 */
 	int (*read_raw)(void* stream_context, uint8_t* buffer, int buffer_size, int timeout_secs);
 
+	/***
+	 * Puts bytes back, so that they are the first to be read next (can be NULL)
+	 * @param stream_context the context
+	 * @param data the bytes
+	 * @param data_size the number of bytes
+	 * @returns true(1) on success, false(0) otherwise
+	 */
+	int (*unread)(void* stream_context, const uint8_t* data, size_t data_size);
+
 	/**
 	 * Writes to a stream
 	 * @param stream the stream context (usually a SessionContext pointer)
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <pthread.h>
+
 #include "libp2p/utils/linked_list.h"
+#include "libp2p/utils/vector.h"
 #include "libp2p/peer/peer.h"
 
 /**
@@ -12,20 +15,35 @@
  * An entry in the "database" is a PeerEntry. This contains metadata
  * about the peer
  */
+// the size of PeerEntry.hashed_id (a SHA256 digest)
+#define PEER_ENTRY_HASHED_ID_SIZE 32
+
 struct PeerEntry {
 	struct Libp2pPeer* peer;
+	// SHA256 of the peer id (its position in the kademlia keyspace), filled in when added to a Peerstore
+	unsigned char hashed_id[PEER_ENTRY_HASHED_ID_SIZE];
 	// other metadata for the peer goes here
 	// TODO: add some type of timer to expire the record
 };
 
+// the number of hash buckets a new Peerstore starts with (grows as peers are added)
+#define PEERSTORE_INITIAL_BUCKETS 64
+
 /**
  * Contains a collection of peers and their metadata
- * NOTE: this is currently a linked list. Perhaps a better algo would
- * improve performance, but will wait.
+ * NOTE: Lookups go through a hash table keyed by peer id. The linked list keeps
+ * the order the peers were added in, and is only appended to, so walking it without
+ * the lock is safe. Prefer libp2p_peerstore_get_peers for iterating.
  */
 struct Peerstore {
+	// PeerEntry structs, in the order they were added. The local peer is first.
 	struct Libp2pLinkedList* head_entry;
 	struct Libp2pLinkedList* last_entry;
+	// each bucket is a linked list of PeerEntry structs
+	struct Libp2pLinkedList** buckets;
+	size_t bucket_count;
+	size_t num_entries;
+	pthread_rwlock_t lock;
 };
 
 struct PeerEntry* libp2p_peer_entry_new();
@@ -79,6 +97,24 @@ struct PeerEntry* libp2p_peerstore_get_peer_entry(struct Peerstore* peerstore, c
  */
 struct Libp2pPeer* libp2p_peerstore_get_peer(struct Peerstore* peerstore, const unsigned char* peer_id, size_t peer_id_size);
 
+/***
+ * Get all the peers, in the order they were added
+ * NOTE: The vector is a copy, so the peerstore can change while the caller walks it.
+ * The peers belong to the peerstore, and must not be freed by the caller.
+ * @param peerstore the peerstore
+ * @returns a vector of Libp2pPeer pointers (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_peerstore_get_peers(struct Peerstore* peerstore);
+
+/***
+ * Get all the entries, in the order they were added
+ * NOTE: The vector is a copy, so the peerstore can change while the caller walks it.
+ * The entries belong to the peerstore, and must not be freed by the caller.
+ * @param peerstore the peerstore
+ * @returns a vector of PeerEntry pointers (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_peerstore_get_peer_entries(struct Peerstore* peerstore);
+
 /**
  * Retrieves the local peer, which is always the first in the collection
  * @param peerstore the peerstore
@@ -1,7 +1,22 @@
 #pragma once
 
+#include <pthread.h>
+#include <time.h>
+
 #include "libp2p/db/datastore.h"
 #include "libp2p/peer/peer.h"
+#include "libp2p/utils/vector.h"
+
+// the number of hash buckets a new ProviderStore starts with (grows as keys are added)
+#define PROVIDERSTORE_INITIAL_BUCKETS 256
+// the most providers remembered for one key. When full, the stalest is dropped
+#define PROVIDERSTORE_MAX_PROVIDERS 20
+// how long an announcement is good for, unless it is announced again
+#define PROVIDERSTORE_DEFAULT_TTL (24 * 60 * 60)
+// the number of slots in the timing wheel that expires announcements
+#define PROVIDERSTORE_WHEEL_SLOTS 256
+
+struct ProviderKey;
 
 /**
  * Contains a hash and the peer id of
@@ -12,15 +27,49 @@ struct ProviderEntry {
 	int hash_size;
 	unsigned char* peer_id;
 	int peer_id_size;
+	// when the provider last announced this hash
+	time_t announced;
+	time_t expires;
+	// the key this entry belongs to (NULL for copies handed out by the store)
+	struct ProviderKey* key;
+	// the providers of the key, freshest first
+	struct ProviderEntry* fresher;
+	struct ProviderEntry* staler;
+	// the other entries in the same timing wheel slot
+	struct ProviderEntry* wheel_prev;
+	struct ProviderEntry* wheel_next;
 };
 
 /***
- * A structure to store providers. The implementation
- * is a vector of ProviderEntry structures, which contain
- * the hash and peer id.
+ * The providers of one hash
+ */
+struct ProviderKey {
+	unsigned char* hash;
+	int hash_size;
+	struct ProviderEntry* freshest;
+	struct ProviderEntry* stalest;
+	int num_providers;
+	// the next key in the same hash bucket
+	struct ProviderKey* next;
+};
+
+/***
+ * A structure to store providers. The implementation is a hash table
+ * keyed by the multihash, with a bounded list of providers per key.
+ * Announcements expire after ttl_secs, using a timing wheel.
  */
 struct ProviderStore {
-	struct Libp2pVector* provider_entries;
+	struct ProviderKey** buckets;
+	size_t bucket_count;
+	size_t num_keys;
+	// each slot is a list of entries that expire in that slot's tick
+	struct ProviderEntry* wheel[PROVIDERSTORE_WHEEL_SLOTS];
+	// the number of seconds covered by one slot
+	time_t wheel_tick_secs;
+	// the last tick that was expired
+	time_t wheel_tick;
+	int ttl_secs;
+	pthread_mutex_t lock;
 	// this is requred so we can look locally for requests
 	const struct Datastore* datastore;
 	const struct Libp2pPeer* local_peer;
@@ -28,6 +77,8 @@ struct ProviderStore {
 
 /**
  * Create a new ProviderStore
+ * @param datastore the datastore (required in order to look for the file locally)
+ * @param local_peer the local peer
  * @returns a ProviderStore struct
  */
 struct ProviderStore* libp2p_providerstore_new(const struct Datastore* datastore, const struct Libp2pPeer* local_peer);
@@ -38,6 +89,50 @@ struct ProviderStore* libp2p_providerstore_new(const struct Datastore* datastore
  */
 void libp2p_providerstore_free(struct ProviderStore* in);
 
+/***
+ * Free a ProviderEntry that was handed out by libp2p_providerstore_get_providers
+ * @param in the entry
+ */
+void libp2p_providerstore_entry_free(struct ProviderEntry* in);
+
+/***
+ * Remember that a peer can provide a hash. If the peer already announced it,
+ * the announcement is refreshed.
+ * @param store the ProviderStore
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @param peer_id the peer that can provide it
+ * @param peer_id_size the size of peer_id
+ * @returns true(1) on success, false(0) otherwise
+ */
 int libp2p_providerstore_add(struct ProviderStore* store, const unsigned char* hash, int hash_size, const unsigned char* peer_id, int peer_id_size);
 
+/**
+ * See if someone has announced a key. If so, pass the peer_id of the freshest announcement
+ * NOTE: This will check to see if I can provide it from my datastore
+ *
+ * @param store the list of providers
+ * @param hash what we're looking for
+ * @param hash_size the length of the hash
+ * @param peer_id the peer_id of who can provide it
+ * @param peer_id_size the allocated size of peer_id
+ * @returns true(1) if we found something, false(0) if not.
+ */
 int libp2p_providerstore_get(struct ProviderStore* store, const unsigned char* hash, int hash_size, unsigned char** peer_id, int *peer_id_size);
+
+/***
+ * Get the freshest providers of a hash that others have announced
+ * NOTE: This does not check the local datastore
+ * @param store the ProviderStore
+ * @param hash what we're looking for
+ * @param hash_size the length of the hash
+ * @param max_providers the most to return
+ * @returns a vector of ProviderEntry copies, freshest first (free with libp2p_providerstore_providers_free), or NULL if none
+ */
+struct Libp2pVector* libp2p_providerstore_get_providers(struct ProviderStore* store, const unsigned char* hash, int hash_size, int max_providers);
+
+/***
+ * Free the results of libp2p_providerstore_get_providers
+ * @param providers the vector of ProviderEntry copies
+ */
+void libp2p_providerstore_providers_free(struct Libp2pVector* providers);
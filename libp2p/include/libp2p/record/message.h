@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 #include "libp2p/record/record.h"
+#include "libp2p/utils/arena.h"
+#include "libp2p/utils/vector.h"
 
 /**
  * protobuf stuff for Message
@@ -25,6 +27,8 @@ struct KademliaMessage {
 	struct Libp2pLinkedList* closer_peer_head; // protobuf field 8 linked list of Libp2pPeers
 	struct Libp2pLinkedList* provider_peer_head; // protobuf field 9 linked list of Libp2pPeers
 	int32_t cluster_level_raw; // protobuf field 10
+	// not protobuf'd. If set, the message and everything it points to lives in this arena
+	struct Libp2pArena* arena;
 };
 
 /**
@@ -35,6 +39,7 @@ struct KademliaMessage* libp2p_message_new();
 
 /**
  * Deallocate memory from a Message struct
+ * NOTE: if the message was decoded into an arena, only the arena is freed
  * @param in the struct
  */
 void libp2p_message_free(struct KademliaMessage* in);
@@ -75,3 +80,28 @@ int libp2p_message_protobuf_allocate_and_encode(const struct KademliaMessage* in
  */
 int libp2p_message_protobuf_decode(unsigned char* buffer, size_t buffer_size, struct KademliaMessage** out);
 
+
+/***
+ * Encode a message, adding peers that are not in the message's lists. The extra
+ * peers are encoded straight from the vectors (i.e. from the peerstore) without
+ * being copied.
+ * @param in the message
+ * @param closer_peers more Libp2pPeers for field 8 (can be NULL)
+ * @param provider_peers more Libp2pPeers for field 9 (can be NULL)
+ * @param buffer where to put the results (allocated here)
+ * @param buffer_size the size written into buffer
+ * @returns true(1) on success, otherwise false(0)
+ */
+int libp2p_message_protobuf_encode_with_peers(const struct KademliaMessage* in, const struct Libp2pVector* closer_peers,
+		const struct Libp2pVector* provider_peers, unsigned char** buffer, size_t* buffer_size);
+
+/***
+ * turn a protobuf back into a message, putting everything in one arena. Free
+ * the results with libp2p_message_free, which frees the arena.
+ * NOTE: Nothing in the message can be taken and freed separately
+ * @param buffer the protobuf
+ * @param buffer_size the length of the buffer
+ * @param out the message
+ * @returns true(1) on success, otherwise false(0)
+ */
+int libp2p_message_protobuf_decode_arena(const unsigned char* buffer, size_t buffer_size, struct KademliaMessage** out);
@@ -77,6 +77,16 @@ int dht_nodes(int af,
 void dht_dump_tables(FILE *f);
 int dht_get_nodes(struct sockaddr_in *sin, int *num,
                   struct sockaddr_in6 *sin6, int *num6);
+/**
+ * Get the good nodes of one address family, with their ids
+ * @param af IP family (AF_INET or AF_INET6)
+ * @param ids where to put the ids (20 bytes each)
+ * @param ss where to put the addresses
+ * @param num the size of the arrays. On return, the number of nodes
+ * @returns the number of nodes
+ */
+int dht_get_good_nodes(int af, unsigned char *ids, struct sockaddr_storage *ss,
+                       int *num);
 int dht_uninit(void);
 
 /* This must be provided by the user. */
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+#include "libp2p/record/message.h"
+
+/***
+ * A short lived cache of encoded DHT responses. Popular keys get the same
+ * request from many peers, and the answer rarely changes from one second
+ * to the next. Entries are keyed by the message type and key of the request,
+ * and are dropped when they expire, when the cache is full (least recently
+ * used first), or when something changes the answer for that key.
+ */
+
+// how long a response is good for
+#define DHT_CACHE_DEFAULT_TTL 10
+// the most responses kept
+#define DHT_CACHE_DEFAULT_MAX_ENTRIES 1024
+// the most bytes of responses kept
+#define DHT_CACHE_DEFAULT_MAX_BYTES (4 * 1024 * 1024)
+// the number of hash buckets
+#define DHT_CACHE_BUCKETS 256
+
+struct DhtCacheEntry {
+	enum MessageType message_type;
+	int32_t cluster_level_raw;
+	unsigned char* key;
+	size_t key_size;
+	// the encoded response
+	unsigned char* response;
+	size_t response_size;
+	struct timespec expires;
+	// the next entry in the same hash bucket
+	struct DhtCacheEntry* next;
+	// the least recently used list (most recent first)
+	struct DhtCacheEntry* newer;
+	struct DhtCacheEntry* older;
+};
+
+struct DhtResponseCache {
+	struct DhtCacheEntry* buckets[DHT_CACHE_BUCKETS];
+	struct DhtCacheEntry* newest;
+	struct DhtCacheEntry* oldest;
+	int num_entries;
+	size_t num_bytes;
+	int max_entries;
+	size_t max_bytes;
+	int ttl_secs;
+	// bumped when something changes the answers for the keys of a bucket. A response
+	// computed while it changed is stale, and is not put in the cache.
+	// NOTE: keys in the same bucket share one, so a change to one key can keep
+	// the response for another out of the cache once. That is only a miss.
+	unsigned long long generations[DHT_CACHE_BUCKETS];
+	unsigned long long hits;
+	unsigned long long misses;
+	pthread_mutex_t lock;
+};
+
+/***
+ * Create a new response cache with the default limits
+ * @returns the cache, or NULL on error
+ */
+struct DhtResponseCache* libp2p_routing_dht_cache_new();
+
+/***
+ * Free the resources of a response cache
+ * @param cache the cache
+ */
+void libp2p_routing_dht_cache_free(struct DhtResponseCache* cache);
+
+/***
+ * Look for a response to a request
+ * @param cache the cache
+ * @param request the request
+ * @param response where to put a copy of the response (allocated here)
+ * @param response_size the size of the response
+ * @param generation where to put the generation of the key, to pass to libp2p_routing_dht_cache_put on a miss
+ * @returns true(1) if found, false(0) otherwise
+ */
+int libp2p_routing_dht_cache_get(struct DhtResponseCache* cache, const struct KademliaMessage* request, unsigned char** response, size_t* response_size, unsigned long long* generation);
+
+/***
+ * Remember the response to a request, unless the answer for the key changed while it was computed
+ * @param cache the cache
+ * @param request the request
+ * @param response the encoded response (copied)
+ * @param response_size the size of the response
+ * @param generation what libp2p_routing_dht_cache_get gave before the response was computed
+ * @returns true(1) on success, false(0) otherwise (or if the response is stale)
+ */
+int libp2p_routing_dht_cache_put(struct DhtResponseCache* cache, const struct KademliaMessage* request, const unsigned char* response, size_t response_size, unsigned long long generation);
+
+/***
+ * Forget all responses about a key
+ * @param cache the cache
+ * @param key the key
+ * @param key_size the size of the key
+ */
+void libp2p_routing_dht_cache_invalidate(struct DhtResponseCache* cache, const unsigned char* key, size_t key_size);
+
+/***
+ * A datastore put listener that forgets the responses for the key that was put
+ * @see Datastore->datastore_put_listener
+ * @param key the key that was put
+ * @param key_size the size of the key
+ * @param cache the DhtResponseCache
+ */
+void libp2p_routing_dht_cache_datastore_listener(const uint8_t* key, size_t key_size, void* cache);
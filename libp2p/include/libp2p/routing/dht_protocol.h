@@ -2,20 +2,32 @@
 
 #include "libp2p/conn/session.h"
 #include "libp2p/net/protocol.h"
+#include "libp2p/net/ratelimit.h"
 #include "libp2p/peer/peerstore.h"
 #include "libp2p/peer/providerstore.h"
 #include "libp2p/record/message.h"
+#include "libp2p/routing/dht_cache.h"
 
 /***
  * This is where kademlia and dht talk to the outside world
  */
 
+// the size of an id in the kademlia keyspace (a sha256 of the peer id or key)
+// (the same as PeerEntry.hashed_id, so the peerstore can keep it)
+#define DHT_PROTOCOL_ID_SIZE PEER_ENTRY_HASHED_ID_SIZE
+// the number of closer peers sent back in a response (kademlia's k)
+#define DHT_PROTOCOL_K 20
+
 
 struct DhtContext {
 	struct Peerstore* peer_store;
 	struct ProviderStore* provider_store;
 	struct Datastore* datastore;
 	struct Filestore* filestore;
+	// admission control for incoming requests
+	struct Libp2pRateLimiter* rate_limiter;
+	// recent GET_PROVIDERS responses
+	struct DhtResponseCache* response_cache;
 };
 
 struct Libp2pProtocolHandler* libp2p_routing_dht_build_protocol_handler(struct Peerstore* peer_store, struct ProviderStore* provider_store,
@@ -54,6 +66,17 @@ int libp2p_routing_dht_handle_message(struct Stream* stream, struct DhtContext*
  */
 int libp2p_routing_dht_send_message(struct SessionContext* sessionContext, struct KademliaMessage* message);
 
+/***
+ * Send a kademlia message that was already protobuf'd. Lets the same
+ * bytes go to many peers without encoding them again.
+ * NOTE: this call upgrades the stream to /ipfs/kad/1.0.0
+ * @param sessionContext the context
+ * @param protobuf the encoded KademliaMessage
+ * @param protobuf_size the size of protobuf
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_routing_dht_send_encoded(struct SessionContext* sessionContext, unsigned char* protobuf, size_t protobuf_size);
+
 /**
  * Attempt to receive a kademlia message
  * NOTE: This call assumes that a send_message was sent
@@ -74,3 +97,32 @@ int libp2p_routing_dht_receive_message(struct SessionContext* sessionContext, st
  */
 int libp2p_routing_dht_send_message_nearest_x(const struct Dialer* dialer, struct Peerstore* peerstore,
 		struct Datastore* datastore, struct KademliaMessage* msg, int numToSend);
+
+/***
+ * Compute the position of a peer id or key in the kademlia keyspace
+ * @param id the peer id or key
+ * @param id_size the size of id
+ * @param kad_id where to put the results (DHT_PROTOCOL_ID_SIZE bytes)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_routing_dht_kademlia_id(const unsigned char* id, size_t id_size, unsigned char* kad_id);
+
+/***
+ * Compare the XOR distance of two kademlia ids to a target
+ * @param a the first kademlia id
+ * @param b the second kademlia id
+ * @param target the kademlia id to measure from
+ * @returns less than 0 if a is closer, greater than 0 if b is closer, 0 if they are the same
+ */
+int libp2p_routing_dht_xor_compare(const unsigned char* a, const unsigned char* b, const unsigned char* target);
+
+/***
+ * Find the peers in the peerstore that are closest to a key by XOR distance
+ * NOTE: The local peer and peers without addresses are skipped
+ * @param peerstore the peerstore
+ * @param key the key (or peer id)
+ * @param key_size the size of key
+ * @param max_peers the most to return
+ * @returns a vector of peers from the peerstore, closest first (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_routing_dht_closest_peers(struct Peerstore* peerstore, const unsigned char* key, size_t key_size, int max_peers);
@@ -3,8 +3,30 @@
 #include "libp2p/utils/vector.h"
 #include "multiaddr/multiaddr.h"
 
+// the size of the hashes searched for
+#define KADEMLIA_HASH_SIZE 20
+// the most searches that can wait to be started by the kademlia thread (a power of 2)
+#define KADEMLIA_QUEUE_SIZE 64
+
+/***
+ * Called with the events of a search (the same as dht_callback)
+ * @param closure what was passed with the search
+ * @param event one of the DHT_EVENT_ values
+ * @param info_hash the hash searched for
+ * @param data the new value (for DHT_EVENT_VALUES and DHT_EVENT_VALUES6)
+ * @param data_len the length of data
+ */
+typedef void kademlia_search_callback(void *closure, int event, const unsigned char *info_hash, const void *data, size_t data_len);
+
 int start_kademlia(int sock, int family, char* peer_id, int timeout, struct Libp2pVector* bootstrap_addresses);
 int start_kademlia_multiaddress(struct MultiAddress* multiaddress, char* peer_id, int timeout, struct Libp2pVector* bootstrap_addresses);
+/***
+ * Set the file the routing table is saved to and loaded from
+ * NOTE: call before start_kademlia
+ * @param path the file name, or NULL to not save
+ * @returns true(1) on success, false(0) otherwise
+ */
+int set_kademlia_cache_path (const char* path);
 void stop_kademlia (void);
 
 void *kademlia_thread (void *ptr);
@@ -12,6 +34,17 @@ void *announce_thread (void *ptr);
 
 int announce_kademlia (char* peer_id, uint16_t port);
 
+/***
+ * Start a search for a hash. The search runs on the kademlia thread, and
+ * the events of this search (and only this search) are passed to cb.
+ * @param id the hash to look for (KADEMLIA_HASH_SIZE bytes)
+ * @param port the port to announce, or 0 to only search
+ * @param cb called from the kademlia thread with the events of the search. Can be NULL.
+ * @param closure passed to cb
+ * @returns true(1) if the search was queued, false(0) if not started or the queue is full
+ */
+int search_kademlia_async (const unsigned char* id, uint16_t port, kademlia_search_callback *cb, void *closure);
+
 /***
  * Search for a hash
  * @param peer_id the hash to search for
@@ -39,6 +39,16 @@ struct Libp2pProtocolHandler* libp2p_secio_build_protocol_handler(struct RsaPriv
  */
 struct Stream* libp2p_secio_stream_new(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key);
 
+/***
+ * Build a secio Stream when the protocol id has already been accepted by the
+ * remote (see libp2p_net_multistream_propose). The caller does the handshake.
+ * @param parent_stream the parent stream
+ * @param peerstore the peerstore
+ * @param rsa_private_key the local private key
+ * @returns a Secio Stream
+ */
+struct Stream* libp2p_secio_stream_new_negotiated(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key);
+
 /***
  * Initiates a secio handshake. Use this method when you want to initiate a secio
  * session. This should not be used to respond to incoming secio requests
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * A simple arena (bump) allocator. Memory is handed out from large chunks,
+ * and everything is freed at once with libp2p_utils_arena_free.
+ *
+ * NOTE: There is no way to free a single allocation, and the arena is not
+ * thread safe.
+ */
+
+// the size of the first chunk if none is given
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+
+struct Libp2pArenaChunk {
+	struct Libp2pArenaChunk* next;
+	size_t size;
+	size_t used;
+};
+
+struct Libp2pArena {
+	// the chunk being allocated from. Older chunks follow it.
+	struct Libp2pArenaChunk* head;
+	// the size of the next chunk
+	size_t chunk_size;
+};
+
+/***
+ * Create a new arena. The arena struct and the first chunk are one allocation.
+ * @param chunk_size the size of the first chunk (0 for the default)
+ * @returns the arena, or NULL on error
+ */
+struct Libp2pArena* libp2p_utils_arena_new(size_t chunk_size);
+
+/***
+ * Allocate memory from the arena. The memory is aligned for any type.
+ * @param arena the arena
+ * @param size the number of bytes
+ * @returns the memory, or NULL on error
+ */
+void* libp2p_utils_arena_alloc(struct Libp2pArena* arena, size_t size);
+
+/***
+ * Copy bytes into the arena
+ * @param arena the arena
+ * @param data the bytes to copy
+ * @param size the number of bytes
+ * @returns the copy, or NULL on error
+ */
+void* libp2p_utils_arena_memdup(struct Libp2pArena* arena, const void* data, size_t size);
+
+/***
+ * Free the arena and everything allocated from it
+ * @param arena the arena
+ */
+void libp2p_utils_arena_free(struct Libp2pArena* arena);
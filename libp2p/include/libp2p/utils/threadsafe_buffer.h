@@ -2,19 +2,42 @@
 
 /**
  * A thredsafe buffer
+ *
+ * The bytes are kept in a list of fixed size chunks, so appending
+ * and consuming never move bytes that are already in the buffer.
  */
 
 #include <string.h>
 #include <pthread.h>
 #include <stdint.h>
 
+#define THREADSAFE_BUFFER_CHUNK_SIZE 4096
+
+/***
+ * A piece of the buffer
+ */
+struct ThreadsafeBufferChunk {
+	struct ThreadsafeBufferChunk* next;
+	uint8_t data[THREADSAFE_BUFFER_CHUNK_SIZE];
+};
+
 /***
  * Holds the information about the buffer
  */
 struct ThreadsafeBufferContext {
+	// the number of bytes available to be read
 	size_t buffer_size;
-	uint8_t* buffer;
+	// where reading starts
+	struct ThreadsafeBufferChunk* head;
+	size_t head_pos;
+	// where writing continues
+	struct ThreadsafeBufferChunk* tail;
+	size_t tail_pos;
+	// a consumed chunk, kept to avoid an allocation on the next write
+	struct ThreadsafeBufferChunk* spare;
 	pthread_mutex_t lock;
+	// signaled when bytes are added
+	pthread_cond_t data_available;
 };
 
 /***
@@ -29,6 +52,13 @@ struct ThreadsafeBufferContext* threadsafe_buffer_context_new();
  */
 void threadsafe_buffer_context_free(struct ThreadsafeBufferContext* context);
 
+/***
+ * Get the number of bytes waiting to be read
+ * @param context the context
+ * @returns the number of bytes in the buffer
+ */
+size_t threadsafe_buffer_size(struct ThreadsafeBufferContext* context);
+
 /***
  * Read from the buffer without destroying its contents or moving its read pointer
  * @param context the context
@@ -38,6 +68,24 @@ void threadsafe_buffer_context_free(struct ThreadsafeBufferContext* context);
  */
 size_t threadsafe_buffer_peek(struct ThreadsafeBufferContext* context, uint8_t* results, size_t results_size);
 
+/***
+ * Look at the beginning of the buffer without copying it
+ * NOTE: The pointer is valid until the next read or consume. Only the contiguous
+ * bytes of the first chunk are returned, so this can be less than the buffer size.
+ * @param context the context
+ * @param results where to put the pointer to the bytes
+ * @returns the number of contiguous bytes at results
+ */
+size_t threadsafe_buffer_peek_contiguous(struct ThreadsafeBufferContext* context, const uint8_t** results);
+
+/***
+ * Discard bytes from the beginning of the buffer
+ * @param context the context
+ * @param bytes_size the number of bytes to discard
+ * @returns the number of bytes discarded
+ */
+size_t threadsafe_buffer_consume(struct ThreadsafeBufferContext* context, size_t bytes_size);
+
 /***
  * Read from the buffer.
  * NOTE: If results_size is more than what is left in the buffer, this will read everything.
@@ -56,3 +104,12 @@ size_t threadsafe_buffer_read(struct ThreadsafeBufferContext* context, uint8_t*
  * @returns the size added to the buffer (0 on error)
  */
 size_t threadsafe_buffer_write(struct ThreadsafeBufferContext* context, const uint8_t* bytes, size_t bytes_size);
+
+/***
+ * Block until the buffer holds at least min_bytes, or the timeout expires
+ * @param context the context
+ * @param min_bytes the number of bytes wanted
+ * @param timeout_secs the maximum number of seconds to wait
+ * @returns the number of bytes in the buffer
+ */
+size_t threadsafe_buffer_wait(struct ThreadsafeBufferContext* context, size_t min_bytes, int timeout_secs);
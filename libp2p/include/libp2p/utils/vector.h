@@ -34,6 +34,6 @@ int libp2p_utils_vector_total(struct Libp2pVector* in);
  */
 int libp2p_utils_vector_add(struct Libp2pVector *vector, const void * value);
 void libp2p_utils_vector_set(struct Libp2pVector *vector, int pos, void *value);
-const void *libp2p_utils_vector_get(struct Libp2pVector *vector, int);
+const void *libp2p_utils_vector_get(const struct Libp2pVector *vector, int);
 void libp2p_utils_vector_delete(struct Libp2pVector *vector, int pos);
 void libp2p_utils_vector_free(struct Libp2pVector *vector);
@@ -12,6 +12,9 @@ struct yamux_config
 
 #define YAMUX_DEFAULT_WINDOW (0x100*0x400)
 
+// number of workers shared by all channels to process incoming data
+#define YAMUX_READ_THREADS 4
+
 #define YAMUX_DEFAULT_CONFIG ((struct yamux_config)\
 {\
     .accept_backlog=0x100,\
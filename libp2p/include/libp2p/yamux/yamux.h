@@ -57,8 +57,8 @@ struct YamuxChannelContext {
 	int closed;
 	// a buffer for data coming in from the network
 	struct ThreadsafeBufferContext* buffer;
-	// true if read is already running
-	int read_running;
+	// true if a read job is queued or running on the worker pool
+	volatile int read_running;
 };
 
 /**
@@ -90,6 +90,16 @@ int yamux_receive_protocol(struct YamuxContext* context);
  */
 struct Stream* libp2p_yamux_stream_new(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers);
 
+/***
+ * Build a yamux Stream when the protocol id has already been accepted by the
+ * remote (see libp2p_net_multistream_propose)
+ * @param parent_stream the parent stream
+ * @param am_server true(1) if we are considered the server, false(0) if we are the client.
+ * @param protocol_handlers the protocol handlers
+ * @returns a Stream that is ready for yamux
+ */
+struct Stream* libp2p_yamux_stream_new_negotiated(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers);
+
 void libp2p_yamux_stream_free(struct Stream* stream);
 
 /****
@@ -114,6 +124,14 @@ struct Stream* libp2p_yamux_channel_stream_new(struct Stream* incoming_stream, i
 
 void libp2p_yamux_channel_free(struct YamuxChannelContext* ctx);
 
+/***
+ * Give up on a channel opened with yamux_channel_new. The other side is sent a reset,
+ * the channel is taken out of the session, and it is freed along with its child stream.
+ * NOTE: Unlike libp2p_yamux_channel_close, this leaves the parent's mutex and address alone.
+ * @param channel_stream the channel
+ */
+void libp2p_yamux_channel_abandon(struct Stream* channel_stream);
+
 /***
  * Prepare a new Yamux StreamMessage based on another StreamMessage
  * NOTE: This is here for testing. This should normally not be used.
@@ -51,7 +51,9 @@ int libp2p_net_connection_peek(void* stream_context) {
 
 	int bytes = 0;
 	int retVal = ioctl(socket_fd, FIONREAD, &bytes);
-	ctx->last_comm_epoch = time(NULL);
+	// only count it as communication if something came in
+	if (retVal >= 0 && bytes > 0)
+		ctx->last_comm_epoch = time(NULL);
 	if (retVal < 0) {
 		// Ooff, we're having problems. Don't use this socket again.
 		libp2p_logger_error("connectionstream", "Attempted a peek, but ioctl reported %s.\n", strerror(errno));
@@ -91,7 +93,9 @@ int libp2p_net_connection_read(void* stream_context, struct StreamMessage** msg,
 					retVal += 2; // compensate the first read.
 			}
 		}
-		ctx->last_comm_epoch = time(NULL);
+		// a timeout is not communication
+		if (retVal > 0)
+			ctx->last_comm_epoch = time(NULL);
 		libp2p_logger_debug("connectionstream", "Retrieved %d bytes from socket %d.\n", retVal, ctx->socket_descriptor);
 		if (retVal < 1) { // get out of the loop
 			if (retVal < 0) // error
@@ -203,6 +207,7 @@ struct Stream* libp2p_net_connection_established(int fd, char* ip, int port, str
 		out->peek = libp2p_net_connection_peek;
 		out->read = libp2p_net_connection_read;
 		out->read_raw = libp2p_net_connection_read_raw;
+		out->unread = NULL;
 		out->write = libp2p_net_connection_write;
 		out->handle_upgrade = libp2p_net_handle_upgrade;
 		// Multiaddresss
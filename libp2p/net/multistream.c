@@ -165,6 +165,122 @@ struct StreamMessage* libp2p_net_multistream_prepare_to_send(struct StreamMessag
 	return out;
 }
 
+/***
+ * Find the next length-prefixed frame in a buffer
+ * @param data the buffer
+ * @param data_size the size of the buffer
+ * @param pos where to start, moved past the frame on success
+ * @param frame where to put the pointer to the frame
+ * @param frame_size where to put the size of the frame
+ * @returns true(1) if a complete frame was found, false(0) otherwise
+ */
+static int libp2p_net_multistream_next_frame(const uint8_t* data, size_t data_size, size_t* pos, const uint8_t** frame, size_t* frame_size) {
+	size_t varint_size = 0;
+	if (*pos >= data_size)
+		return 0;
+	size_t size = varint_decode(&data[*pos], data_size - *pos, &varint_size);
+	if (varint_size == 0 || *pos + varint_size + size > data_size)
+		return 0;
+	*frame = &data[*pos + varint_size];
+	*frame_size = size;
+	*pos += varint_size + size;
+	return 1;
+}
+
+/***
+ * Send the multistream header and a protocol id in one write, without waiting
+ * for the remote to answer the header first (multistream-select "lazy")
+ * NOTE: Use libp2p_net_multistream_accept_proposal to read the answer
+ * @param parent_stream the stream to negotiate on (a raw connection or secio)
+ * @param protocol_id the protocol we want (i.e. "/secio/1.0.0\n")
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_net_multistream_propose(struct Stream* parent_stream, const char* protocol_id) {
+	const char* header = "/multistream/1.0.0\n";
+	struct StreamMessage incoming;
+	incoming.data = (uint8_t*)header;
+	incoming.data_size = strlen(header);
+	struct StreamMessage* header_frame = libp2p_net_multistream_prepare_to_send(&incoming);
+	incoming.data = (uint8_t*)protocol_id;
+	incoming.data_size = strlen(protocol_id);
+	struct StreamMessage* protocol_frame = libp2p_net_multistream_prepare_to_send(&incoming);
+	struct StreamMessage* out = libp2p_stream_message_new();
+	int retVal = 0;
+	if (header_frame == NULL || protocol_frame == NULL || out == NULL)
+		goto exit;
+	out->data_size = header_frame->data_size + protocol_frame->data_size;
+	out->data = (uint8_t*) malloc(out->data_size);
+	if (out->data == NULL)
+		goto exit;
+	memcpy(out->data, header_frame->data, header_frame->data_size);
+	memcpy(&out->data[header_frame->data_size], protocol_frame->data, protocol_frame->data_size);
+	libp2p_logger_debug("multistream", "propose: Sending the header and %s in one write.\n", protocol_id);
+	if (parent_stream->write(parent_stream->stream_context, out) <= 0) {
+		libp2p_logger_error("multistream", "propose: Unable to send the proposal.\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	libp2p_stream_message_free(header_frame);
+	libp2p_stream_message_free(protocol_frame);
+	libp2p_stream_message_free(out);
+	return retVal;
+}
+
+/***
+ * Read the answer to libp2p_net_multistream_propose. The remote sends its
+ * multistream header, and then either echoes the protocol id or sends "na".
+ * NOTE: Nothing else should be reading from parent_stream while this runs. Bytes
+ * that come after the answer in the same read are put back with parent_stream->unread.
+ * @param parent_stream the stream the proposal was sent on
+ * @param protocol_id the protocol that was proposed
+ * @param timeout_secs the number of seconds to wait for each read
+ * @returns true(1) if the remote accepted the protocol, false(0) otherwise
+ */
+int libp2p_net_multistream_accept_proposal(struct Stream* parent_stream, const char* protocol_id, int timeout_secs) {
+	const char* header = "/multistream/1.0.0\n";
+	int header_seen = 0;
+	int accepted = 0;
+	// the header and the echo can come in one message or two
+	for (int i = 0; i < 2 && !accepted; i++) {
+		struct StreamMessage* msg = NULL;
+		if (!parent_stream->read(parent_stream->stream_context, &msg, timeout_secs) || msg == NULL) {
+			libp2p_logger_error("multistream", "accept_proposal: No answer to our proposal of %s", protocol_id);
+			libp2p_stream_message_free(msg);
+			return 0;
+		}
+		size_t pos = 0;
+		const uint8_t* frame = NULL;
+		size_t frame_size = 0;
+		while (!accepted && libp2p_net_multistream_next_frame(msg->data, msg->data_size, &pos, &frame, &frame_size)) {
+			if (!header_seen && frame_size == strlen(header) && memcmp(frame, header, frame_size) == 0) {
+				header_seen = 1;
+			} else if (header_seen && frame_size == strlen(protocol_id) && memcmp(frame, protocol_id, frame_size) == 0) {
+				accepted = 1;
+			} else {
+				libp2p_logger_error("multistream", "accept_proposal: The remote did not accept %s", protocol_id);
+				libp2p_stream_message_free(msg);
+				return 0;
+			}
+		}
+		if (pos != msg->data_size && !accepted) {
+			libp2p_logger_error("multistream", "accept_proposal: The answer to %s came in pieces", protocol_id);
+			libp2p_stream_message_free(msg);
+			return 0;
+		}
+		if (pos != msg->data_size) {
+			// the remote is already talking the new protocol, so keep what it sent for the next read
+			if (parent_stream->unread == NULL || !parent_stream->unread(parent_stream->stream_context, &msg->data[pos], msg->data_size - pos)) {
+				libp2p_logger_error("multistream", "accept_proposal: Unable to keep the %d bytes after the answer.\n", (int)(msg->data_size - pos));
+				libp2p_stream_message_free(msg);
+				return 0;
+			}
+		}
+		libp2p_stream_message_free(msg);
+	}
+	return accepted;
+}
+
 /**
  * Write to an open multistream host
  * @param stream_context the session context
@@ -452,13 +568,12 @@ int libp2p_net_multistream_handle_upgrade(struct Stream* multistream, struct Str
 	return 1;
 }
 
-/**
- * Create a new MultiStream structure
+/***
+ * Build a MultiStream structure, and tell the parent about the upgrade
  * @param parent_stream the stream
- * @param they_requested true(1) if they requested it (i.e. protocol id has already been sent)
- * @returns the new Stream
+ * @returns the new Stream, or NULL on error
  */
-struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, int theyRequested) {
+static struct Stream* libp2p_net_multistream_stream_build(struct Stream* parent_stream) {
 	struct Stream* out = (struct Stream*)malloc(sizeof(struct Stream));
 	if (out != NULL) {
 		out->stream_type = STREAM_TYPE_MULTISTREAM;
@@ -468,6 +583,7 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
 		out->write = libp2p_net_multistream_write;
 		out->peek = libp2p_net_multistream_peek;
 		out->read_raw = libp2p_net_multistream_read_raw;
+		out->unread = NULL;
 		out->negotiate = libp2p_net_multistream_handshake;
 		out->handle_upgrade = libp2p_net_multistream_handle_upgrade;
 		out->address = parent_stream->address;
@@ -476,7 +592,7 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
 		// build MultistreamContext
 		struct MultistreamContext* ctx = (struct MultistreamContext*) malloc(sizeof(struct MultistreamContext));
 		if (ctx == NULL) {
-			libp2p_net_multistream_stream_free(out);
+			free(out);
 			return NULL;
 		}
 		ctx->status = multistream_status_initialized;
@@ -485,6 +601,20 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
 		ctx->handlers = NULL;
 		ctx->session_context = NULL;
 		parent_stream->handle_upgrade(parent_stream, out);
+	}
+	return out;
+}
+
+/**
+ * Create a new MultiStream structure
+ * @param parent_stream the stream
+ * @param they_requested true(1) if they requested it (i.e. protocol id has already been sent)
+ * @returns the new Stream
+ */
+struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, int theyRequested) {
+	struct Stream* out = libp2p_net_multistream_stream_build(parent_stream);
+	if (out != NULL) {
+		struct MultistreamContext* ctx = (struct MultistreamContext*) out->stream_context;
 		// attempt to negotiate multistream protocol
 		if (!libp2p_net_multistream_negotiate(ctx, theyRequested)) {
 			libp2p_logger_debug("multistream", "multistream_stream_new: negotiate failed\n");
@@ -504,6 +634,40 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
 	return out;
 }
 
+/***
+ * Create a MultiStream structure when the negotiation has already been done
+ * (see libp2p_net_multistream_propose). Nothing is sent.
+ * NOTE: A protocol built on this stream is moved onto parent_stream by
+ * handle_upgrade, the same as on the listening side. Its frames are not
+ * varint prefixed. Free this stream with libp2p_net_multistream_stream_discard
+ * after that.
+ * @param parent_stream the stream the negotiation was done on
+ * @returns the new Stream, or NULL on error
+ */
+struct Stream* libp2p_net_multistream_stream_new_negotiated(struct Stream* parent_stream) {
+	struct Stream* out = libp2p_net_multistream_stream_build(parent_stream);
+	if (out != NULL) {
+		struct MultistreamContext* ctx = (struct MultistreamContext*) out->stream_context;
+		ctx->status = multistream_status_ack;
+	}
+	return out;
+}
+
+/***
+ * Free a MultiStream that a protocol has been upgraded over. The parent is left open.
+ * @param stream the multistream
+ */
+void libp2p_net_multistream_stream_discard(struct Stream* stream) {
+	if (stream != NULL) {
+		// if nothing was upgraded over it, the session still points here
+		struct SessionContext* session_context = libp2p_net_connection_get_session_context(stream);
+		if (session_context != NULL && session_context->default_stream == stream)
+			session_context->default_stream = stream->parent_stream;
+		free(stream->stream_context);
+		free(stream);
+	}
+}
+
 /***
  * The remote is attempting to negotiate the multistream protocol
  * @param msg incoming message
@@ -512,6 +676,7 @@ struct Stream* libp2p_net_multistream_stream_new(struct Stream* parent_stream, i
  * @returns <0 on error, 0 for the caller to stop handling this, 1 for success
  */
 int libp2p_net_multistream_handle_message(const struct StreamMessage* msg, struct Stream* stream, void* protocol_context) {
+	int retVal = -1;
 	// get the latest stream, as this stuff is multithreaded and may be stale
 	struct Stream* latest_stream = libp2p_stream_get_latest_stream(stream);
 	if (latest_stream != NULL)
@@ -525,17 +690,34 @@ int libp2p_net_multistream_handle_message(const struct StreamMessage* msg, struc
 		} else {
 			ctx->status = multistream_status_ack;
 		}
-		return 1;
-	}
-	// the incoming stream is not a multistream. They are attempting to upgrade to multistream
-	struct Stream* new_stream = libp2p_net_multistream_stream_new(stream, 1);
-	if (new_stream != NULL) {
+		retVal = 1;
+	} else {
+		// the incoming stream is not a multistream. They are attempting to upgrade to multistream
+		struct Stream* new_stream = libp2p_net_multistream_stream_new(stream, 1);
+		if (new_stream == NULL)
+			return -1;
 		struct MultistreamContext* ctx = (struct MultistreamContext*)stream->stream_context;
 		ctx->status = multistream_status_ack;
 		// upgrade
-		return stream->handle_upgrade(stream, new_stream);
+		retVal = stream->handle_upgrade(stream, new_stream);
 	}
-	return -1;
+	// a remote that proposes lazily sends its protocol id in the same message as the header
+	size_t pos = 0;
+	const uint8_t* frame = NULL;
+	size_t frame_size = 0;
+	struct MultistreamContext* protocol_ctx = (struct MultistreamContext*) protocol_context;
+	if (retVal >= 0 && protocol_ctx != NULL
+			&& libp2p_net_multistream_next_frame(msg->data, msg->data_size, &pos, &frame, &frame_size)
+			&& pos < msg->data_size) {
+		struct StreamMessage proposal;
+		proposal.data = &msg->data[pos];
+		proposal.data_size = msg->data_size - pos;
+		proposal.error_number = 0;
+		libp2p_logger_debug("multistream", "handle_message: Handling %d bytes that came with the header.\n", (int)proposal.data_size);
+		latest_stream = libp2p_stream_get_latest_stream(stream);
+		retVal = libp2p_protocol_marshal(&proposal, latest_stream != NULL ? latest_stream : stream, protocol_ctx->handlers);
+	}
+	return retVal;
 }
 
 /***
@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/net/ratelimit.h"
+#include "libp2p/utils/logger.h"
+
+/***
+ * Admission control for inbound requests
+ */
+
+// the share of the global bucket and of the slots kept back from each priority,
+// so that lower priorities are turned away first as we get busy
+static const double ratelimit_reserve[RATELIMIT_PRIORITY_COUNT] = { 0.0, 0.25, 0.5 };
+
+/***
+ * Add tokens to a bucket for the time that has passed
+ * @param bucket the bucket
+ * @param rate tokens per second
+ * @param burst the most tokens the bucket can hold
+ * @param now the current time
+ */
+static void libp2p_net_ratelimit_refill(struct RateLimitBucket* bucket, double rate, double burst, const struct timespec* now) {
+	double elapsed = (now->tv_sec - bucket->last_refill.tv_sec) + (now->tv_nsec - bucket->last_refill.tv_nsec) / 1e9;
+	if (elapsed > 0) {
+		bucket->tokens += elapsed * rate;
+		if (bucket->tokens > burst)
+			bucket->tokens = burst;
+	}
+	bucket->last_refill = *now;
+}
+
+/***
+ * Fill a bucket, as if it had been idle forever
+ * @param bucket the bucket
+ * @param burst the most tokens the bucket can hold
+ * @param now the current time
+ */
+static void libp2p_net_ratelimit_bucket_init(struct RateLimitBucket* bucket, double burst, const struct timespec* now) {
+	bucket->tokens = burst;
+	bucket->last_refill = *now;
+}
+
+/***
+ * Hash a peer id (FNV-1a)
+ * @param peer_id the peer id
+ * @param peer_id_size the size of peer_id
+ * @returns the index into the peer table
+ */
+static unsigned int libp2p_net_ratelimit_hash(const char* peer_id, size_t peer_id_size) {
+	unsigned int hash = 2166136261u;
+	for(size_t i = 0; i < peer_id_size; i++) {
+		hash ^= (unsigned char)peer_id[i];
+		hash *= 16777619u;
+	}
+	return hash % RATELIMIT_PEER_BUCKETS;
+}
+
+/***
+ * Forget the peers whose buckets have filled back up, as they are no different from new peers
+ * NOTE: caller must hold the lock
+ * @param limiter the limiter
+ * @param now the current time
+ */
+static void libp2p_net_ratelimit_sweep(struct Libp2pRateLimiter* limiter, const struct timespec* now) {
+	for(int i = 0; i < RATELIMIT_PEER_BUCKETS; i++) {
+		struct RateLimitPeer** current = &limiter->peers[i];
+		while (*current != NULL) {
+			struct RateLimitPeer* peer = *current;
+			libp2p_net_ratelimit_refill(&peer->bucket, limiter->peer_rate, limiter->peer_burst, now);
+			if (peer->bucket.tokens >= limiter->peer_burst) {
+				*current = peer->next;
+				free(peer->peer_id);
+				free(peer);
+				limiter->num_peers--;
+			} else {
+				current = &peer->next;
+			}
+		}
+	}
+}
+
+/***
+ * Find the bucket of a peer, adding the peer if there is room
+ * NOTE: caller must hold the lock
+ * @param limiter the limiter
+ * @param peer_id the peer id
+ * @param peer_id_size the size of peer_id
+ * @param now the current time
+ * @returns the bucket of the peer, or the shared overflow bucket
+ */
+static struct RateLimitBucket* libp2p_net_ratelimit_peer_bucket(struct Libp2pRateLimiter* limiter, const char* peer_id, size_t peer_id_size, const struct timespec* now) {
+	if (peer_id == NULL || peer_id_size == 0)
+		return &limiter->overflow;
+	unsigned int index = libp2p_net_ratelimit_hash(peer_id, peer_id_size);
+	for(struct RateLimitPeer* current = limiter->peers[index]; current != NULL; current = current->next) {
+		if (current->peer_id_size == peer_id_size && memcmp(current->peer_id, peer_id, peer_id_size) == 0)
+			return &current->bucket;
+	}
+	if (limiter->num_peers >= RATELIMIT_MAX_PEERS) {
+		libp2p_net_ratelimit_sweep(limiter, now);
+		if (limiter->num_peers >= RATELIMIT_MAX_PEERS)
+			return &limiter->overflow;
+	}
+	struct RateLimitPeer* peer = (struct RateLimitPeer*) malloc(sizeof(struct RateLimitPeer));
+	if (peer == NULL)
+		return &limiter->overflow;
+	peer->peer_id = (char*) malloc(peer_id_size);
+	if (peer->peer_id == NULL) {
+		free(peer);
+		return &limiter->overflow;
+	}
+	memcpy(peer->peer_id, peer_id, peer_id_size);
+	peer->peer_id_size = peer_id_size;
+	libp2p_net_ratelimit_bucket_init(&peer->bucket, limiter->peer_burst, now);
+	peer->next = limiter->peers[index];
+	limiter->peers[index] = peer;
+	limiter->num_peers++;
+	return &peer->bucket;
+}
+
+/***
+ * Log the drop counters, if something was dropped since the last report
+ * NOTE: caller must hold the lock
+ * @param limiter the limiter
+ * @param now the current time
+ */
+static void libp2p_net_ratelimit_report(struct Libp2pRateLimiter* limiter, const struct timespec* now) {
+	if (now->tv_sec - limiter->last_report < RATELIMIT_REPORT_SECS)
+		return;
+	unsigned long long dropped = 0;
+	for(int i = 0; i < RATELIMIT_PRIORITY_COUNT; i++)
+		dropped += limiter->stats.dropped_peer[i] + limiter->stats.dropped_global[i] + limiter->stats.dropped_busy[i];
+	if (dropped == limiter->dropped_at_last_report)
+		return;
+	struct RateLimitStats* s = &limiter->stats;
+	libp2p_logger_info("ratelimit", "%s: dropped %llu requests since last report. Per peer %llu/%llu/%llu, global %llu/%llu/%llu, busy %llu/%llu/%llu (high/normal/low).\n",
+			limiter->protocol_id, dropped - limiter->dropped_at_last_report,
+			s->dropped_peer[0], s->dropped_peer[1], s->dropped_peer[2],
+			s->dropped_global[0], s->dropped_global[1], s->dropped_global[2],
+			s->dropped_busy[0], s->dropped_busy[1], s->dropped_busy[2]);
+	limiter->dropped_at_last_report = dropped;
+	limiter->last_report = now->tv_sec;
+}
+
+/***
+ * Take a slot, if one is free for this priority. Nothing waits, as the callers
+ * are on shared worker threads, and the remote is better off being told no.
+ * NOTE: caller must hold the lock
+ * @param limiter the limiter
+ * @param priority the priority of the request
+ * @returns true(1) if the request now has a slot, false(0) otherwise
+ */
+static int libp2p_net_ratelimit_take_slot(struct Libp2pRateLimiter* limiter, enum RateLimitPriority priority) {
+	int slots = limiter->max_in_flight - (int)(ratelimit_reserve[priority] * limiter->max_in_flight);
+	if (slots < 1)
+		slots = 1;
+	if (limiter->in_flight >= slots)
+		return 0;
+	limiter->in_flight++;
+	return 1;
+}
+
+/***
+ * See if a peer and the protocol as a whole have a token for a request.
+ * Nothing is taken. A drop is counted if they do not.
+ * NOTE: caller must hold the lock
+ * @param limiter the limiter
+ * @param peer_id the remote peer (can be NULL)
+ * @param peer_id_size the size of peer_id
+ * @param priority the priority of the request
+ * @param peer_bucket where to put the bucket of the peer
+ * @returns true(1) if there are tokens for the request, false(0) otherwise
+ */
+static int libp2p_net_ratelimit_has_tokens(struct Libp2pRateLimiter* limiter, const char* peer_id, size_t peer_id_size,
+		enum RateLimitPriority priority, struct RateLimitBucket** peer_bucket) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*peer_bucket = libp2p_net_ratelimit_peer_bucket(limiter, peer_id, peer_id_size, &now);
+	libp2p_net_ratelimit_refill(*peer_bucket, limiter->peer_rate, limiter->peer_burst, &now);
+	libp2p_net_ratelimit_refill(&limiter->global, limiter->global_rate, limiter->global_burst, &now);
+	if ((*peer_bucket)->tokens < 1.0) {
+		limiter->stats.dropped_peer[priority]++;
+		return 0;
+	}
+	if (limiter->global.tokens < 1.0 + ratelimit_reserve[priority] * limiter->global_burst) {
+		limiter->stats.dropped_global[priority]++;
+		return 0;
+	}
+	return 1;
+}
+
+struct Libp2pRateLimiter* libp2p_net_ratelimit_new(const char* protocol_id) {
+	struct Libp2pRateLimiter* limiter = (struct Libp2pRateLimiter*) malloc(sizeof(struct Libp2pRateLimiter));
+	if (limiter == NULL)
+		return NULL;
+	memset(limiter, 0, sizeof(struct Libp2pRateLimiter));
+	limiter->protocol_id = strdup(protocol_id == NULL ? "" : protocol_id);
+	if (limiter->protocol_id == NULL) {
+		free(limiter);
+		return NULL;
+	}
+	pthread_mutex_init(&limiter->lock, NULL);
+	libp2p_net_ratelimit_set_limits(limiter, RATELIMIT_DEFAULT_GLOBAL_RATE, RATELIMIT_DEFAULT_GLOBAL_BURST,
+			RATELIMIT_DEFAULT_PEER_RATE, RATELIMIT_DEFAULT_PEER_BURST, RATELIMIT_DEFAULT_MAX_IN_FLIGHT);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	limiter->last_report = now.tv_sec;
+	return limiter;
+}
+
+void libp2p_net_ratelimit_set_limits(struct Libp2pRateLimiter* limiter, double global_rate, double global_burst,
+		double peer_rate, double peer_burst, int max_in_flight) {
+	if (limiter == NULL)
+		return;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&limiter->lock);
+	limiter->global_rate = global_rate;
+	limiter->global_burst = global_burst < 1 ? 1 : global_burst;
+	limiter->peer_rate = peer_rate;
+	limiter->peer_burst = peer_burst < 1 ? 1 : peer_burst;
+	limiter->max_in_flight = max_in_flight < 1 ? 1 : max_in_flight;
+	libp2p_net_ratelimit_bucket_init(&limiter->global, limiter->global_burst, &now);
+	libp2p_net_ratelimit_bucket_init(&limiter->overflow, limiter->peer_burst, &now);
+	for(int i = 0; i < RATELIMIT_PEER_BUCKETS; i++)
+		for(struct RateLimitPeer* current = limiter->peers[i]; current != NULL; current = current->next)
+			libp2p_net_ratelimit_bucket_init(&current->bucket, limiter->peer_burst, &now);
+	pthread_mutex_unlock(&limiter->lock);
+}
+
+int libp2p_net_ratelimit_admit(struct Libp2pRateLimiter* limiter, const char* peer_id, size_t peer_id_size, enum RateLimitPriority priority) {
+	if (limiter == NULL)
+		return 1;
+	if (priority < RATELIMIT_PRIORITY_HIGH || priority >= RATELIMIT_PRIORITY_COUNT)
+		priority = RATELIMIT_PRIORITY_LOW;
+	int retVal = 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&limiter->lock);
+	struct RateLimitBucket* peer_bucket = NULL;
+	if (!libp2p_net_ratelimit_has_tokens(limiter, peer_id, peer_id_size, priority, &peer_bucket))
+		goto exit;
+	if (!libp2p_net_ratelimit_take_slot(limiter, priority)) {
+		limiter->stats.dropped_busy[priority]++;
+		goto exit;
+	}
+	// only a request that is worked on uses up tokens
+	peer_bucket->tokens -= 1.0;
+	limiter->global.tokens -= 1.0;
+	limiter->stats.admitted[priority]++;
+	retVal = 1;
+
+	exit:
+	if (!retVal) {
+		libp2p_logger_debug("ratelimit", "%s: dropped a request of priority %d.\n", limiter->protocol_id, priority);
+		libp2p_net_ratelimit_report(limiter, &now);
+	}
+	pthread_mutex_unlock(&limiter->lock);
+	return retVal;
+}
+
+void libp2p_net_ratelimit_release(struct Libp2pRateLimiter* limiter) {
+	if (limiter == NULL)
+		return;
+	pthread_mutex_lock(&limiter->lock);
+	if (limiter->in_flight > 0)
+		limiter->in_flight--;
+	pthread_mutex_unlock(&limiter->lock);
+}
+
+void libp2p_net_ratelimit_get_stats(struct Libp2pRateLimiter* limiter, struct RateLimitStats* stats) {
+	if (limiter == NULL) {
+		memset(stats, 0, sizeof(struct RateLimitStats));
+		return;
+	}
+	pthread_mutex_lock(&limiter->lock);
+	*stats = limiter->stats;
+	pthread_mutex_unlock(&limiter->lock);
+}
+
+void libp2p_net_ratelimit_free(struct Libp2pRateLimiter* limiter) {
+	if (limiter == NULL)
+		return;
+	for(int i = 0; i < RATELIMIT_PEER_BUCKETS; i++) {
+		struct RateLimitPeer* current = limiter->peers[i];
+		while (current != NULL) {
+			struct RateLimitPeer* next = current->next;
+			free(current->peer_id);
+			free(current);
+			current = next;
+		}
+	}
+	pthread_mutex_destroy(&limiter->lock);
+	free(limiter->protocol_id);
+	free(limiter);
+}
@@ -177,6 +177,54 @@ int socket_connect4_with_timeout(int s, uint32_t ip, uint16_t port, int timeout_
    return retVal;
 }
 
+/***
+ * Begin a non-blocking client connection. Use socket_connect4_finish once
+ * the socket becomes writable.
+ * @param s the socket number
+ * @param ip the ip address
+ * @param port the port number
+ * @returns 0 if connected, 1 if the connection is in progress, -1 on error
+ */
+int socket_connect4_start(int s, uint32_t ip, uint16_t port) {
+	struct sockaddr_in sa;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = ip;
+
+	long args = fcntl(s, F_GETFL, NULL);
+	if (args < 0 || fcntl(s, F_SETFL, args | O_NONBLOCK) < 0) {
+		libp2p_logger_error("socket", "Unable to set socket to non-blocking on connect.\n");
+		return -1;
+	}
+	if (connect(s, (struct sockaddr *) &sa, sizeof sa) == 0)
+		return 0;
+	if (errno == EINPROGRESS)
+		return 1;
+	libp2p_logger_debug("socket", "Socket connect failed with error %d.\n", errno);
+	return -1;
+}
+
+/***
+ * Complete a connection started with socket_connect4_start, and set
+ * the socket back to blocking
+ * @param s the socket number (should be writable)
+ * @returns 0 on success, otherwise -1
+ */
+int socket_connect4_finish(int s) {
+	int error = 0;
+	socklen_t error_size = sizeof(error);
+	if (getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &error_size) < 0 || error != 0) {
+		libp2p_logger_debug("socket", "Socket connect failed with error %d.\n", error);
+		return -1;
+	}
+	long args = fcntl(s, F_GETFL, NULL);
+	if (args < 0 || fcntl(s, F_SETFL, args & (~O_NONBLOCK)) < 0)
+		return -1;
+	return 0;
+}
+
 /**
  *  bind and listen to a socket.
  *  @param s socket file descriptor
@@ -18,6 +18,7 @@ struct Stream* libp2p_stream_new() {
 		stream->peek = NULL;
 		stream->read = NULL;
 		stream->read_raw = NULL;
+		stream->unread = NULL;
 		stream->socket_mutex = NULL;
 		stream->stream_context = NULL;
 		stream->write = NULL;
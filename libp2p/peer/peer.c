@@ -84,6 +84,8 @@ void libp2p_peer_free(struct Libp2pPeer* in) {
  */
 int libp2p_peer_handle_connection_error(struct Libp2pPeer* peer) {
 	peer->connection_type = CONNECTION_TYPE_NOT_CONNECTED;
+	// others (i.e. the swarm) may still hold the session, so they are told it is over
+	libp2p_session_context_shutdown(peer->sessionContext);
 	libp2p_session_context_free(peer->sessionContext);
 	peer->sessionContext = NULL;
 	return 1;
@@ -109,7 +111,7 @@ int libp2p_peer_connect(const struct Dialer* dialer, struct Libp2pPeer* peer, st
 /**
  * Make a copy of a peer
  *
- * NOTE: SessionContext is not copied.
+ * NOTE: SessionContext is not copied. The copy shares it.
  *
  * @param in what is to be copied
  * @returns a new struct, that does not rely on the old
@@ -147,7 +149,7 @@ struct Libp2pPeer* libp2p_peer_copy(const struct Libp2pPeer* in) {
 			}
 			current_in = current_in->next;
 		}
-		out->sessionContext = in->sessionContext;
+		out->sessionContext = libp2p_session_context_retain(in->sessionContext);
 	}
 	return out;
 }
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "libp2p/peer/peerstore.h"
+#include "libp2p/crypto/sha256.h"
 #include "libp2p/utils/logger.h"
 
 /***
@@ -12,6 +13,7 @@ struct PeerEntry* libp2p_peer_entry_new() {
 	struct PeerEntry* out = (struct PeerEntry*)malloc(sizeof(struct PeerEntry));
 	if (out != NULL) {
 		out->peer = NULL;
+		memset(out->hashed_id, 0, PEER_ENTRY_HASHED_ID_SIZE);
 	}
 	return out;
 }
@@ -40,10 +42,110 @@ struct PeerEntry* libp2p_peer_entry_copy(struct PeerEntry* in) {
 			free(out);
 			return NULL;
 		}
+		memcpy(out->hashed_id, in->hashed_id, PEER_ENTRY_HASHED_ID_SIZE);
 	}
 	return out;
 }
 
+/***
+ * Hash a peer id (FNV-1a)
+ * @param peer_id the peer id
+ * @param peer_id_size the size of peer_id
+ * @returns the hash
+ */
+static size_t libp2p_peerstore_hash(const unsigned char* peer_id, size_t peer_id_size) {
+	size_t hash = 2166136261u;
+	for(size_t i = 0; i < peer_id_size; i++) {
+		hash ^= peer_id[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/***
+ * Find an entry in the hash table
+ * NOTE: caller must hold the lock
+ * @param peerstore the peerstore
+ * @param peer_id the peer id
+ * @param peer_id_size the size of peer_id
+ * @returns the PeerEntry, or NULL if not found
+ */
+static struct PeerEntry* libp2p_peerstore_find(struct Peerstore* peerstore, const unsigned char* peer_id, size_t peer_id_size) {
+	struct Libp2pLinkedList* current = peerstore->buckets[libp2p_peerstore_hash(peer_id, peer_id_size) % peerstore->bucket_count];
+	while (current != NULL) {
+		struct Libp2pPeer* peer = ((struct PeerEntry*)current->item)->peer;
+		if (peer->id_size == peer_id_size && memcmp(peer_id, peer->id, peer_id_size) == 0)
+			return (struct PeerEntry*)current->item;
+		current = current->next;
+	}
+	return NULL;
+}
+
+/***
+ * Double the number of hash buckets
+ * NOTE: caller must hold the write lock
+ * @param peerstore the peerstore
+ * @returns true(1) on success, false(0) otherwise (the old buckets are still usable)
+ */
+static int libp2p_peerstore_grow(struct Peerstore* peerstore) {
+	size_t new_count = peerstore->bucket_count * 2;
+	struct Libp2pLinkedList** new_buckets = (struct Libp2pLinkedList**) calloc(new_count, sizeof(struct Libp2pLinkedList*));
+	if (new_buckets == NULL)
+		return 0;
+	for(size_t i = 0; i < peerstore->bucket_count; i++) {
+		struct Libp2pLinkedList* current = peerstore->buckets[i];
+		while (current != NULL) {
+			struct Libp2pLinkedList* next = current->next;
+			struct Libp2pPeer* peer = ((struct PeerEntry*)current->item)->peer;
+			size_t pos = libp2p_peerstore_hash((unsigned char*)peer->id, peer->id_size) % new_count;
+			current->next = new_buckets[pos];
+			new_buckets[pos] = current;
+			current = next;
+		}
+	}
+	free(peerstore->buckets);
+	peerstore->buckets = new_buckets;
+	peerstore->bucket_count = new_count;
+	return 1;
+}
+
+/***
+ * Put an entry in the hash table and at the end of the list
+ * NOTE: caller must hold the write lock
+ * @param peerstore the peerstore
+ * @param peer_entry the entry
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int libp2p_peerstore_insert(struct Peerstore* peerstore, struct PeerEntry* peer_entry) {
+	struct Libp2pLinkedList* new_item = libp2p_utils_linked_list_new();
+	struct Libp2pLinkedList* bucket_item = libp2p_utils_linked_list_new();
+	if (new_item == NULL || bucket_item == NULL) {
+		free(new_item);
+		free(bucket_item);
+		return 0;
+	}
+	if (peerstore->num_entries >= peerstore->bucket_count * 2)
+		libp2p_peerstore_grow(peerstore);
+	// the id never changes, so this is done once instead of on every distance lookup
+	libp2p_crypto_hashing_sha256((unsigned char*)peer_entry->peer->id, peer_entry->peer->id_size, peer_entry->hashed_id);
+	size_t pos = libp2p_peerstore_hash((unsigned char*)peer_entry->peer->id, peer_entry->peer->id_size) % peerstore->bucket_count;
+	bucket_item->item = peer_entry;
+	bucket_item->next = peerstore->buckets[pos];
+	peerstore->buckets[pos] = bucket_item;
+	peerstore->num_entries++;
+	// the item is complete before it is linked, so readers walking the list never see half of it
+	new_item->item = peer_entry;
+	__sync_synchronize();
+	if (peerstore->head_entry == NULL) {
+		peerstore->head_entry = new_item;
+		peerstore->last_entry = new_item;
+	} else {
+		peerstore->last_entry->next = new_item;
+		peerstore->last_entry = new_item;
+	}
+	return 1;
+}
+
 /**
  * Creates a new empty peerstore
  * @param peer_id the peer id as a null terminated string
@@ -54,6 +156,14 @@ struct Peerstore* libp2p_peerstore_new(const struct Libp2pPeer* local_peer) {
 	if (out != NULL) {
 		out->head_entry = NULL;
 		out->last_entry = NULL;
+		out->num_entries = 0;
+		out->bucket_count = PEERSTORE_INITIAL_BUCKETS;
+		out->buckets = (struct Libp2pLinkedList**) calloc(out->bucket_count, sizeof(struct Libp2pLinkedList*));
+		if (out->buckets == NULL) {
+			free(out);
+			return NULL;
+		}
+		pthread_rwlock_init(&out->lock, NULL);
 		// now add this peer as the first entry
 		libp2p_peerstore_add_peer(out, local_peer);
 	}
@@ -78,6 +188,17 @@ int libp2p_peerstore_free(struct Peerstore* in) {
 		}
 		// now free the linked list entries
 		libp2p_utils_linked_list_free(in->head_entry);
+		// the buckets point to the same entries, so only the list items go
+		for(size_t i = 0; i < in->bucket_count; i++) {
+			current = in->buckets[i];
+			while (current != NULL) {
+				next = current->next;
+				free(current);
+				current = next;
+			}
+		}
+		free(in->buckets);
+		pthread_rwlock_destroy(&in->lock);
 		// and finally the peerstore itself
 		free(in);
 	}
@@ -91,22 +212,13 @@ int libp2p_peerstore_free(struct Peerstore* in) {
  * @returns true(1) on success, otherwise false
  */
 int libp2p_peerstore_add_peer_entry(struct Peerstore* peerstore, struct PeerEntry* peer_entry) {
-	if (peer_entry == NULL)
-		return 0;
-
-	struct Libp2pLinkedList* new_item = libp2p_utils_linked_list_new();
-	if (new_item == NULL)
+	if (peer_entry == NULL || peer_entry->peer == NULL)
 		return 0;
 
-	new_item->item = peer_entry;
-	if (peerstore->head_entry == NULL) {
-		peerstore->head_entry = new_item;
-		peerstore->last_entry = new_item;
-	} else {
-		peerstore->last_entry->next = new_item;
-		peerstore->last_entry = new_item;
-	}
-	return 1;
+	pthread_rwlock_wrlock(&peerstore->lock);
+	int retVal = libp2p_peerstore_insert(peerstore, peer_entry);
+	pthread_rwlock_unlock(&peerstore->lock);
+	return retVal;
 }
 
 int libp2p_peerstore_update_addresses(struct Libp2pPeer* existing, const struct Libp2pPeer* incoming) {
@@ -157,10 +269,12 @@ int libp2p_peerstore_add_peer(struct Peerstore* peerstore, const struct Libp2pPe
 		ma_string = ((struct MultiAddress*)peer->addr_head->item)->string;
 	}
 	// first check to see if it exists. If it does, return TRUE
-	struct PeerEntry* peer_entry = libp2p_peerstore_get_peer_entry(peerstore, (unsigned char*)peer->id, peer->id_size);
+	pthread_rwlock_wrlock(&peerstore->lock);
+	struct PeerEntry* peer_entry = libp2p_peerstore_find(peerstore, (unsigned char*)peer->id, peer->id_size);
 	if (peer_entry != NULL) {
 		libp2p_logger_debug("peerstore", "Attempted to add %s to peerstore, but already there. Checking if we need to update addresses.\n", ma_string);
 		libp2p_peerstore_update_addresses(peer_entry->peer, peer);
+		pthread_rwlock_unlock(&peerstore->lock);
 		return 1;
 	}
 
@@ -171,19 +285,26 @@ int libp2p_peerstore_add_peer(struct Peerstore* peerstore, const struct Libp2pPe
 		} else {
 			libp2p_logger_debug("peerstore", "Adding peer %s with no addresses to peer store.\n", libp2p_peer_id_to_string(peer));
 		}
-		struct PeerEntry* peer_entry = libp2p_peer_entry_new();
+		peer_entry = libp2p_peer_entry_new();
 		if (peer_entry == NULL) {
 			libp2p_logger_error("peerstore", "Unable to allocate memory for new PeerEntry.\n");
+			pthread_rwlock_unlock(&peerstore->lock);
 			return 0;
 		}
 		peer_entry->peer = libp2p_peer_copy(peer);
 		if (peer_entry->peer == NULL) {
 			libp2p_logger_error("peerstore", "Could not copy peer for PeerEntry.\n");
+			libp2p_peer_entry_free(peer_entry);
+			pthread_rwlock_unlock(&peerstore->lock);
 			return 0;
 		}
-		retVal = libp2p_peerstore_add_peer_entry(peerstore, peer_entry);
-		libp2p_logger_debug("peerstore", "Adding peer %s to peerstore was a success\n", libp2p_peer_id_to_string(peer));
+		retVal = libp2p_peerstore_insert(peerstore, peer_entry);
+		if (!retVal)
+			libp2p_peer_entry_free(peer_entry);
+		else
+			libp2p_logger_debug("peerstore", "Adding peer %s to peerstore was a success\n", libp2p_peer_id_to_string(peer));
 	}
+	pthread_rwlock_unlock(&peerstore->lock);
 	return retVal;
 }
 
@@ -198,17 +319,10 @@ struct PeerEntry* libp2p_peerstore_get_peer_entry(struct Peerstore* peerstore, c
 	if (peer_id_size == 0 || peer_id == NULL || peerstore == NULL)
 		return NULL;
 
-	struct Libp2pLinkedList* current = peerstore->head_entry;
-	while(current != NULL) {
-		struct Libp2pPeer* peer = ((struct PeerEntry*)current->item)->peer;
-		if (peer->id_size == peer_id_size) {
-			if (memcmp(peer_id, peer->id, peer->id_size) == 0) {
-				return (struct PeerEntry*)current->item;
-			}
-		}
-		current = current->next;
-	}
-	return NULL;
+	pthread_rwlock_rdlock(&peerstore->lock);
+	struct PeerEntry* entry = libp2p_peerstore_find(peerstore, peer_id, peer_id_size);
+	pthread_rwlock_unlock(&peerstore->lock);
+	return entry;
 }
 
 /**
@@ -225,6 +339,48 @@ struct Libp2pPeer* libp2p_peerstore_get_peer(struct Peerstore* peerstore, const
 	return entry->peer;
 }
 
+/***
+ * Get all the peers, in the order they were added
+ * NOTE: The vector is a copy, so the peerstore can change while the caller walks it.
+ * The peers belong to the peerstore, and must not be freed by the caller.
+ * @param peerstore the peerstore
+ * @returns a vector of Libp2pPeer pointers (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_peerstore_get_peers(struct Peerstore* peerstore) {
+	if (peerstore == NULL)
+		return NULL;
+	pthread_rwlock_rdlock(&peerstore->lock);
+	struct Libp2pVector* peers = libp2p_utils_vector_new(peerstore->num_entries > 0 ? peerstore->num_entries : 1);
+	if (peers != NULL) {
+		for(struct Libp2pLinkedList* current = peerstore->head_entry; current != NULL; current = current->next) {
+			libp2p_utils_vector_add(peers, ((struct PeerEntry*)current->item)->peer);
+		}
+	}
+	pthread_rwlock_unlock(&peerstore->lock);
+	return peers;
+}
+
+/***
+ * Get all the entries, in the order they were added
+ * NOTE: The vector is a copy, so the peerstore can change while the caller walks it.
+ * The entries belong to the peerstore, and must not be freed by the caller.
+ * @param peerstore the peerstore
+ * @returns a vector of PeerEntry pointers (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_peerstore_get_peer_entries(struct Peerstore* peerstore) {
+	if (peerstore == NULL)
+		return NULL;
+	pthread_rwlock_rdlock(&peerstore->lock);
+	struct Libp2pVector* entries = libp2p_utils_vector_new(peerstore->num_entries > 0 ? peerstore->num_entries : 1);
+	if (entries != NULL) {
+		for(struct Libp2pLinkedList* current = peerstore->head_entry; current != NULL; current = current->next) {
+			libp2p_utils_vector_add(entries, current->item);
+		}
+	}
+	pthread_rwlock_unlock(&peerstore->lock);
+	return entries;
+}
+
 /**
  * Retrieves the local peer, which is always the first in the collection
  * @param peerstore the peerstore
@@ -9,6 +9,21 @@
  * Stores hashes, and peers where you can possibly get them
  */
 
+/***
+ * Hash a multihash (FNV-1a)
+ * @param hash the bytes
+ * @param hash_size the number of bytes
+ * @returns the hash
+ */
+static size_t libp2p_providerstore_hash(const unsigned char* hash, int hash_size) {
+	size_t result = 2166136261u;
+	for(int i = 0; i < hash_size; i++) {
+		result ^= hash[i];
+		result *= 16777619u;
+	}
+	return result;
+}
+
 /**
  * Create a new ProviderStore
  * @param datastore the datastore (required in order to look for the file locally)
@@ -20,11 +35,29 @@ struct ProviderStore* libp2p_providerstore_new(const struct Datastore* datastore
 	if (out != NULL) {
 		out->datastore = datastore;
 		out->local_peer = local_peer;
-		out->provider_entries = libp2p_utils_vector_new(4);
+		out->num_keys = 0;
+		out->bucket_count = PROVIDERSTORE_INITIAL_BUCKETS;
+		out->buckets = (struct ProviderKey**) calloc(out->bucket_count, sizeof(struct ProviderKey*));
+		if (out->buckets == NULL) {
+			free(out);
+			return NULL;
+		}
+		memset(out->wheel, 0, sizeof(out->wheel));
+		out->ttl_secs = PROVIDERSTORE_DEFAULT_TTL;
+		// make one turn of the wheel cover the ttl, so a slot only holds one tick's entries
+		out->wheel_tick_secs = (out->ttl_secs + PROVIDERSTORE_WHEEL_SLOTS - 2) / (PROVIDERSTORE_WHEEL_SLOTS - 1);
+		if (out->wheel_tick_secs < 1)
+			out->wheel_tick_secs = 1;
+		out->wheel_tick = time(NULL) / out->wheel_tick_secs;
+		pthread_mutex_init(&out->lock, NULL);
 	}
 	return out;
 }
 
+/***
+ * Free a ProviderEntry
+ * @param in the entry
+ */
 void libp2p_providerstore_entry_free(struct ProviderEntry* in) {
 	if (in != NULL) {
 		if (in->hash != NULL) {
@@ -39,43 +72,299 @@ void libp2p_providerstore_entry_free(struct ProviderEntry* in) {
 	}
 }
 
+static void libp2p_providerstore_key_free(struct ProviderKey* key) {
+	if (key != NULL) {
+		struct ProviderEntry* current = key->freshest;
+		while (current != NULL) {
+			struct ProviderEntry* next = current->staler;
+			libp2p_providerstore_entry_free(current);
+			current = next;
+		}
+		free(key->hash);
+		free(key);
+	}
+}
+
 /***
  * Clean resources used by a ProviderStore
  * @param in the ProviderStore to clean up
  */
 void libp2p_providerstore_free(struct ProviderStore* in) {
 	if (in != NULL) {
-		for(int i = 0; i < in->provider_entries->total; i++) {
-			struct ProviderEntry* entry = (struct ProviderEntry*) libp2p_utils_vector_get(in->provider_entries, i);
-			libp2p_providerstore_entry_free(entry);
+		for(size_t i = 0; i < in->bucket_count; i++) {
+			struct ProviderKey* current = in->buckets[i];
+			while (current != NULL) {
+				struct ProviderKey* next = current->next;
+				libp2p_providerstore_key_free(current);
+				current = next;
+			}
 		}
-		libp2p_utils_vector_free(in->provider_entries);
+		free(in->buckets);
+		pthread_mutex_destroy(&in->lock);
 		free(in);
 		in = NULL;
 	}
 }
 
+/***
+ * Find the providers of a hash
+ * NOTE: caller must hold the lock
+ * @param store the ProviderStore
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns the ProviderKey, or NULL if nobody announced it
+ */
+static struct ProviderKey* libp2p_providerstore_find_key(struct ProviderStore* store, const unsigned char* hash, int hash_size) {
+	struct ProviderKey* current = store->buckets[libp2p_providerstore_hash(hash, hash_size) % store->bucket_count];
+	while (current != NULL) {
+		if (current->hash_size == hash_size && memcmp(current->hash, hash, hash_size) == 0)
+			return current;
+		current = current->next;
+	}
+	return NULL;
+}
+
+/***
+ * Take a key out of the hash table and free it
+ * NOTE: caller must hold the lock, and the key must have no providers left
+ * @param store the ProviderStore
+ * @param key the key
+ */
+static void libp2p_providerstore_remove_key(struct ProviderStore* store, struct ProviderKey* key) {
+	struct ProviderKey** current = &store->buckets[libp2p_providerstore_hash(key->hash, key->hash_size) % store->bucket_count];
+	while (*current != NULL) {
+		if (*current == key) {
+			*current = key->next;
+			store->num_keys--;
+			libp2p_providerstore_key_free(key);
+			return;
+		}
+		current = &(*current)->next;
+	}
+}
+
+/***
+ * Double the number of hash buckets
+ * NOTE: caller must hold the lock
+ * @param store the ProviderStore
+ */
+static void libp2p_providerstore_grow(struct ProviderStore* store) {
+	size_t new_count = store->bucket_count * 2;
+	struct ProviderKey** new_buckets = (struct ProviderKey**) calloc(new_count, sizeof(struct ProviderKey*));
+	if (new_buckets == NULL)
+		return;
+	for(size_t i = 0; i < store->bucket_count; i++) {
+		struct ProviderKey* current = store->buckets[i];
+		while (current != NULL) {
+			struct ProviderKey* next = current->next;
+			size_t pos = libp2p_providerstore_hash(current->hash, current->hash_size) % new_count;
+			current->next = new_buckets[pos];
+			new_buckets[pos] = current;
+			current = next;
+		}
+	}
+	free(store->buckets);
+	store->buckets = new_buckets;
+	store->bucket_count = new_count;
+}
+
+/***
+ * Put an entry in the timing wheel slot for its expiration
+ * NOTE: caller must hold the lock
+ */
+static void libp2p_providerstore_wheel_link(struct ProviderStore* store, struct ProviderEntry* entry) {
+	struct ProviderEntry** slot = &store->wheel[(entry->expires / store->wheel_tick_secs) % PROVIDERSTORE_WHEEL_SLOTS];
+	entry->wheel_prev = NULL;
+	entry->wheel_next = *slot;
+	if (*slot != NULL)
+		(*slot)->wheel_prev = entry;
+	*slot = entry;
+}
+
+/***
+ * Take an entry out of its timing wheel slot
+ * NOTE: caller must hold the lock
+ */
+static void libp2p_providerstore_wheel_unlink(struct ProviderStore* store, struct ProviderEntry* entry) {
+	if (entry->wheel_prev != NULL)
+		entry->wheel_prev->wheel_next = entry->wheel_next;
+	else
+		store->wheel[(entry->expires / store->wheel_tick_secs) % PROVIDERSTORE_WHEEL_SLOTS] = entry->wheel_next;
+	if (entry->wheel_next != NULL)
+		entry->wheel_next->wheel_prev = entry->wheel_prev;
+	entry->wheel_prev = NULL;
+	entry->wheel_next = NULL;
+}
+
+/***
+ * Take an entry out of the provider list of its key
+ * NOTE: caller must hold the lock
+ */
+static void libp2p_providerstore_list_unlink(struct ProviderEntry* entry) {
+	struct ProviderKey* key = entry->key;
+	if (entry->fresher != NULL)
+		entry->fresher->staler = entry->staler;
+	else
+		key->freshest = entry->staler;
+	if (entry->staler != NULL)
+		entry->staler->fresher = entry->fresher;
+	else
+		key->stalest = entry->fresher;
+	entry->fresher = NULL;
+	entry->staler = NULL;
+	key->num_providers--;
+}
+
+/***
+ * Put an entry at the front of the provider list of its key
+ * NOTE: caller must hold the lock
+ */
+static void libp2p_providerstore_list_push(struct ProviderEntry* entry) {
+	struct ProviderKey* key = entry->key;
+	entry->fresher = NULL;
+	entry->staler = key->freshest;
+	if (key->freshest != NULL)
+		key->freshest->fresher = entry;
+	key->freshest = entry;
+	if (key->stalest == NULL)
+		key->stalest = entry;
+	key->num_providers++;
+}
+
+/***
+ * Forget an announcement, and the key if it was the last one
+ * NOTE: caller must hold the lock
+ */
+static void libp2p_providerstore_drop(struct ProviderStore* store, struct ProviderEntry* entry) {
+	struct ProviderKey* key = entry->key;
+	libp2p_providerstore_wheel_unlink(store, entry);
+	libp2p_providerstore_list_unlink(entry);
+	libp2p_providerstore_entry_free(entry);
+	if (key->num_providers == 0)
+		libp2p_providerstore_remove_key(store, key);
+}
+
+/***
+ * Turn the timing wheel up to now, forgetting the announcements that expired
+ * NOTE: caller must hold the lock
+ * @param store the ProviderStore
+ * @param now the current time
+ */
+static void libp2p_providerstore_expire(struct ProviderStore* store, time_t now) {
+	// only ticks that are completely in the past
+	time_t last_tick = now / store->wheel_tick_secs - 1;
+	int turns = 0;
+	while (store->wheel_tick < last_tick && turns < PROVIDERSTORE_WHEEL_SLOTS) {
+		store->wheel_tick++;
+		turns++;
+		struct ProviderEntry* current = store->wheel[store->wheel_tick % PROVIDERSTORE_WHEEL_SLOTS];
+		while (current != NULL) {
+			struct ProviderEntry* next = current->wheel_next;
+			if (current->expires <= now)
+				libp2p_providerstore_drop(store, current);
+			current = next;
+		}
+	}
+	if (store->wheel_tick < last_tick)
+		store->wheel_tick = last_tick;
+}
+
+/***
+ * Remember that a peer can provide a hash. If the peer already announced it,
+ * the announcement is refreshed.
+ * @param store the ProviderStore
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @param peer_id the peer that can provide it
+ * @param peer_id_size the size of peer_id
+ * @returns true(1) on success, false(0) otherwise
+ */
 int libp2p_providerstore_add(struct ProviderStore* store, const unsigned char* hash, int hash_size, const unsigned char* peer_id, int peer_id_size) {
-	char hash_str[hash_size + 1];
-	memcpy(hash_str, hash, hash_size);
-	hash_str[hash_size] = 0;
+	if (store == NULL || hash == NULL || hash_size <= 0 || peer_id == NULL || peer_id_size <= 0)
+		return 0;
 	char peer_str[peer_id_size + 1];
 	memcpy(peer_str, peer_id, peer_id_size);
 	peer_str[peer_id_size] = 0;
 	libp2p_logger_debug("providerstore", "Adding hash to providerstore. It can be retrieved from %s\n", peer_str);
-	struct ProviderEntry* entry = (struct ProviderEntry*)malloc(sizeof(struct ProviderEntry));
-	entry->hash = malloc(hash_size);
-	memcpy(entry->hash, hash, hash_size);
-	entry->hash_size = hash_size;
-	entry->peer_id = malloc(peer_id_size);
-	memcpy(entry->peer_id, peer_id, peer_id_size);
-	entry->peer_id_size = peer_id_size;
-	libp2p_utils_vector_add(store->provider_entries, entry);
+
+	time_t now = time(NULL);
+	pthread_mutex_lock(&store->lock);
+	libp2p_providerstore_expire(store, now);
+	struct ProviderKey* key = libp2p_providerstore_find_key(store, hash, hash_size);
+	if (key == NULL) {
+		key = (struct ProviderKey*) malloc(sizeof(struct ProviderKey));
+		if (key == NULL) {
+			pthread_mutex_unlock(&store->lock);
+			return 0;
+		}
+		key->hash = malloc(hash_size);
+		if (key->hash == NULL) {
+			free(key);
+			pthread_mutex_unlock(&store->lock);
+			return 0;
+		}
+		memcpy(key->hash, hash, hash_size);
+		key->hash_size = hash_size;
+		key->freshest = NULL;
+		key->stalest = NULL;
+		key->num_providers = 0;
+		if (store->num_keys >= store->bucket_count * 2)
+			libp2p_providerstore_grow(store);
+		size_t pos = libp2p_providerstore_hash(hash, hash_size) % store->bucket_count;
+		key->next = store->buckets[pos];
+		store->buckets[pos] = key;
+		store->num_keys++;
+	}
+	// have they announced this before?
+	struct ProviderEntry* entry = key->freshest;
+	while (entry != NULL) {
+		if (entry->peer_id_size == peer_id_size && memcmp(entry->peer_id, peer_id, peer_id_size) == 0)
+			break;
+		entry = entry->staler;
+	}
+	if (entry != NULL) {
+		// refresh it
+		libp2p_providerstore_wheel_unlink(store, entry);
+		libp2p_providerstore_list_unlink(entry);
+	} else {
+		if (key->num_providers >= PROVIDERSTORE_MAX_PROVIDERS) {
+			// make room by forgetting the stalest
+			struct ProviderEntry* stalest = key->stalest;
+			libp2p_providerstore_wheel_unlink(store, stalest);
+			libp2p_providerstore_list_unlink(stalest);
+			libp2p_providerstore_entry_free(stalest);
+		}
+		entry = (struct ProviderEntry*) malloc(sizeof(struct ProviderEntry));
+		if (entry == NULL) {
+			if (key->num_providers == 0)
+				libp2p_providerstore_remove_key(store, key);
+			pthread_mutex_unlock(&store->lock);
+			return 0;
+		}
+		entry->hash = NULL;
+		entry->hash_size = 0;
+		entry->peer_id = malloc(peer_id_size);
+		if (entry->peer_id == NULL) {
+			free(entry);
+			if (key->num_providers == 0)
+				libp2p_providerstore_remove_key(store, key);
+			pthread_mutex_unlock(&store->lock);
+			return 0;
+		}
+		memcpy(entry->peer_id, peer_id, peer_id_size);
+		entry->peer_id_size = peer_id_size;
+		entry->key = key;
+	}
+	entry->announced = now;
+	entry->expires = now + store->ttl_secs;
+	libp2p_providerstore_list_push(entry);
+	libp2p_providerstore_wheel_link(store, entry);
+	pthread_mutex_unlock(&store->lock);
 	return 1;
 }
 
 /**
- * See if someone has announced a key. If so, pass the peer_id
+ * See if someone has announced a key. If so, pass the peer_id of the freshest announcement
  * NOTE: This will check to see if I can provide it from my datastore
  *
  * @param store the list of providers
@@ -86,7 +375,6 @@ int libp2p_providerstore_add(struct ProviderStore* store, const unsigned char* h
  * @returns true(1) if we found something, false(0) if not.
  */
 int libp2p_providerstore_get(struct ProviderStore* store, const unsigned char* hash, int hash_size, unsigned char** peer_id, int *peer_id_size) {
-	struct ProviderEntry* current = NULL;
 	// can I provide it locally?
 	struct DatastoreRecord* datastore_record = NULL;
 	if (store->datastore->datastore_get(hash, hash_size, &datastore_record, store->datastore)) {
@@ -99,15 +387,78 @@ int libp2p_providerstore_get(struct ProviderStore* store, const unsigned char* h
 		libp2p_datastore_record_free(datastore_record);
 		return 1;
 	}
-	// skip index 0, as we checked above...
-	for (int i = 0; i < store->provider_entries->total; i++) {
-		current = (struct ProviderEntry*)libp2p_utils_vector_get(store->provider_entries, i);
-		if (current->hash_size == hash_size && memcmp(current->hash, hash, hash_size) == 0) {
-			*peer_id = malloc(current->peer_id_size);
-			memcpy(*peer_id, current->peer_id, current->peer_id_size);
-			*peer_id_size = current->peer_id_size;
-			return 1;
+	struct Libp2pVector* providers = libp2p_providerstore_get_providers(store, hash, hash_size, 1);
+	if (providers == NULL)
+		return 0;
+	struct ProviderEntry* freshest = (struct ProviderEntry*) libp2p_utils_vector_get(providers, 0);
+	// hand over the peer id instead of copying it again
+	*peer_id = freshest->peer_id;
+	*peer_id_size = freshest->peer_id_size;
+	freshest->peer_id = NULL;
+	libp2p_providerstore_providers_free(providers);
+	return 1;
+}
+
+/***
+ * Get the freshest providers of a hash that others have announced
+ * NOTE: This does not check the local datastore
+ * @param store the ProviderStore
+ * @param hash what we're looking for
+ * @param hash_size the length of the hash
+ * @param max_providers the most to return
+ * @returns a vector of ProviderEntry copies, freshest first (free with libp2p_providerstore_providers_free), or NULL if none
+ */
+struct Libp2pVector* libp2p_providerstore_get_providers(struct ProviderStore* store, const unsigned char* hash, int hash_size, int max_providers) {
+	struct Libp2pVector* results = NULL;
+	if (store == NULL || hash == NULL || hash_size <= 0 || max_providers <= 0)
+		return NULL;
+	time_t now = time(NULL);
+	pthread_mutex_lock(&store->lock);
+	libp2p_providerstore_expire(store, now);
+	struct ProviderKey* key = libp2p_providerstore_find_key(store, hash, hash_size);
+	struct ProviderEntry* current = (key == NULL ? NULL : key->freshest);
+	for(int i = 0; current != NULL && i < max_providers; current = current->staler) {
+		// the wheel works in ticks, so some may be a little past their time
+		if (current->expires <= now)
+			continue;
+		struct ProviderEntry* copy = (struct ProviderEntry*) malloc(sizeof(struct ProviderEntry));
+		if (copy == NULL)
+			break;
+		memset(copy, 0, sizeof(struct ProviderEntry));
+		copy->hash = malloc(hash_size);
+		copy->peer_id = malloc(current->peer_id_size);
+		if (copy->hash == NULL || copy->peer_id == NULL) {
+			libp2p_providerstore_entry_free(copy);
+			break;
+		}
+		memcpy(copy->hash, hash, hash_size);
+		copy->hash_size = hash_size;
+		memcpy(copy->peer_id, current->peer_id, current->peer_id_size);
+		copy->peer_id_size = current->peer_id_size;
+		copy->announced = current->announced;
+		copy->expires = current->expires;
+		if (results == NULL)
+			results = libp2p_utils_vector_new(max_providers < key->num_providers ? max_providers : key->num_providers);
+		if (results == NULL) {
+			libp2p_providerstore_entry_free(copy);
+			break;
+		}
+		libp2p_utils_vector_add(results, copy);
+		i++;
+	}
+	pthread_mutex_unlock(&store->lock);
+	return results;
+}
+
+/***
+ * Free the results of libp2p_providerstore_get_providers
+ * @param providers the vector of ProviderEntry copies
+ */
+void libp2p_providerstore_providers_free(struct Libp2pVector* providers) {
+	if (providers != NULL) {
+		for(int i = 0; i < providers->total; i++) {
+			libp2p_providerstore_entry_free((struct ProviderEntry*) libp2p_utils_vector_get(providers, i));
 		}
+		libp2p_utils_vector_free(providers);
 	}
-	return 0;
 }
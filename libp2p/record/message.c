@@ -1,11 +1,15 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "libp2p/record/message.h"
 #include "libp2p/peer/peer.h"
 #include "libp2p/utils/linked_list.h"
 #include "libp2p/utils/vector.h"
+#include "libp2p/utils/arena.h"
 #include "protobuf/protobuf.h"
+#include "protobuf/varint.h"
 #include "multiaddr/multiaddr.h"
+#include "multiaddr/protoutils.h"
 
 
 /***
@@ -26,6 +30,7 @@ struct KademliaMessage* libp2p_message_new() {
 		out->message_type = MESSAGE_TYPE_PING;
 		out->provider_peer_head = NULL;
 		out->record = NULL;
+		out->arena = NULL;
 	}
 	return out;
 }
@@ -35,6 +40,11 @@ struct KademliaMessage* libp2p_message_new() {
  * @param in the incoming message
  */
 void libp2p_message_free(struct KademliaMessage* in) {
+	if (in != NULL && in->arena != NULL) {
+		// everything, including the message, is in the arena
+		libp2p_utils_arena_free(in->arena);
+		return;
+	}
 	if (in != NULL) {
 		// a linked list of peer structs
 		struct Libp2pLinkedList* current = in->closer_peer_head;
@@ -44,6 +54,8 @@ void libp2p_message_free(struct KademliaMessage* in) {
 			struct Libp2pPeer* peer = (struct Libp2pPeer*)current->item;
 			libp2p_peer_free(peer);
 			current->item = NULL;
+			// free only this node, not the rest of the list
+			current->next = NULL;
 			libp2p_utils_linked_list_free(current);
 			current = next;
 		}
@@ -57,6 +69,8 @@ void libp2p_message_free(struct KademliaMessage* in) {
 			peer->sessionContext = NULL;
 			libp2p_peer_free(peer);
 			current->item = NULL;
+			// free only this node, not the rest of the list
+			current->next = NULL;
 			libp2p_utils_linked_list_free(current);
 			current = next;
 		}
@@ -65,6 +79,18 @@ void libp2p_message_free(struct KademliaMessage* in) {
 	}
 }
 
+/***
+ * The size needed to encode the peers in a vector
+ * @param peers a vector of Libp2pPeers (can be NULL)
+ * @returns the approximate number of bytes required
+ */
+static size_t libp2p_message_peers_encode_size(const struct Libp2pVector* peers) {
+	size_t retVal = 0;
+	for(int i = 0; peers != NULL && i < peers->total; i++)
+		retVal += 11 + libp2p_peer_protobuf_encode_size((struct Libp2pPeer*)libp2p_utils_vector_get(peers, i));
+	return retVal;
+}
+
 size_t libp2p_message_protobuf_encode_size(const struct KademliaMessage* in) {
 	// message type
 	size_t retVal = 11;
@@ -113,13 +139,80 @@ int libp2p_message_protobuf_allocate_and_encode(const struct KademliaMessage* in
 	return retVal;
 }
 
-int libp2p_message_protobuf_encode(const struct KademliaMessage* in, unsigned char* buffer, size_t max_buffer_size, size_t* bytes_written) {
+/***
+ * Write the tag of a length delimited field, and leave room for its length.
+ * The field itself is then encoded right after, in place.
+ * @param field_no the field number
+ * @param max_field_size the most the field can be
+ * @param buffer where to write
+ * @param max_buffer_size the room left in buffer
+ * @param header_size the bytes used by the tag and the room for the length
+ * @returns true(1) on success, false(0) if there is not enough room
+ */
+static int libp2p_message_protobuf_begin_field(int field_no, size_t max_field_size, unsigned char* buffer, size_t max_buffer_size, size_t* header_size) {
+	unsigned long long tag = (field_no << 3) | WIRETYPE_LENGTH_DELIMITED;
+	size_t tag_size = varint_encoding_length(tag);
+	*header_size = tag_size + varint_encoding_length(max_field_size);
+	if (*header_size + max_field_size > max_buffer_size)
+		return 0;
+	varint_encode(tag, buffer, max_buffer_size, &tag_size);
+	return 1;
+}
+
+/***
+ * Write the length of a field started with libp2p_message_protobuf_begin_field,
+ * moving the field back if its length needs less room than was left
+ * @param field_no the field number
+ * @param buffer where the tag was written
+ * @param header_size what libp2p_message_protobuf_begin_field returned
+ * @param field_size the actual size of the field
+ * @param bytes_written the total size of the tag, length and field
+ */
+static void libp2p_message_protobuf_end_field(int field_no, unsigned char* buffer, size_t header_size, size_t field_size, size_t* bytes_written) {
+	size_t tag_size = varint_encoding_length((field_no << 3) | WIRETYPE_LENGTH_DELIMITED);
+	size_t length_size = varint_encoding_length(field_size);
+	if (tag_size + length_size < header_size)
+		memmove(&buffer[tag_size + length_size], &buffer[header_size], field_size);
+	varint_encode(field_size, &buffer[tag_size], length_size, &length_size);
+	*bytes_written = tag_size + length_size + field_size;
+}
+
+/***
+ * Encode a peer as a length delimited field, directly into the buffer
+ * @param field_no the field number
+ * @param peer the peer
+ * @param buffer where to write
+ * @param max_buffer_size the room left in buffer
+ * @param bytes_written the number of bytes written
+ * @returns true(1) on success, otherwise false(0)
+ */
+static int libp2p_message_protobuf_encode_peer(int field_no, struct Libp2pPeer* peer, unsigned char* buffer, size_t max_buffer_size, size_t* bytes_written) {
+	size_t header_size = 0;
+	size_t field_size = 0;
+	if (!libp2p_message_protobuf_begin_field(field_no, libp2p_peer_protobuf_encode_size(peer), buffer, max_buffer_size, &header_size))
+		return 0;
+	if (!libp2p_peer_protobuf_encode(peer, &buffer[header_size], max_buffer_size - header_size, &field_size))
+		return 0;
+	libp2p_message_protobuf_end_field(field_no, buffer, header_size, field_size, bytes_written);
+	return 1;
+}
+
+/***
+ * Encode a message, with peers from vectors following the ones in the message's lists
+ * @param in the message
+ * @param closer_peers more peers for field 8 (can be NULL)
+ * @param provider_peers more peers for field 9 (can be NULL)
+ * @param buffer where to write
+ * @param max_buffer_size the size of buffer
+ * @param bytes_written the number of bytes written
+ * @returns true(1) on success, otherwise false(0)
+ */
+static int libp2p_message_protobuf_encode_internal(const struct KademliaMessage* in, const struct Libp2pVector* closer_peers,
+		const struct Libp2pVector* provider_peers, unsigned char* buffer, size_t max_buffer_size, size_t* bytes_written) {
 	// data & data_size
 	size_t bytes_used = 0;
 	*bytes_written = 0;
 	int retVal = 0;
-	size_t protobuf_size = 0;
-	unsigned char* protobuf = NULL;
 	// field 1
 	retVal = protobuf_encode_varint(1, WIRETYPE_VARINT, in->message_type, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
 	if (retVal == 0)
@@ -134,56 +227,41 @@ int libp2p_message_protobuf_encode(const struct KademliaMessage* in, unsigned ch
 	}
 	// field 3
 	if (in->record != NULL) {
-		protobuf_size = libp2p_record_protobuf_encode_size(in->record);
-		protobuf = (unsigned char*) malloc(protobuf_size);
-		if (!libp2p_record_protobuf_encode(in->record, protobuf, protobuf_size, &protobuf_size)) {
-			free(protobuf);
+		size_t header_size = 0;
+		size_t field_size = 0;
+		if (!libp2p_message_protobuf_begin_field(3, libp2p_record_protobuf_encode_size(in->record), &buffer[*bytes_written], max_buffer_size - *bytes_written, &header_size))
 			return 0;
-		}
-		retVal = protobuf_encode_length_delimited(3, WIRETYPE_LENGTH_DELIMITED, (char*)protobuf, protobuf_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
-		free(protobuf);
-		if (retVal == 0)
+		if (!libp2p_record_protobuf_encode(in->record, &buffer[*bytes_written + header_size], max_buffer_size - *bytes_written - header_size, &field_size))
 			return 0;
+		libp2p_message_protobuf_end_field(3, &buffer[*bytes_written], header_size, field_size, &bytes_used);
 		*bytes_written += bytes_used;
 	}
 	// field 8 (repeated)
 	struct Libp2pLinkedList* current = in->closer_peer_head;
 	while (current != NULL) {
-		struct Libp2pPeer* peer = (struct Libp2pPeer*)current->item;
-		protobuf_size = libp2p_peer_protobuf_encode_size(peer);
-		unsigned char* peer_buffer = (unsigned char*)malloc(protobuf_size);
-		if (peer_buffer == NULL)
-			return 0;
-		if (!libp2p_peer_protobuf_encode(peer, peer_buffer, protobuf_size, &protobuf_size)) {
-			free(peer_buffer);
-			return 0;
-		}
-		retVal = protobuf_encode_length_delimited(8, WIRETYPE_LENGTH_DELIMITED, (char*)peer_buffer, protobuf_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
-		free(peer_buffer);
-		if (retVal == 0)
+		if (!libp2p_message_protobuf_encode_peer(8, (struct Libp2pPeer*)current->item, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
 			return 0;
 		*bytes_written += bytes_used;
 		current = current->next;
 	}
+	for(int i = 0; closer_peers != NULL && i < closer_peers->total; i++) {
+		if (!libp2p_message_protobuf_encode_peer(8, (struct Libp2pPeer*)libp2p_utils_vector_get(closer_peers, i), &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+	}
 	// field 9 (repeated)
 	current = in->provider_peer_head;
 	while (current != NULL) {
-		struct Libp2pPeer* peer = (struct Libp2pPeer*)current->item;
-		protobuf_size = libp2p_peer_protobuf_encode_size(peer);
-		unsigned char* peer_buffer = (unsigned char*)malloc(protobuf_size);
-		if (peer_buffer == NULL)
-			return 0;
-		if (!libp2p_peer_protobuf_encode(peer, peer_buffer, protobuf_size, &protobuf_size)) {
-			free(peer_buffer);
-			return 0;
-		}
-		retVal = protobuf_encode_length_delimited(9, WIRETYPE_LENGTH_DELIMITED, (char*)peer_buffer, protobuf_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
-		free(peer_buffer);
-		if (retVal == 0)
+		if (!libp2p_message_protobuf_encode_peer(9, (struct Libp2pPeer*)current->item, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
 			return 0;
 		*bytes_written += bytes_used;
 		current = current->next;
 	}
+	for(int i = 0; provider_peers != NULL && i < provider_peers->total; i++) {
+		if (!libp2p_message_protobuf_encode_peer(9, (struct Libp2pPeer*)libp2p_utils_vector_get(provider_peers, i), &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+	}
 	// field 10
 	retVal = protobuf_encode_varint(10, WIRETYPE_VARINT, in->cluster_level_raw, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
 	if (retVal == 0)
@@ -192,6 +270,28 @@ int libp2p_message_protobuf_encode(const struct KademliaMessage* in, unsigned ch
 	return 1;
 }
 
+int libp2p_message_protobuf_encode(const struct KademliaMessage* in, unsigned char* buffer, size_t max_buffer_size, size_t* bytes_written) {
+	return libp2p_message_protobuf_encode_internal(in, NULL, NULL, buffer, max_buffer_size, bytes_written);
+}
+
+int libp2p_message_protobuf_encode_with_peers(const struct KademliaMessage* in, const struct Libp2pVector* closer_peers,
+		const struct Libp2pVector* provider_peers, unsigned char** buffer, size_t* buffer_size) {
+	size_t max_size = libp2p_message_protobuf_encode_size(in) + libp2p_message_peers_encode_size(closer_peers)
+			+ libp2p_message_peers_encode_size(provider_peers);
+	*buffer = (unsigned char*) malloc(max_size);
+	if (*buffer == NULL) {
+		*buffer_size = 0;
+		return 0;
+	}
+	if (!libp2p_message_protobuf_encode_internal(in, closer_peers, provider_peers, *buffer, max_size, buffer_size)) {
+		free(*buffer);
+		*buffer = NULL;
+		*buffer_size = 0;
+		return 0;
+	}
+	return 1;
+}
+
 int libp2p_message_protobuf_decode(unsigned char* in, size_t in_size, struct KademliaMessage** out) {
 	size_t pos = 0;
 	int retVal = 0;
@@ -303,3 +403,313 @@ exit:
 		free(buffer);
 	return retVal;
 }
+
+/***
+ * Read a varint, making sure it does not run past the end of the buffer
+ * @param in the buffer
+ * @param in_size the bytes left in the buffer
+ * @param results the value
+ * @param bytes_read the number of bytes used
+ * @returns true(1) on success, false(0) if the varint is cut off
+ */
+static int libp2p_message_arena_decode_varint(const unsigned char* in, size_t in_size, unsigned long long* results, size_t* bytes_read) {
+	*results = 0;
+	for(size_t i = 0; i < in_size && i < 10; i++) {
+		*results |= (unsigned long long)(in[i] & 0x7F) << (7 * i);
+		if ((in[i] & 0x80) == 0) {
+			*bytes_read = i + 1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***
+ * Find a length delimited field without copying it
+ * @param in the buffer, positioned at the length
+ * @param in_size the bytes left in the buffer
+ * @param field where the field starts
+ * @param field_size the size of the field
+ * @param bytes_read the number of bytes used, including the length
+ * @returns true(1) on success, false(0) if the field is cut off
+ */
+static int libp2p_message_arena_decode_field(const unsigned char* in, size_t in_size, const unsigned char** field, size_t* field_size, size_t* bytes_read) {
+	unsigned long long length = 0;
+	size_t length_size = 0;
+	if (!libp2p_message_arena_decode_varint(in, in_size, &length, &length_size))
+		return 0;
+	if (length > in_size - length_size)
+		return 0;
+	*field = &in[length_size];
+	*field_size = length;
+	*bytes_read = length_size + length;
+	return 1;
+}
+
+/***
+ * Copy a length delimited field into the arena
+ * NOTE: a NULL is added after the copy, so strings can be used as-is
+ * @param arena the arena
+ * @param in the buffer, positioned at the length
+ * @param in_size the bytes left in the buffer
+ * @param results the copy
+ * @param results_size the size of the field
+ * @param bytes_read the number of bytes used
+ * @returns true(1) on success, otherwise false(0)
+ */
+static int libp2p_message_arena_decode_bytes(struct Libp2pArena* arena, const unsigned char* in, size_t in_size, char** results, size_t* results_size, size_t* bytes_read) {
+	const unsigned char* field = NULL;
+	if (!libp2p_message_arena_decode_field(in, in_size, &field, results_size, bytes_read))
+		return 0;
+	*results = (char*) libp2p_utils_arena_alloc(arena, *results_size + 1);
+	if (*results == NULL)
+		return 0;
+	memcpy(*results, field, *results_size);
+	(*results)[*results_size] = 0;
+	return 1;
+}
+
+/***
+ * Step over a field we do not know about
+ * @param in the buffer, positioned after the tag
+ * @param in_size the bytes left in the buffer
+ * @param field_type the wire type of the field
+ * @param bytes_read the number of bytes to skip
+ * @returns true(1) on success, false(0) if the field cannot be skipped
+ */
+static int libp2p_message_arena_skip_field(const unsigned char* in, size_t in_size, enum WireType field_type, size_t* bytes_read) {
+	unsigned long long value = 0;
+	const unsigned char* field = NULL;
+	size_t field_size = 0;
+	switch(field_type) {
+		case (WIRETYPE_VARINT):
+			return libp2p_message_arena_decode_varint(in, in_size, &value, bytes_read);
+		case (WIRETYPE_64BIT):
+			*bytes_read = 8;
+			return in_size >= 8;
+		case (WIRETYPE_32BIT):
+			*bytes_read = 4;
+			return in_size >= 4;
+		case (WIRETYPE_LENGTH_DELIMITED):
+			return libp2p_message_arena_decode_field(in, in_size, &field, &field_size, bytes_read);
+		default:
+			return 0;
+	}
+}
+
+/***
+ * Turn a protobuf'd peer into a Libp2pPeer that lives in the arena
+ * @param arena the arena
+ * @param in the protobuf
+ * @param in_size the size of the protobuf
+ * @param out the peer
+ * @returns true(1) on success, otherwise false(0)
+ */
+static int libp2p_message_arena_decode_peer(struct Libp2pArena* arena, const unsigned char* in, size_t in_size, struct Libp2pPeer** out) {
+	size_t pos = 0;
+	struct Libp2pLinkedList* last = NULL;
+	struct Libp2pPeer* peer = (struct Libp2pPeer*) libp2p_utils_arena_alloc(arena, sizeof(struct Libp2pPeer));
+	if (peer == NULL)
+		return 0;
+	memset(peer, 0, sizeof(struct Libp2pPeer));
+	peer->connection_type = CONNECTION_TYPE_NOT_CONNECTED;
+
+	while (pos < in_size) {
+		unsigned long long tag = 0;
+		unsigned long long value = 0;
+		size_t bytes_read = 0;
+		const unsigned char* field = NULL;
+		size_t field_size = 0;
+		if (!libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &tag, &bytes_read))
+			return 0;
+		pos += bytes_read;
+		enum WireType field_type = tag & 0x07;
+		switch(tag >> 3) {
+			case (1): // id
+				if (field_type != WIRETYPE_LENGTH_DELIMITED
+						|| !libp2p_message_arena_decode_bytes(arena, &in[pos], in_size - pos, &peer->id, &peer->id_size, &bytes_read))
+					return 0;
+				break;
+			case (2): { // multiaddress bytes
+				if (field_type != WIRETYPE_LENGTH_DELIMITED
+						|| !libp2p_message_arena_decode_field(&in[pos], in_size - pos, &field, &field_size, &bytes_read))
+					return 0;
+				struct Libp2pLinkedList* current = (struct Libp2pLinkedList*) libp2p_utils_arena_alloc(arena, sizeof(struct Libp2pLinkedList));
+				struct MultiAddress* address = (struct MultiAddress*) libp2p_utils_arena_alloc(arena, sizeof(struct MultiAddress));
+				if (current == NULL || address == NULL)
+					return 0;
+				address->bsize = field_size;
+				address->bytes = (uint8_t*) libp2p_utils_arena_memdup(arena, field, field_size);
+				if (address->bytes == NULL)
+					return 0;
+				// the string form is built by the multiaddr code, so it has to be copied in
+				char* string = NULL;
+				if (!bytes_to_string(&string, field, field_size)) {
+					free(string);
+					return 0;
+				}
+				address->string = (char*) libp2p_utils_arena_memdup(arena, string, strlen(string) + 1);
+				free(string);
+				if (address->string == NULL)
+					return 0;
+				current->item = address;
+				current->next = NULL;
+				if (last == NULL)
+					peer->addr_head = current;
+				else
+					last->next = current;
+				last = current;
+				break;
+			}
+			case (3): // connection type
+				if (field_type != WIRETYPE_VARINT || !libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &value, &bytes_read))
+					return 0;
+				peer->connection_type = (enum ConnectionType)value;
+				break;
+			default:
+				if (!libp2p_message_arena_skip_field(&in[pos], in_size - pos, field_type, &bytes_read))
+					return 0;
+				break;
+		}
+		pos += bytes_read;
+	}
+	*out = peer;
+	return 1;
+}
+
+/***
+ * Turn a protobuf'd record into a Libp2pRecord that lives in the arena
+ * @param arena the arena
+ * @param in the protobuf
+ * @param in_size the size of the protobuf
+ * @param out the record
+ * @returns true(1) on success, otherwise false(0)
+ */
+static int libp2p_message_arena_decode_record(struct Libp2pArena* arena, const unsigned char* in, size_t in_size, struct Libp2pRecord** out) {
+	size_t pos = 0;
+	struct Libp2pRecord* record = (struct Libp2pRecord*) libp2p_utils_arena_alloc(arena, sizeof(struct Libp2pRecord));
+	if (record == NULL)
+		return 0;
+	memset(record, 0, sizeof(struct Libp2pRecord));
+
+	while (pos < in_size) {
+		unsigned long long tag = 0;
+		size_t bytes_read = 0;
+		char** field = NULL;
+		size_t* field_size = NULL;
+		if (!libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &tag, &bytes_read))
+			return 0;
+		pos += bytes_read;
+		enum WireType field_type = tag & 0x07;
+		switch(tag >> 3) {
+			case (1): field = &record->key; field_size = &record->key_size; break;
+			case (2): field = (char**)&record->value; field_size = &record->value_size; break;
+			case (3): field = &record->author; field_size = &record->author_size; break;
+			case (4): field = (char**)&record->signature; field_size = &record->signature_size; break;
+			case (5): field = &record->time_received; field_size = &record->time_received_size; break;
+		}
+		if (field != NULL && field_type == WIRETYPE_LENGTH_DELIMITED) {
+			if (!libp2p_message_arena_decode_bytes(arena, &in[pos], in_size - pos, field, field_size, &bytes_read))
+				return 0;
+		} else if (!libp2p_message_arena_skip_field(&in[pos], in_size - pos, field_type, &bytes_read)) {
+			return 0;
+		}
+		pos += bytes_read;
+	}
+	*out = record;
+	return 1;
+}
+
+int libp2p_message_protobuf_decode_arena(const unsigned char* in, size_t in_size, struct KademliaMessage** out) {
+	size_t pos = 0;
+	int retVal = 0;
+	struct Libp2pLinkedList* last_closer = NULL;
+	struct Libp2pLinkedList* last_provider = NULL;
+	struct KademliaMessage* ptr = NULL;
+	// the decoded message is about the size of the protobuf, plus the structs
+	struct Libp2pArena* arena = libp2p_utils_arena_new(in_size * 2 + 1024);
+
+	*out = NULL;
+	if (arena == NULL)
+		return 0;
+	ptr = (struct KademliaMessage*) libp2p_utils_arena_alloc(arena, sizeof(struct KademliaMessage));
+	if (ptr == NULL)
+		goto exit;
+	memset(ptr, 0, sizeof(struct KademliaMessage));
+	ptr->message_type = MESSAGE_TYPE_PING;
+	ptr->arena = arena;
+
+	while (pos < in_size) {
+		unsigned long long tag = 0;
+		unsigned long long value = 0;
+		size_t bytes_read = 0;
+		const unsigned char* field = NULL;
+		size_t field_size = 0;
+		struct Libp2pLinkedList* current_item = NULL;
+		if (!libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &tag, &bytes_read))
+			goto exit;
+		pos += bytes_read;
+		enum WireType field_type = tag & 0x07;
+		switch(tag >> 3) {
+			case (1): // message type
+				if (field_type != WIRETYPE_VARINT || !libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &value, &bytes_read))
+					goto exit;
+				ptr->message_type = (enum MessageType)value;
+				break;
+			case (2): // key
+				if (field_type != WIRETYPE_LENGTH_DELIMITED
+						|| !libp2p_message_arena_decode_bytes(arena, &in[pos], in_size - pos, &ptr->key, &ptr->key_size, &bytes_read))
+					goto exit;
+				break;
+			case (3): // record
+				if (field_type != WIRETYPE_LENGTH_DELIMITED
+						|| !libp2p_message_arena_decode_field(&in[pos], in_size - pos, &field, &field_size, &bytes_read)
+						|| !libp2p_message_arena_decode_record(arena, field, field_size, &ptr->record))
+					goto exit;
+				break;
+			case (8): // closer peers
+			case (9): // provider peers
+				if (field_type != WIRETYPE_LENGTH_DELIMITED
+						|| !libp2p_message_arena_decode_field(&in[pos], in_size - pos, &field, &field_size, &bytes_read))
+					goto exit;
+				current_item = (struct Libp2pLinkedList*) libp2p_utils_arena_alloc(arena, sizeof(struct Libp2pLinkedList));
+				if (current_item == NULL)
+					goto exit;
+				current_item->next = NULL;
+				if (!libp2p_message_arena_decode_peer(arena, field, field_size, (struct Libp2pPeer**)&current_item->item))
+					goto exit;
+				if (tag >> 3 == 8) {
+					if (last_closer == NULL)
+						ptr->closer_peer_head = current_item;
+					else
+						last_closer->next = current_item;
+					last_closer = current_item;
+				} else {
+					if (last_provider == NULL)
+						ptr->provider_peer_head = current_item;
+					else
+						last_provider->next = current_item;
+					last_provider = current_item;
+				}
+				break;
+			case (10): // cluster level raw
+				if (field_type != WIRETYPE_VARINT || !libp2p_message_arena_decode_varint(&in[pos], in_size - pos, &value, &bytes_read))
+					goto exit;
+				ptr->cluster_level_raw = (int32_t)value;
+				break;
+			default:
+				if (!libp2p_message_arena_skip_field(&in[pos], in_size - pos, field_type, &bytes_read))
+					goto exit;
+				break;
+		}
+		pos += bytes_read;
+	}
+
+	*out = ptr;
+	retVal = 1;
+
+	exit:
+	if (retVal == 0)
+		libp2p_utils_arena_free(arena);
+	return retVal;
+}
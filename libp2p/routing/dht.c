@@ -36,6 +36,7 @@ THE SOFTWARE.
 #include <errno.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #if !defined(_WIN32) || defined(__MINGW32__)
 #include <sys/time.h>
@@ -321,6 +322,19 @@ static unsigned char oldsecret[8];
 
 static struct bucket *buckets = NULL;
 static struct bucket *buckets6 = NULL;
+
+/* Only our own bucket is ever split, so every other bucket holds exactly
+   the ids that have a given number of bits in common with myid.  The
+   index maps that number (the common prefix length) to its bucket;
+   entry depth and above is our own bucket.  It is rebuilt lazily after a
+   split. */
+struct bucket_index {
+    struct bucket *by_cpl[161];
+    int depth;
+    int dirty;
+};
+static struct bucket_index bucket_index = { {NULL}, 0, 1 };
+static struct bucket_index bucket_index6 = { {NULL}, 0, 1 };
 static struct storage *storage;
 static int numstorage;
 
@@ -436,29 +450,65 @@ lowbit(const unsigned char *id)
     return 8 * i + j;
 }
 
-/* Find how many bits two ids have in common. */
-static int
-common_bits(const unsigned char *id1, const unsigned char *id2)
+/* Ids are compared a word at a time.  Loading them big-endian keeps the
+   order of the words the same as the order of the bytes. */
+static inline uint64_t
+load_be64(const unsigned char *p)
 {
-    int i, j;
-    unsigned char xor;
-    for(i = 0; i < 20; i++) {
-        if(id1[i] != id2[i])
-            break;
-    }
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
 
-    if(i == 20)
-        return 160;
+static inline uint64_t
+load_be32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
 
-    xor = id1[i] ^ id2[i];
+/* The XOR distance between two ids, as three big-endian words (the last
+   one holds the remaining 4 bytes). */
+static inline void
+xor_distance(const unsigned char *id1, const unsigned char *id2,
+             uint64_t *distance)
+{
+    distance[0] = load_be64(id1) ^ load_be64(id2);
+    distance[1] = load_be64(id1 + 8) ^ load_be64(id2 + 8);
+    distance[2] = load_be32(id1 + 16) ^ load_be32(id2 + 16);
+}
 
-    j = 0;
-    while((xor & 0x80) == 0) {
-        xor <<= 1;
-        j++;
+static inline int
+distance_cmp(const uint64_t *d1, const uint64_t *d2)
+{
+    int i;
+    for(i = 0; i < 3; i++) {
+        if(d1[i] != d2[i])
+            return d1[i] < d2[i] ? -1 : 1;
     }
+    return 0;
+}
 
-    return 8 * i + j;
+/* Find how many bits two ids have in common. */
+static int
+common_bits(const unsigned char *id1, const unsigned char *id2)
+{
+    uint64_t distance[3];
+    xor_distance(id1, id2, distance);
+    if(distance[0])
+        return __builtin_clzll(distance[0]);
+    if(distance[1])
+        return 64 + __builtin_clzll(distance[1]);
+    if(distance[2])
+        return 128 + __builtin_clzll(distance[2]) - 32;
+    return 160;
 }
 
 /* Determine whether id1 or id2 is closer to ref */
@@ -466,19 +516,10 @@ static int
 xorcmp(const unsigned char *id1, const unsigned char *id2,
        const unsigned char *ref)
 {
-    int i;
-    for(i = 0; i < 20; i++) {
-        unsigned char xor1, xor2;
-        if(id1[i] == id2[i])
-            continue;
-        xor1 = id1[i] ^ ref[i];
-        xor2 = id2[i] ^ ref[i];
-        if(xor1 < xor2)
-            return -1;
-        else
-            return 1;
-    }
-    return 0;
+    uint64_t d1[3], d2[3];
+    xor_distance(id1, ref, d1);
+    xor_distance(id2, ref, d2);
+    return distance_cmp(d1, d2);
 }
 
 /* We keep buckets in a sorted linked list.  A bucket b ranges from
@@ -490,21 +531,47 @@ in_bucket(const unsigned char *id, struct bucket *b)
         (b->next == NULL || id_cmp(id, b->next->first) < 0);
 }
 
+/* Rebuild the index of a bucket list, if it has changed. */
+static struct bucket_index *
+get_bucket_index(int af)
+{
+    struct bucket_index *index =
+        af == AF_INET ? &bucket_index : &bucket_index6;
+    struct bucket *b, *mine = NULL;
+    int i;
+
+    if(!index->dirty)
+        return index;
+
+    memset(index->by_cpl, 0, sizeof(index->by_cpl));
+    index->depth = 0;
+    for(b = af == AF_INET ? buckets : buckets6; b; b = b->next) {
+        if(in_bucket(myid, b)) {
+            mine = b;
+        } else {
+            /* All of b has the same prefix in common with myid. */
+            int cpl = common_bits(b->first, myid);
+            index->by_cpl[cpl] = b;
+            if(cpl + 1 > index->depth)
+                index->depth = cpl + 1;
+        }
+    }
+    for(i = index->depth; i <= 160; i++)
+        index->by_cpl[i] = mine;
+    index->dirty = 0;
+    return index;
+}
+
 static struct bucket *
 find_bucket(unsigned const char *id, int af)
 {
-    struct bucket *b = af == AF_INET ? buckets : buckets6;
+    struct bucket_index *index;
 
-    if(b == NULL)
+    if((af == AF_INET ? buckets : buckets6) == NULL)
         return NULL;
 
-    while(1) {
-        if(b->next == NULL)
-            return b;
-        if(id_cmp(id, b->next->first) < 0)
-            return b;
-        b = b->next;
-    }
+    index = get_bucket_index(af);
+    return index->by_cpl[common_bits(id, myid)];
 }
 
 static struct bucket *
@@ -758,6 +825,10 @@ split_bucket(struct bucket *b)
     b->count = 0;
     new->next = b->next;
     b->next = new;
+    if(b->af == AF_INET)
+        bucket_index.dirty = 1;
+    else
+        bucket_index6.dirty = 1;
     while(nodes) {
         struct node *n;
         n = nodes;
@@ -1682,6 +1753,9 @@ dht_init(int s, int s6, const unsigned char *id, const unsigned char *v)
     storage = NULL;
     numstorage = 0;
 
+    bucket_index.dirty = 1;
+    bucket_index6.dirty = 1;
+
     if(s >= 0) {
         buckets = calloc(sizeof(struct bucket), 1);
         if(buckets == NULL)
@@ -1759,6 +1833,8 @@ dht_uninit()
     dht_socket = -1;
     dht_socket6 = -1;
 
+    bucket_index.dirty = 1;
+    bucket_index6.dirty = 1;
     while(buckets) {
         struct bucket *b = buckets;
         buckets = b->next;
@@ -2343,6 +2419,47 @@ dht_get_nodes(struct sockaddr_in *sin, int *num,
     return i + j;
 }
 
+/* Like dht_get_nodes, but for one address family, and with the ids, so
+   that the nodes can be restored with dht_insert_node.  The ids are 20
+   bytes each.  Our own bucket comes first, as in dht_get_nodes. */
+int
+dht_get_good_nodes(int af, unsigned char *ids, struct sockaddr_storage *ss,
+                   int *num)
+{
+    int i = 0;
+    struct bucket *b, *mine;
+    struct node *n;
+
+    mine = find_bucket(myid, af);
+    if(mine == NULL) {
+        *num = 0;
+        return 0;
+    }
+
+    for(n = mine->nodes; n && i < *num; n = n->next) {
+        if(node_good(n)) {
+            memcpy(ids + 20 * i, n->id, 20);
+            ss[i] = n->ss;
+            i++;
+        }
+    }
+
+    for(b = af == AF_INET ? buckets : buckets6; b && i < *num; b = b->next) {
+        if(b == mine)
+            continue;
+        for(n = b->nodes; n && i < *num; n = n->next) {
+            if(node_good(n)) {
+                memcpy(ids + 20 * i, n->id, 20);
+                ss[i] = n->ss;
+                i++;
+            }
+        }
+    }
+
+    *num = i;
+    return i;
+}
+
 int
 dht_insert_node(const unsigned char *id, struct sockaddr *sa, int salen)
 {
@@ -2561,62 +2678,84 @@ send_nodes_peers(const struct sockaddr *sa, int salen,
     return -1;
 }
 
+struct closest_node {
+    uint64_t distance[3];
+    struct node *node;
+};
+
+/* Keep the 8 good nodes of a bucket that are closest to id, in order. */
 static int
-insert_closest_node(unsigned char *nodes, int numnodes,
-                    const unsigned char *id, struct node *n)
+insert_closest_nodes(struct closest_node *closest, int numnodes,
+                     const unsigned char *id, struct bucket *b)
 {
-    int i, size;
-
-    if(n->ss.ss_family == AF_INET)
-        size = 26;
-    else if(n->ss.ss_family == AF_INET6)
-        size = 38;
-    else
-        abort();
-
-    for(i = 0; i< numnodes; i++) {
-        if(id_cmp(n->id, nodes + size * i) == 0)
-            return numnodes;
-        if(xorcmp(n->id, nodes + size * i, id) < 0)
-            break;
-    }
+    struct node *n;
+    uint64_t distance[3];
+    int i;
 
-    if(i == 8)
+    if(b == NULL)
         return numnodes;
 
-    if(numnodes < 8)
-        numnodes++;
-
-    if(i < numnodes - 1)
-        memmove(nodes + size * (i + 1), nodes + size * i,
-                size * (numnodes - i - 1));
-
-    if(n->ss.ss_family == AF_INET) {
-        struct sockaddr_in *sin = (struct sockaddr_in*)&n->ss;
-        memcpy(nodes + size * i, n->id, 20);
-        memcpy(nodes + size * i + 20, &sin->sin_addr, 4);
-        memcpy(nodes + size * i + 24, &sin->sin_port, 2);
-    } else if(n->ss.ss_family == AF_INET6) {
-        struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&n->ss;
-        memcpy(nodes + size * i, n->id, 20);
-        memcpy(nodes + size * i + 20, &sin6->sin6_addr, 16);
-        memcpy(nodes + size * i + 36, &sin6->sin6_port, 2);
-    } else {
-        abort();
+    for(n = b->nodes; n; n = n->next) {
+        if(!node_good(n))
+            continue;
+        xor_distance(n->id, id, distance);
+        i = numnodes;
+        while(i > 0 && distance_cmp(distance, closest[i - 1].distance) < 0)
+            i--;
+        if(i == 8)
+            continue;
+        if(numnodes < 8)
+            numnodes++;
+        memmove(closest + i + 1, closest + i,
+                sizeof(struct closest_node) * (numnodes - i - 1));
+        memcpy(closest[i].distance, distance, sizeof(distance));
+        closest[i].node = n;
     }
-
     return numnodes;
 }
 
+/* Find the 8 good nodes closest to id, and write them in compact form.
+   A bucket that is not ours shares exactly cpl bits with myid, so the
+   buckets can be visited in order of distance to id, and we can stop as
+   soon as 8 are found:
+     - the bucket of id, whose nodes share more than c bits with id,
+     - the buckets deeper than c, whose nodes share exactly c bits,
+     - then the buckets c - 1, c - 2, ..., 0, each farther than the last. */
 static int
-buffer_closest_nodes(unsigned char *nodes, int numnodes,
-                     const unsigned char *id, struct bucket *b)
+buffer_closest_nodes(unsigned char *nodes, const unsigned char *id, int af)
 {
-    struct node *n = b->nodes;
-    while(n) {
-        if(node_good(n))
-            numnodes = insert_closest_node(nodes, numnodes, id, n);
-        n = n->next;
+    struct closest_node closest[8];
+    struct bucket_index *index;
+    int numnodes = 0, c, i, size = af == AF_INET ? 26 : 38;
+
+    if((af == AF_INET ? buckets : buckets6) == NULL)
+        return 0;
+
+    index = get_bucket_index(af);
+    c = MIN(common_bits(id, myid), index->depth);
+    numnodes = insert_closest_nodes(closest, numnodes, id, index->by_cpl[c]);
+    if(c < index->depth && numnodes < 8) {
+        /* The deeper buckets tie with each other, so read them all. */
+        for(i = c + 1; i <= index->depth; i++)
+            numnodes = insert_closest_nodes(closest, numnodes, id,
+                                            index->by_cpl[i]);
+    }
+    for(i = c - 1; i >= 0 && numnodes < 8; i--)
+        numnodes = insert_closest_nodes(closest, numnodes, id,
+                                        index->by_cpl[i]);
+
+    for(i = 0; i < numnodes; i++) {
+        struct node *n = closest[i].node;
+        memcpy(nodes + size * i, n->id, 20);
+        if(af == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in*)&n->ss;
+            memcpy(nodes + size * i + 20, &sin->sin_addr, 4);
+            memcpy(nodes + size * i + 24, &sin->sin_port, 2);
+        } else {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&n->ss;
+            memcpy(nodes + size * i + 20, &sin6->sin6_addr, 16);
+            memcpy(nodes + size * i + 36, &sin6->sin6_port, 2);
+        }
     }
     return numnodes;
 }
@@ -2631,35 +2770,16 @@ send_closest_nodes(const struct sockaddr *sa, int salen,
     unsigned char nodes[8 * 26];
     unsigned char nodes6[8 * 38];
     int numnodes = 0, numnodes6 = 0;
-    struct bucket *b;
 
     if(want < 0)
         want = sa->sa_family == AF_INET ? WANT4 : WANT6;
 
-    if((want & WANT4)) {
-        b = find_bucket(id, AF_INET);
-        if(b) {
-            numnodes = buffer_closest_nodes(nodes, numnodes, id, b);
-            if(b->next)
-                numnodes = buffer_closest_nodes(nodes, numnodes, id, b->next);
-            b = previous_bucket(b);
-            if(b)
-                numnodes = buffer_closest_nodes(nodes, numnodes, id, b);
-        }
-    }
+    if((want & WANT4))
+        numnodes = buffer_closest_nodes(nodes, id, AF_INET);
+
+    if((want & WANT6))
+        numnodes6 = buffer_closest_nodes(nodes6, id, AF_INET6);
 
-    if((want & WANT6)) {
-        b = find_bucket(id, AF_INET6);
-        if(b) {
-            numnodes6 = buffer_closest_nodes(nodes6, numnodes6, id, b);
-            if(b->next)
-                numnodes6 =
-                    buffer_closest_nodes(nodes6, numnodes6, id, b->next);
-            b = previous_bucket(b);
-            if(b)
-                numnodes6 = buffer_closest_nodes(nodes6, numnodes6, id, b);
-        }
-    }
     debugf("  (%d+%d nodes.)\n", numnodes, numnodes6);
 
     return send_nodes_peers(sa, salen, tid, tid_len,
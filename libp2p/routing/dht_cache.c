@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/routing/dht_cache.h"
+
+/***
+ * A short lived cache of encoded DHT responses
+ */
+
+/***
+ * Hash a key (FNV-1a)
+ * @param key the key
+ * @param key_size the size of the key
+ * @returns the bucket index
+ */
+static unsigned int libp2p_routing_dht_cache_hash(const unsigned char* key, size_t key_size) {
+	unsigned int hash = 2166136261u;
+	for(size_t i = 0; i < key_size; i++) {
+		hash ^= key[i];
+		hash *= 16777619u;
+	}
+	return hash % DHT_CACHE_BUCKETS;
+}
+
+/***
+ * See if a timespec has passed
+ * @param when the time to check
+ * @param now the current time
+ * @returns true(1) if "when" is before "now"
+ */
+static int libp2p_routing_dht_cache_expired(const struct timespec* when, const struct timespec* now) {
+	if (when->tv_sec != now->tv_sec)
+		return when->tv_sec < now->tv_sec;
+	return when->tv_nsec < now->tv_nsec;
+}
+
+/***
+ * Take an entry out of the least recently used list
+ * NOTE: caller must hold the lock
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void libp2p_routing_dht_cache_unlink(struct DhtResponseCache* cache, struct DhtCacheEntry* entry) {
+	if (entry->newer != NULL)
+		entry->newer->older = entry->older;
+	else
+		cache->newest = entry->older;
+	if (entry->older != NULL)
+		entry->older->newer = entry->newer;
+	else
+		cache->oldest = entry->newer;
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+/***
+ * Put an entry at the front of the least recently used list
+ * NOTE: caller must hold the lock
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void libp2p_routing_dht_cache_link_newest(struct DhtResponseCache* cache, struct DhtCacheEntry* entry) {
+	entry->newer = NULL;
+	entry->older = cache->newest;
+	if (cache->newest != NULL)
+		cache->newest->newer = entry;
+	cache->newest = entry;
+	if (cache->oldest == NULL)
+		cache->oldest = entry;
+}
+
+/***
+ * Remove an entry from the cache and free it
+ * NOTE: caller must hold the lock
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void libp2p_routing_dht_cache_remove(struct DhtResponseCache* cache, struct DhtCacheEntry* entry) {
+	struct DhtCacheEntry** current = &cache->buckets[libp2p_routing_dht_cache_hash(entry->key, entry->key_size)];
+	while (*current != NULL && *current != entry)
+		current = &(*current)->next;
+	if (*current != NULL)
+		*current = entry->next;
+	libp2p_routing_dht_cache_unlink(cache, entry);
+	cache->num_entries--;
+	cache->num_bytes -= entry->response_size + entry->key_size;
+	free(entry->key);
+	free(entry->response);
+	free(entry);
+}
+
+/***
+ * Find the entry for a request
+ * NOTE: caller must hold the lock
+ * @param cache the cache
+ * @param request the request
+ * @returns the entry, or NULL if not found
+ */
+static struct DhtCacheEntry* libp2p_routing_dht_cache_find(struct DhtResponseCache* cache, const struct KademliaMessage* request) {
+	struct DhtCacheEntry* current = cache->buckets[libp2p_routing_dht_cache_hash((unsigned char*)request->key, request->key_size)];
+	while (current != NULL) {
+		if (current->message_type == request->message_type && current->cluster_level_raw == request->cluster_level_raw
+				&& current->key_size == request->key_size && memcmp(current->key, request->key, request->key_size) == 0)
+			return current;
+		current = current->next;
+	}
+	return NULL;
+}
+
+struct DhtResponseCache* libp2p_routing_dht_cache_new() {
+	struct DhtResponseCache* cache = (struct DhtResponseCache*) malloc(sizeof(struct DhtResponseCache));
+	if (cache == NULL)
+		return NULL;
+	memset(cache, 0, sizeof(struct DhtResponseCache));
+	cache->max_entries = DHT_CACHE_DEFAULT_MAX_ENTRIES;
+	cache->max_bytes = DHT_CACHE_DEFAULT_MAX_BYTES;
+	cache->ttl_secs = DHT_CACHE_DEFAULT_TTL;
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+void libp2p_routing_dht_cache_free(struct DhtResponseCache* cache) {
+	if (cache == NULL)
+		return;
+	while (cache->newest != NULL)
+		libp2p_routing_dht_cache_remove(cache, cache->newest);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+int libp2p_routing_dht_cache_get(struct DhtResponseCache* cache, const struct KademliaMessage* request, unsigned char** response, size_t* response_size, unsigned long long* generation) {
+	if (cache == NULL || request == NULL || request->key == NULL)
+		return 0;
+	int retVal = 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&cache->lock);
+	*generation = cache->generations[libp2p_routing_dht_cache_hash((unsigned char*)request->key, request->key_size)];
+	struct DhtCacheEntry* entry = libp2p_routing_dht_cache_find(cache, request);
+	if (entry != NULL && libp2p_routing_dht_cache_expired(&entry->expires, &now)) {
+		libp2p_routing_dht_cache_remove(cache, entry);
+		entry = NULL;
+	}
+	if (entry != NULL) {
+		*response = (unsigned char*) malloc(entry->response_size);
+		if (*response != NULL) {
+			memcpy(*response, entry->response, entry->response_size);
+			*response_size = entry->response_size;
+			libp2p_routing_dht_cache_unlink(cache, entry);
+			libp2p_routing_dht_cache_link_newest(cache, entry);
+			retVal = 1;
+		}
+	}
+	if (retVal)
+		cache->hits++;
+	else
+		cache->misses++;
+	pthread_mutex_unlock(&cache->lock);
+	return retVal;
+}
+
+int libp2p_routing_dht_cache_put(struct DhtResponseCache* cache, const struct KademliaMessage* request, const unsigned char* response, size_t response_size, unsigned long long generation) {
+	if (cache == NULL || request == NULL || request->key == NULL || response == NULL)
+		return 0;
+	size_t entry_bytes = response_size + request->key_size;
+	if (entry_bytes > cache->max_bytes)
+		return 0;
+	struct DhtCacheEntry* entry = (struct DhtCacheEntry*) malloc(sizeof(struct DhtCacheEntry));
+	if (entry == NULL)
+		return 0;
+	memset(entry, 0, sizeof(struct DhtCacheEntry));
+	entry->key = (unsigned char*) malloc(request->key_size);
+	entry->response = (unsigned char*) malloc(response_size);
+	if (entry->key == NULL || entry->response == NULL) {
+		free(entry->key);
+		free(entry->response);
+		free(entry);
+		return 0;
+	}
+	memcpy(entry->key, request->key, request->key_size);
+	entry->key_size = request->key_size;
+	memcpy(entry->response, response, response_size);
+	entry->response_size = response_size;
+	entry->message_type = request->message_type;
+	entry->cluster_level_raw = request->cluster_level_raw;
+	clock_gettime(CLOCK_MONOTONIC, &entry->expires);
+	entry->expires.tv_sec += cache->ttl_secs;
+
+	unsigned int index = libp2p_routing_dht_cache_hash(entry->key, entry->key_size);
+	pthread_mutex_lock(&cache->lock);
+	if (cache->generations[index] != generation) {
+		// the key changed after the response was computed
+		pthread_mutex_unlock(&cache->lock);
+		free(entry->key);
+		free(entry->response);
+		free(entry);
+		return 0;
+	}
+	// replace what was there
+	struct DhtCacheEntry* old = libp2p_routing_dht_cache_find(cache, request);
+	if (old != NULL)
+		libp2p_routing_dht_cache_remove(cache, old);
+	// make room
+	while (cache->oldest != NULL && (cache->num_entries >= cache->max_entries || cache->num_bytes + entry_bytes > cache->max_bytes))
+		libp2p_routing_dht_cache_remove(cache, cache->oldest);
+	entry->next = cache->buckets[index];
+	cache->buckets[index] = entry;
+	libp2p_routing_dht_cache_link_newest(cache, entry);
+	cache->num_entries++;
+	cache->num_bytes += entry_bytes;
+	pthread_mutex_unlock(&cache->lock);
+	return 1;
+}
+
+void libp2p_routing_dht_cache_invalidate(struct DhtResponseCache* cache, const unsigned char* key, size_t key_size) {
+	if (cache == NULL || key == NULL)
+		return;
+	unsigned int index = libp2p_routing_dht_cache_hash(key, key_size);
+	pthread_mutex_lock(&cache->lock);
+	// responses being computed now are stale too
+	cache->generations[index]++;
+	struct DhtCacheEntry* current = cache->buckets[index];
+	while (current != NULL) {
+		struct DhtCacheEntry* next = current->next;
+		if (current->key_size == key_size && memcmp(current->key, key, key_size) == 0)
+			libp2p_routing_dht_cache_remove(cache, current);
+		current = next;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void libp2p_routing_dht_cache_datastore_listener(const uint8_t* key, size_t key_size, void* cache) {
+	libp2p_routing_dht_cache_invalidate((struct DhtResponseCache*)cache, key, key_size);
+}
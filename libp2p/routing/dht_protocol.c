@@ -2,7 +2,9 @@
 #include <string.h>
 
 #include "libp2p/crypto/encoding/base58.h"
+#include "libp2p/crypto/sha256.h"
 #include "libp2p/net/stream.h"
+#include "libp2p/net/connectionstream.h"
 #include "libp2p/os/utils.h"
 #include "libp2p/routing/dht_protocol.h"
 #include "libp2p/record/message.h"
@@ -27,6 +29,15 @@ int libp2p_routing_dht_can_handle(const struct StreamMessage* msg) {
 }
 
 int libp2p_routing_dht_shutdown(void* context) {
+	struct DhtContext* ctx = (struct DhtContext*)context;
+	if (ctx != NULL) {
+		libp2p_net_ratelimit_free(ctx->rate_limiter);
+		if (ctx->datastore != NULL && ctx->datastore->datastore_put_listener_context == ctx->response_cache) {
+			ctx->datastore->datastore_put_listener = NULL;
+			ctx->datastore->datastore_put_listener_context = NULL;
+		}
+		libp2p_routing_dht_cache_free(ctx->response_cache);
+	}
 	free(context);
 	return 1;
 }
@@ -47,6 +58,13 @@ struct Libp2pProtocolHandler* libp2p_routing_dht_build_protocol_handler(struct P
 		ctx->provider_store = provider_store;
 		ctx->datastore = datastore;
 		ctx->filestore = filestore;
+		ctx->rate_limiter = libp2p_net_ratelimit_new("/ipfs/kad/1.0.0");
+		ctx->response_cache = libp2p_routing_dht_cache_new();
+		// a local put can make us a provider, so the cached answer for that key is wrong
+		if (datastore != NULL && ctx->response_cache != NULL) {
+			datastore->datastore_put_listener = libp2p_routing_dht_cache_datastore_listener;
+			datastore->datastore_put_listener_context = ctx->response_cache;
+		}
 		handler->context = ctx;
 		handler->CanHandle = libp2p_routing_dht_can_handle;
 		handler->HandleMessage = libp2p_routing_dht_handle_msg;
@@ -67,6 +85,7 @@ int libp2p_routing_dht_protobuf_message(struct KademliaMessage* message, unsigne
 	*buffer = malloc(*buffer_size);
 	if (!libp2p_message_protobuf_encode(message, *buffer, *buffer_size, buffer_size)) {
 		free(*buffer);
+		*buffer = NULL;
 		*buffer_size = 0;
 		return 0;
 	}
@@ -144,11 +163,22 @@ int libp2p_routing_dht_handle_ping(struct KademliaMessage* message, unsigned cha
  */
 int libp2p_routing_dht_handle_get_providers(struct Stream* stream, struct KademliaMessage* message, struct DhtContext* protocol_context,
 		unsigned char** results, size_t* results_size) {
-	unsigned char* peer_id = NULL;
-	int peer_id_size = 0;
+	struct Libp2pVector* providers = NULL;
+	// the peers sent back. These point into the peerstore, and are encoded without copying
+	struct Libp2pVector* provider_peers = NULL;
+	struct Libp2pVector* closest = NULL;
+	int retVal = 1;
 
 	// This shouldn't be needed, but just in case:
 	message->provider_peer_head = NULL;
+	message->closer_peer_head = NULL;
+
+	// has someone asked this recently?
+	unsigned long long generation = 0;
+	if (libp2p_routing_dht_cache_get(protocol_context->response_cache, message, results, results_size, &generation)) {
+		libp2p_logger_debug("dht_protocol", "GetProviders: Sending cached response.\n");
+		return 1;
+	}
 
 	// Can I provide it locally?
 	struct DatastoreRecord* datastore_record = NULL;
@@ -156,30 +186,23 @@ int libp2p_routing_dht_handle_get_providers(struct Stream* stream, struct Kademl
 		// we can provide this hash from our datastore
 		libp2p_datastore_record_free(datastore_record);
 		libp2p_logger_debug("dht_protocol", "I can provide myself as a provider for this key.\n");
-		message->provider_peer_head = libp2p_utils_linked_list_new();
-		message->provider_peer_head->item = libp2p_peer_copy(libp2p_peerstore_get_local_peer(protocol_context->peer_store));
-	} else if (libp2p_providerstore_get(protocol_context->provider_store, (unsigned char*)message->key, message->key_size, &peer_id, &peer_id_size)) {
+		struct Libp2pPeer* local_peer = libp2p_peerstore_get_local_peer(protocol_context->peer_store);
+		provider_peers = libp2p_utils_vector_new(1);
+		if (provider_peers != NULL && local_peer != NULL)
+			libp2p_utils_vector_add(provider_peers, local_peer);
+	} else if ((providers = libp2p_providerstore_get_providers(protocol_context->provider_store, (unsigned char*)message->key, message->key_size, PROVIDERSTORE_MAX_PROVIDERS)) != NULL) {
 		// Can I provide it because someone announced it earlier?
-		// we have a peer id, convert it to a peer object
-		struct Libp2pPeer* peer = libp2p_peerstore_get_peer(protocol_context->peer_store, peer_id, peer_id_size);
-		if (peer != NULL) {
+		// add the ones we know how to reach, freshest first
+		provider_peers = libp2p_utils_vector_new(providers->total);
+		for(int i = 0; provider_peers != NULL && i < providers->total; i++) {
+			struct ProviderEntry* entry = (struct ProviderEntry*) libp2p_utils_vector_get(providers, i);
+			struct Libp2pPeer* peer = libp2p_peerstore_get_peer(protocol_context->peer_store, entry->peer_id, entry->peer_id_size);
+			if (peer == NULL)
+				continue;
 			libp2p_logger_debug("dht_protocol", "I can provide a provider for this key, because %s says he has it.\n", libp2p_peer_id_to_string(peer));
-			// add it to the message
-			if (message->provider_peer_head == NULL) {
-				message->provider_peer_head = libp2p_utils_linked_list_new();
-				message->provider_peer_head->item = libp2p_peer_copy(peer);
-			} else {
-
-				struct Libp2pLinkedList* current = message->provider_peer_head;
-				// find the last one in the list
-				while (current->next != NULL) {
-					current = current->next;
-				}
-				// add to the list
-				current->next = libp2p_utils_linked_list_new();
-				current->next->item = peer;
-			}
+			libp2p_utils_vector_add(provider_peers, peer);
 		}
+		libp2p_providerstore_providers_free(providers);
 	} else {
 		size_t b58_size = 100;
 		uint8_t *b58key = (uint8_t *) malloc(b58_size);
@@ -190,24 +213,23 @@ int libp2p_routing_dht_handle_get_providers(struct Stream* stream, struct Kademl
 		}
 		free(b58key);
 	}
-	if (peer_id != NULL)
-		free(peer_id);
-	// TODO: find closer peers
-	/*
-	if (message->provider_peer_head == NULL) {
-		// Who else can provide it?
-		//while ()
-	}
-	*/
-	if (message->provider_peer_head != NULL) {
-		libp2p_logger_debug("dht_protocol", "GetProviders: We have a peer. Sending it back.");
+	// Who else may know? Send back the peers we know of that are closest to the key
+	closest = libp2p_routing_dht_closest_peers(protocol_context->peer_store, (unsigned char*)message->key, message->key_size, DHT_PROTOCOL_K);
+	if ((provider_peers != NULL && provider_peers->total > 0) || (closest != NULL && closest->total > 0)) {
+		libp2p_logger_debug("dht_protocol", "GetProviders: We have peers. Sending them back.\n");
 		// protobuf it and send it back
-		if (!libp2p_routing_dht_protobuf_message(message, results, results_size)) {
+		if (!libp2p_message_protobuf_encode_with_peers(message, closest, provider_peers, results, results_size)) {
 			libp2p_logger_error("dht_protocol", "GetProviders: Error protobufing results\n");
-			return 0;
+			retVal = 0;
+		} else {
+			libp2p_routing_dht_cache_put(protocol_context->response_cache, message, *results, *results_size, generation);
 		}
 	}
-	return 1;
+	if (provider_peers != NULL)
+		libp2p_utils_vector_free(provider_peers);
+	if (closest != NULL)
+		libp2p_utils_vector_free(closest);
+	return retVal;
 }
 
 /***
@@ -298,6 +320,8 @@ int libp2p_routing_dht_handle_add_provider(struct Stream* stream, struct Kademli
 		libp2p_logger_debug("dht_protocol", "About to add key to providerstore\n");
 		if (!libp2p_providerstore_add(protocol_context->provider_store, (unsigned char*)message->key, message->key_size, (unsigned char*)peer->id, peer->id_size))
 			goto exit;
+		// the providers of this key have changed
+		libp2p_routing_dht_cache_invalidate(protocol_context->response_cache, (unsigned char*)message->key, message->key_size);
 	}
 
 	if (!libp2p_routing_dht_protobuf_message(message, result_buffer, result_buffer_size)) {
@@ -335,11 +359,20 @@ int libp2p_routing_dht_handle_get_value(struct Stream* stream, struct KademliaMe
 		unsigned char** result_buffer, size_t *result_buffer_size) {
 
 	struct Filestore* filestore = dht_context->filestore;
+	struct DatastoreRecord* datastore_record = NULL;
 	size_t data_size = 0;
 	unsigned char* data = NULL;
 
-	// We need to get the data from the disk
-	if(!filestore->node_get((unsigned char*)message->key, message->key_size, (void**)&data, &data_size, filestore)) {
+	// blocks are on the disk. Records sent with PUT_VALUE (i.e. IPNS names) are in the datastore
+	if (!filestore->node_get((unsigned char*)message->key, message->key_size, (void**)&data, &data_size, filestore)
+			&& dht_context->datastore != NULL
+			&& dht_context->datastore->datastore_get((unsigned char*)message->key, message->key_size, &datastore_record, dht_context->datastore)) {
+		data = datastore_record->value;
+		data_size = datastore_record->value_size;
+		datastore_record->value = NULL;
+		libp2p_datastore_record_free(datastore_record);
+	}
+	if (data == NULL) {
 		size_t sz = 100;
 		unsigned char key[sz];
 		memset(key, 0, sz);
@@ -361,13 +394,11 @@ int libp2p_routing_dht_handle_get_value(struct Stream* stream, struct KademliaMe
 	message->record = record;
 	free(data);
 
-	if (!libp2p_routing_dht_protobuf_message(message, result_buffer, result_buffer_size)) {
-		libp2p_record_free(record);
-		message->record = NULL;
-		return 0;
-	}
-
-	return 1;
+	int retVal = libp2p_routing_dht_protobuf_message(message, result_buffer, result_buffer_size);
+	// the message may live in an arena, so it cannot keep the record
+	libp2p_record_free(record);
+	message->record = NULL;
+	return retVal;
 }
 
 /**
@@ -426,16 +457,63 @@ int libp2p_routing_dht_handle_find_node(struct Stream* stream, struct KademliaMe
 	// look through peer store
 	struct Libp2pPeer* peer = libp2p_peerstore_get_peer(protocol_context->peer_store, (unsigned char*)message->key, message->key_size);
 	if (peer != NULL) {
-		message->provider_peer_head = libp2p_utils_linked_list_new();
-		message->provider_peer_head->item = libp2p_peer_copy(peer);
-		if (!libp2p_routing_dht_protobuf_message(message, result_buffer, result_buffer_size)) {
+		// send the peer straight from the peerstore
+		struct Libp2pVector* provider_peers = libp2p_utils_vector_new(1);
+		if (provider_peers == NULL)
 			return 0;
-		}
-		return 1;
+		libp2p_utils_vector_add(provider_peers, peer);
+		int retVal = libp2p_message_protobuf_encode_with_peers(message, NULL, provider_peers, result_buffer, result_buffer_size);
+		libp2p_utils_vector_free(provider_peers);
+		return retVal;
 	}
 	return 0;
 }
 
+/***
+ * How important an incoming request is when we are busy
+ * @param message_type the type of request
+ * @returns the priority
+ */
+static enum RateLimitPriority libp2p_routing_dht_priority(enum MessageType message_type) {
+	switch(message_type) {
+		case (MESSAGE_TYPE_PING):
+		case (MESSAGE_TYPE_FIND_NODE):
+			return RATELIMIT_PRIORITY_HIGH;
+		case (MESSAGE_TYPE_GET_VALUE):
+		case (MESSAGE_TYPE_GET_PROVIDERS):
+			return RATELIMIT_PRIORITY_NORMAL;
+		default:
+			// these make us store something
+			return RATELIMIT_PRIORITY_LOW;
+	}
+}
+
+/***
+ * Build the reply to a request we are too busy to work on. It is the request
+ * with nothing in it, so the remote moves on instead of waiting for a reply.
+ * NOTE: Requests that get no reply when they are worked on get none here either
+ * @param message the request (it is emptied)
+ * @param result_buffer where to put the reply
+ * @param result_buffer_size the size of the reply
+ * @returns true(1) if there is a reply to send, false(0) otherwise
+ */
+static int libp2p_routing_dht_busy_reply(struct KademliaMessage* message, unsigned char** result_buffer, size_t* result_buffer_size) {
+	switch(message->message_type) {
+		case (MESSAGE_TYPE_GET_VALUE):
+		case (MESSAGE_TYPE_GET_PROVIDERS):
+		case (MESSAGE_TYPE_FIND_NODE):
+		case (MESSAGE_TYPE_PING):
+			break;
+		default:
+			return 0;
+	}
+	// these live in the arena of the message, so they are freed with it
+	message->record = NULL;
+	message->closer_peer_head = NULL;
+	message->provider_peer_head = NULL;
+	return libp2p_routing_dht_protobuf_message(message, result_buffer, result_buffer_size);
+}
+
 /***
  * Handle the incoming message. Handshake should have already
  * been done. We should expect  that the next read contains
@@ -449,15 +527,27 @@ int libp2p_routing_dht_handle_message(struct Stream* stream, struct DhtContext*
 	struct StreamMessage* buffer = NULL;
 	size_t result_buffer_size = 0;
 	int retVal = 0;
+	int admitted = 0;
 	struct KademliaMessage* message = NULL;
 
 	// read from stream
 	if (!stream->read(stream->stream_context, &buffer, 5))
 		goto exit;
-	// unprotobuf
-	if (!libp2p_message_protobuf_decode(buffer->data, buffer->data_size, &message))
+	// unprotobuf. The message is only needed until the reply is sent, so it all goes in one arena
+	if (!libp2p_message_protobuf_decode_arena(buffer->data, buffer->data_size, &message))
 		goto exit;
 
+	// make sure we are not doing too much for this peer, or for everyone
+	struct SessionContext* session_context = libp2p_net_connection_get_session_context(stream);
+	const char* remote_peer_id = (session_context != NULL) ? session_context->remote_peer_id : NULL;
+	if (!libp2p_net_ratelimit_admit(protocol_context->rate_limiter, remote_peer_id, remote_peer_id == NULL ? 0 : strlen(remote_peer_id),
+			libp2p_routing_dht_priority(message->message_type))) {
+		libp2p_logger_debug("dht_protocol", "DhtHandleMessage: Too busy. Sending an empty reply to message type %d.\n", message->message_type);
+		libp2p_routing_dht_busy_reply(message, &result_buffer, &result_buffer_size);
+		goto reply;
+	}
+	admitted = 1;
+
 	// handle message
 	switch(message->message_type) {
 		case(MESSAGE_TYPE_PUT_VALUE): // store a value in local storage
@@ -479,6 +569,7 @@ int libp2p_routing_dht_handle_message(struct Stream* stream, struct DhtContext*
 				libp2p_routing_dht_handle_ping(message, &result_buffer, &result_buffer_size);
 				break;
 	}
+	reply:
 	// if we have something to send, send it.
 	if (result_buffer != NULL) {
 		libp2p_logger_debug("dht_protocol", "Sending message back to caller. Message type: %d\n", message->message_type);
@@ -492,6 +583,8 @@ int libp2p_routing_dht_handle_message(struct Stream* stream, struct DhtContext*
 	}
 	retVal = 1;
 	exit:
+	if (admitted)
+		libp2p_net_ratelimit_release(protocol_context->rate_limiter);
 	libp2p_stream_message_free(buffer);
 	if (result_buffer != NULL)
 		free(result_buffer);
@@ -533,19 +626,36 @@ int libp2p_routing_dht_receive_message(struct SessionContext* sessionContext, st
  * @returns true(1) on success, false(0) otherwise
  */
 int libp2p_routing_dht_send_message(struct SessionContext* sessionContext, struct KademliaMessage* message) {
-	size_t protobuf_size = 0, retVal = 0;
+	size_t protobuf_size = 0;
 	unsigned char* protobuf = NULL;
-	struct StreamMessage outgoing;
 
 	protobuf_size = libp2p_message_protobuf_encode_size(message);
 	protobuf = (unsigned char*)malloc(protobuf_size);
+	if (protobuf == NULL)
+		return 0;
 	libp2p_message_protobuf_encode(message, &protobuf[0], protobuf_size, &protobuf_size);
 
+	int retVal = libp2p_routing_dht_send_encoded(sessionContext, protobuf, protobuf_size);
+	free(protobuf);
+	return retVal;
+}
+
+/***
+ * Send a kademlia message that was already protobuf'd. Lets the same
+ * bytes go to many peers without encoding them again.
+ * NOTE: this call upgrades the stream to /ipfs/kad/1.0.0
+ * @param sessionContext the context
+ * @param protobuf the encoded KademliaMessage
+ * @param protobuf_size the size of protobuf
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_routing_dht_send_encoded(struct SessionContext* sessionContext, unsigned char* protobuf, size_t protobuf_size) {
+	struct StreamMessage outgoing;
 
 	// upgrade to kademlia protocol
 	if (!libp2p_routing_dht_upgrade_stream(sessionContext)) {
 		libp2p_logger_error("dht_protocol", "send_message: Unable to upgrade to kademlia stream.\n");
-		goto exit;
+		return 0;
 	}
 
 	// send the message
@@ -553,13 +663,9 @@ int libp2p_routing_dht_send_message(struct SessionContext* sessionContext, struc
 	outgoing.data_size = protobuf_size;
 	if (!sessionContext->default_stream->write(sessionContext, &outgoing)) {
 		libp2p_logger_error("dht_protocol", "send_message: Attempted to write to Kademlia stream, but could not.\n");
-		goto exit;
+		return 0;
 	}
-	retVal = 1;
-	exit:
-	if (protobuf != NULL)
-		free(protobuf);
-	return retVal;
+	return 1;
 }
 
 /**
@@ -576,12 +682,9 @@ int libp2p_routing_dht_send_message_nearest_x(const struct Dialer* dialer, struc
 	// TODO: Calculate "Nearest"
 	// but for now, grab x peers, and send to them
 	int numSent = 0;
-	struct Libp2pLinkedList* llpeer_entry = peerstore->head_entry;
-	while (llpeer_entry != NULL) {
-		struct PeerEntry* entry = llpeer_entry->item;
-		if (entry == NULL)
-			break;
-		struct Libp2pPeer* remote_peer = entry->peer;
+	struct Libp2pVector* known_peers = libp2p_peerstore_get_peers(peerstore);
+	for(int i = 0; known_peers != NULL && i < known_peers->total; i++) {
+		struct Libp2pPeer* remote_peer = (struct Libp2pPeer*) libp2p_utils_vector_get(known_peers, i);
 		if (!remote_peer->is_local) {
 			// connect (if not connected)
 			if (libp2p_peer_connect(dialer, remote_peer, peerstore, datastore, 5)) {
@@ -592,8 +695,97 @@ int libp2p_routing_dht_send_message_nearest_x(const struct Dialer* dialer, struc
 			if (numSent >= numToSend)
 				break;
 		}
-		// grab next entry
-		llpeer_entry = llpeer_entry->next;
 	}
+	if (known_peers != NULL)
+		libp2p_utils_vector_free(known_peers);
 	return numSent > 0;
 }
+
+/***
+ * Compute the position of a peer id or key in the kademlia keyspace
+ * @param id the peer id or key
+ * @param id_size the size of id
+ * @param kad_id where to put the results (DHT_PROTOCOL_ID_SIZE bytes)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_routing_dht_kademlia_id(const unsigned char* id, size_t id_size, unsigned char* kad_id) {
+	if (id == NULL || kad_id == NULL)
+		return 0;
+	return libp2p_crypto_hashing_sha256(id, id_size, kad_id) > 0;
+}
+
+/***
+ * Compare the XOR distance of two kademlia ids to a target
+ * @param a the first kademlia id
+ * @param b the second kademlia id
+ * @param target the kademlia id to measure from
+ * @returns less than 0 if a is closer, greater than 0 if b is closer, 0 if they are the same
+ */
+int libp2p_routing_dht_xor_compare(const unsigned char* a, const unsigned char* b, const unsigned char* target) {
+	for(int i = 0; i < DHT_PROTOCOL_ID_SIZE; i++) {
+		unsigned char distance_a = a[i] ^ target[i];
+		unsigned char distance_b = b[i] ^ target[i];
+		if (distance_a != distance_b)
+			return distance_a < distance_b ? -1 : 1;
+	}
+	return 0;
+}
+
+/***
+ * Find the peers in the peerstore that are closest to a key by XOR distance
+ * NOTE: The local peer and peers without addresses are skipped
+ * @param peerstore the peerstore
+ * @param key the key (or peer id)
+ * @param key_size the size of key
+ * @param max_peers the most to return
+ * @returns a vector of peers from the peerstore, closest first (free with libp2p_utils_vector_free), or NULL on error
+ */
+struct Libp2pVector* libp2p_routing_dht_closest_peers(struct Peerstore* peerstore, const unsigned char* key, size_t key_size, int max_peers) {
+	unsigned char target[DHT_PROTOCOL_ID_SIZE];
+	struct Libp2pVector* known_peers = NULL;
+	struct Libp2pVector* results = NULL;
+	struct Libp2pPeer** closest = NULL;
+	unsigned char (*closest_ids)[DHT_PROTOCOL_ID_SIZE] = NULL;
+	int num_closest = 0;
+
+	if (peerstore == NULL || max_peers <= 0 || !libp2p_routing_dht_kademlia_id(key, key_size, target))
+		return NULL;
+	known_peers = libp2p_peerstore_get_peer_entries(peerstore);
+	if (known_peers == NULL)
+		return NULL;
+	closest = (struct Libp2pPeer**) malloc(sizeof(struct Libp2pPeer*) * max_peers);
+	closest_ids = malloc(DHT_PROTOCOL_ID_SIZE * max_peers);
+	if (closest == NULL || closest_ids == NULL)
+		goto exit;
+	// keep the closest max_peers, in order, by insertion
+	for(int i = 0; i < known_peers->total; i++) {
+		struct PeerEntry* entry = (struct PeerEntry*) libp2p_utils_vector_get(known_peers, i);
+		struct Libp2pPeer* peer = entry->peer;
+		if (peer->is_local || peer->addr_head == NULL || peer->id_size == 0)
+			continue;
+		// the peerstore keeps the hashed id, so nothing is hashed here
+		const unsigned char* kad_id = entry->hashed_id;
+		int pos = num_closest;
+		while (pos > 0 && libp2p_routing_dht_xor_compare(kad_id, closest_ids[pos-1], target) < 0)
+			pos--;
+		if (pos >= max_peers)
+			continue;
+		int last = num_closest < max_peers ? num_closest : max_peers - 1;
+		for(int j = last; j > pos; j--) {
+			closest[j] = closest[j-1];
+			memcpy(closest_ids[j], closest_ids[j-1], DHT_PROTOCOL_ID_SIZE);
+		}
+		closest[pos] = peer;
+		memcpy(closest_ids[pos], kad_id, DHT_PROTOCOL_ID_SIZE);
+		if (num_closest < max_peers)
+			num_closest++;
+	}
+	results = libp2p_utils_vector_new(num_closest > 0 ? num_closest : 1);
+	for(int i = 0; results != NULL && i < num_closest; i++)
+		libp2p_utils_vector_add(results, closest[i]);
+	exit:
+	free(closest);
+	free(closest_ids);
+	libp2p_utils_vector_free(known_peers);
+	return results;
+}
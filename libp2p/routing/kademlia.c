@@ -7,6 +7,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
@@ -35,15 +36,47 @@ pthread_t pth_kademlia, pth_announce;
 time_t tosleep = 0;
 int kfd = -1;
 int net_family = 0;
-volatile int8_t searching = 0; // search lock, -1 to busy, 0 to free, 1 to running.
-volatile char hash[20];     // hash to be search or announce.
-volatile uint16_t announce_port = 0;
 volatile int8_t closing = 0;
 
+/* Searches are handed to kademlia_thread through a bounded multi-producer,
+   single-consumer ring. Producers claim a slot with a compare-and-swap on
+   queue_head, fill it, and publish it by bumping the slot's sequence. Then
+   they write a byte to wake_fds[1] so the select() in kademlia_thread
+   returns right away. */
+struct search_request {
+    volatile size_t sequence;
+    unsigned char hash[KADEMLIA_HASH_SIZE];
+    uint16_t port;
+    kademlia_search_callback *callback;
+    void *closure;
+};
+static struct search_request search_queue[KADEMLIA_QUEUE_SIZE];
+static size_t queue_head = 0; // next slot for a producer
+static size_t queue_tail = 0; // next slot for kademlia_thread
+static int wake_fds[2] = { -1, -1 };
+
+/* The searches dht.c is working on. Only touched by kademlia_thread. */
+#define SEARCH_EXPIRE_TIME		(62 * 60) // dht.c forgets searches after this
+struct active_search {
+    unsigned char hash[KADEMLIA_HASH_SIZE];
+    kademlia_search_callback *callback;
+    void *closure;
+    time_t started;
+    struct active_search *next;
+} *active_searches = NULL;
+
+/* The good nodes of the routing table are saved to cache_path every
+   CACHE_SAVE_INTERVAL seconds and when closing, and are loaded again by
+   start_kademlia, so a restart does not have to begin from scratch. */
+#define CACHE_SAVE_INTERVAL		(10 * 60)
+#define CACHE_MAX_NODES			400
+#define CACHE_MAGIC			"KAD1"
+static char *cache_path = NULL;
+
 #define ANNOUNCE_WAIT_TIME		(28 * 60) // Wait 28 minutes.
 #define ANNOUNCE_WAIT_TOLERANCE		60
 struct announce_struct {
-    unsigned char hash[sizeof hash];
+    unsigned char hash[KADEMLIA_HASH_SIZE];
     uint16_t port;
     unsigned int time;
     struct announce_struct *next;
@@ -63,7 +96,7 @@ struct ipv6_struct {
 };
 
 struct search_struct {
-    unsigned char hash[sizeof hash];
+    unsigned char hash[KADEMLIA_HASH_SIZE];
     uint8_t ipv4_count;
     uint8_t ipv6_count;
     struct ipv4_struct ipv4[DHT_MAX_IPV4];
@@ -92,7 +125,7 @@ static void callback(void *closure, int event, const unsigned char *info_hash, c
             }
             // Find the item in the list.
             for (rp = search_result ; rp ; rp = rp->next) {
-                if (memcmp(rp->hash, info_hash, sizeof hash) == 0) { // Found.
+                if (memcmp(rp->hash, info_hash, KADEMLIA_HASH_SIZE) == 0) { // Found.
                     int i;
                     if (event == DHT_EVENT_VALUES) { // IPv4
                         struct ipv4_struct ipv4;
@@ -140,7 +173,7 @@ static void callback(void *closure, int event, const unsigned char *info_hash, c
             if (search_result) {
                 // Try to find the item in the list.
                 for (sp = search_result ; sp->next ; sp = sp->next) {
-                    if (memcmp(sp->hash, info_hash, sizeof hash) == 0) { // Found.
+                    if (memcmp(sp->hash, info_hash, KADEMLIA_HASH_SIZE) == 0) { // Found.
                         rp = sp;
                         break;
                     }
@@ -149,14 +182,14 @@ static void callback(void *closure, int event, const unsigned char *info_hash, c
                     rp = malloc(sizeof(struct search_struct));
                     if (!rp) return; // Abort, out of memory.
                     memset(rp, 0, sizeof(struct search_struct));
-                    memcpy(rp->hash, info_hash, sizeof hash);
+                    memcpy(rp->hash, info_hash, KADEMLIA_HASH_SIZE);
                     sp->next = rp; // Insert in the list.
                 }
             } else {
                 rp = malloc(sizeof(struct search_struct));
                 if (!rp) return; // Abort, out of memory.
                 memset(rp, 0, sizeof(struct search_struct));
-                memcpy(rp->hash, info_hash, sizeof hash);
+                memcpy(rp->hash, info_hash, KADEMLIA_HASH_SIZE);
                 search_result = rp; // Insert first item in the list.
             }
             break;
@@ -165,6 +198,282 @@ static void callback(void *closure, int event, const unsigned char *info_hash, c
     }
 }
 
+/***
+ * The callback given to dht.c. Passes the event on to the callbacks of
+ * the searches for info_hash, and forgets those searches when they are done.
+ * NOTE: only called from kademlia_thread
+ * @param closure not used
+ * @param event the event
+ * @param info_hash the hash of the search
+ * @param data the new value
+ * @param data_len the length of the data
+ */
+static void dispatch_callback(void *closure, int event, const unsigned char *info_hash, const void *data, size_t data_len) {
+    struct active_search **sp = &active_searches, *as;
+    time_t now = time(NULL);
+
+    while ((as = *sp) != NULL) {
+        if (memcmp(as->hash, info_hash, KADEMLIA_HASH_SIZE) == 0) {
+            if (as->callback) {
+                (*as->callback)(as->closure, event, info_hash, data, data_len);
+            }
+            if (event == DHT_EVENT_SEARCH_DONE || event == DHT_EVENT_SEARCH_DONE6) {
+                *sp = as->next;
+                free(as);
+                continue;
+            }
+        } else if (now - as->started > SEARCH_EXPIRE_TIME) {
+            // dht.c gave up on it without telling us.
+            *sp = as->next;
+            free(as);
+            continue;
+        }
+        sp = &as->next;
+    }
+}
+
+/***
+ * Reset the submission queue
+ * NOTE: kademlia_thread must not be running
+ */
+static void search_queue_init(void) {
+    size_t i;
+    for (i = 0 ; i < KADEMLIA_QUEUE_SIZE ; i++) {
+        search_queue[i].sequence = i;
+    }
+    queue_head = 0;
+    queue_tail = 0;
+}
+
+/***
+ * Put a search on the submission queue. Safe to call from any thread.
+ * @param id the hash to search for
+ * @param port the port to announce, or 0 to only search
+ * @param cb called with the events of the search
+ * @param closure passed to cb
+ * @returns true(1) on success, false(0) if the queue is full
+ */
+static int search_queue_push(const unsigned char *id, uint16_t port, kademlia_search_callback *cb, void *closure) {
+    struct search_request *slot;
+    size_t pos = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &search_queue[pos % KADEMLIA_QUEUE_SIZE];
+        size_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&queue_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break; // the slot is ours.
+            }
+        } else if (dif < 0) {
+            return 0; // full.
+        } else {
+            pos = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(slot->hash, id, KADEMLIA_HASH_SIZE);
+    slot->port = port;
+    slot->callback = cb;
+    slot->closure = closure;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // Wake up kademlia_thread. If the pipe is full, it is awake anyway.
+    if (wake_fds[1] != -1) {
+        char c = 0;
+        if (write(wake_fds[1], &c, 1) < 0 && errno != EAGAIN) {
+            fprintf(stderr, "search_queue_push: wake up failed with %d\n", errno);
+        }
+    }
+    return 1;
+}
+
+/***
+ * Take a search off the submission queue
+ * NOTE: only called from kademlia_thread
+ * @param request where to put the search
+ * @returns true(1) if there was one, false(0) if the queue is empty
+ */
+static int search_queue_pop(struct search_request *request) {
+    struct search_request *slot = &search_queue[queue_tail % KADEMLIA_QUEUE_SIZE];
+    size_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if (seq != queue_tail + 1) {
+        return 0; // empty, or the producer is not done with it yet.
+    }
+    memcpy(request->hash, slot->hash, KADEMLIA_HASH_SIZE);
+    request->port = slot->port;
+    request->callback = slot->callback;
+    request->closure = slot->closure;
+    __atomic_store_n(&slot->sequence, queue_tail + KADEMLIA_QUEUE_SIZE, __ATOMIC_RELEASE);
+    queue_tail++;
+    return 1;
+}
+
+/***
+ * Start the searches waiting on the submission queue
+ * NOTE: only called from kademlia_thread
+ */
+static void start_queued_searches(void) {
+    struct search_request request;
+    struct active_search *as;
+    char buf[64];
+
+    // empty the wake up pipe first, so a push after this wakes us again.
+    while (read(wake_fds[0], buf, sizeof buf) > 0)
+        ;
+
+    while (search_queue_pop(&request)) {
+        as = malloc(sizeof(struct active_search));
+        if (as) {
+            memcpy(as->hash, request.hash, KADEMLIA_HASH_SIZE);
+            as->callback = request.callback;
+            as->closure = request.closure;
+            as->started = time(NULL);
+            as->next = active_searches;
+            active_searches = as;
+        }
+        /* If port (the second argument) is non-zero, it also performs an
+           announce. Since peers expire announced data after 30 minutes,
+           it's a good idea to reannounce every 28 minutes or so. */
+        if (dht_search(request.hash, request.port, net_family, dispatch_callback, NULL) < 0 && as) {
+            active_searches = as->next;
+            free(as);
+        }
+    }
+}
+
+/***
+ * Save the good nodes of the routing table to cache_path. The file is a
+ * magic, followed by records of family (4 or 6), id, address and port.
+ * NOTE: only called from kademlia_thread
+ * @returns the number of nodes saved, or -1 on error
+ */
+static int save_cache_nodes(void) {
+    unsigned char ids[CACHE_MAX_NODES * KADEMLIA_HASH_SIZE];
+    struct sockaddr_storage ss[CACHE_MAX_NODES];
+    char tmp_path[strlen(cache_path) + 5];
+    int i, num = CACHE_MAX_NODES;
+    FILE *f;
+
+    dht_get_good_nodes(net_family, ids, ss, &num);
+    if (num == 0) {
+        return 0; // keep what we had, it is better than nothing.
+    }
+
+    // write to a temporary file first, so a crash can't leave half a file.
+    sprintf(tmp_path, "%s.tmp", cache_path);
+    f = fopen(tmp_path, "wb");
+    if (!f) {
+        return -1;
+    }
+    fwrite(CACHE_MAGIC, 1, 4, f);
+    for (i = 0 ; i < num ; i++) {
+        if (ss[i].ss_family == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in*)&ss[i];
+            fputc(4, f);
+            fwrite(&ids[i * KADEMLIA_HASH_SIZE], 1, KADEMLIA_HASH_SIZE, f);
+            fwrite(&sin->sin_addr, 1, 4, f);
+            fwrite(&sin->sin_port, 1, 2, f);
+        } else {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&ss[i];
+            fputc(6, f);
+            fwrite(&ids[i * KADEMLIA_HASH_SIZE], 1, KADEMLIA_HASH_SIZE, f);
+            fwrite(&sin6->sin6_addr, 1, 16, f);
+            fwrite(&sin6->sin6_port, 1, 2, f);
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp_path, cache_path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    if (dht_debug) {
+        fprintf(dht_debug, "Saved %d nodes to %s.\n", num, cache_path);
+    }
+    return num;
+}
+
+/***
+ * Load the nodes saved by save_cache_nodes. They are all pinged at once,
+ * so the ones that are still alive become good within a round trip.
+ * NOTE: kademlia_thread must not be running
+ * @param family the family of the socket
+ * @returns the number of nodes loaded
+ */
+static int load_cache_nodes(int family) {
+    unsigned char magic[4], id[KADEMLIA_HASH_SIZE];
+    int c, num = 0;
+    FILE *f;
+
+    if (!cache_path || (f = fopen(cache_path, "rb")) == NULL) {
+        return 0;
+    }
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, CACHE_MAGIC, 4) != 0) {
+        fclose(f);
+        return 0;
+    }
+    while ((c = fgetc(f)) != EOF && num < CACHE_MAX_NODES) {
+        struct sockaddr_storage ss;
+        memset(&ss, 0, sizeof ss);
+        if (c == 4) {
+            struct sockaddr_in *sin = (struct sockaddr_in*)&ss;
+            if (fread(id, 1, KADEMLIA_HASH_SIZE, f) != KADEMLIA_HASH_SIZE ||
+                fread(&sin->sin_addr, 1, 4, f) != 4 ||
+                fread(&sin->sin_port, 1, 2, f) != 2) {
+                break; // truncated.
+            }
+            sin->sin_family = AF_INET;
+            if (family != AF_INET) {
+                continue;
+            }
+            // dht.c will ask it again before trusting it.
+            dht_insert_node(id, (struct sockaddr*)sin, sizeof(struct sockaddr_in));
+            dht_ping_node((struct sockaddr*)sin, sizeof(struct sockaddr_in));
+        } else if (c == 6) {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&ss;
+            if (fread(id, 1, KADEMLIA_HASH_SIZE, f) != KADEMLIA_HASH_SIZE ||
+                fread(&sin6->sin6_addr, 1, 16, f) != 16 ||
+                fread(&sin6->sin6_port, 1, 2, f) != 2) {
+                break; // truncated.
+            }
+            sin6->sin6_family = AF_INET6;
+            if (family != AF_INET6) {
+                continue;
+            }
+            // dht_insert_node is IPv4 only, the ping will add it.
+            dht_ping_node((struct sockaddr*)sin6, sizeof(struct sockaddr_in6));
+        } else {
+            break; // corrupt.
+        }
+        num++;
+    }
+    fclose(f);
+    if (dht_debug) {
+        fprintf(dht_debug, "Loaded %d nodes from %s.\n", num, cache_path);
+    }
+    return num;
+}
+
+/***
+ * Set the file the routing table is saved to and loaded from
+ * NOTE: call before start_kademlia
+ * @param path the file name, or NULL to not save
+ * @returns true(1) on success, false(0) otherwise
+ */
+int set_kademlia_cache_path (const char* path)
+{
+    if (kfd != -1) {
+        return 0; // already started.
+    }
+    free(cache_path);
+    cache_path = NULL;
+    if (path) {
+        cache_path = strdup(path);
+        return cache_path != NULL;
+    }
+    return 1;
+}
+
 int start_kademlia_multiaddress(struct MultiAddress* address, char* peer_id, int timeout, struct Libp2pVector* bootstrap_addresses) {
 	int port = multiaddress_get_ip_port(address);
 	int family = multiaddress_get_ip_family(address);
@@ -190,7 +499,7 @@ int start_kademlia_multiaddress(struct MultiAddress* address, char* peer_id, int
 int start_kademlia(int net_fd, int family, char* peer_id, int timeout, struct Libp2pVector* bootstrap_addresses)
 {
     int rc, i, len;
-    unsigned char id[sizeof hash];
+    unsigned char id[KADEMLIA_HASH_SIZE];
     struct sockaddr_in sa;
 
     dht_debug = stderr;
@@ -260,7 +569,14 @@ int start_kademlia(int net_fd, int family, char* peer_id, int timeout, struct Li
         usleep(random() % 100000);
     }
 
-    // TODO: Read cache nodes from file and load using dht_insert_node.
+    load_cache_nodes(family);
+
+    search_queue_init();
+    if (pipe(wake_fds) < 0) {
+        return -1;
+    }
+    fcntl(wake_fds[0], F_SETFL, fcntl(wake_fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wake_fds[1], F_SETFL, fcntl(wake_fds[1], F_GETFL) | O_NONBLOCK);
 
     kfd = net_fd;
     net_family = family;
@@ -281,6 +597,12 @@ void stop_kademlia (void)
 
         pthread_cancel(pth_announce);
 
+        // Wake kademlia_thread up so it sees closing.
+        char c = 0;
+        if (write(wake_fds[1], &c, 1) < 0) {
+            // it will wake up on its own at the next timeout.
+        }
+
         // Wait kademlia_thread finish.
         pthread_join(pth_kademlia, NULL);
 
@@ -288,6 +610,15 @@ void stop_kademlia (void)
 
         close (kfd);
         kfd = -1;
+
+        while (active_searches) {
+            struct active_search *as = active_searches;
+            active_searches = as->next;
+            free(as);
+        }
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+        wake_fds[0] = wake_fds[1] = -1;
     }
 }
 
@@ -299,6 +630,8 @@ void *kademlia_thread (void *ptr)
     char buf[4096];
     struct sockaddr from;
     socklen_t fromlen;
+    int maxfd = kfd > wake_fds[0] ? kfd : wake_fds[0];
+    time_t last_save = time(NULL);
 
     for(;;) {
         tv.tv_sec = tosleep;
@@ -306,7 +639,8 @@ void *kademlia_thread (void *ptr)
 
         FD_ZERO(&readfds);
         FD_SET(kfd, &readfds);
-        rc = select(kfd + 1, &readfds, NULL, NULL, &tv);
+        FD_SET(wake_fds[0], &readfds);
+        rc = select(maxfd + 1, &readfds, NULL, NULL, &tv);
         if(rc < 0) {
             if(errno != EINTR) {
                 perror("select");
@@ -314,6 +648,13 @@ void *kademlia_thread (void *ptr)
             }
         }
 
+        if(rc > 0 && FD_ISSET(wake_fds[0], &readfds)) {
+            start_queued_searches();
+            if (!FD_ISSET(kfd, &readfds) && !closing) {
+                continue;
+            }
+        }
+
         if(rc > 0 && FD_ISSET(kfd, &readfds)) {
             fromlen = sizeof(from);
             rc = recvfrom(kfd, buf, sizeof(buf) - 1, 0,
@@ -328,9 +669,9 @@ void *kademlia_thread (void *ptr)
             }
             buf[rc] = '\0';
             rc = dht_periodic(buf, rc, (struct sockaddr*)&from, fromlen,
-                              &tosleep, callback, NULL);
+                              &tosleep, dispatch_callback, NULL);
         } else {
-            rc = dht_periodic(NULL, 0, NULL, 0, &tosleep, callback, NULL);
+            rc = dht_periodic(NULL, 0, NULL, 0, &tosleep, dispatch_callback, NULL);
         }
         if(rc < 0) {
             if(errno == EINTR) {
@@ -343,30 +684,38 @@ void *kademlia_thread (void *ptr)
             }
         }
 
-        /* This is how you trigger a search for a torrent hash.  If port
-           (the second argument) is non-zero, it also performs an announce.
-           Since peers expire announced data after 30 minutes, it's a good
-           idea to reannounce every 28 minutes or so. */
-        if(searching > 0) {
-            unsigned char h[sizeof hash];
-            int i;
-            for (i = 0 ; i < sizeof hash ; i++) {
-                h[i] = hash[i]; // Copy hash array to new array so can call
-                                // dht_search without volatile variable.
-            }
-            dht_search(h, announce_port, net_family, callback, NULL);
-            searching = 0;
+        // In case a push came in while dht_periodic was busy.
+        start_queued_searches();
+        if(cache_path && (closing || time(NULL) - last_save >= CACHE_SAVE_INTERVAL)) {
+            save_cache_nodes();
+            last_save = time(NULL);
         }
         if(closing) {
-            // TODO: Create a routine to save the cache nodes in the file sometimes and before closing.
             return 0; // end thread.
         }
     }
     return (void*)1;
 }
 
+/***
+ * Start a search for a hash. The search runs on kademlia_thread, and
+ * the events of this search (and only this search) are passed to cb.
+ * @param id the hash to look for (KADEMLIA_HASH_SIZE bytes)
+ * @param port the port to announce, or 0 to only search
+ * @param cb called from kademlia_thread with the events of the search. Can be NULL.
+ * @param closure passed to cb
+ * @returns true(1) if the search was queued, false(0) if not started or the queue is full
+ */
+int search_kademlia_async (const unsigned char* id, uint16_t port, kademlia_search_callback *cb, void *closure)
+{
+    if (kfd == -1) {
+        return 0; // start thread first.
+    }
+    return search_queue_push(id, port, cb, closure);
+}
+
 /**
- * Search for a hash
+ * Search for a hash, collecting the results in search_result
  * @param id the hash to look for
  * @param port the port if it is available
  * @param to the time out
@@ -376,7 +725,8 @@ int search_kademlia_internal (unsigned char* id, int port, int to)
 {
     int i;
 
-    while (searching != 0) {
+    // only wait if the queue is full
+    while (!search_kademlia_async(id, port, callback, NULL)) {
         i = random() % 100000;
         if (i > to) {
             return 0; // timeout waiting a chance
@@ -385,16 +735,6 @@ int search_kademlia_internal (unsigned char* id, int port, int to)
         to -= i;
     }
 
-    searching = -1; // lock.
-
-    for (i = 0 ; i < sizeof hash ; i++) {
-        hash[i] = id[i];
-    }
-
-    announce_port = port;
-
-    searching = 1; // search.
-
     return to;
 }
 
@@ -437,7 +777,7 @@ void *announce_thread (void *ptr)
 
 int announce_kademlia (char* peer_id, uint16_t port)
 {
-    unsigned char id[sizeof hash];
+    unsigned char id[KADEMLIA_HASH_SIZE];
     struct announce_struct *n, *p;
 
     dht_hash (id, sizeof(id), peer_id, strlen(peer_id), NULL, 0, NULL, 0);
@@ -474,7 +814,7 @@ int announce_kademlia (char* peer_id, uint16_t port)
 
 struct MultiAddress** search_kademlia(char* peer_id, int timeout)
 {
-    unsigned char id[sizeof hash];
+    unsigned char id[KADEMLIA_HASH_SIZE];
     int i, to = timeout * 1000000;
     struct search_struct *rp; // result pointer
     struct MultiAddress **ret;
@@ -485,8 +825,6 @@ struct MultiAddress** search_kademlia(char* peer_id, int timeout)
 
     dht_hash (id, sizeof(id), peer_id, strlen(peer_id), NULL, 0, NULL, 0);
 
-    //TODO: Is this the right place to ask the net?
-    dht_search((unsigned char*)peer_id, 0, AF_INET, NULL, NULL);
     to = search_kademlia_internal (id, 0, to);
     if (to == 0) return NULL; // time out.
 
@@ -498,7 +836,7 @@ struct MultiAddress** search_kademlia(char* peer_id, int timeout)
         }
         usleep(i);
         for (rp = search_result ; rp ; rp = rp->next) {
-            if (memcmp(rp->hash, id, sizeof hash) == 0) { // Found.
+            if (memcmp(rp->hash, id, KADEMLIA_HASH_SIZE) == 0) { // Found.
                 char ipstr[INET6_ADDRSTRLEN + 1];
                 char str[sizeof ipstr + 16];
                 int c = 0;
@@ -932,6 +932,25 @@ int libp2p_secio_decrypt(struct SessionContext* session, const unsigned char* in
 	return message->data_size;
 }
 
+/***
+ * Hand over what is left of the buffered message
+ * @param ctx the SecioContext, that has a buffered message
+ * @param bytes where to put the bytes
+ * @returns the number of bytes
+ */
+static int libp2p_secio_take_buffered(struct SecioContext* ctx, struct StreamMessage** bytes) {
+	struct StreamMessage* buffered = ctx->buffered_message;
+	ctx->buffered_message = NULL;
+	if (ctx->buffered_message_pos > 0) {
+		size_t remaining = buffered->data_size - ctx->buffered_message_pos;
+		memmove(buffered->data, &buffered->data[ctx->buffered_message_pos], remaining);
+		buffered->data_size = remaining;
+	}
+	ctx->buffered_message_pos = -1;
+	*bytes = buffered;
+	return buffered->data_size;
+}
+
 /**
  * Read from an encrypted stream
  * @param session the session parameters
@@ -943,6 +962,8 @@ int libp2p_secio_encrypted_read(void* stream_context, struct StreamMessage** byt
 	struct SecioContext* ctx = (struct SecioContext*)stream_context;
 	struct Stream* parent_stream = ctx->stream->parent_stream;
 
+	if (ctx->buffered_message != NULL)
+		return libp2p_secio_take_buffered(ctx, bytes);
 	if (ctx->status != secio_status_ack) {
 		return parent_stream->read(parent_stream->stream_context, bytes, timeout_secs);
 	}
@@ -978,7 +999,7 @@ struct Libp2pPeer* libp2p_secio_get_peer_or_add(struct Peerstore* peerstore, str
 				remote_peer->id[remote_peer->id_size] = 0;
 			}
 		}
-		remote_peer->sessionContext = local_session;
+		remote_peer->sessionContext = libp2p_session_context_retain(local_session);
 		// add a multiaddress to the peer (if we have what we need)
 		char url[100];
 		sprintf(url, "/ip4/%s/tcp/%d/ipfs/%s", local_session->host, local_session->port, libp2p_peer_id_to_string(remote_peer));
@@ -1003,7 +1024,7 @@ struct Libp2pPeer* libp2p_secio_get_peer_or_add(struct Peerstore* peerstore, str
 			// clean up old session context
 			libp2p_logger_debug("secio", "Same remote connected. Replacing SessionContext.\n");
 			libp2p_session_context_free(remote_peer->sessionContext);
-			remote_peer->sessionContext = local_session;
+			remote_peer->sessionContext = libp2p_session_context_retain(local_session);
 		}
 	}
 	remote_peer->connection_type = CONNECTION_TYPE_CONNECTED;
@@ -1371,6 +1392,8 @@ int libp2p_secio_peek(void* stream_context) {
 		return -1;
 	}
 	struct SecioContext* ctx = (struct SecioContext*)stream_context;
+	if (ctx->buffered_message != NULL)
+		return ctx->buffered_message->data_size - ctx->buffered_message_pos;
 	return ctx->stream->parent_stream->peek(ctx->stream->parent_stream->stream_context);
 }
 
@@ -1394,8 +1417,9 @@ int libp2p_secio_read_raw(void* stream_context, uint8_t* buffer, int buffer_size
 		}
 		ctx->buffered_message_pos = 0;
 	}
-	// max_to_read is the lesser of bytes read or buffer_size
-	int max_to_read = (buffer_size > ctx->buffered_message->data_size ? ctx->buffered_message->data_size : buffer_size);
+	// max_to_read is the lesser of bytes left or buffer_size
+	size_t remaining = ctx->buffered_message->data_size - ctx->buffered_message_pos;
+	int max_to_read = (buffer_size > remaining ? remaining : buffer_size);
 	memcpy(buffer, &ctx->buffered_message->data[ctx->buffered_message_pos], max_to_read);
 	ctx->buffered_message_pos += max_to_read;
 	if (ctx->buffered_message_pos == ctx->buffered_message->data_size) {
@@ -1403,28 +1427,61 @@ int libp2p_secio_read_raw(void* stream_context, uint8_t* buffer, int buffer_size
 		libp2p_stream_message_free(ctx->buffered_message);
 		ctx->buffered_message = NULL;
 		ctx->buffered_message_pos = -1;
-	} else {
-		// we didn't read everything.
-		ctx->buffered_message_pos = max_to_read;
 	}
 	return max_to_read;
 }
 
+/***
+ * Put decrypted bytes back, in front of anything that is still buffered
+ * @param stream_context the secio context
+ * @param data the bytes
+ * @param data_size the number of bytes
+ * @returns true(1) on success, false(0) otherwise
+ */
+int libp2p_secio_unread(void* stream_context, const uint8_t* data, size_t data_size) {
+	if (stream_context == NULL || data == NULL)
+		return 0;
+	if (data_size == 0)
+		return 1;
+	struct SecioContext* ctx = (struct SecioContext*)stream_context;
+	size_t buffered = (ctx->buffered_message == NULL ? 0 : ctx->buffered_message->data_size - ctx->buffered_message_pos);
+	uint8_t* joined = (uint8_t*) malloc(data_size + buffered);
+	if (joined == NULL)
+		return 0;
+	memcpy(joined, data, data_size);
+	if (ctx->buffered_message == NULL) {
+		ctx->buffered_message = libp2p_stream_message_new();
+		if (ctx->buffered_message == NULL) {
+			free(joined);
+			return 0;
+		}
+	} else {
+		memcpy(&joined[data_size], &ctx->buffered_message->data[ctx->buffered_message_pos], buffered);
+		free(ctx->buffered_message->data);
+	}
+	ctx->buffered_message->data = joined;
+	ctx->buffered_message->data_size = data_size + buffered;
+	ctx->buffered_message_pos = 0;
+	return 1;
+}
+
 int libp2p_secio_close(struct Stream* stream) {
-	if (stream != NULL && stream->stream_context != NULL)
-		free(stream->stream_context);
+	if (stream != NULL && stream->stream_context != NULL) {
+		struct SecioContext* ctx = (struct SecioContext*)stream->stream_context;
+		libp2p_stream_message_free(ctx->buffered_message);
+		free(ctx);
+	}
 	return 1;
 }
 
 /***
- * Initiates a secio handshake. Use this method when you want to initiate a secio
- * session. This should not be used to respond to incoming secio requests
+ * Build a secio Stream on top of parent_stream, and make it the default stream
  * @param parent_stream the parent stream
  * @param peerstore the peerstore
  * @param rsa_private_key the local private key
- * @returns a Secio Stream
+ * @returns a Secio Stream, or NULL on error
  */
-struct Stream* libp2p_secio_stream_new(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key) {
+static struct Stream* libp2p_secio_stream_build(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key) {
 	struct Stream* new_stream = libp2p_stream_new();
 	// get SessionContext
 	struct Stream* root_stream = parent_stream;
@@ -1454,9 +1511,25 @@ struct Stream* libp2p_secio_stream_new(struct Stream* parent_stream, struct Peer
 		new_stream->peek = libp2p_secio_peek;
 		new_stream->read = libp2p_secio_encrypted_read;
 		new_stream->read_raw = libp2p_secio_read_raw;
+		new_stream->unread = libp2p_secio_unread;
 		new_stream->write = libp2p_secio_encrypted_write;
 		new_stream->socket_mutex = parent_stream->socket_mutex;
 		parent_stream->handle_upgrade(parent_stream, new_stream);
+	}
+	return new_stream;
+}
+
+/***
+ * Initiates a secio handshake. Use this method when you want to initiate a secio
+ * session. This should not be used to respond to incoming secio requests
+ * @param parent_stream the parent stream
+ * @param peerstore the peerstore
+ * @param rsa_private_key the local private key
+ * @returns a Secio Stream
+ */
+struct Stream* libp2p_secio_stream_new(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key) {
+	struct Stream* new_stream = libp2p_secio_stream_build(parent_stream, peerstore, rsa_private_key);
+	if (new_stream != NULL) {
 		if (!libp2p_secio_send_protocol(parent_stream)) {
 			libp2p_stream_free(new_stream);
 			new_stream = NULL;
@@ -1465,6 +1538,18 @@ struct Stream* libp2p_secio_stream_new(struct Stream* parent_stream, struct Peer
 	return new_stream;
 }
 
+/***
+ * Build a secio Stream when the protocol id has already been accepted by the
+ * remote (see libp2p_net_multistream_propose). The caller does the handshake.
+ * @param parent_stream the parent stream
+ * @param peerstore the peerstore
+ * @param rsa_private_key the local private key
+ * @returns a Secio Stream
+ */
+struct Stream* libp2p_secio_stream_new_negotiated(struct Stream* parent_stream, struct Peerstore* peerstore, struct RsaPrivateKey* rsa_private_key) {
+	return libp2p_secio_stream_build(parent_stream, peerstore, rsa_private_key);
+}
+
 /***
  * Wait for secio stream to become ready
  * @param session_context the session context to check
@@ -76,11 +76,14 @@ void libp2p_swarm_listen(void* ctx) {
 			libp2p_logger_debug("swarm", "listen: Exiting loop due to retVal being %d.\n", retVal);
 			break;
 		}
+		if (session_context->closed) {
+			libp2p_logger_debug("swarm", "listen: Exiting loop as the connection was shut down.\n");
+			break;
+		}
 	} // end of loop
 
 	// clean up memory
-	if (session_context->host != NULL)
-		free(session_context->host);
+	libp2p_session_context_free(session_context);
 	free(swarm_session);
 }
 
@@ -94,11 +97,14 @@ void libp2p_swarm_listen(void* ctx) {
 int libp2p_swarm_add_peer(struct SwarmContext* context, struct Libp2pPeer* peer) {
 	// spin off a thread for this peer
     struct SwarmSession* swarm_session = (struct SwarmSession*) malloc(sizeof(struct SwarmSession));
-    swarm_session->session_context = peer->sessionContext;
+    // the listener holds on to the session, so it outlives the peer letting go of it
+    swarm_session->session_context = libp2p_session_context_retain(peer->sessionContext);
     swarm_session->swarm_context = context;
 
     if (thpool_add_work(context->thread_pool, libp2p_swarm_listen, swarm_session) < 0) {
     	libp2p_logger_error("swarm", "Unable to fire up thread for peer %s\n", libp2p_peer_id_to_string(peer));
+    	libp2p_session_context_free(swarm_session->session_context);
+    	free(swarm_session);
     	return 0;
     }
     libp2p_logger_info("swarm", "add_connection: added connection for peer %s.\n", libp2p_peer_id_to_string(peer));
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "libp2p/utils/arena.h"
+
+// every allocation starts on this boundary
+#define ARENA_ALIGNMENT (sizeof(max_align_t))
+#define ARENA_ALIGN(x) (((x) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+// the chunk header, rounded up so the data after it is aligned
+#define ARENA_CHUNK_HEADER ARENA_ALIGN(sizeof(struct Libp2pArenaChunk))
+
+/***
+ * The start of the usable memory of a chunk
+ * @param chunk the chunk
+ * @returns a pointer to the first byte after the header
+ */
+static unsigned char* libp2p_utils_arena_chunk_data(struct Libp2pArenaChunk* chunk) {
+	return (unsigned char*)chunk + ARENA_CHUNK_HEADER;
+}
+
+struct Libp2pArena* libp2p_utils_arena_new(size_t chunk_size) {
+	if (chunk_size == 0)
+		chunk_size = ARENA_DEFAULT_CHUNK_SIZE;
+	chunk_size = ARENA_ALIGN(chunk_size);
+	// one allocation: the first chunk, followed by the arena struct in its data
+	struct Libp2pArenaChunk* chunk = (struct Libp2pArenaChunk*) malloc(ARENA_CHUNK_HEADER + ARENA_ALIGN(sizeof(struct Libp2pArena)) + chunk_size);
+	if (chunk == NULL)
+		return NULL;
+	chunk->next = NULL;
+	chunk->size = ARENA_ALIGN(sizeof(struct Libp2pArena)) + chunk_size;
+	chunk->used = ARENA_ALIGN(sizeof(struct Libp2pArena));
+	struct Libp2pArena* arena = (struct Libp2pArena*) libp2p_utils_arena_chunk_data(chunk);
+	arena->head = chunk;
+	arena->chunk_size = chunk_size;
+	return arena;
+}
+
+void* libp2p_utils_arena_alloc(struct Libp2pArena* arena, size_t size) {
+	if (arena == NULL)
+		return NULL;
+	size = ARENA_ALIGN(size == 0 ? 1 : size);
+	struct Libp2pArenaChunk* chunk = arena->head;
+	if (chunk->size - chunk->used < size) {
+		// start a new chunk. Each one is twice the size of the last, or big enough for this allocation
+		size_t new_size = arena->chunk_size * 2;
+		if (new_size < size)
+			new_size = size;
+		chunk = (struct Libp2pArenaChunk*) malloc(ARENA_CHUNK_HEADER + new_size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->size = new_size;
+		chunk->used = 0;
+		chunk->next = arena->head;
+		arena->head = chunk;
+		arena->chunk_size = new_size;
+	}
+	void* retVal = libp2p_utils_arena_chunk_data(chunk) + chunk->used;
+	chunk->used += size;
+	return retVal;
+}
+
+void* libp2p_utils_arena_memdup(struct Libp2pArena* arena, const void* data, size_t size) {
+	void* retVal = libp2p_utils_arena_alloc(arena, size);
+	if (retVal != NULL && size > 0)
+		memcpy(retVal, data, size);
+	return retVal;
+}
+
+void libp2p_utils_arena_free(struct Libp2pArena* arena) {
+	if (arena == NULL)
+		return;
+	// the last chunk holds the arena struct itself, so it goes last
+	struct Libp2pArenaChunk* chunk = arena->head;
+	while (chunk != NULL) {
+		struct Libp2pArenaChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
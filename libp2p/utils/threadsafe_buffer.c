@@ -3,9 +3,11 @@
  */
 
 #include <stdlib.h>
+#include <time.h>
 
 #include "libp2p/utils/threadsafe_buffer.h"
 #include "libp2p/utils/logger.h"
+#include "libp2p/os/timespec.h"
 
 /***
  * Allocate a new context
@@ -15,8 +17,13 @@ struct ThreadsafeBufferContext* threadsafe_buffer_context_new() {
 	struct ThreadsafeBufferContext* context = (struct ThreadsafeBufferContext*) malloc(sizeof(struct ThreadsafeBufferContext));
 	if (context != NULL) {
 		context->buffer_size = 0;
-		context->buffer = NULL;
+		context->head = NULL;
+		context->head_pos = 0;
+		context->tail = NULL;
+		context->tail_pos = 0;
+		context->spare = NULL;
 		pthread_mutex_init(&context->lock, NULL);
+		pthread_cond_init(&context->data_available, NULL);
 	}
 	return context;
 }
@@ -27,12 +34,121 @@ struct ThreadsafeBufferContext* threadsafe_buffer_context_new() {
  */
 void threadsafe_buffer_context_free(struct ThreadsafeBufferContext* context) {
 	if (context != NULL) {
-		if (context->buffer != NULL)
-			free(context->buffer);
+		struct ThreadsafeBufferChunk* current = context->head;
+		while (current != NULL) {
+			struct ThreadsafeBufferChunk* next = current->next;
+			free(current);
+			current = next;
+		}
+		if (context->spare != NULL)
+			free(context->spare);
+		pthread_cond_destroy(&context->data_available);
+		pthread_mutex_destroy(&context->lock);
 		free(context);
 	}
 }
 
+/***
+ * Get a chunk to write into
+ * NOTE: caller must hold the lock
+ * @param context the context
+ * @returns an empty chunk, or NULL if out of memory
+ */
+static struct ThreadsafeBufferChunk* threadsafe_buffer_chunk_new(struct ThreadsafeBufferContext* context) {
+	struct ThreadsafeBufferChunk* chunk = context->spare;
+	if (chunk != NULL)
+		context->spare = NULL;
+	else
+		chunk = (struct ThreadsafeBufferChunk*) malloc(sizeof(struct ThreadsafeBufferChunk));
+	if (chunk != NULL)
+		chunk->next = NULL;
+	return chunk;
+}
+
+/***
+ * Give back a chunk that has been completely read
+ * NOTE: caller must hold the lock
+ * @param context the context
+ * @param chunk the chunk
+ */
+static void threadsafe_buffer_chunk_release(struct ThreadsafeBufferContext* context, struct ThreadsafeBufferChunk* chunk) {
+	if (context->spare == NULL)
+		context->spare = chunk;
+	else
+		free(chunk);
+}
+
+/***
+ * The number of readable bytes in the first chunk
+ * NOTE: caller must hold the lock
+ * @param context the context
+ * @returns the number of bytes
+ */
+static size_t threadsafe_buffer_head_available(struct ThreadsafeBufferContext* context) {
+	if (context->head == NULL)
+		return 0;
+	if (context->head == context->tail)
+		return context->tail_pos - context->head_pos;
+	return THREADSAFE_BUFFER_CHUNK_SIZE - context->head_pos;
+}
+
+/***
+ * Copy bytes from the front of the buffer, optionally removing them
+ * NOTE: caller must hold the lock
+ * @param context the context
+ * @param results where to put the bytes (can be NULL to just discard them)
+ * @param results_size the maximum number of bytes
+ * @param remove true(1) to move the read pointer
+ * @returns the number of bytes
+ */
+static size_t threadsafe_buffer_take(struct ThreadsafeBufferContext* context, uint8_t* results, size_t results_size, int remove) {
+	size_t bytes_read = 0;
+	struct ThreadsafeBufferChunk* current = context->head;
+	size_t pos = context->head_pos;
+	while (current != NULL && bytes_read < results_size) {
+		size_t end = (current == context->tail ? context->tail_pos : THREADSAFE_BUFFER_CHUNK_SIZE);
+		size_t amount = end - pos;
+		if (amount > results_size - bytes_read)
+			amount = results_size - bytes_read;
+		if (results != NULL)
+			memcpy(&results[bytes_read], &current->data[pos], amount);
+		bytes_read += amount;
+		pos += amount;
+		if (pos == end) {
+			struct ThreadsafeBufferChunk* next = (current == context->tail ? NULL : current->next);
+			if (remove) {
+				threadsafe_buffer_chunk_release(context, current);
+				context->head = next;
+				if (next == NULL) {
+					context->tail = NULL;
+					context->tail_pos = 0;
+				}
+			}
+			current = next;
+			pos = 0;
+		}
+	}
+	if (remove) {
+		context->head_pos = (context->head == NULL ? 0 : pos);
+		context->buffer_size -= bytes_read;
+	}
+	return bytes_read;
+}
+
+/***
+ * Get the number of bytes waiting to be read
+ * @param context the context
+ * @returns the number of bytes in the buffer
+ */
+size_t threadsafe_buffer_size(struct ThreadsafeBufferContext* context) {
+	if (context == NULL)
+		return 0;
+	pthread_mutex_lock(&context->lock);
+	size_t size = context->buffer_size;
+	pthread_mutex_unlock(&context->lock);
+	return size;
+}
+
 /***
  * Read from the buffer without destroying its contents or moving its read pointer
  * @param context the context
@@ -45,11 +161,44 @@ size_t threadsafe_buffer_peek(struct ThreadsafeBufferContext* context, uint8_t*
 	if (context == NULL)
 		return 0;
 	pthread_mutex_lock(&context->lock);
-	// do the read
-	if (context->buffer != NULL && context->buffer_size > 0) {
-		bytes_read = results_size < context->buffer_size ? results_size : context->buffer_size;
-		memcpy(results, context->buffer, bytes_read);
-	}
+	bytes_read = threadsafe_buffer_take(context, results, results_size, 0);
+	pthread_mutex_unlock(&context->lock);
+	return bytes_read;
+}
+
+/***
+ * Look at the beginning of the buffer without copying it
+ * NOTE: The pointer is valid until the next read or consume. Only the contiguous
+ * bytes of the first chunk are returned, so this can be less than the buffer size.
+ * @param context the context
+ * @param results where to put the pointer to the bytes
+ * @returns the number of contiguous bytes at results
+ */
+size_t threadsafe_buffer_peek_contiguous(struct ThreadsafeBufferContext* context, const uint8_t** results) {
+	size_t bytes_available = 0;
+	if (context == NULL || results == NULL)
+		return 0;
+	*results = NULL;
+	pthread_mutex_lock(&context->lock);
+	bytes_available = threadsafe_buffer_head_available(context);
+	if (bytes_available > 0)
+		*results = &context->head->data[context->head_pos];
+	pthread_mutex_unlock(&context->lock);
+	return bytes_available;
+}
+
+/***
+ * Discard bytes from the beginning of the buffer
+ * @param context the context
+ * @param bytes_size the number of bytes to discard
+ * @returns the number of bytes discarded
+ */
+size_t threadsafe_buffer_consume(struct ThreadsafeBufferContext* context, size_t bytes_size) {
+	size_t bytes_read = 0;
+	if (context == NULL)
+		return 0;
+	pthread_mutex_lock(&context->lock);
+	bytes_read = threadsafe_buffer_take(context, NULL, bytes_size, 1);
 	pthread_mutex_unlock(&context->lock);
 	return bytes_read;
 }
@@ -67,29 +216,8 @@ size_t threadsafe_buffer_read(struct ThreadsafeBufferContext* context, uint8_t*
 	if (context == NULL)
 		return 0;
 	pthread_mutex_lock(&context->lock);
-	// do the read
-	if (context->buffer != NULL && context->buffer_size > 0) {
-		bytes_read = results_size < context->buffer_size ? results_size : context->buffer_size;
-		libp2p_logger_debug("threadsafe_buffer", "read: We want to read %d bytes, and have %d in the buffer. Therefore, we will read %d.\n", results_size, context->buffer_size, bytes_read);
-		memcpy(results, context->buffer, bytes_read);
-	}
-	// adjust the size
-	if (bytes_read > 0) {
-		if (context->buffer_size - bytes_read > 0) {
-			// more remains
-			size_t new_buffer_size = context->buffer_size - bytes_read;
-			uint8_t* new_buffer = (uint8_t*) malloc(new_buffer_size);
-			memcpy(new_buffer, &context->buffer[bytes_read], new_buffer_size);
-			free(context->buffer);
-			context->buffer = new_buffer;
-			context->buffer_size = new_buffer_size;
-		} else {
-			// everything has been read
-			free(context->buffer);
-			context->buffer = NULL;
-			context->buffer_size = 0;
-		}
-	}
+	libp2p_logger_debug("threadsafe_buffer", "read: We want to read %d bytes, and have %d in the buffer.\n", results_size, context->buffer_size);
+	bytes_read = threadsafe_buffer_take(context, results, results_size, 1);
 	pthread_mutex_unlock(&context->lock);
 	return bytes_read;
 }
@@ -108,16 +236,55 @@ size_t threadsafe_buffer_write(struct ThreadsafeBufferContext* context, const ui
 		return 0;
 	size_t bytes_copied = 0;
 	pthread_mutex_lock(&context->lock);
-	// allocate memory
-	uint8_t* new_buffer = (uint8_t*) realloc(context->buffer, context->buffer_size + bytes_size);
-	if (new_buffer != NULL) {
-		// copy data
-		memcpy(&new_buffer[context->buffer_size], bytes, bytes_size);
-		context->buffer_size += bytes_size;
-		context->buffer = new_buffer;
-		bytes_copied = bytes_size;
-		libp2p_logger_debug("threadsafe_buffer", "write: Added %d bytes. Buffer now contains %d bytes.\n", bytes_size, context->buffer_size);
+	while (bytes_copied < bytes_size) {
+		if (context->tail == NULL || context->tail_pos == THREADSAFE_BUFFER_CHUNK_SIZE) {
+			// we need more room
+			struct ThreadsafeBufferChunk* chunk = threadsafe_buffer_chunk_new(context);
+			if (chunk == NULL)
+				break;
+			if (context->tail == NULL) {
+				context->head = chunk;
+				context->head_pos = 0;
+			} else {
+				context->tail->next = chunk;
+			}
+			context->tail = chunk;
+			context->tail_pos = 0;
+		}
+		size_t amount = THREADSAFE_BUFFER_CHUNK_SIZE - context->tail_pos;
+		if (amount > bytes_size - bytes_copied)
+			amount = bytes_size - bytes_copied;
+		memcpy(&context->tail->data[context->tail_pos], &bytes[bytes_copied], amount);
+		context->tail_pos += amount;
+		bytes_copied += amount;
 	}
+	context->buffer_size += bytes_copied;
+	libp2p_logger_debug("threadsafe_buffer", "write: Added %d bytes. Buffer now contains %d bytes.\n", bytes_copied, context->buffer_size);
+	if (bytes_copied > 0)
+		pthread_cond_broadcast(&context->data_available);
 	pthread_mutex_unlock(&context->lock);
 	return bytes_copied;
 }
+
+/***
+ * Block until the buffer holds at least min_bytes, or the timeout expires
+ * @param context the context
+ * @param min_bytes the number of bytes wanted
+ * @param timeout_secs the maximum number of seconds to wait
+ * @returns the number of bytes in the buffer
+ */
+size_t threadsafe_buffer_wait(struct ThreadsafeBufferContext* context, size_t min_bytes, int timeout_secs) {
+	if (context == NULL)
+		return 0;
+	struct timespec deadline;
+	timespec_get(&deadline, TIME_UTC);
+	deadline.tv_sec += timeout_secs;
+	pthread_mutex_lock(&context->lock);
+	while (context->buffer_size < min_bytes) {
+		if (pthread_cond_timedwait(&context->data_available, &context->lock, &deadline) != 0)
+			break;
+	}
+	size_t size = context->buffer_size;
+	pthread_mutex_unlock(&context->lock);
+	return size;
+}
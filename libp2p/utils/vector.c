@@ -49,7 +49,7 @@ void libp2p_utils_vector_set(struct Libp2pVector *v, int index, void *item)
         v->items[index] = item;
 }
 
-const void *libp2p_utils_vector_get(struct Libp2pVector *v, int index)
+const void *libp2p_utils_vector_get(const struct Libp2pVector *v, int index)
 {
     if (index >= 0 && index < v->total)
         return v->items[index];
@@ -1,6 +1,7 @@
 
 #include <errno.h>
 #include <memory.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <stdlib.h>
@@ -11,7 +12,9 @@
 #include "libp2p/yamux/stream.h"
 #include "libp2p/yamux/yamux.h"
 #include "libp2p/utils/logger.h"
+#include "libp2p/utils/thread_pool.h"
 #include "libp2p/utils/threadsafe_buffer.h"
+#include "protobuf/varint.h"
 
 #define MIN(x,y) (y^((x^y)&-(x<y)))
 #define MAX(x,y) (x^((x^y)&-(x<y)))
@@ -369,53 +372,132 @@ struct yamux_stream* yamux_stream_new() {
 	return out;
 }
 
+/***
+ * See if the buffer of a channel holds a whole message for its child, so reading it does not wait
+ * NOTE: If the child reads through multistream, a message is a varint length and that many bytes.
+ * Other children are handed whatever is there.
+ * @param context the YamuxChannelContext
+ * @returns true(1) if there is a whole message, false(0) otherwise
+ */
+static int yamux_channel_has_message(struct YamuxChannelContext* context) {
+	size_t size = threadsafe_buffer_size(context->buffer);
+	if (size == 0)
+		return 0;
+	int framed = 0;
+	for(struct Stream* curr = context->child_stream; curr != NULL && curr != context->stream; curr = curr->parent_stream) {
+		if (curr->stream_type == STREAM_TYPE_MULTISTREAM) {
+			framed = 1;
+			break;
+		}
+	}
+	if (!framed)
+		return 1;
+	uint8_t varint[12];
+	size_t peeked = threadsafe_buffer_peek(context->buffer, varint, size < 12 ? size : 12);
+	for(size_t i = 0; i < peeked; i++) {
+		if (varint[i] >> 7 == 0) {
+			size_t varint_length = 0;
+			unsigned long long length = varint_decode(varint, i + 1, &varint_length);
+			return size >= varint_length + length;
+		}
+	}
+	// a length that long is bad, and the read will say so
+	return peeked == 12;
+}
+
 /***
  * Called by notify_child_stream_has_data to process incoming data (perhaps)
+ * NOTE: Only one of these runs per channel at a time (see read_running), which
+ * keeps the messages of a channel in order.
  * @param args a YamuxChannelContext
  * @returns NULL;
  */
 void* yamux_read_method(void* args) {
 	struct YamuxChannelContext* context = (struct YamuxChannelContext*) args;
-	context->read_running = 1;
 	struct StreamMessage* message = NULL;
-	// continue to read until the buffer is empty
-	while (context->buffer->buffer_size > 0) {
-		if (context->child_stream == NULL || context->child_stream->stream_context == NULL || context->child_stream->read == NULL) {
-			libp2p_logger_error("yamux", "read_method: Child stream not set up properly for channel %d.\n", context->channel);
-			context->read_running = 0;
-			return NULL;
-		}
-		struct Stream* child_stream = context->child_stream;
-		if (child_stream == NULL || child_stream->read == NULL) {
-			libp2p_logger_error("yamux", "read_method: Child stream not set up properly for channel %d.\n", context->channel);
-			context->read_running = 0;
-			return NULL;
-		}
-		if (context->child_stream->read(context->child_stream->stream_context, &message, 5) && message != NULL) {
-			libp2p_logger_debug("yamux", "read_method: read returned a message of %d bytes. [%s]\n", message->data_size, message->data);
-			int retVal = libp2p_protocol_marshal(message, context->child_stream, context->yamux_context->protocol_handlers);
-			libp2p_logger_debug("yamux", "read_method: protocol_marshal returned %d.\n", retVal);
-			libp2p_stream_message_free(message);
-		} else {
-			libp2p_logger_debug("yamux", "read_method: read returned false.\n");
+	// the bytes left in the buffer when a read could not make progress, or 0 if it never stalled
+	size_t stalled_at = 0;
+	do {
+		stalled_at = 0;
+		// continue to read until the buffer is empty
+		while (threadsafe_buffer_size(context->buffer) > 0) {
+			struct Stream* child_stream = context->child_stream;
+			if (child_stream == NULL || child_stream->stream_context == NULL || child_stream->read == NULL) {
+				libp2p_logger_error("yamux", "read_method: Child stream not set up properly for channel %d.\n", context->channel);
+				context->read_running = 0;
+				return NULL;
+			}
+			size_t size_before = threadsafe_buffer_size(context->buffer);
+			// never wait for the rest of a message here. That would hold a worker that
+			// every channel shares. The next frame for this channel will schedule us again.
+			if (!yamux_channel_has_message(context)) {
+				stalled_at = size_before;
+				break;
+			}
+			if (child_stream->read(child_stream->stream_context, &message, 0) && message != NULL) {
+				libp2p_logger_debug("yamux", "read_method: read returned a message of %d bytes. [%s]\n", message->data_size, message->data);
+				int retVal = libp2p_protocol_marshal(message, child_stream, context->yamux_context->protocol_handlers);
+				libp2p_logger_debug("yamux", "read_method: protocol_marshal returned %d.\n", retVal);
+				libp2p_stream_message_free(message);
+				message = NULL;
+			} else {
+				libp2p_logger_debug("yamux", "read_method: read returned false.\n");
+				// don't spin on a message the child will not take
+				if (threadsafe_buffer_size(context->buffer) == size_before) {
+					stalled_at = size_before;
+					break;
+				}
+			}
 		}
-	}
-	context->read_running = 0;
+		context->read_running = 0;
+		// data could have arrived after the loop ended, but before the flag was cleared.
+		// If so, and nobody else has claimed the channel, keep going. If the loop stalled,
+		// only new data is worth another try.
+	} while (threadsafe_buffer_size(context->buffer) > stalled_at && __sync_bool_compare_and_swap(&context->read_running, 0, 1));
 	return NULL;
 }
 
+/***
+ * Thread pool entry point for yamux_read_method
+ * @param args a YamuxChannelContext
+ */
+static void yamux_read_job(void* args) {
+	yamux_read_method(args);
+}
+
+static threadpool yamux_read_pool = NULL;
+static pthread_once_t yamux_read_pool_once = PTHREAD_ONCE_INIT;
+
+/***
+ * Build the worker pool shared by all yamux channels
+ */
+static void yamux_read_pool_init() {
+	yamux_read_pool = thpool_init(YAMUX_READ_THREADS);
+	if (yamux_read_pool == NULL)
+		libp2p_logger_error("yamux", "Unable to create the channel read thread pool.\n");
+}
+
 /**
- * spin off a new thread to handle a child's reading of data
+ * Queue a job on the shared worker pool to handle a child's reading of data
+ * NOTE: A channel is only queued once. If it is already queued or running, the
+ * running job will pick up the new data.
  * @param context the YamuxChannelContext
+ * @returns true(1) if a job was queued, false(0) otherwise
  */
 int libp2p_yamux_notify_child_stream_has_data(struct YamuxChannelContext* context) {
-	if (!context->read_running) {
-		pthread_t new_thread;
-
-		if (pthread_create(&new_thread, NULL, yamux_read_method, context) == 0)
-			return 1;
+	if (context == NULL)
+		return 0;
+	pthread_once(&yamux_read_pool_once, yamux_read_pool_init);
+	if (yamux_read_pool == NULL)
+		return 0;
+	if (!__sync_bool_compare_and_swap(&context->read_running, 0, 1))
+		return 0;
+	if (thpool_add_work(yamux_read_pool, yamux_read_job, context) != 0) {
+		libp2p_logger_error("yamux", "Unable to queue read for channel %d.\n", context->channel);
+		context->read_running = 0;
+		return 0;
 	}
-	return 0;
+	return 1;
 }
 
 /***
@@ -472,7 +554,7 @@ ssize_t yamux_stream_process(struct yamux_stream* stream, struct yamux_frame* fr
                 if(channelContext->child_stream == NULL) {
                 	// we have to handle this ourselves
                 	// see if we have the entire message
-                	int buffer_size = channelContext->buffer->buffer_size;
+                	int buffer_size = threadsafe_buffer_size(channelContext->buffer);
                 	uint8_t buffer[buffer_size];
                 	buffer_size = threadsafe_buffer_peek(channelContext->buffer, buffer, buffer_size);
                 	struct StreamMessage message;
@@ -487,7 +569,7 @@ ssize_t yamux_stream_process(struct yamux_stream* stream, struct yamux_frame* fr
                 	}
                 } else {
                 	// Alert the child protocol that these bytes came in.
-                	// NOTE: We're doing the work in a separate thread
+                	// NOTE: The work is done on the shared yamux worker pool
                 	// we tell them, and they need to be smart enough to see if this is a complete message or not
                 	libp2p_yamux_notify_child_stream_has_data(channelContext);
                 	/*
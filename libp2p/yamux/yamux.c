@@ -240,7 +240,7 @@ int libp2p_yamux_channel_read(void* stream_context, struct StreamMessage** messa
 		libp2p_logger_error("yamux", "channel_read: Unable to allocate memory for message struct.\n");
 		return 0;
 	}
-	msg->data_size = context->buffer->buffer_size;
+	msg->data_size = threadsafe_buffer_size(context->buffer);
 	if (msg->data_size == 0) {
 		libp2p_logger_debug("yamux", "channel_read: Nothing to read.\n");
 		libp2p_stream_message_free(msg);
@@ -474,7 +474,7 @@ int libp2p_yamux_peek(void* stream_context) {
  * @param stream_context a YamuxChannelContext
  * @param buffer where to put the results
  * @param buffer_size the size of the buffer
- * @param timeout_secs how long to wait (currently unused)
+ * @param timeout_secs how long to wait for buffer_size bytes to arrive
  * @returns the number of bytes placed into the buffer
  */
 int libp2p_yamux_channel_read_raw(void* stream_context, uint8_t* buffer, int buffer_size, int timeout_secs) {
@@ -484,11 +484,7 @@ int libp2p_yamux_channel_read_raw(void* stream_context, uint8_t* buffer, int buf
 	if (channelContext == NULL)
 		return 0;
 	// wait to see if we get the bytes we need
-	int counter = 0;
-	while (channelContext->buffer->buffer_size < buffer_size && counter < timeout_secs) {
-		sleep(1);
-		counter++;
-	}
+	threadsafe_buffer_wait(channelContext->buffer, buffer_size, timeout_secs);
 	return threadsafe_buffer_read(channelContext->buffer, buffer, buffer_size);
 }
 
@@ -616,13 +612,13 @@ void libp2p_yamux_new_stream(struct YamuxContext* context, struct Stream* stream
 }
 
 /***
- * Negotiate the Yamux protocol
+ * Build a yamux Stream on top of parent_stream, and tell the parent about the upgrade
  * @param parent_stream the parent stream
  * @param am_server true(1) if we are considered the server, false(0) if we are the client.
  * @param protocol_handlers the protocol handlers
- * @returns a Stream initialized and ready for yamux
+ * @returns a yamux Stream, or NULL on error
  */
-struct Stream* libp2p_yamux_stream_new(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers) {
+static struct Stream* libp2p_yamux_stream_build(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers) {
 	struct Stream* out = libp2p_stream_new();
 	if (out != NULL) {
 		out->stream_type = STREAM_TYPE_YAMUX;
@@ -649,6 +645,20 @@ struct Stream* libp2p_yamux_stream_new(struct Stream* parent_stream, int am_serv
 		ctx->state = yamux_stream_inited;
 		// tell protocol below that we want to upgrade
 		parent_stream->handle_upgrade(parent_stream, out);
+	}
+	return out;
+}
+
+/***
+ * Negotiate the Yamux protocol
+ * @param parent_stream the parent stream
+ * @param am_server true(1) if we are considered the server, false(0) if we are the client.
+ * @param protocol_handlers the protocol handlers
+ * @returns a Stream initialized and ready for yamux
+ */
+struct Stream* libp2p_yamux_stream_new(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers) {
+	struct Stream* out = libp2p_yamux_stream_build(parent_stream, am_server, protocol_handlers);
+	if (out != NULL) {
 		// attempt to negotiate yamux protocol
 		if (!libp2p_yamux_send_protocol(parent_stream)) {
 			libp2p_yamux_stream_free(out);
@@ -658,6 +668,23 @@ struct Stream* libp2p_yamux_stream_new(struct Stream* parent_stream, int am_serv
 	return out;
 }
 
+/***
+ * Build a yamux Stream when the protocol id has already been accepted by the
+ * remote (see libp2p_net_multistream_propose)
+ * @param parent_stream the parent stream
+ * @param am_server true(1) if we are considered the server, false(0) if we are the client.
+ * @param protocol_handlers the protocol handlers
+ * @returns a Stream that is ready for yamux
+ */
+struct Stream* libp2p_yamux_stream_new_negotiated(struct Stream* parent_stream, int am_server, struct Libp2pVector* protocol_handlers) {
+	struct Stream* out = libp2p_yamux_stream_build(parent_stream, am_server, protocol_handlers);
+	if (out != NULL) {
+		struct YamuxContext* ctx = (struct YamuxContext*) out->stream_context;
+		ctx->state = yamux_stream_est;
+	}
+	return out;
+}
+
 /***
  * This will retrieve the stream that yamux is riding on top of
  * @param context a YamuxContext or YamuxChannelContext
@@ -711,6 +738,9 @@ int libp2p_yamux_channel_close(void* context) {
 		return 0;
 	struct YamuxChannelContext* ctx = (struct YamuxChannelContext*)context;
 	if (ctx != NULL) {
+		// wait out a read that is queued or running, and keep new ones from starting
+		while (!__sync_bool_compare_and_swap(&ctx->read_running, 0, 1))
+			usleep(1000);
 		//Send FIN
 		libp2p_yamux_channel_send_FIN(ctx);
 		// close the child's stream
@@ -721,6 +751,39 @@ int libp2p_yamux_channel_close(void* context) {
 	return 1;
 }
 
+/***
+ * Give up on a channel opened with yamux_channel_new. The other side is sent a reset,
+ * the channel is taken out of the session, and it is freed along with its child stream.
+ * NOTE: Unlike libp2p_yamux_channel_close, this leaves the parent's mutex and address alone.
+ * @param channel_stream the channel
+ */
+void libp2p_yamux_channel_abandon(struct Stream* channel_stream) {
+	if (channel_stream == NULL || channel_stream->stream_context == NULL)
+		return;
+	struct YamuxChannelContext* ctx = (struct YamuxChannelContext*)channel_stream->stream_context;
+	yamux_stream_reset(ctx);
+	// stop frames from being handed to it
+	struct yamux_session* session = ctx->yamux_context->session;
+	for (size_t i = 0; session != NULL && i < session->cap_streams; ++i) {
+		struct yamux_session_stream* ss = &session->streams[i];
+		if (ss->alive && ss->stream != NULL && ss->stream->id == ctx->channel) {
+			// the yamux_stream stays allocated, as yamux_channel_new reuses dead ones
+			ss->alive = 0;
+			break;
+		}
+	}
+	// wait out a read that is running, and keep new ones from starting
+	while (!__sync_bool_compare_and_swap(&ctx->read_running, 0, 1))
+		usleep(1000);
+	if (ctx->child_stream != NULL) {
+		ctx->child_stream->close(ctx->child_stream);
+		free(ctx->child_stream);
+	}
+	threadsafe_buffer_context_free(ctx->buffer);
+	free(ctx);
+	free(channel_stream);
+}
+
 /***
  * Close all channels
  * @param ctx the YamuxContext that contains a vector of channels